@@ -1,10 +1,18 @@
 #include "audio_data.h"
 
-#include "dywapitchtrack/dywapitchtrack.h"
-#include "r8brain-resampler/CDSPResampler.h"
+#include <algorithm>
 
+#include "doctest.hpp"
+
+#include "audio_file_io.h"
 #include "common.h"
+#include "defer.h"
 #include "gain_calculators.h"
+#include "pitch_tracker.h"
+#include "resampler.h"
+#include "test_helpers.h"
+#include "tests_config.h"
+#include "thread_pool.h"
 
 size_t AudioData::NumFrames() const {
     assert(num_channels != 0);
@@ -33,24 +41,7 @@ void AudioData::ChangePitch(double cents) {
 void AudioData::Resample(double new_sample_rate) {
     if (sample_rate == new_sample_rate) return;
 
-    const auto result_num_frames = (usize)(NumFrames() * (new_sample_rate / (double)sample_rate));
-    std::vector<double> result_interleaved_samples(num_channels * result_num_frames);
-
-    r8b::CDSPResampler24 resampler(sample_rate, new_sample_rate, (int)NumFrames());
-
-    ForEachDeinterleavedChannel(
-        interleaved_samples, num_channels, [&](const auto &channel_buffer, auto channel) {
-            std::vector<double> output_buffer(result_num_frames);
-            resampler.oneshot(channel_buffer.data(), (int)channel_buffer.size(), output_buffer.data(),
-                              (int)result_num_frames);
-            for (size_t frame = 0; frame < result_num_frames; ++frame) {
-                result_interleaved_samples[frame * num_channels + channel] = output_buffer[frame];
-            }
-
-            resampler.clear();
-        });
-
-    interleaved_samples = std::move(result_interleaved_samples);
+    interleaved_samples = ResampleInterleaved(interleaved_samples, num_channels, sample_rate, new_sample_rate);
 
     const auto stretch_factor = new_sample_rate / (double)sample_rate;
     AudioDataWasStretched(stretch_factor);
@@ -91,62 +82,169 @@ std::vector<double> AudioData::MixDownToMono() const {
     return mono_signal;
 }
 
-std::vector<AudioData::PitchTrackEntry> AudioData::DetectPitchTrack(double chunk_seconds) const {
-    std::vector<PitchTrackEntry> track;
-    if (NumFrames() == 0 || sample_rate == 0) return track;
+// Normalises the signal in place. The chunks are independent of each other, so they are spread across the
+// thread pool, each writing its own entry of the track.
+static std::vector<AudioData::PitchTrackEntry> PitchTrackOfMonoSignal(std::vector<double> &mono_signal,
+                                                                      unsigned sample_rate,
+                                                                      double chunk_seconds,
+                                                                      double hop_seconds) {
+    if (mono_signal.empty() || sample_rate == 0) return {};
 
-    auto mono_signal = MixDownToMono();
     NormaliseToTarget(mono_signal, 1);
 
     const auto chunk_frames = (usize)(chunk_seconds * sample_rate);
-    if (chunk_frames == 0) return track;
+    const auto hop_frames = (usize)(hop_seconds * sample_rate);
+    if (chunk_frames == 0 || hop_frames == 0) return {};
+
+    const auto engine = g_pitch_engine;
+    const auto num_frames = mono_signal.size();
+
+    // Chunks start every hop until the last one that fits in the signal. As with contiguous chunks, one
+    // shorter chunk then follows if the signal goes on past the end of that.
+    usize num_chunks = 1;
+    if (num_frames > chunk_frames) {
+        const auto num_full_chunks = (num_frames - chunk_frames) / hop_frames + 1;
+        const auto end_of_full_chunks = (num_full_chunks - 1) * hop_frames + chunk_frames;
+        num_chunks = num_full_chunks;
+        if (end_of_full_chunks < num_frames && num_full_chunks * hop_frames < num_frames) ++num_chunks;
+    }
 
-    for (usize frame = 0; frame < NumFrames(); frame += chunk_frames) {
-        const auto chunk_size = (int)std::min(chunk_frames, NumFrames() - frame);
+    std::vector<AudioData::PitchTrackEntry> track(num_chunks);
+    ParallelFor(track.size(), [&](usize i) {
+        const auto frame = i * hop_frames;
+        const auto chunk_size = std::min(chunk_frames, num_frames - frame);
 
-        dywapitchtracker pitch_tracker;
-        dywapitch_inittracking(&pitch_tracker);
-        auto detected_pitch = dywapitch_computepitch(&pitch_tracker, mono_signal.data(),
-                                                     (int)frame, chunk_size);
-        if (sample_rate != 44100) {
-            detected_pitch *= static_cast<double>(sample_rate) / 44100.0;
-        }
+        const auto estimate =
+            GetPitchTracker(engine).DetectPitch(mono_signal.data() + frame, chunk_size, sample_rate);
         const double t = ((double)frame + (double)chunk_size * 0.5) / (double)sample_rate;
-        const double rms = GetRMS({mono_signal.data() + frame, (usize)chunk_size});
-        track.push_back({t, detected_pitch, rms});
-    }
+        const double rms = GetRMS({mono_signal.data() + frame, chunk_size});
+        track[i] = {t, estimate.hz, rms, estimate.confidence};
+    });
     return track;
 }
 
-static std::optional<double> DetectSinglePitch(const AudioData &audio) {
+std::vector<AudioData::PitchTrackEntry> AudioData::DetectPitchTrack(double chunk_seconds,
+                                                                    std::optional<double> hop_seconds) const {
+    if (NumFrames() == 0) return {};
+    auto mono_signal = MixDownToMono();
+    return PitchTrackOfMonoSignal(mono_signal, sample_rate, chunk_seconds,
+                                  hop_seconds.value_or(chunk_seconds));
+}
+
+// The coefficients of a half-band lowpass filter, for the taps that are an odd distance from the centre
+// (the rest are 0, apart from the centre tap of 0.5). They are the ideal sinc shaped by a Blackman window,
+// and scaled so that the filter has a gain of 1 at DC.
+static const std::array<double, 16> &HalfBandCoefficients() {
+    static const auto coeffs = []() {
+        std::array<double, 16> result {};
+        constexpr auto num_taps = (double)(result.size() * 4 + 1);
+        double sum = 0;
+        for (usize k = 0; k < result.size(); ++k) {
+            const auto x = (double)k + 0.5;
+            const auto window_pos = ((num_taps - 1) / 2 + (2 * x)) / (num_taps - 1);
+            const auto window =
+                0.42 - 0.5 * std::cos(2 * pi * window_pos) + 0.08 * std::cos(4 * pi * window_pos);
+            result[k] = window * std::sin(pi * x) / (pi * x);
+            sum += 2 * result[k];
+        }
+        for (auto &c : result) {
+            c /= sum;
+        }
+        return result;
+    }();
+    return coeffs;
+}
+
+// The signal with enough zeros either side that the half-band filter never reads outside of it
+static std::vector<double> ZeroPadded(const std::vector<double> &signal, usize padding) {
+    std::vector<double> result(signal.size() + padding * 2);
+    std::copy(signal.begin(), signal.end(), result.begin() + (std::ptrdiff_t)padding);
+    return result;
+}
+
+// Doubles the length of the signal: the same as playing it an octave lower at the original sample rate
+static std::vector<double> UpsampleByTwo(const std::vector<double> &signal) {
+    const auto &coeffs = HalfBandCoefficients();
+    const auto padded = ZeroPadded(signal, coeffs.size());
+    const auto *in = padded.data() + coeffs.size();
+
+    std::vector<double> result(signal.size() * 2);
+    for (usize i = 0; i < signal.size(); ++i) {
+        double mid = 0;
+        for (usize k = 0; k < coeffs.size(); ++k) {
+            mid += coeffs[k] * (in[i - k] + in[i + 1 + k]);
+        }
+        result[i * 2] = in[i];
+        result[i * 2 + 1] = mid;
+    }
+    return result;
+}
+
+// Halves the length of the signal: the same as playing it an octave higher at the original sample rate
+static std::vector<double> DecimateByTwo(const std::vector<double> &signal) {
+    const auto &coeffs = HalfBandCoefficients();
+    const auto padded = ZeroPadded(signal, coeffs.size() * 2);
+    const auto *in = padded.data() + coeffs.size() * 2;
+
+    std::vector<double> result(signal.size() / 2);
+    for (usize n = 0; n < result.size(); ++n) {
+        const auto i = n * 2;
+        double v = 0;
+        for (usize k = 0; k < coeffs.size(); ++k) {
+            v += coeffs[k] * (in[i - 1 - 2 * k] + in[i + 1 + 2 * k]);
+        }
+        result[n] = 0.5 * in[i] + 0.5 * v;
+    }
+    return result;
+}
+
+// What ChangePitch(octaves * 1200) does to a mono signal, but far cheaper since each octave is a factor of 2
+static std::vector<double> OctaveShiftedSignal(const std::vector<double> &signal, int octaves) {
+    auto result = signal;
+    for (; octaves < 0; ++octaves) {
+        result = UpsampleByTwo(result);
+    }
+    for (; octaves > 0; --octaves) {
+        result = DecimateByTwo(result);
+    }
+    return result;
+}
+
+static std::optional<double> DetectSinglePitch(const std::vector<AudioData::PitchTrackEntry> &pitch_track) {
     struct ChunkData {
         double detected_pitch {};
         double rms {};
         double suitability {};
     };
 
-    auto pitch_track = audio.DetectPitchTrack();
     std::vector<ChunkData> chunks;
     chunks.reserve(pitch_track.size());
     for (const auto &e : pitch_track) chunks.push_back({e.hz, e.rms, 0});
 
     if (chunks.empty()) return std::nullopt;
 
-    for (auto &chunk : chunks) {
-        const auto p1 = chunk.detected_pitch;
-
-        for (const auto &other_c : chunks) {
-            const auto p2 = other_c.detected_pitch;
-            if (p2 == 0) continue;
+    // Each chunk is scored by how many other chunks detected a similar pitch. The Gaussian is so narrow that
+    // chunks more than a few Hz apart add nothing measurable, so only the nearby pitches are visited, rather
+    // than comparing every chunk with every other one, which is slow for long files.
+    const auto GaussianFunction = [](const auto x) {
+        constexpr auto height = 10;
+        constexpr auto peak_centre = 0;
+        constexpr auto width = 0.9;
+        return height * std::exp(-(std::pow(x - peak_centre, 2) / (2 * std::pow(width, 2))));
+    };
+    constexpr double max_pitch_delta = 10;
 
-            const auto GaussianFunction = [](const auto x) {
-                constexpr auto height = 10;
-                constexpr auto peak_centre = 0;
-                constexpr auto width = 0.9;
-                return height * std::exp(-(std::pow(x - peak_centre, 2) / (2 * std::pow(width, 2))));
-            };
+    std::vector<double> sorted_pitches;
+    for (const auto &chunk : chunks) {
+        if (chunk.detected_pitch != 0) sorted_pitches.push_back(chunk.detected_pitch);
+    }
+    std::sort(sorted_pitches.begin(), sorted_pitches.end());
 
-            const auto pitch_delta = p2 - p1;
+    for (auto &chunk : chunks) {
+        const auto p1 = chunk.detected_pitch;
+        for (auto it = std::lower_bound(sorted_pitches.begin(), sorted_pitches.end(), p1 - max_pitch_delta);
+             it != sorted_pitches.end() && *it <= p1 + max_pitch_delta; ++it) {
+            const auto pitch_delta = *it - p1;
             chunk.suitability += GaussianFunction(pitch_delta);
         }
     }
@@ -156,7 +254,7 @@ static std::optional<double> DetectSinglePitch(const AudioData &audio) {
         double max_rms = 0;
         double min_rms = DBL_MAX;
         for (auto &chunk : chunks) {
-            REQUIRE(chunk.rms >= 0);
+            assert(chunk.rms >= 0);
             if (chunk.rms < min_rms) min_rms = chunk.rms;
             if (chunk.rms > max_rms) max_rms = chunk.rms;
         }
@@ -164,8 +262,8 @@ static std::optional<double> DetectSinglePitch(const AudioData &audio) {
         for (auto &chunk : chunks) {
             if ((max_rms - min_rms) == 0) continue;
             const auto rms_relative = (chunk.rms - min_rms) / (max_rms - min_rms);
-            REQUIRE(rms_relative >= 0);
-            REQUIRE(rms_relative <= 1);
+            assert(rms_relative >= 0);
+            assert(rms_relative <= 1);
             constexpr auto multiplier_for_loudest_chunk = 1.5;
             chunk.suitability *=
                 1 + (std::cos(half_pi - (rms_relative * half_pi)) * multiplier_for_loudest_chunk);
@@ -200,11 +298,42 @@ std::optional<AudioData::PitchDetectionResult> AudioData::DetectPitchWithConfide
         double suitability {};
     };
 
+    if (NumFrames() == 0 || sample_rate == 0) return {};
+
+    if (g_pitch_engine != PitchEngine::Wavelet) {
+        // These engines do not have the wavelet detector's octave errors, so the octave-shifted re-detections
+        // are not needed. The confidence is the total confidence of the chunks that agree with the result,
+        // relative to the number of chunks that found a pitch at all.
+        const auto track = DetectPitchTrack();
+        const auto pitch = DetectSinglePitch(track);
+        if (!pitch) return {};
+        double agreeing_confidence = 0;
+        usize num_voiced = 0;
+        for (const auto &entry : track) {
+            if (entry.hz == 0) continue;
+            ++num_voiced;
+            if (std::abs(GetCentsDifference(*pitch, entry.hz)) < 50) agreeing_confidence += entry.confidence;
+        }
+        return PitchDetectionResult {*pitch, agreeing_confidence / (double)num_voiced};
+    }
+
+    // All of the detections work on the same mono mix, and since they are whole octaves apart, the shifted
+    // versions are made by simply doubling or halving the rate rather than with a full resample of the audio.
+    // The shifted versions are made together; each detection then spreads its own chunks across the threads,
+    // which balances the work better than a thread per detection, since the lowest octave is the longest.
+    const auto mono_signal = MixDownToMono();
     std::vector<PitchedData> pitches;
-    for (double cents = -2400; cents < 2400; cents += 1200) {
-        AudioData pitched_audio = *this;
-        pitched_audio.ChangePitch(cents);
-        pitches.push_back({DetectSinglePitch(pitched_audio), cents});
+    for (int octaves = -2; octaves < 2; ++octaves) {
+        pitches.push_back({{}, octaves * 1200.0});
+    }
+    std::vector<std::vector<double>> signals(pitches.size());
+    ParallelFor(pitches.size(), [&](usize i) {
+        signals[i] = OctaveShiftedSignal(mono_signal, (int)(pitches[i].cents / 1200));
+    });
+    for (usize i = 0; i < pitches.size(); ++i) {
+        pitches[i].detected_pitch = DetectSinglePitch(PitchTrackOfMonoSignal(
+            signals[i], sample_rate, pitch_track_chunk_seconds, pitch_track_chunk_seconds));
+        signals[i] = {};
     }
 
     for (auto &p : pitches) {
@@ -246,6 +375,121 @@ std::optional<double> AudioData::DetectPitch() const {
     return {};
 }
 
+TEST_CASE("[Resample]") {
+    auto stereo = TestHelpers::CreateSineWaveAtFrequency(2, 44100, 0.5, 440);
+    for (usize frame = 0; frame < stereo.NumFrames(); ++frame) {
+        stereo.GetSample(1, frame) *= -0.5;
+    }
+    auto right = TestHelpers::CreateSineWaveAtFrequency(1, 44100, 0.5, 440);
+    right.MultiplyByScalar(-0.5);
+
+    auto resampled = stereo;
+    resampled.Resample(48000);
+    REQUIRE(resampled.sample_rate == 48000);
+    REQUIRE(resampled.NumFrames() == 24000);
+
+    SUBCASE("each channel is resampled the same as it would be on its own") {
+        right.Resample(48000);
+        for (usize frame = 0; frame < resampled.NumFrames(); ++frame) {
+            REQUIRE(resampled.GetSample(1, frame) == right.GetSample(0, frame));
+        }
+    }
+
+    SUBCASE("reused resamplers start from silence") {
+        auto again = stereo;
+        again.Resample(48000);
+        REQUIRE(again.interleaved_samples == resampled.interleaved_samples);
+    }
+}
+
+TEST_CASE("[DetectPitchTrack]") {
+    constexpr double length_seconds = 1.05;
+    const auto sine = TestHelpers::CreateSineWaveAtFrequency(2, 48000, length_seconds, 440);
+    const auto chunk_seconds = AudioData::pitch_track_chunk_seconds;
+
+    const auto CheckTrack = [&](const std::vector<AudioData::PitchTrackEntry> &track, double hop_seconds,
+                                bool ends_with_partial_chunk) {
+        const auto num_full_chunks =
+            (usize)std::floor((length_seconds - chunk_seconds) / hop_seconds + 0.0001) + 1;
+        REQUIRE(track.size() == num_full_chunks + (ends_with_partial_chunk ? 1 : 0));
+        for (usize i = 0; i < track.size(); ++i) {
+            CAPTURE(i);
+            const auto start = (double)i * hop_seconds;
+            REQUIRE(track[i].rms > 0);
+            if (i < num_full_chunks) {
+                REQUIRE(track[i].time_seconds == doctest::Approx(start + chunk_seconds / 2));
+                REQUIRE(track[i].hz == doctest::Approx(440).epsilon(0.01));
+            } else {
+                // Only the final chunk is cut short, and it runs to the end of the audio
+                REQUIRE(i == track.size() - 1);
+                REQUIRE(track[i].time_seconds == doctest::Approx((start + length_seconds) / 2));
+            }
+        }
+    };
+
+    SUBCASE("contiguous chunks") { CheckTrack(sine.DetectPitchTrack(), chunk_seconds, true); }
+    SUBCASE("overlapping chunks that end with the audio") {
+        CheckTrack(sine.DetectPitchTrack(chunk_seconds, 0.025), 0.025, false);
+    }
+    SUBCASE("overlapping chunks that end before the audio") {
+        CheckTrack(sine.DetectPitchTrack(chunk_seconds, 0.04), 0.04, true);
+    }
+}
+
+TEST_CASE("[DetectPitchWithConfidence]") {
+    SUBCASE("octave shifts give the same detections as ChangePitch") {
+        const auto CheckMatches = [](const AudioData &audio) {
+            CAPTURE(audio.num_channels);
+            CAPTURE(audio.sample_rate);
+            const auto mono_signal = audio.MixDownToMono();
+            for (int octaves = -2; octaves < 2; ++octaves) {
+                CAPTURE(octaves);
+                auto pitched_audio = audio;
+                pitched_audio.ChangePitch(octaves * 1200.0);
+                const auto expected = DetectSinglePitch(pitched_audio.DetectPitchTrack());
+
+                auto signal = OctaveShiftedSignal(mono_signal, octaves);
+                REQUIRE(signal.size() == pitched_audio.NumFrames());
+                const auto detected = DetectSinglePitch(
+                    PitchTrackOfMonoSignal(signal, audio.sample_rate, AudioData::pitch_track_chunk_seconds,
+                                           AudioData::pitch_track_chunk_seconds));
+
+                REQUIRE(detected.has_value() == expected.has_value());
+                if (expected) REQUIRE(std::abs(GetCentsDifference(*expected, *detected)) < 5);
+            }
+        };
+
+        for (const auto hz : {40.0, 110.0, 440.0, 1000.0, 3000.0}) {
+            CAPTURE(hz);
+            CheckMatches(TestHelpers::CreateSineWaveAtFrequency(2, 44100, 1, hz));
+            CheckMatches(TestHelpers::CreateSquareWaveAtFrequency(1, 48000, 1, hz));
+        }
+        CheckMatches(ReadAudioFile(TEST_DATA_DIRECTORY "/sawtooth_unlooped.flac").value());
+    }
+
+    SUBCASE("detected pitch") {
+        const auto engine = g_pitch_engine;
+        defer { g_pitch_engine = engine; };
+        for (const auto e : {PitchEngine::Wavelet, PitchEngine::Yin, PitchEngine::Mpm}) {
+            CAPTURE((int)e);
+            g_pitch_engine = e;
+            for (const auto hz : {55.0, 220.0, 1500.0}) {
+                CAPTURE(hz);
+                const auto sine = TestHelpers::CreateSineWaveAtFrequency(2, 44100, 1, hz);
+                const auto result = sine.DetectPitchWithConfidence();
+                REQUIRE(result);
+                REQUIRE(result->hz == doctest::Approx(hz).epsilon(0.01));
+                REQUIRE(result->confidence > 0.5);
+            }
+
+            AudioData silence {{}, 1, 44100};
+            silence.interleaved_samples.resize(44100);
+            REQUIRE(!silence.DetectPitchWithConfidence());
+            REQUIRE(!AudioData {{}, 1, 44100}.DetectPitchWithConfidence());
+        }
+    }
+}
+
 bool AudioData::IsSilent() const {
     for (const auto v : interleaved_samples) {
         if (v != 0.0) return false;
@@ -48,7 +48,9 @@ struct AudioData {
 
     struct PitchDetectionResult {
         double hz;
-        double confidence; // 0..1, based on agreement across octave-shifted re-detections
+        // 0..1: for the wavelet engine, based on agreement across octave-shifted re-detections; for the
+        // others, based on the confidence and agreement of the chunks of the pitch track
+        double confidence;
     };
     std::optional<PitchDetectionResult> DetectPitchWithConfidence() const;
     std::optional<double> DetectPitch() const;
@@ -57,12 +59,18 @@ struct AudioData {
         double time_seconds; // centre of the chunk
         double hz;           // 0 if unvoiced
         double rms;
+        double confidence;   // 0..1, how clearly the chunk has this pitch
     };
-    // Raw per-chunk pitch track from the underlying detector. Chunks of `chunk_seconds` are
-    // taken contiguously across the file; the returned hz is 0 for chunks the detector marked
-    // unvoiced. Used both as input to DetectPitchWithConfidence and exposed for time-resolved
-    // analysis (MIR reports, pitch-over-time visualisations).
-    std::vector<PitchTrackEntry> DetectPitchTrack(double chunk_seconds = 0.1) const;
+
+    static constexpr double pitch_track_chunk_seconds = 0.1;
+
+    // Raw per-chunk pitch track from the pitch engine (--pitch-engine). Chunks of `chunk_seconds` are
+    // taken across the file, starting every `hop_seconds` (by default the chunks are contiguous; a smaller
+    // hop gives overlapping chunks and finer time resolution); the returned hz is 0 for chunks the
+    // detector marked unvoiced. Used both as input to DetectPitchWithConfidence and exposed for
+    // time-resolved analysis (MIR reports, pitch-over-time visualisations).
+    std::vector<PitchTrackEntry> DetectPitchTrack(double chunk_seconds = pitch_track_chunk_seconds,
+                                                  std::optional<double> hop_seconds = {}) const;
 
     bool IsSilent() const;
 
@@ -1,5 +1,6 @@
 #pragma once
 #include <algorithm>
+#include <cassert>
 #include <optional>
 #include <string>
 #include <utility>
@@ -45,7 +46,7 @@ class AudioDuration {
             case Unit::Milliseconds: result = sample_rate * (m_value / 1000.0); break;
             case Unit::Percent: result = num_frames * (std::clamp(m_value, 0.0, 100.0) / 100.0); break;
             case Unit::Samples: result = m_value; break;
-            default: REQUIRE(0);
+            default: assert(0);
         }
         return std::min(num_frames, (size_t)result);
     }
@@ -16,6 +16,8 @@
 #include "cereal_optional.hpp"
 
 #include "common.h"
+#include "defer.h"
+#include "filter.h"
 #include "flac_decoder.h"
 #include "test_helpers.h"
 #include "tests_config.h"
@@ -23,6 +25,7 @@
 
 static constexpr unsigned valid_wave_bit_depths[] = {8, 16, 24, 32, 64};
 static constexpr unsigned valid_flac_bit_depths[] = {8, 16, 20, 24};
+static constexpr unsigned flac_padding_size = 4096;
 
 bool CanFileBeConvertedToBitDepth(AudioFileFormat file, const unsigned bit_depth) {
     switch (file) {
@@ -34,7 +37,7 @@ bool CanFileBeConvertedToBitDepth(AudioFileFormat file, const unsigned bit_depth
             const auto &arr = valid_flac_bit_depths;
             return std::find(std::begin(arr), std::end(arr), bit_depth) != std::end(arr);
         }
-        default: REQUIRE(false);
+        default: assert(false);
     }
     return false;
 }
@@ -533,6 +536,183 @@ std::optional<AudioData> ReadAudioFile(const fs::path &path) {
     return result;
 }
 
+std::optional<AudioData>
+ReadAudioFileRange(const fs::path &path, usize start_frame, usize num_frames, usize *file_num_frames) {
+    const auto file = OpenFile(path, "rb");
+    if (!file) return {};
+
+    AudioData result {};
+    usize total_frames = 0;
+    const auto ext = path.extension();
+    if (ext == ".wav") {
+        drwav wav;
+        if (!drwav_init(&wav, OnReadFile, OnSeekFile, OnTellFile, file.get(), nullptr)) {
+            WarningWithNewLine("Wav", path, "could not init the WAV file");
+            return {};
+        }
+        defer { drwav_uninit(&wav); };
+        result.num_channels = wav.channels;
+        result.sample_rate = wav.sampleRate;
+        result.bits_per_sample = wav.bitsPerSample;
+        result.format = AudioFileFormat::Wav;
+        total_frames = (usize)wav.totalPCMFrameCount;
+
+        if (start_frame < total_frames && num_frames) {
+            num_frames = std::min(num_frames, total_frames - start_frame);
+            if (!drwav_seek_to_pcm_frame(&wav, start_frame)) {
+                WarningWithNewLine("Wav", path, "failed to seek to frame {}", start_frame);
+                return {};
+            }
+            std::vector<float> f32_buf(num_frames * wav.channels);
+            if (drwav_read_pcm_frames_f32(&wav, num_frames, f32_buf.data()) != num_frames) {
+                WarningWithNewLine("Wav", path, "failed to get all the frames from file");
+                return {};
+            }
+            result.interleaved_samples.assign(f32_buf.begin(), f32_buf.end());
+        }
+    } else if (ext == ".flac") {
+        if (!DecodeFlacFileRange(file.get(), result, start_frame, num_frames, total_frames)) {
+            WarningWithNewLine("Wav", path, "failed to decode flac file");
+            return {};
+        }
+        result.format = AudioFileFormat::Flac;
+    } else {
+        WarningWithNewLine("Wav", path, "file is not a WAV or a FLAC");
+        return {};
+    }
+
+    if (file_num_frames) *file_num_frames = total_frames;
+    return result;
+}
+
+// Builds the analysis signal a frame at a time. When the sample rate is being reduced the signal is low-pass
+// filtered first to avoid aliasing.
+class AnalysisAudioBuilder {
+  public:
+    AnalysisAudioBuilder(AudioData &output, unsigned sample_rate, unsigned bits_per_sample, usize num_frames)
+        : m_output(output), m_decimation(std::max(1u, sample_rate / analysis_min_sample_rate)) {
+        m_output = {};
+        m_output.num_channels = 1;
+        m_output.sample_rate = sample_rate / m_decimation;
+        m_output.bits_per_sample = bits_per_sample;
+        m_output.interleaved_samples.reserve(num_frames / m_decimation + 1);
+
+        if (m_decimation > 1) {
+            // A 4th-order Butterworth made from 2 biquads
+            constexpr double qs[num_filter_stages] = {0.54119610014619701, 1.3065629648763764};
+            for (usize i = 0; i < num_filter_stages; ++i) {
+                Filter::Params params;
+                Filter::SetParamsAndCoeffs(Filter::Type::RBJ, params, m_filter_coeffs[i],
+                                           (int)Filter::RBJType::LowPass, (double)sample_rate,
+                                           m_output.sample_rate * 0.45, qs[i], 0);
+            }
+        }
+    }
+
+    void AddFrame(double mono_sample) {
+        if (m_decimation == 1) {
+            m_output.interleaved_samples.push_back(mono_sample);
+            return;
+        }
+        for (usize i = 0; i < num_filter_stages; ++i) {
+            mono_sample = Filter::Process(m_filter_data[i], m_filter_coeffs[i], mono_sample);
+        }
+        if (++m_frame_counter == m_decimation) {
+            m_output.interleaved_samples.push_back(mono_sample);
+            m_frame_counter = 0;
+        }
+    }
+
+  private:
+    static constexpr usize num_filter_stages = 2;
+    AudioData &m_output;
+    const unsigned m_decimation;
+    unsigned m_frame_counter = 0;
+    Filter::Coeffs m_filter_coeffs[num_filter_stages] {};
+    Filter::Data m_filter_data[num_filter_stages] {};
+};
+
+AudioData CreateAnalysisAudio(const AudioData &audio) {
+    AudioData result {};
+    const auto num_frames = audio.IsEmpty() ? 0 : audio.NumFrames();
+    AnalysisAudioBuilder builder(result, audio.sample_rate, audio.bits_per_sample, num_frames);
+    for (usize frame = 0; frame < num_frames; ++frame) {
+        double v = 0;
+        for (unsigned chan = 0; chan < audio.num_channels; ++chan) {
+            v += audio.GetSample(chan, frame);
+        }
+        builder.AddFrame(v);
+    }
+    return result;
+}
+
+std::optional<AudioData> ReadAudioFileForAnalysis(const fs::path &path) {
+    MessageWithNewLine("Signet", path, "Reading file for analysis");
+    const auto file = OpenFile(path, "rb");
+    if (!file) return {};
+
+    AudioData result {};
+    const auto ext = path.extension();
+    if (ext == ".wav") {
+        drwav wav;
+        if (!drwav_init(&wav, OnReadFile, OnSeekFile, OnTellFile, file.get(), nullptr)) {
+            WarningWithNewLine("Wav", path, "could not init the WAV file");
+            return {};
+        }
+        defer { drwav_uninit(&wav); };
+        AnalysisAudioBuilder builder(result, wav.sampleRate, wav.bitsPerSample,
+                                     (usize)wav.totalPCMFrameCount);
+
+        constexpr usize block_frames = 4096;
+        std::vector<float> f32_buf(block_frames * wav.channels);
+        drwav_uint64 total_frames_read = 0;
+        while (total_frames_read < wav.totalPCMFrameCount) {
+            const auto frames_read = drwav_read_pcm_frames_f32(&wav, block_frames, f32_buf.data());
+            if (frames_read == 0) break;
+            for (usize frame = 0; frame < frames_read; ++frame) {
+                double v = 0;
+                for (unsigned chan = 0; chan < wav.channels; ++chan) {
+                    v += (double)f32_buf[frame * wav.channels + chan];
+                }
+                builder.AddFrame(v);
+            }
+            total_frames_read += frames_read;
+        }
+        if (total_frames_read != wav.totalPCMFrameCount) {
+            WarningWithNewLine("Wav", path, "failed to get all the frames from file");
+            return {};
+        }
+        result.format = AudioFileFormat::Wav;
+    } else if (ext == ".flac") {
+        AudioData format {};
+        std::optional<AnalysisAudioBuilder> builder {};
+        const bool decoded = DecodeFlacFileBlocks(
+            file.get(), format,
+            [&](usize total_frames) {
+                builder.emplace(result, format.sample_rate, format.bits_per_sample, total_frames);
+            },
+            [&](const FLAC__int32 *const channels[], usize num_frames, double divisor) {
+                for (usize frame = 0; frame < num_frames; ++frame) {
+                    double v = 0;
+                    for (unsigned chan = 0; chan < format.num_channels; ++chan) {
+                        v += channels[chan][frame] / divisor;
+                    }
+                    builder->AddFrame(v);
+                }
+            });
+        if (!decoded) {
+            WarningWithNewLine("Wav", path, "failed to decode flac file");
+            return {};
+        }
+        result.format = AudioFileFormat::Flac;
+    } else {
+        WarningWithNewLine("Wav", path, "file is not a WAV or a FLAC");
+        return {};
+    }
+
+    return result;
+}
+
 template <typename SignedIntType>
 SignedIntType ScaleSampleToSignedInt(const double s, const unsigned bits_per_sample) {
     const auto negative_max = std::pow(2, bits_per_sample) / 2;
@@ -638,12 +818,191 @@ static void GetAudioDataConvertedAndScaledToBitDepth(const std::vector<double> f
             break;
         }
         default: {
-            REQUIRE(0);
+            assert(0);
             return;
         }
     }
 }
 
+// Reads the samples of an integer PCM WAV or FLAC file as right-justified integers (e.g. -32768 to 32767 for
+// 16-bit), a block at a time. This lets us copy samples from one file to another without them ever being
+// converted to floating point, which is both faster and guaranteed to be lossless.
+class IntegerSampleReader {
+  public:
+    struct Info {
+        unsigned num_channels;
+        unsigned sample_rate;
+        unsigned bits_per_sample;
+        u64 num_frames;
+    };
+
+    virtual ~IntegerSampleReader() {}
+    // Returns the number of frames that were read; this is fewer than max_frames only at the end of the file
+    // or on error
+    virtual usize Read(s32 *interleaved_buffer, usize max_frames) = 0;
+    virtual bool Failed() const = 0;
+
+    Info info {};
+};
+
+class WaveIntegerSampleReader : public IntegerSampleReader {
+  public:
+    ~WaveIntegerSampleReader() {
+        if (m_initialised) drwav_uninit(&m_wav);
+    }
+
+    bool Open(const fs::path &path) {
+        m_file = OpenFile(path, "rb");
+        if (!m_file) return false;
+        if (!drwav_init(&m_wav, OnReadFile, OnSeekFile, OnTellFile, m_file.get(), nullptr)) return false;
+        m_initialised = true;
+        if (m_wav.translatedFormatTag != DR_WAVE_FORMAT_PCM || m_wav.bitsPerSample > 24) return false;
+        info = {m_wav.channels, m_wav.sampleRate, m_wav.bitsPerSample, m_wav.totalPCMFrameCount};
+        return true;
+    }
+
+    usize Read(s32 *interleaved_buffer, usize max_frames) override {
+        // drwav gives us samples scaled to the full 32-bit range, so we shift them back down
+        const auto frames_read = (usize)drwav_read_pcm_frames_s32(&m_wav, max_frames, interleaved_buffer);
+        const auto shift = 32 - info.bits_per_sample;
+        for (usize i = 0; i < frames_read * info.num_channels; ++i) {
+            interleaved_buffer[i] >>= shift;
+        }
+        m_frames_read += frames_read;
+        if (frames_read != max_frames && m_frames_read != info.num_frames) m_failed = true;
+        return frames_read;
+    }
+
+    bool Failed() const override { return m_failed; }
+
+  private:
+    std::unique_ptr<FILE, void (*)(FILE *)> m_file {nullptr, nullptr};
+    drwav m_wav {};
+    bool m_initialised = false;
+    bool m_failed = false;
+    u64 m_frames_read = 0;
+};
+
+class FlacIntegerSampleReader : public IntegerSampleReader {
+  public:
+    ~FlacIntegerSampleReader() {
+        if (m_decoder) {
+            FLAC__stream_decoder_finish(m_decoder);
+            FLAC__stream_decoder_delete(m_decoder);
+        }
+    }
+
+    bool Open(const fs::path &path) {
+        m_decoder = FLAC__stream_decoder_new();
+        if (!m_decoder) return false;
+        auto file = OpenFileRaw(path, "rb");
+        if (!file) return false;
+        // The decoder takes ownership of the file
+        if (FLAC__stream_decoder_init_FILE(m_decoder, file, OnWriteCallback, OnMetadataCallback,
+                                           OnErrorCallback, this) != FLAC__STREAM_DECODER_INIT_STATUS_OK) {
+            return false;
+        }
+        return FLAC__stream_decoder_process_until_end_of_metadata(m_decoder) && m_got_stream_info &&
+               !m_failed;
+    }
+
+    usize Read(s32 *interleaved_buffer, usize max_frames) override {
+        const auto num_channels = info.num_channels;
+        usize frames_read = 0;
+        while (frames_read != max_frames) {
+            if (m_pending_pos == m_pending.size()) {
+                m_pending.clear();
+                m_pending_pos = 0;
+                if (m_failed ||
+                    FLAC__stream_decoder_get_state(m_decoder) == FLAC__STREAM_DECODER_END_OF_STREAM) {
+                    break;
+                }
+                if (!FLAC__stream_decoder_process_single(m_decoder)) {
+                    m_failed = true;
+                    break;
+                }
+                continue;
+            }
+            const auto num_frames =
+                std::min(max_frames - frames_read, (m_pending.size() - m_pending_pos) / num_channels);
+            std::copy_n(m_pending.begin() + m_pending_pos, num_frames * num_channels,
+                        interleaved_buffer + frames_read * num_channels);
+            m_pending_pos += num_frames * num_channels;
+            frames_read += num_frames;
+        }
+        return frames_read;
+    }
+
+    bool Failed() const override { return m_failed; }
+
+  private:
+    static FLAC__StreamDecoderWriteStatus OnWriteCallback(const FLAC__StreamDecoder *,
+                                                          const FLAC__Frame *frame,
+                                                          const FLAC__int32 *const buffer[],
+                                                          void *data) {
+        auto &reader = *(FlacIntegerSampleReader *)data;
+        if (frame->header.channels != reader.info.num_channels ||
+            frame->header.bits_per_sample != reader.info.bits_per_sample) {
+            reader.m_failed = true;
+            return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+        }
+        for (unsigned i = 0; i < frame->header.blocksize; ++i) {
+            for (unsigned chan = 0; chan < frame->header.channels; ++chan) {
+                reader.m_pending.push_back(buffer[chan][i]);
+            }
+        }
+        return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+    }
+
+    static void
+    OnMetadataCallback(const FLAC__StreamDecoder *, const FLAC__StreamMetadata *metadata, void *data) {
+        auto &reader = *(FlacIntegerSampleReader *)data;
+        if (metadata->type == FLAC__METADATA_TYPE_STREAMINFO) {
+            const auto &stream_info = metadata->data.stream_info;
+            reader.info = {stream_info.channels, stream_info.sample_rate, stream_info.bits_per_sample,
+                           stream_info.total_samples};
+            reader.m_got_stream_info = true;
+        }
+    }
+
+    static void OnErrorCallback(const FLAC__StreamDecoder *, FLAC__StreamDecoderErrorStatus, void *data) {
+        ((FlacIntegerSampleReader *)data)->m_failed = true;
+    }
+
+    FLAC__StreamDecoder *m_decoder = nullptr;
+    std::vector<s32> m_pending {};
+    usize m_pending_pos = 0;
+    bool m_got_stream_info = false;
+    bool m_failed = false;
+};
+
+// Returns a reader only if the file's samples are integers that exactly match audio_data at the given bit
+// depth
+static std::unique_ptr<IntegerSampleReader> OpenMatchingIntegerSampleReader(const fs::path &path,
+                                                                            const AudioData &audio_data,
+                                                                            const unsigned bits_per_sample) {
+    std::unique_ptr<IntegerSampleReader> reader;
+    const auto ext = path.extension();
+    if (ext == ".wav") {
+        auto wave_reader = std::make_unique<WaveIntegerSampleReader>();
+        if (wave_reader->Open(path)) reader = std::move(wave_reader);
+    } else if (ext == ".flac") {
+        auto flac_reader = std::make_unique<FlacIntegerSampleReader>();
+        if (flac_reader->Open(path)) reader = std::move(flac_reader);
+    }
+    if (!reader) return nullptr;
+
+    const auto &info = reader->info;
+    if (info.num_channels != audio_data.num_channels || info.sample_rate != audio_data.sample_rate ||
+        info.bits_per_sample != bits_per_sample || info.bits_per_sample != audio_data.bits_per_sample ||
+        info.num_frames != audio_data.NumFrames() || info.num_frames == 0) {
+        return nullptr;
+    }
+    return reader;
+}
+
+static constexpr usize integer_sample_block_frames = 16384;
+
 class NonSpecificMetadataToWaveMetadata {
   public:
     NonSpecificMetadataToWaveMetadata(const AudioData &audio_data, const unsigned /*bits_per_sample*/)
@@ -888,7 +1247,21 @@ class NonSpecificMetadataToWaveMetadata {
     std::vector<drwav_metadata> m_wave_metadata {};
 };
 
-static bool WriteWaveFile(const fs::path &path, const AudioData &audio_data, const unsigned bits_per_sample) {
+static drwav_data_format WaveDataFormat(const AudioData &audio_data, const unsigned bits_per_sample) {
+    drwav_data_format format {};
+    format.container = drwav_container_riff; // Use rf64 for large files?
+    format.format =
+        (bits_per_sample == 32 || bits_per_sample == 64) ? DR_WAVE_FORMAT_IEEE_FLOAT : DR_WAVE_FORMAT_PCM;
+    format.channels = audio_data.num_channels;
+    format.sampleRate = audio_data.sample_rate;
+    format.bitsPerSample = bits_per_sample;
+    return format;
+}
+
+static bool WriteWaveFile(const fs::path &path,
+                          const AudioData &audio_data,
+                          const unsigned bits_per_sample,
+                          IntegerSampleReader *integer_samples) {
     if (std::find(std::begin(valid_wave_bit_depths), std::end(valid_wave_bit_depths), bits_per_sample) ==
         std::end(valid_wave_bit_depths)) {
         WarningWithNewLine("Wav", path, "could not write wave file - {} is not a valid bit depth",
@@ -899,13 +1272,7 @@ static bool WriteWaveFile(const fs::path &path, const AudioData &audio_data, con
     const auto file = OpenFile(path, "wb");
     if (!file) return false;
 
-    drwav_data_format format {};
-    format.container = drwav_container_riff; // Use rf64 for large files?
-    format.format =
-        (bits_per_sample == 32 || bits_per_sample == 64) ? DR_WAVE_FORMAT_IEEE_FLOAT : DR_WAVE_FORMAT_PCM;
-    format.channels = audio_data.num_channels;
-    format.sampleRate = audio_data.sample_rate;
-    format.bitsPerSample = bits_per_sample;
+    auto format = WaveDataFormat(audio_data, bits_per_sample);
 
     // NonSpecificMetadataToWaveMetadata must exist for the lifetime of drwav as drwav keeps a pointer to the
     // metadata
@@ -918,18 +1285,42 @@ static bool WriteWaveFile(const fs::path &path, const AudioData &audio_data, con
                                    (u32)metadata.size());
 
     bool succeed_writing = true;
-    GetAudioDataConvertedAndScaledToBitDepth(
-        audio_data.interleaved_samples, bits_per_sample, [&](const void *raw_data) {
-            if (!succeed_writing) return;
-            const auto frames_written = drwav_write_pcm_frames(&wav, audio_data.NumFrames(), raw_data);
-            if (frames_written != audio_data.NumFrames()) {
-                ErrorWithNewLine(
-                    "Wav", path,
-                    "failed to write the correct number of frames, {} were written, {} we requested",
-                    frames_written, audio_data.NumFrames());
-                succeed_writing = true;
+    if (integer_samples) {
+        const auto bytes_per_sample = bits_per_sample / 8;
+        std::vector<s32> block(integer_sample_block_frames * audio_data.num_channels);
+        std::vector<u8> bytes(block.size() * bytes_per_sample);
+        while (const auto num_frames = integer_samples->Read(block.data(), integer_sample_block_frames)) {
+            const auto num_samples = num_frames * audio_data.num_channels;
+            for (usize i = 0; i < num_samples; ++i) {
+                // 8-bit WAV samples are unsigned, the rest are signed little-endian
+                const auto sample = bits_per_sample == 8 ? block[i] + 128 : block[i];
+                for (unsigned b = 0; b < bytes_per_sample; ++b) {
+                    bytes[i * bytes_per_sample + b] = (u8)((sample >> (8 * b)) & 0xff);
+                }
             }
-        });
+            if (drwav_write_pcm_frames(&wav, num_frames, bytes.data()) != num_frames) {
+                succeed_writing = false;
+                break;
+            }
+        }
+        if (!succeed_writing || integer_samples->Failed()) {
+            ErrorWithNewLine("Wav", path, "failed to copy the samples from the original file");
+            succeed_writing = false;
+        }
+    } else {
+        GetAudioDataConvertedAndScaledToBitDepth(
+            audio_data.interleaved_samples, bits_per_sample, [&](const void *raw_data) {
+                if (!succeed_writing) return;
+                const auto frames_written = drwav_write_pcm_frames(&wav, audio_data.NumFrames(), raw_data);
+                if (frames_written != audio_data.NumFrames()) {
+                    ErrorWithNewLine(
+                        "Wav", path,
+                        "failed to write the correct number of frames, {} were written, {} we requested",
+                        frames_written, audio_data.NumFrames());
+                    succeed_writing = true;
+                }
+            });
+    }
 
     drwav_uninit(&wav);
     return succeed_writing;
@@ -1025,8 +1416,29 @@ static void SafeMetadataDelete(FLAC__StreamMetadata *obj) {
     if (obj) FLAC__metadata_object_delete(obj);
 }
 
-static bool
-WriteFlacFile(const fs::path &filename, const AudioData &audio_data, const unsigned bits_per_sample) {
+// Returns null if there is nothing to write
+static FLAC__StreamMetadata *CreateSignetFlacMetadataBlock(const AudioData &audio_data) {
+    std::stringstream ss;
+    try {
+        cereal::JSONOutputArchive archive(ss);
+        archive(cereal::make_nvp(signet_root_json_object_name, audio_data.metadata));
+    } catch (const std::exception &e) {
+        ErrorWithNewLine("Flac", {}, "Internal error when writing FLAC signet json metadata: {}", e.what());
+    }
+    const auto str = ss.str();
+    if (!str.size()) return nullptr;
+
+    auto block = FLAC__metadata_object_new(FLAC__METADATA_TYPE_APPLICATION);
+    if (!block) return nullptr;
+    memcpy(block->data.application.id, flac_custom_signet_application_id, 4);
+    FLAC__metadata_object_application_set_data(block, (FLAC__byte *)str.data(), (unsigned)str.size(), true);
+    return block;
+}
+
+static bool WriteFlacFile(const fs::path &filename,
+                          const AudioData &audio_data,
+                          const unsigned bits_per_sample,
+                          IntegerSampleReader *integer_samples) {
     if (std::find(std::begin(valid_flac_bit_depths), std::end(valid_flac_bit_depths), bits_per_sample) ==
         std::end(valid_flac_bit_depths)) {
         WarningWithNewLine("Flac", filename, "could not write flac file - {} is not a valid bit depth",
@@ -1053,23 +1465,19 @@ WriteFlacFile(const fs::path &filename, const AudioData &audio_data, const unsig
 
     // Add in our metadata to a custom FLAC block
     std::unique_ptr<FLAC__StreamMetadata, decltype(&SafeMetadataDelete)> signet_metadata {
-        nullptr, &SafeMetadataDelete};
-    {
-        std::stringstream ss;
-        try {
-            cereal::JSONOutputArchive archive(ss);
-            archive(cereal::make_nvp(signet_root_json_object_name, audio_data.metadata));
-        } catch (const std::exception &e) {
-            ErrorWithNewLine("Flac", {}, "Internal error when writing FLAC signet json metadata: {}",
-                             e.what());
-        }
-        const auto str = ss.str();
-        if (str.size()) {
-            signet_metadata.reset(FLAC__metadata_object_new(FLAC__METADATA_TYPE_APPLICATION));
-            memcpy(signet_metadata->data.application.id, flac_custom_signet_application_id, 4);
-            FLAC__metadata_object_application_set_data(signet_metadata.get(), (FLAC__byte *)str.data(),
-                                                       (unsigned)str.size(), true);
-            metadata.push_back(signet_metadata.get());
+        CreateSignetFlacMetadataBlock(audio_data), &SafeMetadataDelete};
+    if (signet_metadata) metadata.push_back(signet_metadata.get());
+
+    // Leave some room so that later metadata-only edits can usually be done in-place rather than by
+    // re-encoding the whole file
+    std::unique_ptr<FLAC__StreamMetadata, decltype(&SafeMetadataDelete)> padding {nullptr,
+                                                                                &SafeMetadataDelete};
+    if (std::none_of(metadata.begin(), metadata.end(),
+                     [](const FLAC__StreamMetadata *m) { return m->type == FLAC__METADATA_TYPE_PADDING; })) {
+        padding.reset(FLAC__metadata_object_new(FLAC__METADATA_TYPE_PADDING));
+        if (padding) {
+            padding->length = flac_padding_size;
+            metadata.push_back(padding.get());
         }
     }
 
@@ -1092,12 +1500,29 @@ WriteFlacFile(const fs::path &filename, const AudioData &audio_data, const unsig
         return false;
     }
 
-    const auto int32_buffer =
-        CreateSignedIntSamplesFromFloat<s32>(audio_data.interleaved_samples, bits_per_sample);
-    if (!FLAC__stream_encoder_process_interleaved(encoder.get(), int32_buffer.data(),
-                                                  (unsigned)audio_data.NumFrames())) {
-        WarningWithNewLine("Flac", filename, "could not write flac file - failed encoding samples");
-        return false;
+    if (integer_samples) {
+        std::vector<s32> block(integer_sample_block_frames * audio_data.num_channels);
+        while (const auto num_frames = integer_samples->Read(block.data(), integer_sample_block_frames)) {
+            if (!FLAC__stream_encoder_process_interleaved(encoder.get(), block.data(),
+                                                          (unsigned)num_frames)) {
+                WarningWithNewLine("Flac", filename, "could not write flac file - failed encoding samples");
+                return false;
+            }
+        }
+        if (integer_samples->Failed()) {
+            WarningWithNewLine(
+                "Flac", filename,
+                "could not write flac file - failed to copy the samples from the original file");
+            return false;
+        }
+    } else {
+        const auto int32_buffer =
+            CreateSignedIntSamplesFromFloat<s32>(audio_data.interleaved_samples, bits_per_sample);
+        if (!FLAC__stream_encoder_process_interleaved(encoder.get(), int32_buffer.data(),
+                                                      (unsigned)audio_data.NumFrames())) {
+            WarningWithNewLine("Flac", filename, "could not write flac file - failed encoding samples");
+            return false;
+        }
     }
 
     if (!FLAC__stream_encoder_finish(encoder.get())) {
@@ -1109,21 +1534,297 @@ WriteFlacFile(const fs::path &filename, const AudioData &audio_data, const unsig
 
 bool WriteAudioFile(const fs::path &filename,
                     const AudioData &audio_data,
-                    std::optional<unsigned> new_bits_per_sample) {
+                    std::optional<unsigned> new_bits_per_sample,
+                    const fs::path &unchanged_samples_file) {
     auto bits_per_sample = audio_data.bits_per_sample;
     if (new_bits_per_sample) bits_per_sample = *new_bits_per_sample;
 
+    // We can't read from the file that we are about to overwrite
+    std::unique_ptr<IntegerSampleReader> integer_samples;
+    std::error_code ec;
+    if (!unchanged_samples_file.empty() && !fs::equivalent(unchanged_samples_file, filename, ec)) {
+        integer_samples =
+            OpenMatchingIntegerSampleReader(unchanged_samples_file, audio_data, bits_per_sample);
+    }
+
     bool result = false;
     const auto ext = filename.extension();
     if (ext == ".flac") {
-        result = WriteFlacFile(filename, audio_data, bits_per_sample);
+        result = WriteFlacFile(filename, audio_data, bits_per_sample, integer_samples.get());
     } else if (ext == ".wav") {
-        result = WriteWaveFile(filename, audio_data, bits_per_sample);
+        result = WriteWaveFile(filename, audio_data, bits_per_sample, integer_samples.get());
+    }
+
+    return result;
+}
+
+static void WriteLE32(std::string &buffer, usize offset, u32 value) {
+    for (int i = 0; i < 4; ++i) {
+        buffer[offset + i] = (char)((value >> (8 * i)) & 0xff);
+    }
+}
+
+static size_t OnWriteToString(void *user_data, const void *data, size_t num_bytes) {
+    ((std::string *)user_data)->append((const char *)data, num_bytes);
+    return num_bytes;
+}
+
+static drwav_bool32 OnSeekString(void *, int, drwav_seek_origin) {
+    // We only ever write the header into a string, which never needs a seek
+    return DRWAV_FALSE;
+}
+
+struct WaveSampleDataLocation {
+    u64 file_size;
+    u64 data_pos;
+    u64 data_size;
+};
+
+// Returns where the sample data is in the WAV file, but only if that data is laid out exactly as
+// WriteWaveFile would write audio_data. Without this guarantee we cannot update the file in-place.
+static std::optional<WaveSampleDataLocation> FindMatchingWaveSampleData(const fs::path &path,
+                                                                        const AudioData &audio_data) {
+    if (std::find(std::begin(valid_wave_bit_depths), std::end(valid_wave_bit_depths),
+                  audio_data.bits_per_sample) == std::end(valid_wave_bit_depths)) {
+        return {};
     }
 
+    std::error_code ec;
+    const auto file_size = fs::file_size(path, ec);
+    if (ec) return {};
+
+    const auto file = OpenFile(path, "rb");
+    if (!file) return {};
+    drwav wav;
+    if (!drwav_init(&wav, OnReadFile, OnSeekFile, OnTellFile, file.get(), nullptr)) return {};
+    const auto format = WaveDataFormat(audio_data, audio_data.bits_per_sample);
+    const bool same_sample_layout =
+        wav.container == drwav_container_riff && wav.translatedFormatTag == format.format &&
+        wav.channels == format.channels && wav.sampleRate == format.sampleRate &&
+        wav.bitsPerSample == format.bitsPerSample &&
+        wav.fmt.blockAlign == format.channels * format.bitsPerSample / 8 &&
+        wav.totalPCMFrameCount == audio_data.NumFrames();
+    const WaveSampleDataLocation result {file_size, wav.dataChunkDataPos, wav.dataChunkDataSize};
+    drwav_uninit(&wav);
+
+    if (!same_sample_layout || result.data_pos + result.data_size > file_size) return {};
     return result;
 }
 
+// The new metadata chunks are put in the space between the fmt chunk and the data chunk if they fit; any
+// space left over is filled with a JUNK chunk. If they do not fit, the whole space is made into a JUNK chunk
+// and the metadata is appended after the data chunk instead. Either way the sample data is not touched.
+static std::optional<FilePatch> CreateMetadataOnlyWaveFilePatch(const fs::path &path,
+                                                                const AudioData &audio_data) {
+    const auto location = FindMatchingWaveSampleData(path, audio_data);
+    if (!location) return {};
+    const auto data_pos = location->data_pos;
+    const auto data_size = location->data_size;
+
+    constexpr u64 fmt_chunk_end = 36;
+    constexpr u64 chunk_header_size = 8;
+    if (data_pos < fmt_chunk_end + chunk_header_size) return {};
+    const u64 free_space = data_pos - chunk_header_size - fmt_chunk_end;
+    if (free_space % 2 != 0 || (free_space != 0 && free_space < chunk_header_size)) return {};
+
+    // Get drwav to generate the exact header that WriteWaveFile would write
+    NonSpecificMetadataToWaveMetadata wave_file_metadata(audio_data, audio_data.bits_per_sample);
+    const auto metadata = wave_file_metadata.BuildMetadata();
+    std::string header;
+    {
+        auto format = WaveDataFormat(audio_data, audio_data.bits_per_sample);
+        drwav wav;
+        if (!drwav_init_write_with_metadata(&wav, &format, OnWriteToString, OnSeekString, &header, nullptr,
+                                            metadata.size() ? (drwav_metadata *)metadata.data() : NULL,
+                                            (u32)metadata.size())) {
+            return {};
+        }
+    }
+    if (header.size() < fmt_chunk_end + chunk_header_size) return {};
+    const auto metadata_chunks =
+        header.substr(fmt_chunk_end, header.size() - fmt_chunk_end - chunk_header_size);
+
+    const auto AppendJunkChunk = [](std::string &buffer, u64 chunk_size) {
+        buffer.append("JUNK");
+        buffer.append(4, '\0');
+        WriteLE32(buffer, buffer.size() - 4, (u32)(chunk_size - chunk_header_size));
+        buffer.append(chunk_size - chunk_header_size, '\0');
+    };
+
+    const u64 data_pad_size = data_size % 2;
+    const u64 leftover_space = free_space - std::min<u64>(free_space, metadata_chunks.size());
+    const bool fits_before_data = metadata_chunks.size() <= free_space &&
+                                  (leftover_space == 0 || leftover_space >= chunk_header_size);
+
+    std::string new_header = header.substr(0, fmt_chunk_end);
+    if (fits_before_data) {
+        new_header += metadata_chunks;
+        if (leftover_space) AppendJunkChunk(new_header, leftover_space);
+    } else if (free_space) {
+        AppendJunkChunk(new_header, free_space);
+    }
+    new_header.append("data");
+    new_header.append(4, '\0');
+    // The header must end up exactly where the audio already starts in the file, otherwise patching it in
+    // would corrupt the file; the file is written in full instead
+    if (new_header.size() != data_pos) return {};
+
+    FilePatch patch {};
+    patch.new_file_size =
+        data_pos + data_size + data_pad_size + (fits_before_data ? 0 : metadata_chunks.size());
+    if (patch.new_file_size - 8 > std::numeric_limits<u32>::max()) return {};
+    WriteLE32(new_header, 4, (u32)(patch.new_file_size - 8));
+    WriteLE32(new_header, new_header.size() - 4, (u32)data_size);
+
+    patch.writes.push_back({0, std::move(new_header)});
+    if (data_pad_size) patch.writes.push_back({data_pos + data_size, std::string(1, '\0')});
+    if (!fits_before_data) patch.writes.push_back({data_pos + data_size + data_pad_size, metadata_chunks});
+    return patch;
+}
+
+static size_t FlacIORead(void *ptr, size_t size, size_t nmemb, FLAC__IOHandle handle) {
+    return std::fread(ptr, size, nmemb, (FILE *)handle);
+}
+
+static int FlacIOSeek(FLAC__IOHandle handle, FLAC__int64 offset, int whence) {
+#if _WIN32
+    return _fseeki64((FILE *)handle, offset, whence);
+#else
+    return fseeko((FILE *)handle, (off_t)offset, whence);
+#endif
+}
+
+static FLAC__int64 FlacIOTell(FLAC__IOHandle handle) {
+#if _WIN32
+    return _ftelli64((FILE *)handle);
+#else
+    return ftello((FILE *)handle);
+#endif
+}
+
+static int FlacIOEof(FLAC__IOHandle handle) { return std::feof((FILE *)handle); }
+
+// Collects everything that libFLAC writes into a FilePatch rather than writing to the file
+struct FlacPatchWriter {
+    FilePatch patch {};
+    u64 position = 0;
+};
+
+static size_t FlacPatchWrite(const void *ptr, size_t size, size_t nmemb, FLAC__IOHandle handle) {
+    auto &writer = *(FlacPatchWriter *)handle;
+    const auto num_bytes = size * nmemb;
+    auto &writes = writer.patch.writes;
+    if (writes.empty() || writes.back().offset + writes.back().bytes.size() != writer.position) {
+        writes.push_back({writer.position, {}});
+    }
+    writes.back().bytes.append((const char *)ptr, num_bytes);
+    writer.position += num_bytes;
+    return nmemb;
+}
+
+static int FlacPatchSeek(FLAC__IOHandle handle, FLAC__int64 offset, int whence) {
+    if (whence != SEEK_SET || offset < 0) return -1;
+    ((FlacPatchWriter *)handle)->position = (u64)offset;
+    return 0;
+}
+
+// libFLAC's metadata chain is used to replace our APPLICATION block. It can only do this without moving the
+// audio frames when the existing PADDING can absorb the change in size; otherwise we return nothing.
+static std::optional<FilePatch> CreateMetadataOnlyFlacFilePatch(const fs::path &path,
+                                                                const AudioData &audio_data) {
+    std::unique_ptr<FLAC__Metadata_Chain, decltype(&FLAC__metadata_chain_delete)> chain {
+        FLAC__metadata_chain_new(), &FLAC__metadata_chain_delete};
+    if (!chain) return {};
+    {
+        const auto file = OpenFile(path, "rb");
+        if (!file) return {};
+        FLAC__IOCallbacks callbacks {};
+        callbacks.read = FlacIORead;
+        callbacks.seek = FlacIOSeek;
+        callbacks.tell = FlacIOTell;
+        callbacks.eof = FlacIOEof;
+        if (!FLAC__metadata_chain_read_with_callbacks(chain.get(), file.get(), callbacks)) return {};
+    }
+
+    std::unique_ptr<FLAC__Metadata_Iterator, decltype(&FLAC__metadata_iterator_delete)> it {
+        FLAC__metadata_iterator_new(), &FLAC__metadata_iterator_delete};
+    if (!it) return {};
+
+    FLAC__metadata_iterator_init(it.get(), chain.get());
+    const auto stream_info = FLAC__metadata_iterator_get_block(it.get());
+    if (stream_info->type != FLAC__METADATA_TYPE_STREAMINFO) return {};
+    const auto &info = stream_info->data.stream_info;
+    if (info.channels != audio_data.num_channels || info.sample_rate != audio_data.sample_rate ||
+        info.bits_per_sample != audio_data.bits_per_sample || info.total_samples != audio_data.NumFrames()) {
+        return {};
+    }
+
+    while (FLAC__metadata_iterator_next(it.get())) {
+        const auto block = FLAC__metadata_iterator_get_block(it.get());
+        if (block->type == FLAC__METADATA_TYPE_APPLICATION &&
+            memcmp(block->data.application.id, flac_custom_signet_application_id, 4) == 0) {
+            if (!FLAC__metadata_iterator_delete_block(it.get(), false)) return {};
+        }
+    }
+
+    // Insert straight after the STREAMINFO so that any PADDING remains the last block; libFLAC only resizes
+    // padding that is at the end
+    if (auto signet_metadata = CreateSignetFlacMetadataBlock(audio_data)) {
+        FLAC__metadata_iterator_init(it.get(), chain.get());
+        if (!FLAC__metadata_iterator_insert_block_after(it.get(), signet_metadata)) {
+            FLAC__metadata_object_delete(signet_metadata);
+            return {};
+        }
+    }
+
+    if (FLAC__metadata_chain_check_if_tempfile_needed(chain.get(), true)) return {};
+
+    FlacPatchWriter writer {};
+    writer.patch.new_file_size = fs::file_size(path);
+    FLAC__IOCallbacks callbacks {};
+    callbacks.write = FlacPatchWrite;
+    callbacks.seek = FlacPatchSeek;
+    if (!FLAC__metadata_chain_write_with_callbacks(chain.get(), true, &writer, callbacks)) return {};
+    return writer.patch;
+}
+
+std::optional<FilePatch> CreateMetadataOnlyFilePatch(const fs::path &path, const AudioData &audio_data) {
+    if (!fs::is_regular_file(path)) return {};
+    const auto ext = path.extension();
+    if (ext == ".wav") return CreateMetadataOnlyWaveFilePatch(path, audio_data);
+    if (ext == ".flac") return CreateMetadataOnlyFlacFilePatch(path, audio_data);
+    return {};
+}
+
+std::optional<FilePatch> CreateFramesOnlyFilePatch(const fs::path &path,
+                                                   const AudioData &audio_data,
+                                                   const std::vector<FrameRange> &frame_ranges) {
+    if (path.extension() != ".wav" || !fs::is_regular_file(path)) return {};
+    const auto location = FindMatchingWaveSampleData(path, audio_data);
+    if (!location) return {};
+
+    // When writing, the whole file is scaled down if any sample is out of range; that is not a local change
+    if (GetScaleToAvoidClipping(audio_data.interleaved_samples) != 1) return {};
+
+    const auto bytes_per_frame = (u64)audio_data.num_channels * (audio_data.bits_per_sample / 8);
+    FilePatch patch {};
+    patch.new_file_size = location->file_size;
+    for (const auto &range : frame_ranges) {
+        if (range.first_frame + range.num_frames > audio_data.NumFrames()) return {};
+        const auto samples_begin =
+            audio_data.interleaved_samples.begin() + range.first_frame * audio_data.num_channels;
+        const std::vector<double> samples {samples_begin,
+                                           samples_begin + range.num_frames * audio_data.num_channels};
+        GetAudioDataConvertedAndScaledToBitDepth(
+            samples, audio_data.bits_per_sample, [&](const void *raw_data) {
+                const auto num_bytes = range.num_frames * bytes_per_frame;
+                patch.writes.push_back({location->data_pos + range.first_frame * bytes_per_frame,
+                                        std::string((const char *)raw_data, num_bytes)});
+            });
+    }
+    return patch;
+}
+
 struct BufferConversionTest {
     template <typename T>
     static void
@@ -1464,3 +2165,273 @@ TEST_CASE("[AudioData]") {
         }
     }
 }
+
+TEST_CASE("[MetadataOnlyFilePatch]") {
+    const auto CheckPatchedFile = [](const fs::path &path, const AudioData &expected) {
+        const auto patch = CreateMetadataOnlyFilePatch(path, expected);
+        REQUIRE(patch);
+        std::string error;
+        REQUIRE(ApplyFilePatch(path, *patch, error));
+
+        // The patched file should read back the same as a file that was completely rewritten
+        fs::path rewritten_path = "metadata_patch_test_rewritten";
+        rewritten_path.replace_extension(path.extension());
+        REQUIRE(WriteAudioFile(rewritten_path, expected));
+        const auto rewritten = ReadAudioFile(rewritten_path);
+        REQUIRE(rewritten);
+
+        const auto result = ReadAudioFile(path);
+        REQUIRE(result);
+        REQUIRE(result->interleaved_samples == rewritten->interleaved_samples);
+        REQUIRE(result->metadata.markers.size() == rewritten->metadata.markers.size());
+        REQUIRE(result->metadata.regions.size() == rewritten->metadata.regions.size());
+        REQUIRE(result->metadata.loops.size() == rewritten->metadata.loops.size());
+        for (usize i = 0; i < rewritten->metadata.markers.size(); ++i) {
+            REQUIRE(result->metadata.markers[i].start_frame == rewritten->metadata.markers[i].start_frame);
+        }
+    };
+
+    const auto AddMarkers = [](AudioData &data, usize num_markers) {
+        for (usize i = 0; i < num_markers; ++i) {
+            MetadataItems::Marker marker {};
+            marker.name = "marker " + std::to_string(i);
+            marker.start_frame = i;
+            data.metadata.markers.push_back(marker);
+        }
+    };
+
+    SUBCASE("wav") {
+        const fs::path filename = "metadata_patch_test.wav";
+        fs::copy_file(TEST_DATA_DIRECTORY "/wav_with_region_and_marker.wav", filename,
+                      fs::copy_options::overwrite_existing);
+        auto data = ReadAudioFile(filename);
+        REQUIRE(data);
+
+        SUBCASE("metadata grows") {
+            AddMarkers(*data, 50);
+            CheckPatchedFile(filename, *data);
+
+            SUBCASE("and then shrinks") {
+                data->metadata.markers.clear();
+                data->metadata.regions.clear();
+                CheckPatchedFile(filename, *data);
+            }
+        }
+        SUBCASE("metadata shrinks") {
+            data->metadata.markers.clear();
+            CheckPatchedFile(filename, *data);
+        }
+    }
+
+    SUBCASE("flac") {
+        const fs::path filename = "metadata_patch_test.flac";
+        {
+            const auto original = ReadAudioFile(TEST_DATA_DIRECTORY "/flac_with_comments.flac");
+            REQUIRE(original);
+            REQUIRE(WriteAudioFile(filename, *original));
+        }
+        auto data = ReadAudioFile(filename);
+        REQUIRE(data);
+
+        SUBCASE("metadata fits in the padding") {
+            AddMarkers(*data, 10);
+            CheckPatchedFile(filename, *data);
+        }
+        SUBCASE("metadata does not fit in the padding") {
+            AddMarkers(*data, 1000);
+            REQUIRE(!CreateMetadataOnlyFilePatch(filename, *data));
+        }
+    }
+
+    SUBCASE("audio change is not patched") {
+        const fs::path filename = "metadata_patch_test_audio.wav";
+        fs::copy_file(TEST_DATA_DIRECTORY "/wav_with_region_and_marker.wav", filename,
+                      fs::copy_options::overwrite_existing);
+        auto data = ReadAudioFile(filename);
+        REQUIRE(data);
+        data->interleaved_samples.resize(data->interleaved_samples.size() / 2);
+        REQUIRE(!CreateMetadataOnlyFilePatch(filename, *data));
+    }
+}
+
+TEST_CASE("[FramesOnlyFilePatch]") {
+    const fs::path filename = "frames_patch_test.wav";
+    auto data = TestHelpers::CreateSineWaveAtFrequency(2, 44100, 0.5, 440);
+    data.bits_per_sample = 16;
+    REQUIRE(WriteAudioFile(filename, data));
+    data = *ReadAudioFile(filename);
+    const auto original_size = fs::file_size(filename);
+
+    SUBCASE("changed frames are written") {
+        for (usize frame = 100; frame < 200; ++frame) {
+            data.GetSample(0, frame) = 0;
+            data.GetSample(1, frame) = 0.5;
+        }
+        data.GetSample(1, data.NumFrames() - 1) = -0.25;
+
+        const auto patch = CreateFramesOnlyFilePatch(filename, data, {{100, 100}, {data.NumFrames() - 1, 1}});
+        REQUIRE(patch);
+        REQUIRE(patch->writes.size() == 2);
+        std::string error;
+        REQUIRE(ApplyFilePatch(filename, *patch, error));
+        REQUIRE(fs::file_size(filename) == original_size);
+
+        // Changed frames are encoded just like a full rewrite would, other frames keep their original bytes
+        const fs::path rewritten_filename = "frames_patch_test_rewritten.wav";
+        REQUIRE(WriteAudioFile(rewritten_filename, data));
+        const auto patched = ReadAudioFile(filename);
+        const auto rewritten = ReadAudioFile(rewritten_filename);
+        REQUIRE(patched);
+        REQUIRE(rewritten);
+        for (usize frame = 0; frame < data.NumFrames(); ++frame) {
+            const bool changed = (frame >= 100 && frame < 200) || frame == data.NumFrames() - 1;
+            for (unsigned channel = 0; channel < data.num_channels; ++channel) {
+                REQUIRE(patched->GetSample(channel, frame) ==
+                        (changed ? rewritten->GetSample(channel, frame) : data.GetSample(channel, frame)));
+            }
+        }
+    }
+
+    SUBCASE("out of range samples need the whole file rewriting") {
+        data.GetSample(0, 10) = 2;
+        REQUIRE(!CreateFramesOnlyFilePatch(filename, data, {{10, 1}}));
+    }
+
+    SUBCASE("changed length needs the whole file rewriting") {
+        data.interleaved_samples.resize(data.interleaved_samples.size() - 2);
+        REQUIRE(!CreateFramesOnlyFilePatch(filename, data, {{0, 1}}));
+    }
+}
+
+TEST_CASE("[IntegerSamplePassThrough]") {
+    // The readers don't all convert 8-bit samples to floating point the same way, so compare the integers
+    // that are actually stored in the files
+    const auto ReadIntegerSamples = [](const fs::path &path, const AudioData &data) {
+        const auto reader = OpenMatchingIntegerSampleReader(path, data, data.bits_per_sample);
+        REQUIRE(reader);
+        std::vector<s32> result(data.interleaved_samples.size());
+        REQUIRE(reader->Read(result.data(), data.NumFrames()) == data.NumFrames());
+        REQUIRE(!reader->Failed());
+        return result;
+    };
+
+    const auto CheckTranscode = [&](const fs::path &in_path, const fs::path &out_path) {
+        const auto in = ReadAudioFile(in_path);
+        REQUIRE(in);
+        REQUIRE(WriteAudioFile(out_path, *in, {}, in_path));
+        const auto out = ReadAudioFile(out_path);
+        REQUIRE(out);
+        REQUIRE(out->bits_per_sample == in->bits_per_sample);
+        REQUIRE(ReadIntegerSamples(out_path, *out) == ReadIntegerSamples(in_path, *in));
+    };
+
+    SUBCASE("wav to flac and back") {
+        CheckTranscode(TEST_DATA_DIRECTORY "/wav_with_region_and_marker.wav", "pass_through.flac");
+        CheckTranscode("pass_through.flac", "pass_through.wav");
+    }
+
+    SUBCASE("8-bit and 16-bit") {
+        for (const unsigned bits : {8u, 16u}) {
+            auto data = TestHelpers::CreateSineWaveAtFrequency(2, 44100, 0.1, 440);
+            data.bits_per_sample = bits;
+            REQUIRE(WriteAudioFile("pass_through_source.wav", data));
+            CheckTranscode("pass_through_source.wav", "pass_through.flac");
+            CheckTranscode("pass_through.flac", "pass_through.wav");
+        }
+    }
+
+    SUBCASE("samples are not copied from a file that does not match") {
+        auto data = *ReadAudioFile(TEST_DATA_DIRECTORY "/wav_with_region_and_marker.wav");
+        data.bits_per_sample = 16;
+        REQUIRE(WriteAudioFile("pass_through_mismatch.flac", data, {},
+                               TEST_DATA_DIRECTORY "/wav_with_region_and_marker.wav"));
+        const auto out = ReadAudioFile("pass_through_mismatch.flac");
+        REQUIRE(out);
+        REQUIRE(out->bits_per_sample == 16);
+    }
+}
+
+TEST_CASE("[ReadAudioFileRange]") {
+    const auto CheckRanges = [](const fs::path &path) {
+        const auto full = ReadAudioFile(path);
+        REQUIRE(full);
+        const auto num_frames = full->NumFrames();
+        REQUIRE(num_frames > 100);
+
+        const auto CheckRange = [&](usize start_frame, usize frames) {
+            CAPTURE(start_frame);
+            CAPTURE(frames);
+            usize file_num_frames = 0;
+            const auto range = ReadAudioFileRange(path, start_frame, frames, &file_num_frames);
+            REQUIRE(range);
+            REQUIRE(file_num_frames == num_frames);
+            REQUIRE(range->num_channels == full->num_channels);
+            REQUIRE(range->sample_rate == full->sample_rate);
+            REQUIRE(range->bits_per_sample == full->bits_per_sample);
+            REQUIRE(range->format == full->format);
+
+            const auto expected_frames =
+                start_frame < num_frames ? std::min(frames, num_frames - start_frame) : 0;
+            REQUIRE(range->NumFrames() == expected_frames);
+            for (usize i = 0; i < range->interleaved_samples.size(); ++i) {
+                REQUIRE(range->interleaved_samples[i] ==
+                        full->interleaved_samples[start_frame * full->num_channels + i]);
+            }
+        };
+
+        CheckRange(0, 0);
+        CheckRange(0, 10);
+        CheckRange(num_frames / 2, 50);
+        CheckRange(num_frames - 10, 50);
+        CheckRange(num_frames + 10, 50);
+        CheckRange(0, num_frames);
+    };
+
+    SUBCASE("wav") { CheckRanges(TEST_DATA_DIRECTORY "/test_96khz_24bit.wav"); }
+
+    SUBCASE("flac") {
+        const auto data = ReadAudioFile(TEST_DATA_DIRECTORY "/test_96khz_24bit.wav");
+        REQUIRE(data);
+        REQUIRE(WriteAudioFile("read_range_test.flac", *data));
+        CheckRanges("read_range_test.flac");
+    }
+}
+
+TEST_CASE("[AnalysisAudio]") {
+    SUBCASE("channels are summed") {
+        AudioData stereo;
+        stereo.num_channels = 2;
+        stereo.sample_rate = 44100;
+        stereo.interleaved_samples = {0.25, 0.5, -0.5, 0.25};
+        const auto mono = CreateAnalysisAudio(stereo);
+        REQUIRE(mono.num_channels == 1);
+        REQUIRE(mono.sample_rate == 44100);
+        REQUIRE(mono.interleaved_samples == std::vector<double> {0.75, -0.25});
+    }
+
+    SUBCASE("high sample rates are reduced") {
+        const auto sine = TestHelpers::CreateSineWaveAtFrequency(2, 96000, 1, 440);
+        const auto mono = CreateAnalysisAudio(sine);
+        REQUIRE(mono.sample_rate == 48000);
+        REQUIRE(mono.NumFrames() == sine.NumFrames() / 2);
+        const auto pitch = mono.DetectPitch();
+        REQUIRE(pitch);
+        REQUIRE(*pitch == doctest::Approx(440).epsilon(0.01));
+    }
+
+    SUBCASE("decoding directly matches converting the whole file") {
+        for (const unsigned sample_rate : {44100u, 96000u}) {
+            auto data = TestHelpers::CreateSineWaveAtFrequency(2, sample_rate, 0.5, 220);
+            data.bits_per_sample = 16;
+            for (const auto format : {AudioFileFormat::Wav, AudioFileFormat::Flac}) {
+                const fs::path path = "analysis_test." + GetLowercaseExtension(format);
+                REQUIRE(WriteAudioFile(path, data));
+                const auto direct = ReadAudioFileForAnalysis(path);
+                REQUIRE(direct);
+                const auto converted = CreateAnalysisAudio(*ReadAudioFile(path));
+                REQUIRE(direct->sample_rate == converted.sample_rate);
+                REQUIRE(direct->interleaved_samples == converted.interleaved_samples);
+            }
+        }
+    }
+}
@@ -4,11 +4,54 @@
 #include "filesystem.hpp"
 
 #include "audio_data.h"
+#include "file_patch.h"
 
 std::optional<AudioData> ReadAudioFile(const fs::path &filename);
+// Reads only the frames [start_frame, start_frame + num_frames) of the file, seeking past the others rather
+// than decoding them. The range is clamped to the length of the file. The result has the format, sample rate
+// etc. of the file but none of its metadata. If file_num_frames is given it is set to the length of the whole
+// file.
+std::optional<AudioData> ReadAudioFileRange(const fs::path &path,
+                                            usize start_frame,
+                                            usize num_frames,
+                                            usize *file_num_frames = nullptr);
+
+// Analysis such as pitch detection only needs a single channel, and it does not need a very high sample rate.
+// Audio above twice this rate is reduced by a whole-number factor to bring it down towards this rate.
+constexpr unsigned analysis_min_sample_rate = 44100;
+
+// Creates the signal that analysis such as pitch detection is done on: a single channel that is the sum of
+// all of the channels, at a reduced sample rate if the audio's rate is high. It has no metadata.
+AudioData CreateAnalysisAudio(const AudioData &audio);
+
+// The same as CreateAnalysisAudio on the whole file, but the file is decoded straight into that form a block
+// at a time so the full audio is never held in memory.
+std::optional<AudioData> ReadAudioFileForAnalysis(const fs::path &path);
+
+// unchanged_samples_file is an optional file that is known to contain exactly the same samples as audio_data.
+// If it is an integer PCM file at the same bit depth, the samples are copied from it directly rather than
+// being converted from audio_data's floating point values, which is faster and guaranteed to be lossless.
 bool WriteAudioFile(const fs::path &filename,
                     const AudioData &audio_data,
-                    const std::optional<unsigned> new_bits_per_sample = {});
+                    const std::optional<unsigned> new_bits_per_sample = {},
+                    const fs::path &unchanged_samples_file = {});
+
+// If the only difference between audio_data and the file at path is the metadata, this returns a patch that
+// updates the metadata of the file in-place, leaving the encoded audio untouched. Returns nothing if the file
+// needs to be rewritten in full instead.
+std::optional<FilePatch> CreateMetadataOnlyFilePatch(const fs::path &path, const AudioData &audio_data);
+
+struct FrameRange {
+    usize first_frame;
+    usize num_frames;
+};
+
+// If the only difference between audio_data and the file at path is the samples within the given frame
+// ranges, this returns a patch that overwrites just the bytes of those frames. Only uncompressed WAV files
+// can be patched like this. Returns nothing if the file needs to be rewritten in full instead.
+std::optional<FilePatch> CreateFramesOnlyFilePatch(const fs::path &path,
+                                                   const AudioData &audio_data,
+                                                   const std::vector<FrameRange> &frame_ranges);
 
 bool CanFileBeConvertedToBitDepth(AudioFileFormat file, unsigned bit_depth);
 bool IsPathReadableAudioFile(const fs::path &path);
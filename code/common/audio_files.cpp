@@ -1,10 +1,13 @@
 #include "audio_files.h"
 
+#include <numeric>
+
 #include "CLI11.hpp"
 #include "doctest.hpp"
 
 #include "backup.h"
 #include "common.h"
+#include "defer.h"
 #include "filepath_set.h"
 
 AudioFiles::AudioFiles(const std::vector<std::string> &path_items,
@@ -28,51 +31,87 @@ AudioFiles::AudioFiles(const std::vector<std::string> &path_items,
     ReadAllAudioFiles(*all_matched_filepaths);
 }
 
-AudioFiles::AudioFiles(const tcb::span<EditTrackedAudioFile> files) {
-    m_all_files.assign(files.begin(), files.end());
+AudioFiles::AudioFiles(const FilepathSet &paths) { ReadAllAudioFiles(paths); }
+
+AudioFiles::AudioFiles(std::vector<EditTrackedAudioFile> files) : m_all_files(std::move(files)) {
     CreateFoldersDataStructure();
 }
 
 void AudioFiles::CreateFoldersDataStructure() {
-    for (auto &f : m_all_files) {
-        fs::path parent = ".";
-        if (f.GetPath().has_parent_path()) parent = f.GetPath().parent_path();
-        if (m_folders.find(parent) == m_folders.end()) {
-            m_folders.insert({parent, {}});
+    std::vector<fs::path> parents;
+    parents.reserve(m_all_files.size());
+    for (const auto &f : m_all_files) {
+        parents.push_back(f.GetPath().has_parent_path() ? f.GetPath().parent_path() : fs::path {"."});
+    }
+
+    std::vector<usize> order(m_all_files.size());
+    std::iota(order.begin(), order.end(), usize {0});
+    std::stable_sort(order.begin(), order.end(), [&](usize a, usize b) { return parents[a] < parents[b]; });
+
+    m_files_by_folder.clear();
+    m_files_by_folder.reserve(m_all_files.size());
+    m_folders.clear();
+    std::vector<usize> folder_starts;
+    for (const auto i : order) {
+        if (m_folders.empty() || m_folders.back().path != parents[i]) {
+            m_folders.push_back({std::move(parents[i]), {}});
+            folder_starts.push_back(m_files_by_folder.size());
         }
-        m_folders[parent].push_back(&f);
+        m_files_by_folder.push_back(&m_all_files[i]);
+    }
+    for (usize i = 0; i < m_folders.size(); ++i) {
+        const auto end = i + 1 < m_folders.size() ? folder_starts[i + 1] : m_files_by_folder.size();
+        m_folders[i].files = {m_files_by_folder.data() + folder_starts[i], end - folder_starts[i]};
     }
 }
 
 void AudioFiles::ReadAllAudioFiles(const FilepathSet &paths) {
+    // The paths in a FilepathSet are already canonical, so we only need to canonicalise the current directory
+    // once and can then do the rest lexically, rather than calling fs::proximate for each file.
+    std::error_code ec;
+    const auto current_dir = fs::weakly_canonical(fs::current_path(), ec);
+    if (ec) {
+        ErrorWithNewLine("Signet", {}, "Could not get the current directory for reason {}", ec.message());
+    }
+
+    m_all_files.reserve(paths.Size());
     for (const auto &path : paths) {
         if (!IsPathReadableAudioFile(path)) continue;
-        std::error_code ec;
-        const auto proximate = fs::proximate(path);
-        if (ec) {
-            ErrorWithNewLine("Signet", {},
-                             "Internal error in function {}: fs::proximate failed for path {} for reason {}",
-                             __FUNCTION__, path, ec.message());
-            m_all_files.push_back(path);
-        } else {
-            m_all_files.push_back(proximate);
-        }
+        auto proximate = path.lexically_proximate(current_dir);
+        m_all_files.push_back(proximate.empty() ? path : proximate);
     }
     CreateFoldersDataStructure();
 }
 
-bool AudioFiles::WouldWritingAllFilesCreateConflicts() {
-    std::set<fs::path> files_set;
+void AudioFiles::KeepOnly(const std::vector<bool> &keep) {
+    assert(keep.size() == m_all_files.size());
+    std::vector<EditTrackedAudioFile> kept;
+    kept.reserve(m_all_files.size());
+    for (usize i = 0; i < m_all_files.size(); ++i) {
+        if (keep[i]) kept.push_back(std::move(m_all_files[i]));
+    }
+    m_all_files = std::move(kept);
+    CreateFoldersDataStructure();
+}
+
+void AudioFiles::SetMemoryLimit(usize max_bytes) {
+    m_memory_budget = std::make_unique<AudioMemoryBudget>(max_bytes);
+    for (auto &f : m_all_files) {
+        f.SetMemoryBudget(m_memory_budget.get());
+    }
+}
+
+bool AudioFiles::WouldWritingAllFilesCreateConflicts(std::set<fs::path> &paths) {
     bool file_conflicts = false;
     for (const auto &f : m_all_files) {
-        if (files_set.find(f.GetPath()) != files_set.end()) {
+        if (paths.find(f.GetPath()) != paths.end()) {
             ErrorWithNewLine(
                 "Signet", f,
                 "Filepath {} would have the same filename as another file. Please review your renaming settings, no action will be taken now",
                 f.GetPath());
             file_conflicts = true;
         }
-        files_set.insert(f.GetPath());
+        paths.insert(f.GetPath());
     }
     return file_conflicts;
 }
@@ -82,16 +121,63 @@ static fs::path PathWithNewExtension(fs::path path, AudioFileFormat format) {
     return path;
 }
 
-bool AudioFiles::WriteFilesThatHaveBeenEdited(SignetBackup &backup, bool create_copies) {
-    if (WouldWritingAllFilesCreateConflicts()) {
+bool AudioFiles::WriteFilesThatHaveBeenEdited(SignetBackup &backup,
+                                              bool create_copies,
+                                              std::set<fs::path> *other_batch_paths) {
+    std::set<fs::path> paths;
+    if (WouldWritingAllFilesCreateConflicts(other_batch_paths ? *other_batch_paths : paths)) {
         return false;
     }
 
+    // Files where only the metadata or a few frames have changed can usually be updated in-place, which
+    // avoids rewriting the whole file and backing it all up.
+    std::vector<std::optional<FilePatch>> in_place_patches(m_all_files.size());
+    if (!create_copies) {
+        for (usize i = 0; i < m_all_files.size(); ++i) {
+            auto &file = m_all_files[i];
+            if (file.FormatChanged()) continue;
+            if (file.OnlyMetadataChanged()) {
+                in_place_patches[i] = CreateMetadataOnlyFilePatch(file.OriginalPath(), file.GetAudio());
+            } else if (const auto frame_ranges = file.ChangedFrameRanges()) {
+                in_place_patches[i] =
+                    CreateFramesOnlyFilePatch(file.OriginalPath(), file.GetAudio(), *frame_ranges);
+            }
+            file.AllowUnloading();
+        }
+    }
+
+    // Back up every original that is about to be overwritten or deleted in one go so that the copying (or
+    // compressing) can happen in parallel.
+    if (!create_copies) {
+        std::vector<fs::path> files_to_backup;
+        for (usize i = 0; i < m_all_files.size(); ++i) {
+            const auto &file = m_all_files[i];
+            if ((file.AudioChanged() || file.FormatChanged()) && !in_place_patches[i]) {
+                files_to_backup.push_back(file.OriginalPath());
+            }
+        }
+        if (files_to_backup.size() && !backup.AddFilesToBackup(files_to_backup)) return false;
+    }
+
     bool error_occurred = false;
-    for (auto &file : m_all_files) {
+    for (usize i = 0; i < m_all_files.size(); ++i) {
+        auto &file = m_all_files[i];
+        defer { file.AllowUnloading(); };
         const bool file_data_changed = file.AudioChanged();
         const bool file_renamed = file.PathChanged();
         const bool file_format_changed = file.FormatChanged();
+        // If the samples are the same as the original file's they can be copied from it losslessly
+        const fs::path unchanged_samples_file = file.SamplesChanged() ? fs::path {} : file.OriginalPath();
+
+        if (const auto &patch = in_place_patches[i]) {
+            // only new metadata or frames, possibly renamed too
+            if (!backup.PatchFile(file.OriginalPath(), *patch) ||
+                (file_renamed && !backup.MoveFile(file.OriginalPath(), file.GetPath()))) {
+                error_occurred = true;
+                break;
+            }
+            continue;
+        }
 
         if (file_renamed) {
             if (!file_data_changed && !file_format_changed) {
@@ -102,7 +188,8 @@ bool AudioFiles::WriteFilesThatHaveBeenEdited(SignetBackup &backup, bool create_
                         break;
                     }
                 } else {
-                    if (!backup.CreateFile(file.GetPath(), file.GetAudio(), true)) {
+                    // the bytes are unchanged so there's no need to decode and re-encode the audio
+                    if (!backup.CopyFile(file.OriginalPath(), file.GetPath(), true)) {
                         error_occurred = true;
                         break;
                     }
@@ -111,7 +198,7 @@ bool AudioFiles::WriteFilesThatHaveBeenEdited(SignetBackup &backup, bool create_
                        (file_data_changed && file_format_changed)) {
                 // renamed and new format
                 if (!backup.CreateFile(PathWithNewExtension(file.GetPath(), file.GetAudio().format),
-                                       file.GetAudio(), true)) {
+                                       file.GetAudio(), true, unchanged_samples_file)) {
                     error_occurred = true;
                     break;
                 }
@@ -121,7 +208,7 @@ bool AudioFiles::WriteFilesThatHaveBeenEdited(SignetBackup &backup, bool create_
                 }
             } else if (file_data_changed && !file_format_changed) {
                 // renamed and new data
-                if (!backup.CreateFile(file.GetPath(), file.GetAudio(), true)) {
+                if (!backup.CreateFile(file.GetPath(), file.GetAudio(), true, unchanged_samples_file)) {
                     error_occurred = true;
                     break;
                 }
@@ -131,11 +218,11 @@ bool AudioFiles::WriteFilesThatHaveBeenEdited(SignetBackup &backup, bool create_
                 }
             }
         } else {
-            REQUIRE(file.GetPath() == file.OriginalPath());
+            assert(file.GetPath() == file.OriginalPath());
             if ((file_format_changed && !file_data_changed) || (file_format_changed && file_data_changed)) {
                 // only new format
                 if (!backup.CreateFile(PathWithNewExtension(file.OriginalPath(), file.GetAudio().format),
-                                       file.GetAudio(), false)) {
+                                       file.GetAudio(), false, unchanged_samples_file)) {
                     error_occurred = true;
                     break;
                 }
@@ -168,3 +255,78 @@ bool AudioFiles::WriteFilesThatHaveBeenEdited(SignetBackup &backup, bool create_
 
     return !error_occurred;
 }
+
+TEST_CASE("[AudioFiles] folders") {
+    using FolderList = std::vector<std::pair<std::string, std::vector<std::string>>>;
+    const auto FolderContents = [](AudioFiles &files) {
+        FolderList result;
+        for (const auto &folder : files.Folders()) {
+            std::vector<std::string> paths;
+            for (const auto f : folder.files) {
+                paths.push_back(f->GetPath().generic_string());
+            }
+            result.push_back({folder.path.generic_string(), paths});
+        }
+        return result;
+    };
+
+    std::vector<EditTrackedAudioFile> file_list;
+    for (const auto path : {"b/1.wav", "a/1.wav", "top.wav", "b/2.wav", "a/sub/1.wav", "a/2.wav", "b/3.wav"}) {
+        file_list.emplace_back(path);
+    }
+    AudioFiles files {std::move(file_list)};
+
+    // Folders are sorted by path, and files keep their original order within each folder
+    REQUIRE(FolderContents(files) == FolderList {
+                {".", {"top.wav"}},
+                {"a", {"a/1.wav", "a/2.wav"}},
+                {"a/sub", {"a/sub/1.wav"}},
+                {"b", {"b/1.wav", "b/2.wav", "b/3.wav"}},
+            });
+
+    SUBCASE("KeepOnly regroups the files that are left") {
+        files.KeepOnly({true, false, false, false, true, true, true});
+        REQUIRE(files.Size() == 4);
+        REQUIRE(FolderContents(files) == FolderList {
+                    {"a", {"a/2.wav"}},
+                    {"a/sub", {"a/sub/1.wav"}},
+                    {"b", {"b/1.wav", "b/3.wav"}},
+                });
+        // The folders point at the files that are now stored, not at where they were before
+        for (const auto &folder : files.Folders()) {
+            for (const auto f : folder.files) {
+                REQUIRE(f >= &files[0]);
+                REQUIRE(f <= &files[files.Size() - 1]);
+            }
+        }
+    }
+
+    SUBCASE("KeepOnly can remove a whole folder or every file") {
+        files.KeepOnly({false, true, true, false, true, true, false});
+        REQUIRE(FolderContents(files) == FolderList {
+                    {".", {"top.wav"}},
+                    {"a", {"a/1.wav", "a/2.wav"}},
+                    {"a/sub", {"a/sub/1.wav"}},
+                });
+        files.KeepOnly(std::vector<bool>(files.Size(), false));
+        REQUIRE(files.Size() == 0);
+        REQUIRE(files.Folders().empty());
+    }
+}
+
+TEST_CASE("[AudioFiles] conflicts between batches") {
+    const auto Batch = [](const char *original_path, const char *new_path) {
+        std::vector<EditTrackedAudioFile> file_list;
+        file_list.emplace_back(original_path);
+        file_list.back().SetPath(new_path);
+        return AudioFiles {std::move(file_list)};
+    };
+
+    std::set<fs::path> output_paths;
+    auto first = Batch("a.wav", "out/1.wav");
+    REQUIRE(!first.WouldWritingAllFilesCreateConflicts(output_paths));
+    auto second = Batch("b.wav", "out/2.wav");
+    REQUIRE(!second.WouldWritingAllFilesCreateConflicts(output_paths));
+    auto third = Batch("c.wav", "out/1.wav");
+    REQUIRE_THROWS_AS(third.WouldWritingAllFilesCreateConflicts(output_paths), SignetError);
+}
@@ -1,5 +1,8 @@
 #pragma once
-#include <map>
+#include <iterator>
+#include <memory>
+#include <set>
+#include <vector>
 
 #include "edit_tracked_audio_file.h"
 #include "types.h"
@@ -17,8 +20,11 @@ class AudioFiles {
                const std::vector<std::string> &exclude_patterns,
                const bool recursive_directory_search);
 
-    // Simply copies the EditTrackedAudioFile
-    AudioFiles(const tcb::span<EditTrackedAudioFile> files);
+    // Uses the readable audio files from an already gathered set of paths
+    AudioFiles(const FilepathSet &paths);
+
+    // Takes the given files as they are
+    AudioFiles(std::vector<EditTrackedAudioFile> files);
 
     //
     // Files are typically read from the underlying vector with these methods.
@@ -26,22 +32,69 @@ class AudioFiles {
     usize Size() const { return m_all_files.size(); }
     const auto &Files() { return m_all_files; }
 
-    auto begin() { return m_all_files.begin(); }
-    auto end() { return m_all_files.end(); }
+    // Looping over the files tells the memory budget (see SetMemoryLimit) that each file is no longer in use
+    // once the loop moves on from it.
+    class Iterator {
+      public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = EditTrackedAudioFile;
+        using difference_type = std::ptrdiff_t;
+        using pointer = EditTrackedAudioFile *;
+        using reference = EditTrackedAudioFile &;
+
+        Iterator(std::vector<EditTrackedAudioFile>::iterator it) : m_it(it) {}
+        EditTrackedAudioFile &operator*() const { return *m_it; }
+        EditTrackedAudioFile *operator->() const { return &*m_it; }
+        Iterator &operator++() {
+            m_it->AllowUnloading();
+            ++m_it;
+            return *this;
+        }
+        bool operator==(const Iterator &other) const { return m_it == other.m_it; }
+        bool operator!=(const Iterator &other) const { return m_it != other.m_it; }
+
+      private:
+        std::vector<EditTrackedAudioFile>::iterator m_it;
+    };
+
+    Iterator begin() { return m_all_files.begin(); }
+    Iterator end() { return m_all_files.end(); }
     auto begin() const { return m_all_files.begin(); }
     auto end() const { return m_all_files.end(); }
     EditTrackedAudioFile &operator[](size_t index) { return m_all_files[index]; }
 
     //
-    // You can also get a std::map of the same files based on what folder each file is in. For example
-    // Folders()["my-folder"] would return a vector of all of the files in the folder with the name
-    // "my-folder".
+    // You can also get the same files grouped by what folder each file is in. The folders are sorted by path,
+    // and within a folder the files are in the same order as above.
     //
-    const auto &Folders() { return m_folders; }
+    struct Folder {
+        fs::path path;
+        tcb::span<EditTrackedAudioFile *const> files;
+    };
+    const std::vector<Folder> &Folders() { return m_folders; }
 
-    //
-    //
-    bool WriteFilesThatHaveBeenEdited(SignetBackup &backup, bool create_copies);
+    // Removes every file whose element in keep is false
+    void KeepOnly(const std::vector<bool> &keep);
+
+    // Keeps the total size of the decoded audio of all of the files under max_bytes by unloading files that
+    // are not in use; see AudioMemoryBudget.
+    void SetMemoryLimit(usize max_bytes);
+
+    // Marks every file as no longer in use. Called once a command has finished with the files.
+    void AllowUnloadingAll() {
+        for (auto &f : m_all_files) {
+            f.AllowUnloading();
+        }
+    }
+
+    // If the files are one batch of several that are written in turn, other_batch_paths should hold the
+    // paths of the files in the batches before this one, so that a file cannot be written over one of them;
+    // the paths of these files are added to it.
+    bool WriteFilesThatHaveBeenEdited(SignetBackup &backup,
+                                      bool create_copies,
+                                      std::set<fs::path> *other_batch_paths = nullptr);
+    // Adds the path of each file to paths, reporting an error if a path is already there
+    bool WouldWritingAllFilesCreateConflicts(std::set<fs::path> &paths);
     int GetNumFilesProcessed() const {
         int n = 0;
         for (const auto &f : m_all_files) {
@@ -54,9 +107,11 @@ class AudioFiles {
 
   private:
     void ReadAllAudioFiles(const FilepathSet &paths);
-    bool WouldWritingAllFilesCreateConflicts();
     void CreateFoldersDataStructure();
 
     std::vector<EditTrackedAudioFile> m_all_files {};
-    std::map<fs::path, std::vector<EditTrackedAudioFile *>> m_folders {};
+    // Each folder's files are a range of this array, which is sorted by folder
+    std::vector<EditTrackedAudioFile *> m_files_by_folder {};
+    std::vector<Folder> m_folders {};
+    std::unique_ptr<AudioMemoryBudget> m_memory_budget {};
 };
@@ -0,0 +1,124 @@
+#include "audio_memory_budget.h"
+
+#include <algorithm>
+
+#include "doctest.hpp"
+
+#include "common.h"
+#include "edit_tracked_audio_file.h"
+#include "tests_config.h"
+
+AudioMemoryBudget::~AudioMemoryBudget() {
+    if (!m_spill_dir.empty()) {
+        std::error_code ec;
+        fs::remove_all(m_spill_dir, ec);
+    }
+}
+
+void AudioMemoryBudget::MakeRoom(EditTrackedAudioFile &file, usize num_bytes) {
+    if (std::find(m_loaded_files.begin(), m_loaded_files.end(), &file) == m_loaded_files.end()) {
+        m_loaded_files.push_back(&file);
+    }
+
+    usize used_bytes = 0;
+    for (const auto f : m_loaded_files) {
+        used_bytes += f->DecodedBytes();
+    }
+
+    while (used_bytes + num_bytes > m_max_bytes) {
+        auto oldest = m_loaded_files.end();
+        for (auto it = m_loaded_files.begin(); it != m_loaded_files.end(); ++it) {
+            if (*it == &file || !(*it)->UnloadingAllowed()) continue;
+            if (oldest == m_loaded_files.end() || (*it)->LastUsed() < (*oldest)->LastUsed()) oldest = it;
+        }
+        if (oldest == m_loaded_files.end()) {
+            if (!m_warned_over_budget) {
+                m_warned_over_budget = true;
+                WarningWithNewLine(
+                    "Signet", {},
+                    "The files that are currently in use need more than the --max-memory limit of {} MB; continuing over the limit",
+                    m_max_bytes / (1024 * 1024));
+            }
+            break;
+        }
+
+        auto &unloading_file = **oldest;
+        m_loaded_files.erase(oldest);
+        const auto bytes_before = unloading_file.DecodedBytes();
+        unloading_file.Unload();
+        used_bytes = used_bytes - bytes_before + unloading_file.DecodedBytes();
+    }
+}
+
+fs::path AudioMemoryBudget::NewSpillPath() {
+    if (m_spill_dir.empty()) {
+        m_spill_dir = GetTempDir() / ("signet-spill-" + RandomAlphanum());
+        std::error_code ec;
+        fs::create_directories(m_spill_dir, ec);
+    }
+    return m_spill_dir / fmt::format("{}.raw", m_num_spill_files++);
+}
+
+bool WriteSpillFile(const fs::path &path, const std::vector<double> &samples) {
+    auto f = OpenFile(path, "wb");
+    if (!f) return false;
+    return std::fwrite(samples.data(), sizeof(double), samples.size(), f.get()) == samples.size();
+}
+
+bool ReadSpillFile(const fs::path &path, std::vector<double> &samples, usize num_samples) {
+    auto f = OpenFile(path, "rb");
+    if (!f) return false;
+    samples.resize(num_samples);
+    return std::fread(samples.data(), sizeof(double), num_samples, f.get()) == num_samples;
+}
+
+TEST_CASE("[AudioMemoryBudget]") {
+    const fs::path path_a = TEST_DATA_DIRECTORY "/white-noise.wav";
+    const fs::path path_b = TEST_DATA_DIRECTORY "/test.wav";
+    const auto original_a = ReadAudioFile(path_a);
+    const auto original_b = ReadAudioFile(path_b);
+    REQUIRE(original_a);
+    REQUIRE(original_b);
+    const auto size_a = original_a->interleaved_samples.size() * sizeof(double);
+    const auto size_b = original_b->interleaved_samples.size() * sizeof(double);
+
+    // Only enough room for 1 of the files at a time
+    AudioMemoryBudget budget {std::max(size_a, size_b)};
+    EditTrackedAudioFile a {path_a};
+    EditTrackedAudioFile b {path_b};
+    a.SetMemoryBudget(&budget);
+    b.SetMemoryBudget(&budget);
+
+    SUBCASE("unedited files are unloaded and read again") {
+        REQUIRE(a.GetAudio().interleaved_samples == original_a->interleaved_samples);
+        a.AllowUnloading();
+        REQUIRE(b.GetAudio().interleaved_samples == original_b->interleaved_samples);
+        REQUIRE(a.DecodedBytes() == 0);
+        b.AllowUnloading();
+        REQUIRE(a.GetAudio().interleaved_samples == original_a->interleaved_samples);
+        REQUIRE(b.DecodedBytes() == 0);
+    }
+
+    SUBCASE("edited files are spilled and restored exactly") {
+        auto &audio = a.GetWritableAudio();
+        for (auto &s : audio.interleaved_samples) {
+            s *= 1.0 / 3.0;
+        }
+        const auto edited_samples = audio.interleaved_samples;
+        a.AllowUnloading();
+
+        REQUIRE(b.GetAudio().interleaved_samples == original_b->interleaved_samples);
+        REQUIRE(a.DecodedBytes() == 0);
+        b.AllowUnloading();
+
+        REQUIRE(a.GetAudio().interleaved_samples == edited_samples);
+        REQUIRE(a.AudioChanged());
+        REQUIRE(b.DecodedBytes() == 0);
+    }
+
+    SUBCASE("files that are in use are never unloaded") {
+        const auto &audio_a = a.GetAudio();
+        REQUIRE(b.GetAudio().interleaved_samples == original_b->interleaved_samples);
+        REQUIRE(audio_a.interleaved_samples == original_a->interleaved_samples);
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <vector>
+
+#include "filesystem.hpp"
+#include "types.h"
+
+struct EditTrackedAudioFile;
+
+// Keeps the total size of the decoded audio of a set of files under a limit. Before a file decodes its audio
+// it asks the budget to make room for it, and the budget unloads the least-recently used files that are not
+// still in use (see EditTrackedAudioFile::AllowUnloading). Unloaded files are reloaded when they are next
+// used; files that have been edited have their samples spilled to a temporary file rather than discarded.
+class AudioMemoryBudget {
+  public:
+    AudioMemoryBudget(usize max_bytes) : m_max_bytes(max_bytes) {}
+    ~AudioMemoryBudget();
+    AudioMemoryBudget(const AudioMemoryBudget &) = delete;
+    AudioMemoryBudget &operator=(const AudioMemoryBudget &) = delete;
+
+    usize MaxBytes() const { return m_max_bytes; }
+
+    // Returns an ever-increasing value for the files to record when they were last used
+    u64 NextUseTick() { return ++m_use_tick; }
+
+    // Unloads other files until there is room for file to have num_bytes more decoded audio. If that is not
+    // possible, because every other file is still in use, the budget is exceeded and a warning is printed.
+    void MakeRoom(EditTrackedAudioFile &file, usize num_bytes);
+
+    // Returns a new unique path in the temporary folder that a file can spill its samples to. The folder is
+    // deleted when the budget is destroyed.
+    fs::path NewSpillPath();
+
+  private:
+    usize m_max_bytes;
+    u64 m_use_tick = 0;
+    std::vector<EditTrackedAudioFile *> m_loaded_files {};
+    fs::path m_spill_dir {};
+    usize m_num_spill_files = 0;
+    bool m_warned_over_budget = false;
+};
+
+// Samples are spilled as their raw bytes so that they are restored exactly. These do not print anything.
+bool WriteSpillFile(const fs::path &path, const std::vector<double> &samples);
+bool ReadSpillFile(const fs::path &path, std::vector<double> &samples, usize num_samples);
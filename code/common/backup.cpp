@@ -2,7 +2,7 @@
 
 #include <iomanip>
 #include <iostream>
-#include <random>
+#include <set>
 
 #include "doctest.hpp"
 
@@ -10,19 +10,7 @@
 #include "common.h"
 #include "test_helpers.h"
 #include "tests_config.h"
-
-static fs::path GetTempDir() {
-    std::error_code ec;
-    const auto temp_dir = fs::temp_directory_path(ec);
-    if (ec) {
-        WarningWithNewLine(
-            "Backup", {},
-            "Could not get the temporary file folder from the OS for reason: {}. Reverting to using the current working directory.",
-            ec.message());
-        return "."; // cwd
-    }
-    return temp_dir;
-}
+#include "thread_pool.h"
 
 static bool CreateDirectoryChecked(const fs::path &dir) {
     std::error_code ec;
@@ -34,20 +22,6 @@ static bool CreateDirectoryChecked(const fs::path &dir) {
     return true;
 }
 
-static std::string RandomAlphanum() {
-    std::random_device rd;
-    std::mt19937 gen(rd());
-
-    const auto alphanum = "0123456789abcdefghijklmnopqrstuvwxyz";
-
-    std::uniform_int_distribution<> dis(0, strlen(alphanum) - 1);
-    std::string result(10, 'a');
-    for (auto &c : result) {
-        c = alphanum[dis(gen)];
-    }
-    return result;
-}
-
 SignetBackup::SignetBackup()
     : m_backup_dir(GetTempDir() / "signet-backup")
     , m_backup_files_dir(m_backup_dir / "files")
@@ -75,7 +49,9 @@ bool SignetBackup::LoadBackup() const {
 
     fs::remove(temp_database_file, ec); // Error is ignored
 
-    if (!database["files"].size() && !database["file_moves"].size() && !database["files_created"].size()) {
+    if (!database["files"].size() && !database["compressed_files"].size() &&
+        !database["file_patches"].size() && !database["file_moves"].size() &&
+        !database["files_created"].size()) {
         WarningWithNewLine("Backup", {}, "There is no backed-up data");
         return false;
     }
@@ -105,14 +81,35 @@ bool SignetBackup::LoadBackup() const {
     for (const auto &[hash, path] : database["files"].items()) {
         MessageWithNewLine("Backup", {}, "Loading backed-up file {}", path);
         std::error_code ec;
-        fs::copy_file(m_backup_files_dir / hash, path.get<std::string>(),
-                      fs::copy_options::overwrite_existing, ec);
+        CopyFileBytes(m_backup_files_dir / hash, path.get<std::string>(), ec);
         if (ec) {
             ErrorWithNewLine("Backup", {}, "Could not copy file from {} to {} for reason: {}",
                              (m_backup_files_dir / hash).string(), path.get<std::string>(), ec.message());
         }
     }
 
+    for (const auto &[hash, path] : database["compressed_files"].items()) {
+        MessageWithNewLine("Backup", {}, "Loading backed-up file {}", path);
+        std::string error;
+        if (!DecompressBackupFile(m_backup_files_dir / (hash + ".flac"), path.get<std::string>(), error)) {
+            ErrorWithNewLine("Backup", {},
+                             "Could not restore file {} from its compressed backup for reason: {}",
+                             path.get<std::string>(), error);
+        }
+    }
+
+    // Patches are last because they are made relative to the file at its original path, and in the state that
+    // any full backup of it was taken
+    for (const auto &[hash, path] : database["file_patches"].items()) {
+        MessageWithNewLine("Backup", {}, "Restoring patched file {}", path);
+        std::string error;
+        const auto patch = ReadFilePatchFromFile(m_backup_files_dir / (hash + ".patch"), error);
+        if (!patch || !ApplyFilePatch(path.get<std::string>(), *patch, error)) {
+            ErrorWithNewLine("Backup", {}, "Could not restore patched file {} for reason: {}",
+                             path.get<std::string>(), error);
+        }
+    }
+
     return true;
 }
 
@@ -163,23 +160,85 @@ bool SignetBackup::WriteDatabaseFile() {
     return true;
 }
 
-bool SignetBackup::AddFileToBackup(const fs::path &path) {
-    if (!CreateDirectoryChecked(m_backup_files_dir)) return false;
+bool SignetBackup::IsFileInBackup(const std::string &hash_string) const {
+    return (m_database.contains("files") && m_database["files"].contains(hash_string)) ||
+           (m_database.contains("compressed_files") && m_database["compressed_files"].contains(hash_string));
+}
 
-    const auto hash_string = std::to_string(fs::hash_value(path));
-    const auto backup_path = m_backup_files_dir / hash_string;
+bool SignetBackup::StoreFileInBackup(const fs::path &path,
+                                     const std::string &hash_string,
+                                     bool &compressed,
+                                     std::string &error) const {
+    compressed = false;
+    if (m_compression == BackupCompression::Flac) {
+        const auto backup_path = m_backup_files_dir / (hash_string + ".flac");
+        switch (CompressWaveFileForBackup(path, backup_path, error)) {
+            case BackupCompressionResult::Success: compressed = true; return true;
+            case BackupCompressionResult::Unsupported: break; // Store it uncompressed instead
+            case BackupCompressionResult::Failed: {
+                error = fmt::format("Could not compress file {} to {} for reason: {}", path, backup_path,
+                                    error);
+                std::error_code ec;
+                fs::remove(backup_path, ec); // Error is ignored
+                return false;
+            }
+        }
+    }
 
+    const auto backup_path = m_backup_files_dir / hash_string;
     std::error_code ec;
-    fs::copy_file(path, backup_path, fs::copy_options::update_existing, ec);
-    if (ec) {
-        ErrorWithNewLine("Signet", {},
-                         "Backing up file failed. Could not copy file from {} to {} for reason: {}", path,
-                         backup_path, ec.message());
+    if (!CopyFileBytes(path, backup_path, ec)) {
+        error = fmt::format("Could not copy file from {} to {} for reason: {}", path, backup_path,
+                            ec.message());
         return false;
     }
+    return true;
+}
 
-    m_database["files"][hash_string] = path.generic_string();
-    return WriteDatabaseFile();
+bool SignetBackup::AddFileToBackup(const fs::path &path) { return AddFilesToBackup({path}); }
+
+bool SignetBackup::AddFilesToBackup(const std::vector<fs::path> &paths) {
+    ClearOldBackIfNeeded();
+    if (!CreateDirectoryChecked(m_backup_files_dir)) return false;
+
+    struct BackupJob {
+        fs::path path;
+        std::string hash_string;
+        bool success;
+        bool compressed;
+        std::string error;
+    };
+    std::vector<BackupJob> jobs;
+    std::set<std::string> hashes;
+    for (const auto &path : paths) {
+        auto hash_string = std::to_string(fs::hash_value(path));
+        if (IsFileInBackup(hash_string) || !hashes.insert(hash_string).second) continue;
+        jobs.push_back({path, std::move(hash_string), false, false, {}});
+    }
+    if (jobs.empty()) return true;
+
+    ParallelFor(jobs.size(), [&](usize i) {
+        auto &job = jobs[i];
+        job.success = StoreFileInBackup(job.path, job.hash_string, job.compressed, job.error);
+    });
+
+    // Record everything that succeeded before reporting any failure so that those files can still be restored
+    const BackupJob *failed_job = nullptr;
+    for (const auto &job : jobs) {
+        if (!job.success) {
+            if (!failed_job) failed_job = &job;
+            continue;
+        }
+        const auto database_key = job.compressed ? "compressed_files" : "files";
+        m_database[database_key][job.hash_string] = job.path.generic_string();
+    }
+    const bool database_written = WriteDatabaseFile();
+
+    if (failed_job) {
+        ErrorWithNewLine("Signet", {}, "Backing up file failed. {}", failed_job->error);
+        return false;
+    }
+    return database_written;
 }
 
 static bool CreateParentDirectories(const fs::path &path) {
@@ -271,15 +330,18 @@ bool SignetBackup::AddMovedFileToBackup(const fs::path &from, const fs::path &to
     return WriteDatabaseFile();
 }
 
-static bool WriteFile(const fs::path &path, const AudioData &data) {
-    if (!WriteAudioFile(path, data)) {
+static bool WriteFile(const fs::path &path, const AudioData &data, const fs::path &unchanged_samples_file) {
+    if (!WriteAudioFile(path, data, {}, unchanged_samples_file)) {
         ErrorWithNewLine("Signet", path, "Could not write the file");
         return false;
     }
     return true;
 }
 
-bool SignetBackup::CreateFile(const fs::path &path, const AudioData &data, bool create_directories) {
+bool SignetBackup::CreateFile(const fs::path &path,
+                              const AudioData &data,
+                              bool create_directories,
+                              const fs::path &unchanged_samples_file) {
     ClearOldBackIfNeeded();
     if (!CheckForValidPath(path)) return false;
 
@@ -293,7 +355,7 @@ bool SignetBackup::CreateFile(const fs::path &path, const AudioData &data, bool
     }
 
     MessageWithNewLine("Signet", path, "Creating file");
-    if (!WriteFile(path, data)) return false;
+    if (!WriteFile(path, data, unchanged_samples_file)) return false;
     return AddNewlyCreatedFileToBackup(path);
 }
 
@@ -301,7 +363,61 @@ bool SignetBackup::OverwriteFile(const fs::path &path, const AudioData &data) {
     ClearOldBackIfNeeded();
     if (!AddFileToBackup(path)) return false;
     MessageWithNewLine("Signet", path, "Overwriting file");
-    return WriteFile(path, data);
+    return WriteFile(path, data, {});
+}
+
+bool SignetBackup::CopyFile(const fs::path &from, const fs::path &to, bool create_directories) {
+    ClearOldBackIfNeeded();
+    if (!CheckForValidPath(to)) return false;
+
+    if (create_directories) {
+        if (!CreateParentDirectories(to)) return false;
+    }
+
+    std::error_code ec;
+    const bool overwriting = fs::exists(to, ec);
+    if (overwriting) {
+        if (!AddFileToBackup(to)) return false;
+        MessageWithNewLine("Signet", to, "Overwriting file with a copy of {}", from);
+    } else {
+        MessageWithNewLine("Signet", to, "Creating file as a copy of {}", from);
+    }
+
+    if (!CopyFileBytes(from, to, ec)) {
+        ErrorWithNewLine("Signet", to, "Could not copy file from {} for reason: {}", from, ec.message());
+        return false;
+    }
+    return overwriting || AddNewlyCreatedFileToBackup(to);
+}
+
+bool SignetBackup::PatchFile(const fs::path &path, const FilePatch &patch) {
+    ClearOldBackIfNeeded();
+    if (!CheckForValidPath(path)) return false;
+    if (!CreateDirectoryChecked(m_backup_files_dir)) return false;
+
+    // If the file is already backed up, whether in full or by an earlier patch, then that backup already
+    // restores the file to how it was before this run
+    const auto hash_string = std::to_string(fs::hash_value(path));
+    if (!IsFileInBackup(hash_string) &&
+        !(m_database.contains("file_patches") && m_database["file_patches"].contains(hash_string))) {
+        std::string error;
+        const auto undo_patch = CreateUndoFilePatch(path, patch, error);
+        if (!undo_patch ||
+            !WriteFilePatchToFile(m_backup_files_dir / (hash_string + ".patch"), *undo_patch, error)) {
+            ErrorWithNewLine("Signet", path, "Backing up file failed. {}", error);
+            return false;
+        }
+        m_database["file_patches"][hash_string] = path.generic_string();
+        if (!WriteDatabaseFile()) return false;
+    }
+
+    MessageWithNewLine("Signet", path, "Updating file in-place");
+    std::string error;
+    if (!ApplyFilePatch(path, patch, error)) {
+        ErrorWithNewLine("Signet", path, "Could not write the file for reason: {}", error);
+        return false;
+    }
+    return true;
 }
 
 TEST_CASE("[SignetBackup]") {
@@ -350,3 +466,61 @@ TEST_CASE("[SignetBackup]") {
         REQUIRE(!silent);
     }
 }
+
+TEST_CASE("[SignetBackup] compressed") {
+    const std::string filename = "backup_file_compressed.wav";
+    fs::copy_file(fs::path(TEST_DATA_DIRECTORY) / "wav_with_region_and_marker.wav", filename,
+                  fs::copy_options::overwrite_existing);
+    const auto original_bytes = ReadEntireFile(filename);
+
+    {
+        SignetBackup b;
+        b.ClearBackup();
+        b.SetCompression(BackupCompression::Flac);
+        REQUIRE(b.AddFilesToBackup({filename, filename}));
+    }
+
+    {
+        auto file_data = ReadAudioFile(filename);
+        REQUIRE(file_data);
+        for (auto &s : file_data->interleaved_samples) {
+            s = 0;
+        }
+        REQUIRE(WriteAudioFile(filename, *file_data));
+    }
+
+    {
+        SignetBackup b;
+        REQUIRE(b.LoadBackup());
+    }
+
+    REQUIRE(ReadEntireFile(filename) == original_bytes);
+}
+
+TEST_CASE("[SignetBackup] patched") {
+    const std::string filename = "backup_file_patched.wav";
+    fs::copy_file(fs::path(TEST_DATA_DIRECTORY) / "wav_with_region_and_marker.wav", filename,
+                  fs::copy_options::overwrite_existing);
+    const auto original_bytes = ReadEntireFile(filename);
+
+    {
+        auto file_data = ReadAudioFile(filename);
+        REQUIRE(file_data);
+        file_data->metadata.markers.clear();
+        file_data->metadata.regions.clear();
+        const auto patch = CreateMetadataOnlyFilePatch(filename, *file_data);
+        REQUIRE(patch);
+
+        SignetBackup b;
+        b.ClearBackup();
+        REQUIRE(b.PatchFile(filename, *patch));
+        REQUIRE(ReadEntireFile(filename) != original_bytes);
+    }
+
+    {
+        SignetBackup b;
+        REQUIRE(b.LoadBackup());
+    }
+
+    REQUIRE(ReadEntireFile(filename) == original_bytes);
+}
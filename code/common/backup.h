@@ -1,5 +1,7 @@
 #pragma once
 
+#include "backup_compression.h"
+#include "file_patch.h"
 #include "filesystem.hpp"
 #include "json.hpp"
 
@@ -13,12 +15,33 @@ class SignetBackup {
 
     bool DeleteFile(const fs::path &path);
     bool MoveFile(const fs::path &from, const fs::path &to);
-    bool CreateFile(const fs::path &path, const AudioData &data, bool create_directories);
+    // unchanged_samples_file is passed to WriteAudioFile
+    bool CreateFile(const fs::path &path,
+                    const AudioData &data,
+                    bool create_directories,
+                    const fs::path &unchanged_samples_file = {});
     bool OverwriteFile(const fs::path &path, const AudioData &data);
 
+    // Creates (or overwrites) to with an exact copy of the bytes of from
+    bool CopyFile(const fs::path &from, const fs::path &to, bool create_directories);
+
+    // Changes part of a file in-place. Only the bytes that the patch changes are backed up.
+    bool PatchFile(const fs::path &path, const FilePatch &patch);
+
     bool AddFileToBackup(const fs::path &path);
 
+    // Backs up all of the given files at once, spreading the copying (or compressing) across threads. Files
+    // that have already been backed up by this run are skipped.
+    bool AddFilesToBackup(const std::vector<fs::path> &paths);
+
+    void SetCompression(BackupCompression compression) { m_compression = compression; }
+
   private:
+    bool IsFileInBackup(const std::string &hash_string) const;
+    bool StoreFileInBackup(const fs::path &path,
+                           const std::string &hash_string,
+                           bool &compressed,
+                           std::string &error) const;
     bool AddMovedFileToBackup(const fs::path &from, const fs::path &to);
     bool AddNewlyCreatedFileToBackup(const fs::path &path);
 
@@ -27,6 +50,7 @@ class SignetBackup {
     void ClearOldBackIfNeeded();
 
     bool m_old_backup_cleared {false};
+    BackupCompression m_compression {BackupCompression::None};
     const fs::path m_backup_dir;
     const fs::path m_backup_files_dir;
     const fs::path m_database_file;
@@ -0,0 +1,466 @@
+#include "backup_compression.h"
+
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "FLAC/all.h"
+#include "doctest.hpp"
+
+#include "common.h"
+#include "tests_config.h"
+#include "types.h"
+
+// The backup file is a normal FLAC stream with one extra APPLICATION block containing everything needed to
+// rebuild the surrounding WAV file:
+//   u32 format version
+//   u64 size of the original file
+//   u64 size of the bytes preceding the sample data
+//   u64 size of the bytes following the sample data
+//   the preceding bytes
+//   the following bytes
+// All integers are little-endian.
+static constexpr char k_backup_application_id[] = "SGBK";
+static constexpr u32 k_backup_format_version = 1;
+static constexpr usize k_backup_header_size = 4 + 8 + 8 + 8;
+// FLAC metadata block lengths are 24 bits, and the 4-byte application ID is part of that length
+static constexpr usize k_max_application_data_size = (1u << 24) - 1 - 4;
+static constexpr usize k_frames_per_block = 1 << 14;
+
+static u32 ReadLE(const u8 *data, unsigned num_bytes) {
+    u32 result = 0;
+    for (unsigned i = 0; i < num_bytes; ++i) {
+        result |= (u32)data[i] << (8 * i);
+    }
+    return result;
+}
+
+static u64 ReadLE64(const u8 *data) { return (u64)ReadLE(data, 4) | ((u64)ReadLE(data + 4, 4) << 32); }
+
+static void AppendLE(std::string &out, u64 value, unsigned num_bytes) {
+    for (unsigned i = 0; i < num_bytes; ++i) {
+        out.push_back((char)((value >> (8 * i)) & 0xff));
+    }
+}
+
+namespace {
+
+struct FileCloser {
+    void operator()(FILE *f) const {
+        if (f) fclose(f);
+    }
+};
+using FilePtr = std::unique_ptr<FILE, FileCloser>;
+
+struct WavePcmLayout {
+    unsigned num_channels {};
+    unsigned sample_rate {};
+    unsigned bits_per_sample {};
+    unsigned block_align {};
+};
+
+} // namespace
+
+// Reads the RIFF header and every chunk up to the start of the sample data into prefix. Returns false if the
+// file is not an integer PCM WAV that FLAC can represent.
+static bool ReadWaveHeader(FILE *f, std::string &prefix, WavePcmLayout &layout, u64 &data_chunk_size) {
+    const auto Read = [&](usize num_bytes) {
+        const auto old_size = prefix.size();
+        prefix.resize(old_size + num_bytes);
+        return std::fread(prefix.data() + old_size, 1, num_bytes, f) == num_bytes;
+    };
+    const auto Bytes = [&](usize offset) { return (const u8 *)prefix.data() + offset; };
+
+    if (!Read(12) || std::memcmp(Bytes(0), "RIFF", 4) != 0 || std::memcmp(Bytes(8), "WAVE", 4) != 0) {
+        return false;
+    }
+
+    bool found_fmt = false;
+    while (true) {
+        const auto chunk_header = prefix.size();
+        if (!Read(8)) return false;
+        const u32 chunk_size = ReadLE(Bytes(chunk_header + 4), 4);
+        if (std::memcmp(Bytes(chunk_header), "data", 4) == 0) {
+            data_chunk_size = chunk_size;
+            break;
+        }
+
+        const usize padded_size = (usize)chunk_size + (chunk_size & 1);
+        if (prefix.size() + padded_size > k_max_application_data_size) return false;
+        const auto chunk_data = prefix.size();
+        if (!Read(padded_size)) return false;
+
+        if (std::memcmp(Bytes(chunk_header), "fmt ", 4) == 0) {
+            if (chunk_size < 16) return false;
+            const auto format_tag = ReadLE(Bytes(chunk_data), 2);
+            layout.num_channels = ReadLE(Bytes(chunk_data + 2), 2);
+            layout.sample_rate = ReadLE(Bytes(chunk_data + 4), 4);
+            layout.block_align = ReadLE(Bytes(chunk_data + 12), 2);
+            layout.bits_per_sample = ReadLE(Bytes(chunk_data + 14), 2);
+
+            constexpr u32 format_pcm = 1;
+            constexpr u32 format_extensible = 0xfffe;
+            if (format_tag == format_extensible) {
+                // The first 2 bytes of the sub-format GUID hold the format tag
+                if (chunk_size < 40 || ReadLE(Bytes(chunk_data + 24), 2) != format_pcm) return false;
+            } else if (format_tag != format_pcm) {
+                return false;
+            }
+            found_fmt = true;
+        }
+    }
+
+    if (!found_fmt) return false;
+    if (layout.bits_per_sample != 8 && layout.bits_per_sample != 16 && layout.bits_per_sample != 24) {
+        return false;
+    }
+    if (layout.num_channels == 0 || layout.num_channels > FLAC__MAX_CHANNELS) return false;
+    if (layout.block_align != layout.num_channels * (layout.bits_per_sample / 8)) return false;
+    if (!FLAC__format_sample_rate_is_valid(layout.sample_rate)) return false;
+    return true;
+}
+
+static void DeleteMetadata(FLAC__StreamMetadata *obj) {
+    if (obj) FLAC__metadata_object_delete(obj);
+}
+
+BackupCompressionResult
+CompressWaveFileForBackup(const fs::path &wave_file, const fs::path &backup_file, std::string &error) {
+    std::error_code ec;
+    const auto file_size = fs::file_size(wave_file, ec);
+    if (ec) {
+        error = ec.message();
+        return BackupCompressionResult::Failed;
+    }
+
+    FilePtr in {OpenFileRaw(wave_file, "rb", &ec)};
+    if (!in) {
+        error = ec.message();
+        return BackupCompressionResult::Failed;
+    }
+
+    std::string prefix;
+    WavePcmLayout layout {};
+    u64 data_chunk_size {};
+    if (!ReadWaveHeader(in.get(), prefix, layout, data_chunk_size)) {
+        return BackupCompressionResult::Unsupported;
+    }
+
+    // The data chunk may claim to be larger than the file actually is, and it might not contain a whole
+    // number of frames; anything that is not a complete frame is kept verbatim.
+    const u64 num_pcm_bytes = std::min<u64>(data_chunk_size, file_size - prefix.size());
+    const u64 num_frames = num_pcm_bytes / layout.block_align;
+    const u64 suffix_size = file_size - prefix.size() - (num_frames * layout.block_align);
+    if (num_frames == 0) return BackupCompressionResult::Unsupported;
+    if (k_backup_header_size + prefix.size() + suffix_size > k_max_application_data_size) {
+        return BackupCompressionResult::Unsupported;
+    }
+
+    std::unique_ptr<FLAC__StreamEncoder, decltype(&FLAC__stream_encoder_delete)> encoder {
+        FLAC__stream_encoder_new(), &FLAC__stream_encoder_delete};
+    if (!encoder) {
+        error = "could not allocate the FLAC encoder";
+        return BackupCompressionResult::Failed;
+    }
+
+    FLAC__stream_encoder_set_channels(encoder.get(), layout.num_channels);
+    FLAC__stream_encoder_set_bits_per_sample(encoder.get(), layout.bits_per_sample);
+    FLAC__stream_encoder_set_sample_rate(encoder.get(), layout.sample_rate);
+    FLAC__stream_encoder_set_streamable_subset(encoder.get(), false);
+    // Backups are made before every run that changes files, so favour speed over the last few percent of size
+    FLAC__stream_encoder_set_compression_level(encoder.get(), 2);
+    FLAC__stream_encoder_set_total_samples_estimate(encoder.get(), num_frames);
+
+    std::string application_data;
+    AppendLE(application_data, k_backup_format_version, 4);
+    AppendLE(application_data, file_size, 8);
+    AppendLE(application_data, prefix.size(), 8);
+    AppendLE(application_data, suffix_size, 8);
+    application_data += prefix;
+
+    {
+        const auto suffix_start = application_data.size();
+        application_data.resize(suffix_start + suffix_size);
+        const auto pcm_start = prefix.size();
+        // Read the suffix up-front by seeking past the sample data; this lets the metadata block be complete
+        // before the encoder is initialised.
+        if (std::fseek(in.get(), -(long)suffix_size, SEEK_END) != 0 ||
+            std::fread(application_data.data() + suffix_start, 1, suffix_size, in.get()) != suffix_size ||
+            std::fseek(in.get(), (long)pcm_start, SEEK_SET) != 0) {
+            error = "could not read the file";
+            return BackupCompressionResult::Failed;
+        }
+    }
+
+    std::unique_ptr<FLAC__StreamMetadata, decltype(&DeleteMetadata)> metadata {
+        FLAC__metadata_object_new(FLAC__METADATA_TYPE_APPLICATION), &DeleteMetadata};
+    if (!metadata) {
+        error = "could not allocate the FLAC metadata";
+        return BackupCompressionResult::Failed;
+    }
+    std::memcpy(metadata->data.application.id, k_backup_application_id, 4);
+    FLAC__metadata_object_application_set_data(metadata.get(), (FLAC__byte *)application_data.data(),
+                                               (unsigned)application_data.size(), true);
+    FLAC__StreamMetadata *metadata_blocks[] = {metadata.get()};
+    FLAC__stream_encoder_set_metadata(encoder.get(), metadata_blocks, 1);
+
+    auto out = OpenFileRaw(backup_file, "w+b", &ec);
+    if (!out) {
+        error = ec.message();
+        return BackupCompressionResult::Failed;
+    }
+    // On success, the encoder takes ownership of the FILE and closes it in FLAC__stream_encoder_finish
+    if (const auto status = FLAC__stream_encoder_init_FILE(encoder.get(), out, nullptr, nullptr);
+        status != FLAC__STREAM_ENCODER_INIT_STATUS_OK) {
+        fclose(out);
+        error = FLAC__StreamEncoderInitStatusString[status];
+        return BackupCompressionResult::Failed;
+    }
+
+    const auto bytes_per_sample = layout.bits_per_sample / 8;
+    std::vector<u8> raw(k_frames_per_block * layout.block_align);
+    std::vector<FLAC__int32> samples(k_frames_per_block * layout.num_channels);
+    u64 frames_remaining = num_frames;
+    while (frames_remaining) {
+        const auto frames = (usize)std::min<u64>(frames_remaining, k_frames_per_block);
+        const auto num_samples = frames * layout.num_channels;
+        if (std::fread(raw.data(), 1, frames * layout.block_align, in.get()) != frames * layout.block_align) {
+            FLAC__stream_encoder_finish(encoder.get());
+            error = "could not read the sample data";
+            return BackupCompressionResult::Failed;
+        }
+
+        const u8 *src = raw.data();
+        switch (layout.bits_per_sample) {
+            case 8:
+                // 8-bit WAV is unsigned
+                for (usize i = 0; i < num_samples; ++i) {
+                    samples[i] = (FLAC__int32)src[i] - 128;
+                }
+                break;
+            case 16:
+                for (usize i = 0; i < num_samples; ++i, src += bytes_per_sample) {
+                    samples[i] = (s16)ReadLE(src, 2);
+                }
+                break;
+            case 24:
+                for (usize i = 0; i < num_samples; ++i, src += bytes_per_sample) {
+                    samples[i] = ((s32)(ReadLE(src, 3) << 8)) >> 8;
+                }
+                break;
+        }
+
+        if (!FLAC__stream_encoder_process_interleaved(encoder.get(), samples.data(), (unsigned)frames)) {
+            error = FLAC__StreamEncoderStateString[FLAC__stream_encoder_get_state(encoder.get())];
+            FLAC__stream_encoder_finish(encoder.get());
+            return BackupCompressionResult::Failed;
+        }
+        frames_remaining -= frames;
+    }
+
+    if (!FLAC__stream_encoder_finish(encoder.get())) {
+        error = FLAC__StreamEncoderStateString[FLAC__stream_encoder_get_state(encoder.get())];
+        return BackupCompressionResult::Failed;
+    }
+    return BackupCompressionResult::Success;
+}
+
+namespace {
+
+struct DecompressContext {
+    FILE *out {};
+    bool header_found {};
+    u64 file_size {};
+    u64 bytes_written {};
+    std::string suffix {};
+    std::vector<u8> buffer {};
+    std::string error {};
+};
+
+} // namespace
+
+static bool WriteBytes(DecompressContext &context, const void *data, usize size) {
+    if (std::fwrite(data, 1, size, context.out) != size) {
+        context.error = "could not write to the output file";
+        return false;
+    }
+    context.bytes_written += size;
+    return true;
+}
+
+static FLAC__StreamDecoderWriteStatus DecompressWriteCallback(const FLAC__StreamDecoder *,
+                                                              const FLAC__Frame *frame,
+                                                              const FLAC__int32 *const buffer[],
+                                                              void *client_data) {
+    auto &context = *(DecompressContext *)client_data;
+    if (!context.header_found) {
+        context.error = "the backup file does not contain the original file header";
+        return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+    }
+
+    const auto num_channels = frame->header.channels;
+    const auto bytes_per_sample = frame->header.bits_per_sample / 8;
+    context.buffer.resize(frame->header.blocksize * num_channels * bytes_per_sample);
+    u8 *dest = context.buffer.data();
+    for (unsigned i = 0; i < frame->header.blocksize; ++i) {
+        for (unsigned chan = 0; chan < num_channels; ++chan) {
+            const auto sample = buffer[chan][i];
+            switch (frame->header.bits_per_sample) {
+                case 8: *dest++ = (u8)(sample + 128); break;
+                case 16:
+                    *dest++ = (u8)(sample & 0xff);
+                    *dest++ = (u8)((sample >> 8) & 0xff);
+                    break;
+                case 24:
+                    *dest++ = (u8)(sample & 0xff);
+                    *dest++ = (u8)((sample >> 8) & 0xff);
+                    *dest++ = (u8)((sample >> 16) & 0xff);
+                    break;
+                default:
+                    context.error = "unexpected bit depth in backup file";
+                    return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+            }
+        }
+    }
+
+    if (!WriteBytes(context, context.buffer.data(), context.buffer.size())) {
+        return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+    }
+    return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
+static void DecompressMetadataCallback(const FLAC__StreamDecoder *,
+                                       const FLAC__StreamMetadata *metadata,
+                                       void *client_data) {
+    auto &context = *(DecompressContext *)client_data;
+    if (metadata->type != FLAC__METADATA_TYPE_APPLICATION ||
+        std::memcmp(metadata->data.application.id, k_backup_application_id, 4) != 0 || context.header_found) {
+        return;
+    }
+
+    const auto data = (const u8 *)metadata->data.application.data;
+    const usize size = metadata->length - (FLAC__STREAM_METADATA_APPLICATION_ID_LEN / 8);
+    if (size < k_backup_header_size || ReadLE(data, 4) != k_backup_format_version) return;
+
+    context.file_size = ReadLE64(data + 4);
+    const auto prefix_size = ReadLE64(data + 12);
+    const auto suffix_size = ReadLE64(data + 20);
+    if (k_backup_header_size + prefix_size + suffix_size != size) return;
+
+    const auto prefix = data + k_backup_header_size;
+    context.suffix.assign((const char *)prefix + prefix_size, suffix_size);
+    if (WriteBytes(context, prefix, prefix_size)) context.header_found = true;
+}
+
+static void DecompressErrorCallback(const FLAC__StreamDecoder *,
+                                    FLAC__StreamDecoderErrorStatus status,
+                                    void *client_data) {
+    auto &context = *(DecompressContext *)client_data;
+    if (context.error.empty()) context.error = FLAC__StreamDecoderErrorStatusString[status];
+}
+
+static bool DecompressToFile(const fs::path &backup_file, FILE *out, std::string &error) {
+    std::unique_ptr<FLAC__StreamDecoder, decltype(&FLAC__stream_decoder_delete)> decoder(
+        FLAC__stream_decoder_new(), &FLAC__stream_decoder_delete);
+    if (!decoder) {
+        error = "could not allocate the FLAC decoder";
+        return false;
+    }
+    FLAC__stream_decoder_set_md5_checking(decoder.get(), true);
+    FLAC__stream_decoder_set_metadata_respond_application(decoder.get(),
+                                                          (const FLAC__byte *)k_backup_application_id);
+
+    std::error_code ec;
+    auto in = OpenFileRaw(backup_file, "rb", &ec);
+    if (!in) {
+        error = ec.message();
+        return false;
+    }
+
+    DecompressContext context {};
+    context.out = out;
+    // On success, the decoder takes ownership of the FILE and closes it in FLAC__stream_decoder_finish
+    if (const auto status =
+            FLAC__stream_decoder_init_FILE(decoder.get(), in, DecompressWriteCallback,
+                                           DecompressMetadataCallback, DecompressErrorCallback, &context);
+        status != FLAC__STREAM_DECODER_INIT_STATUS_OK) {
+        fclose(in);
+        error = FLAC__StreamDecoderInitStatusString[status];
+        return false;
+    }
+
+    const bool decoded = FLAC__stream_decoder_process_until_end_of_stream(decoder.get());
+    const bool md5_ok = FLAC__stream_decoder_finish(decoder.get());
+    if (!context.error.empty()) {
+        error = context.error;
+        return false;
+    }
+    if (!decoded || !context.header_found) {
+        error = "the backup file is corrupt";
+        return false;
+    }
+    if (!md5_ok) {
+        error = "the audio in the backup file does not match its checksum";
+        return false;
+    }
+    if (!WriteBytes(context, context.suffix.data(), context.suffix.size())) {
+        error = context.error;
+        return false;
+    }
+    if (context.bytes_written != context.file_size) {
+        error = "the restored file is not the same size as the original";
+        return false;
+    }
+    return true;
+}
+
+bool DecompressBackupFile(const fs::path &backup_file, const fs::path &output_file, std::string &error) {
+    // Decode into a temporary file first so that a failure never leaves a half-written file in place of the
+    // one being restored
+    const auto temp_file = fs::path(output_file.string() + ".signet-restore.tmp");
+
+    std::error_code ec;
+    FilePtr out {OpenFileRaw(temp_file, "wb", &ec)};
+    if (!out) {
+        error = ec.message();
+        return false;
+    }
+
+    bool success = DecompressToFile(backup_file, out.get(), error);
+    if (std::fclose(out.release()) != 0 && success) {
+        error = "could not write to the output file";
+        success = false;
+    }
+
+    if (success) {
+        fs::rename(temp_file, output_file, ec);
+        if (ec) {
+            error = ec.message();
+            success = false;
+        }
+    }
+    if (!success) fs::remove(temp_file, ec);
+    return success;
+}
+
+TEST_CASE("[BackupCompression]") {
+    const fs::path backup_file = "backup_compression_test.flac";
+    const fs::path restored_file = "backup_compression_test.wav";
+
+    SUBCASE("wave files are restored byte-for-byte") {
+        const fs::path original = fs::path(TEST_DATA_DIRECTORY) / "wav_with_region_and_marker.wav";
+        std::string error;
+        REQUIRE(CompressWaveFileForBackup(original, backup_file, error) == BackupCompressionResult::Success);
+        REQUIRE(fs::file_size(backup_file) < fs::file_size(original));
+        REQUIRE(DecompressBackupFile(backup_file, restored_file, error));
+        REQUIRE(ReadEntireFile(original) == ReadEntireFile(restored_file));
+    }
+
+    SUBCASE("files that are not integer PCM WAV are rejected") {
+        std::string error;
+        REQUIRE(CompressWaveFileForBackup(fs::path(TEST_DATA_DIRECTORY) / "flac_with_comments.flac",
+                                          backup_file, error) == BackupCompressionResult::Unsupported);
+        REQUIRE(CompressWaveFileForBackup(fs::path(TEST_DATA_DIRECTORY) / "wave_with_markers_and_loop.wav",
+                                          backup_file, error) == BackupCompressionResult::Unsupported);
+    }
+}
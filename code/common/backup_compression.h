@@ -0,0 +1,23 @@
+#pragma once
+#include <string>
+
+#include "filesystem.hpp"
+
+enum class BackupCompression {
+    None,
+    Flac,
+};
+
+enum class BackupCompressionResult {
+    Success,
+    Unsupported, // The file is not a kind that we can compress; it should be stored uncompressed instead.
+    Failed,
+};
+
+// Writes a FLAC-encoded version of an integer PCM WAV file to backup_file. Every byte of the WAV that is not
+// part of the sample data (headers, metadata chunks, padding) is stored verbatim alongside the FLAC stream so
+// that DecompressBackupFile reproduces the original file byte-for-byte. These functions do not print
+// anything, so they are safe to call from worker threads; on failure the reason is written to error.
+BackupCompressionResult
+CompressWaveFileForBackup(const fs::path &wave_file, const fs::path &backup_file, std::string &error);
+bool DecompressBackupFile(const fs::path &backup_file, const fs::path &output_file, std::string &error);
@@ -1,5 +1,6 @@
 #include "common.h"
 
+#include <random>
 #include <regex>
 #include <system_error>
 
@@ -7,6 +8,14 @@
 #include <windows.h>
 #endif
 
+#if __linux__
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "doctest.hpp"
 #include "filesystem.hpp"
 #include "fmt/color.h"
@@ -14,8 +23,10 @@
 #include "edit_tracked_audio_file.h"
 #include "types.h"
 
-bool g_messages_enabled = true;
+std::optional<tcb::span<const char *>> g_signet_invocation_args;
+thread_local bool g_messages_enabled = true;
 bool g_warnings_as_errors = false;
+thread_local std::string *g_command_output = nullptr;
 
 bool EnableVTMode() {
 #if WIN32
@@ -45,6 +56,25 @@ void InitConsole() {
     static Obj obj;
 }
 
+void PrintCommandOutput(std::string_view text) {
+    if (g_command_output) {
+        g_command_output->append(text);
+    } else {
+        fmt::print(stdout, "{}", text);
+    }
+}
+
+void PrintCommandResult(std::string_view heading, const EditTrackedAudioFile &f, std::string_view text) {
+    if (g_command_output) {
+        g_command_output->append(fmt::format("{}: {}\n", f.OriginalPath().generic_string(), text));
+    } else {
+        PrintMessagePrefix(stdout, heading);
+        fmt::print(stdout, "{}", text);
+        PrintFilename(stdout, f);
+        fmt::print(stdout, "\n");
+    }
+}
+
 void PrintFilename(FILE *stream, const EditTrackedAudioFile &f) {
     InitConsole();
     fmt::print(stream, ": ");
@@ -146,6 +176,33 @@ FILE *OpenFileRaw(const fs::path &path, const char *mode, std::error_code *ec_ou
     return nullptr;
 }
 
+fs::path GetTempDir() {
+    std::error_code ec;
+    const auto temp_dir = fs::temp_directory_path(ec);
+    if (ec) {
+        WarningWithNewLine(
+            "Signet", {},
+            "Could not get the temporary file folder from the OS for reason: {}. Reverting to using the current working directory.",
+            ec.message());
+        return "."; // cwd
+    }
+    return temp_dir;
+}
+
+std::string RandomAlphanum() {
+    std::random_device rd;
+    std::mt19937 gen(rd());
+
+    const auto alphanum = "0123456789abcdefghijklmnopqrstuvwxyz";
+
+    std::uniform_int_distribution<> dis(0, strlen(alphanum) - 1);
+    std::string result(10, 'a');
+    for (auto &c : result) {
+        c = alphanum[dis(gen)];
+    }
+    return result;
+}
+
 std::unique_ptr<FILE, void (*)(FILE *)> OpenFile(const fs::path &path, const char *mode) {
     static const auto SafeFClose = [](FILE *f) {
         if (f) {
@@ -162,6 +219,15 @@ std::unique_ptr<FILE, void (*)(FILE *)> OpenFile(const fs::path &path, const cha
     return {nullptr, SafeFClose};
 }
 
+std::optional<FileStamp> GetFileStamp(const fs::path &path) {
+    std::error_code ec;
+    const auto size = fs::file_size(path, ec);
+    if (ec) return {};
+    const auto last_write_time = fs::last_write_time(path, ec);
+    if (ec) return {};
+    return FileStamp {size, last_write_time};
+}
+
 std::string ReadEntireFile(const fs::path &path) {
     std::string result {};
     auto f = OpenFile(path, "rb");
@@ -180,9 +246,84 @@ std::string ReadEntireFile(const fs::path &path) {
     return result;
 }
 
+#if __linux__
+// Returns false if the kernel could not do the copy and we should fall back to a normal copy
+static bool CopyFileBytesInKernel(const fs::path &from, const fs::path &to, std::error_code &ec) {
+    const int in = open(from.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in == -1) return false;
+    struct stat in_stat;
+    if (fstat(in, &in_stat) != 0) {
+        close(in);
+        return false;
+    }
+    const int out = open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, in_stat.st_mode & 0777);
+    if (out == -1) {
+        ec = {errno, std::generic_category()};
+        close(in);
+        return true;
+    }
+
+    bool done = false;
+#ifdef FICLONE
+    done = ioctl(out, FICLONE, in) == 0;
+#endif
+    if (!done) {
+        off_t remaining = in_stat.st_size;
+        while (remaining > 0) {
+            const auto copied = copy_file_range(in, nullptr, out, nullptr, (size_t)remaining, 0);
+            if (copied <= 0) break;
+            remaining -= copied;
+        }
+        done = remaining == 0;
+    }
+
+    close(in);
+    if (close(out) != 0 && done) {
+        ec = {errno, std::generic_category()};
+        return true;
+    }
+    return done;
+}
+#endif
+
+bool CopyFileBytes(const fs::path &from, const fs::path &to, std::error_code &ec) {
+    // Opening the destination truncates it, so copying a file onto itself would lose the data
+    if (fs::equivalent(from, to, ec)) {
+        ec = std::make_error_code(std::errc::file_exists);
+        return false;
+    }
+    ec = {};
+#if __linux__
+    if (CopyFileBytesInKernel(from, to, ec)) return !ec;
+    ec = {};
+#endif
+    fs::copy_file(from, to, fs::copy_options::overwrite_existing, ec);
+    return !ec;
+}
+
 TEST_CASE("Common") {
     {
         REQUIRE(GetFreqWithCentDifference(100, 1200) == 200);
         REQUIRE(GetFreqWithCentDifference(100, -1200) == 50);
     }
+
+    SUBCASE("copy file bytes") {
+        const fs::path from = "copy_file_bytes_from.bin";
+        const fs::path to = "copy_file_bytes_to.bin";
+        {
+            auto f = OpenFile(from, "wb");
+            REQUIRE(f);
+            std::fputs("some bytes", f.get());
+        }
+        {
+            auto f = OpenFile(to, "wb");
+            REQUIRE(f);
+            std::fputs("an existing file that is longer", f.get());
+        }
+        std::error_code ec;
+        REQUIRE(CopyFileBytes(from, to, ec));
+        REQUIRE(ReadEntireFile(to) == "some bytes");
+        REQUIRE(!CopyFileBytes("does_not_exist.bin", to, ec));
+        REQUIRE(ec);
+    }
 }
@@ -5,6 +5,7 @@
 #include <iostream>
 #include <optional>
 #include <stdexcept>
+#include <string>
 #include <string_view>
 #include <vector>
 
@@ -14,8 +15,12 @@
 #include "span.hpp"
 
 extern std::optional<tcb::span<const char *>> g_signet_invocation_args;
-extern bool g_messages_enabled;
+// Each thread has its own of these, so that SignetProcessors on different threads do not change each other's
+// output. Commands print from the thread that runs them rather than from inside a ParallelFor.
+extern thread_local bool g_messages_enabled;
 extern bool g_warnings_as_errors;
+// While this is set, PrintCommandOutput and PrintCommandResult append to it rather than printing
+extern thread_local std::string *g_command_output;
 
 struct EditTrackedAudioFile;
 
@@ -44,6 +49,14 @@ struct SignetWarning : public std::runtime_error {
 };
 
 void PrintFilename(FILE *stream, const EditTrackedAudioFile &f);
+
+// Commands print their results, such as the JSON of print-info, through this rather than straight to stdout so
+// that the results can be captured when Signet is used as a library; see SignetProcessor.
+void PrintCommandOutput(std::string_view text);
+// Prints a command's result for a file, such as the pitch that detect-pitch found. It looks like a message
+// but goes to stdout, and is printed even when messages are disabled. When captured, it is added as
+// "<original path>: <text>" on its own line.
+void PrintCommandResult(std::string_view heading, const EditTrackedAudioFile &f, std::string_view text);
 void PrintFilename(FILE *stream, fs::path &path);
 void PrintFilename(FILE *stream, NoneType n);
 
@@ -116,3 +129,24 @@ double GetFreqWithCentDifference(double starting_hz, double cents);
 std::unique_ptr<FILE, void (*)(FILE *)> OpenFile(const fs::path &path, const char *mode);
 FILE *OpenFileRaw(const fs::path &path, const char *mode, std::error_code *ec = nullptr);
 std::string ReadEntireFile(const fs::path &path);
+
+// The size and modification time of a file, for telling whether it has changed since it was last seen
+struct FileStamp {
+    uintmax_t size;
+    fs::file_time_type last_write_time;
+    bool operator==(const FileStamp &other) const {
+        return size == other.size && last_write_time == other.last_write_time;
+    }
+};
+// Returns nothing if the file cannot be found
+std::optional<FileStamp> GetFileStamp(const fs::path &path);
+
+// The OS's folder for temporary files, or the current directory if that cannot be found
+fs::path GetTempDir();
+// A random string of 10 lowercase letters and digits, for making unique filenames
+std::string RandomAlphanum();
+
+// Copies the bytes of a file, overwriting any existing file at to. Where the filesystem supports it the data
+// is shared (reflinked) or copied within the kernel rather than being read into memory. Does not print
+// anything.
+bool CopyFileBytes(const fs::path &from, const fs::path &to, std::error_code &ec);
@@ -0,0 +1,124 @@
+#include "decoded_audio_cache.h"
+
+#include <mutex>
+#include <unordered_map>
+
+#include "doctest.hpp"
+
+#include "audio_file_io.h"
+#include "tests_config.h"
+
+namespace {
+
+enum class DecodeKind { Full, Analysis };
+
+struct CacheEntry {
+    FileStamp stamp;
+    AudioData data;
+    u64 last_used;
+};
+
+struct DecodedAudioCache {
+    std::mutex mutex {};
+    usize max_bytes = 0;
+    usize used_bytes = 0;
+    u64 use_tick = 0;
+    std::unordered_map<std::string, CacheEntry> entries {};
+
+    // The caller must hold the mutex
+    void DropOldestUntilUnder(usize limit) {
+        while (used_bytes > limit && entries.size()) {
+            auto oldest = entries.begin();
+            for (auto it = entries.begin(); it != entries.end(); ++it) {
+                if (it->second.last_used < oldest->second.last_used) oldest = it;
+            }
+            used_bytes -= oldest->second.data.interleaved_samples.size() * sizeof(double);
+            entries.erase(oldest);
+        }
+    }
+};
+
+DecodedAudioCache &Cache() {
+    static DecodedAudioCache cache;
+    return cache;
+}
+
+std::optional<AudioData> ReadCached(const fs::path &path, DecodeKind kind) {
+    const auto Decode = [&]() {
+        return kind == DecodeKind::Full ? ReadAudioFile(path) : ReadAudioFileForAnalysis(path);
+    };
+
+    auto &cache = Cache();
+    {
+        const std::scoped_lock lock {cache.mutex};
+        if (!cache.max_bytes) return Decode();
+    }
+
+    std::error_code ec;
+    const auto absolute_path = fs::absolute(path, ec);
+    const auto stamp = GetFileStamp(path);
+    if (ec || !stamp) return Decode();
+    const auto key = fmt::format("{}:{}", kind == DecodeKind::Full ? 'f' : 'a', absolute_path.generic_string());
+
+    {
+        const std::scoped_lock lock {cache.mutex};
+        if (auto it = cache.entries.find(key); it != cache.entries.end()) {
+            if (it->second.stamp == *stamp) {
+                it->second.last_used = ++cache.use_tick;
+                return it->second.data;
+            }
+            cache.used_bytes -= it->second.data.interleaved_samples.size() * sizeof(double);
+            cache.entries.erase(it);
+        }
+    }
+
+    // Decoding is done without the lock so that files can be decoded in parallel
+    auto data = Decode();
+    if (!data) return data;
+
+    const auto num_bytes = data->interleaved_samples.size() * sizeof(double);
+    const std::scoped_lock lock {cache.mutex};
+    if (num_bytes > cache.max_bytes || cache.entries.count(key)) return data;
+    cache.DropOldestUntilUnder(cache.max_bytes - num_bytes);
+    cache.entries[key] = {*stamp, *data, ++cache.use_tick};
+    cache.used_bytes += num_bytes;
+    return data;
+}
+
+} // namespace
+
+void SetDecodedAudioCacheLimit(usize max_bytes) {
+    auto &cache = Cache();
+    const std::scoped_lock lock {cache.mutex};
+    cache.max_bytes = max_bytes;
+    cache.DropOldestUntilUnder(max_bytes);
+}
+
+std::optional<AudioData> ReadAudioFileCached(const fs::path &path) { return ReadCached(path, DecodeKind::Full); }
+
+std::optional<AudioData> ReadAudioFileForAnalysisCached(const fs::path &path) {
+    return ReadCached(path, DecodeKind::Analysis);
+}
+
+TEST_CASE("[DecodedAudioCache]") {
+    const fs::path path = "decoded-audio-cache-test.wav";
+    REQUIRE(fs::copy_file(TEST_DATA_DIRECTORY "/test.wav", path, fs::copy_options::overwrite_existing));
+    const auto original = ReadAudioFile(path);
+    REQUIRE(original);
+
+    SetDecodedAudioCacheLimit(100 * 1024 * 1024);
+    REQUIRE(ReadAudioFileCached(path)->interleaved_samples == original->interleaved_samples);
+    REQUIRE(ReadAudioFileCached(path)->interleaved_samples == original->interleaved_samples);
+    REQUIRE(ReadAudioFileForAnalysisCached(path)->num_channels == 1);
+
+    SUBCASE("a file that has changed is decoded again") {
+        auto changed = *original;
+        changed.interleaved_samples.resize(changed.interleaved_samples.size() / 2);
+        REQUIRE(WriteAudioFile(path, changed));
+        fs::last_write_time(path, fs::last_write_time(path) + std::chrono::seconds(1));
+        REQUIRE(ReadAudioFileCached(path)->interleaved_samples.size() == changed.interleaved_samples.size());
+    }
+
+    SetDecodedAudioCacheLimit(0);
+    fs::remove(path);
+}
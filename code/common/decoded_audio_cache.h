@@ -0,0 +1,18 @@
+#pragma once
+#include <optional>
+
+#include "audio_data.h"
+#include "filesystem.hpp"
+#include "types.h"
+
+// A process-wide cache of decoded audio, so that a long-running process such as 'signet serve' does not need
+// to decode the same unchanged file again each time it is used. An entry is only used while the file has the
+// same size and modification time as when it was decoded. The cache is disabled unless a limit is set, in
+// which case these functions are the same as ReadAudioFile and ReadAudioFileForAnalysis.
+
+// Sets the maximum total size of the cached samples; the least-recently used entries are dropped to stay
+// under it. 0 disables the cache and frees everything in it.
+void SetDecodedAudioCacheLimit(usize max_bytes);
+
+std::optional<AudioData> ReadAudioFileCached(const fs::path &path);
+std::optional<AudioData> ReadAudioFileForAnalysisCached(const fs::path &path);
@@ -1,45 +1,204 @@
 #pragma once
 
+#include <memory>
+
 #include "audio_file_io.h"
+#include "audio_memory_budget.h"
 #include "common.h"
+#include "decoded_audio_cache.h"
 #include "string_utils.h"
 
 // Changes made to the data, path or format are tracked, and the data is only loaded when it is requested
 struct EditTrackedAudioFile {
-    EditTrackedAudioFile(const fs::path &path) : m_path(path), m_original_path(path) {}
+    EditTrackedAudioFile(const fs::path &path) : m_original_path(path) {}
 
     AudioData &GetWritableAudio() {
         ++m_file_edited;
+        State().analysis_data.reset();
         return const_cast<AudioData &>(GetAudio());
     }
 
+    // Use this instead of GetWritableAudio when only the metadata is going to be changed. If every edit to
+    // the file was done through this then the file can be updated in-place without rewriting the audio.
+    AudioData &GetWritableMetadata() {
+        ++m_metadata_edited;
+        return GetWritableAudio();
+    }
+
+    // Use this instead of GetWritableAudio when only the samples in the given frames are going to be changed;
+    // the length, format and metadata must stay the same. If every edit to the file was done through this
+    // then only those frames need to be written back to the file.
+    AudioData &GetWritableAudioFrames(usize first_frame, usize num_frames) {
+        ++m_frames_edited;
+        if (num_frames) State().dirty_frames.push_back({first_frame, num_frames});
+        return GetWritableAudio();
+    }
+
+    // Changes the format that the file will be written as; the samples themselves are not changed
+    void SetFormat(AudioFileFormat format) {
+        ++m_format_edited;
+        GetWritableAudio().format = format;
+    }
+
     const AudioData &GetAudio() {
+        MarkUsed();
+        if (m_samples_spilled) RestoreSpilledSamples();
         if (!m_file_loaded && m_file_valid) {
-            if (const auto data = ReadAudioFile(m_original_path)) {
-                SetAudioData(*data);
+            if (m_memory_budget) m_memory_budget->MakeRoom(*this, EstimateDecodedBytes(false));
+            if (const auto data = ReadAudioFileCached(m_original_path)) {
+                // Any analysis audio came from the same file so it is still valid, and it may be in use
+                SetLoadedAudioData(*data);
+                m_loaded_from_original_file = true;
             } else {
                 ErrorWithNewLine("Signet", m_original_path, "could not load audio");
                 m_file_valid = false;
             }
         }
-        return m_data;
+        return State().data;
+    }
+
+    // Returns the signal that analysis such as pitch detection should be done on; see CreateAnalysisAudio.
+    const AudioData &GetAnalysisAudio() {
+        MarkUsed();
+        if (!State().analysis_data) {
+            if (!m_file_loaded && m_file_valid && m_decode_analysis_audio_directly) {
+                if (m_memory_budget) m_memory_budget->MakeRoom(*this, EstimateDecodedBytes(true));
+                auto analysis_data = ReadAudioFileForAnalysisCached(m_original_path);
+                if (!analysis_data) {
+                    ErrorWithNewLine("Signet", m_original_path, "could not load audio");
+                    m_file_valid = false;
+                    analysis_data = CreateAnalysisAudio({});
+                }
+                State().analysis_data = std::move(analysis_data);
+            } else {
+                State().analysis_data = CreateAnalysisAudio(GetAudio());
+            }
+        }
+        return *m_state->analysis_data;
+    }
+
+    // If the full audio of the file will never be needed, such as when the command is read-only, then
+    // GetAnalysisAudio can decode the file directly into its analysis form, which is quicker and uses less
+    // memory than loading the audio and then converting it.
+    void SetDecodeAnalysisAudioDirectly(bool directly) { m_decode_analysis_audio_directly = directly; }
+
+    // Returns only the given frames of the audio, without any metadata. If the file has not been loaded yet,
+    // just these frames are decoded rather than the whole file, so commands that only need to look at part of
+    // a file should use this instead of GetAudio. If file_num_frames is given it is set to the length of the
+    // whole file.
+    std::optional<AudioData>
+    GetAudioFrames(usize first_frame, usize num_frames, usize *file_num_frames = nullptr) {
+        if (!m_file_valid) return {};
+        MarkUsed();
+        if (m_samples_spilled) RestoreSpilledSamples();
+        if (!m_file_loaded) return ReadAudioFileRange(m_original_path, first_frame, num_frames, file_num_frames);
+
+        const auto &data = m_state->data;
+        AudioData result {};
+        result.num_channels = data.num_channels;
+        result.sample_rate = data.sample_rate;
+        result.bits_per_sample = data.bits_per_sample;
+        result.format = data.format;
+        const auto total_frames = data.IsEmpty() ? 0 : data.NumFrames();
+        if (first_frame < total_frames) {
+            num_frames = std::min(num_frames, total_frames - first_frame);
+            const auto begin = data.interleaved_samples.begin() + first_frame * data.num_channels;
+            result.interleaved_samples.assign(begin, begin + num_frames * data.num_channels);
+        }
+        if (file_num_frames) *file_num_frames = total_frames;
+        return result;
     }
 
-    const fs::path &GetPath() const { return m_path; }
+    const fs::path &GetPath() const { return m_path.empty() ? m_original_path : m_path; }
 
     void SetPath(const fs::path &path) {
         ++m_path_edited;
         m_path = path;
     }
 
+    // The path that the file is written to: GetPath, but with the extension of the new format if the format
+    // has changed
+    fs::path WrittenPath() const {
+        if (!FormatChanged()) return GetPath();
+        auto path = GetPath();
+        path.replace_extension(GetLowercaseExtension(m_state->data.format));
+        return path;
+    }
+
     bool AudioChanged() const { return m_file_edited && m_file_valid; }
     bool PathChanged() const { return m_path_edited; }
-    bool FormatChanged() const { return m_file_loaded && m_original_file_format != m_data.format; }
+    bool FormatChanged() const {
+        return m_file_loaded && m_state->original_file_format != m_state->data.format;
+    }
+    bool OnlyMetadataChanged() const { return AudioChanged() && m_metadata_edited == m_file_edited; }
+    bool SamplesChanged() const {
+        return AudioChanged() && m_metadata_edited + m_format_edited != m_file_edited;
+    }
+
+    // Returns the sorted and merged ranges of frames that have been changed, or nothing if the file was
+    // edited in a way that was not tracked by frame.
+    std::optional<std::vector<FrameRange>> ChangedFrameRanges() const {
+        if (!AudioChanged() || m_frames_edited != m_file_edited) return {};
+        auto ranges = m_state->dirty_frames;
+        std::sort(ranges.begin(), ranges.end(),
+                  [](const FrameRange &a, const FrameRange &b) { return a.first_frame < b.first_frame; });
+        std::vector<FrameRange> result;
+        for (const auto &r : ranges) {
+            if (result.size() && r.first_frame <= result.back().first_frame + result.back().num_frames) {
+                auto &back = result.back();
+                back.num_frames = std::max(back.num_frames, r.first_frame + r.num_frames - back.first_frame);
+            } else {
+                result.push_back(r);
+            }
+        }
+        return result;
+    }
 
     void SetAudioData(const AudioData &data) {
-        m_data = data;
-        m_original_file_format = m_data.format;
-        m_file_loaded = true;
+        State().analysis_data.reset();
+        SetLoadedAudioData(data);
+    }
+
+    // Limits how much decoded audio can be in memory at once; see AudioMemoryBudget
+    void SetMemoryBudget(AudioMemoryBudget *budget) { m_memory_budget = budget; }
+
+    // Tells the memory budget that nothing is referencing the audio of this file anymore, so it can be
+    // unloaded if room is needed for other files. Using the file again is still fine; the audio is reloaded
+    // and the file is in use again until the next call to this.
+    void AllowUnloading() { m_unloading_allowed = true; }
+    bool UnloadingAllowed() const { return m_unloading_allowed; }
+    u64 LastUsed() const { return m_last_used; }
+
+    usize DecodedBytes() const {
+        if (!m_state) return 0;
+        usize result = m_state->data.interleaved_samples.capacity() * sizeof(double);
+        if (m_state->analysis_data) {
+            result += m_state->analysis_data->interleaved_samples.capacity() * sizeof(double);
+        }
+        return result;
+    }
+
+    // Frees the decoded audio. If the file has not been edited it is simply read again when it is next
+    // needed; otherwise the samples are spilled to a temporary file and read back from that.
+    void Unload() {
+        if (!m_state) return;
+        m_state->analysis_data.reset();
+        if (!m_file_edited && (!m_file_loaded || m_loaded_from_original_file)) {
+            m_state.reset();
+            m_file_loaded = false;
+            return;
+        }
+        if (!m_file_loaded || m_samples_spilled || !m_memory_budget) return;
+        auto &state = *m_state;
+        state.spill_path = m_memory_budget->NewSpillPath();
+        if (!WriteSpillFile(state.spill_path, state.data.interleaved_samples)) {
+            WarningWithNewLine("Signet", m_original_path,
+                               "could not write the audio to the temporary file {}", state.spill_path);
+            return;
+        }
+        state.num_spilled_samples = state.data.interleaved_samples.size();
+        std::vector<double>().swap(state.data.interleaved_samples);
+        m_samples_spilled = true;
     }
 
     int NumTimesAudioChanged() const { return m_file_edited; }
@@ -49,14 +208,73 @@ struct EditTrackedAudioFile {
     std::string OriginalFilename() const { return GetJustFilenameWithNoExtension(OriginalPath()); }
 
   private:
-    AudioFileFormat m_original_file_format {};
-    fs::path m_path {};
-    AudioData m_data {};
-    bool m_file_loaded = false;
-    bool m_file_valid = true;
+    void MarkUsed() {
+        m_unloading_allowed = false;
+        if (m_memory_budget) m_last_used = m_memory_budget->NextUseTick();
+    }
+
+    void SetLoadedAudioData(const AudioData &data) {
+        auto &state = State();
+        state.data = data;
+        state.original_file_format = data.format;
+        m_file_loaded = true;
+        m_loaded_from_original_file = false;
+        m_samples_spilled = false;
+    }
+
+    // Works out the size of the decoded audio from just the header of the file
+    usize EstimateDecodedBytes(bool mono) const {
+        usize num_frames = 0;
+        const auto header = ReadAudioFileRange(m_original_path, 0, 0, &num_frames);
+        if (!header) return 0;
+        return num_frames * (mono ? 1 : header->num_channels) * sizeof(double);
+    }
+
+    void RestoreSpilledSamples() {
+        auto &state = *m_state;
+        if (m_memory_budget) m_memory_budget->MakeRoom(*this, state.num_spilled_samples * sizeof(double));
+        if (!ReadSpillFile(state.spill_path, state.data.interleaved_samples, state.num_spilled_samples)) {
+            ErrorWithNewLine("Signet", m_original_path,
+                             "could not read back the audio from the temporary file {}", state.spill_path);
+        }
+        m_samples_spilled = false;
+        std::error_code ec;
+        fs::remove(state.spill_path, ec);
+    }
+
+    // There can be a very large number of files, so everything that is only needed once a file has been used
+    // is allocated separately, when it is first needed. That way a file that has not been touched is not much
+    // more than its path.
+    struct LoadedState {
+        AudioData data {};
+        AudioFileFormat original_file_format {};
+        std::optional<AudioData> analysis_data {};
+        std::vector<FrameRange> dirty_frames {};
+        fs::path spill_path {};
+        usize num_spilled_samples = 0;
+    };
+
+    LoadedState &State() {
+        if (!m_state) m_state = std::make_unique<LoadedState>();
+        return *m_state;
+    }
+
+    fs::path m_original_path;
+    fs::path m_path {}; // empty unless the file has been given a new path
+    std::unique_ptr<LoadedState> m_state {};
+    AudioMemoryBudget *m_memory_budget {};
+    u64 m_last_used = 0;
 
     int m_file_edited = 0;
+    int m_metadata_edited = 0;
+    int m_format_edited = 0;
+    int m_frames_edited = 0;
     int m_path_edited = 0;
 
-    fs::path m_original_path;
+    bool m_file_loaded = false;
+    bool m_file_valid = true;
+    bool m_decode_analysis_audio_directly = false;
+    bool m_unloading_allowed = false;
+    bool m_loaded_from_original_file = false;
+    bool m_samples_spilled = false;
 };
@@ -4,6 +4,7 @@
 
 #include "common.h"
 #include "edit_tracked_audio_file.h"
+#include "pattern_cache.h"
 
 #include "CLI11.hpp"
 
@@ -36,8 +37,7 @@ std::optional<MIDIPitch> ExpectedMidiPitch::GetExpectedMidiPitch(const std::stri
     if (m_expected_note_capture) {
         const auto filename = GetJustFilenameWithNoExtension(f.GetPath());
         std::smatch match;
-        std::regex re {*m_expected_note_capture};
-        if (std::regex_match(filename, match, re)) {
+        if (std::regex_match(filename, match, GetCompiledRegex(*m_expected_note_capture))) {
             if (match.size() != 2) {
                 ErrorWithNewLine(command_name, f,
                                  "Regex pattern {} contains {} capture group when it should only contain one",
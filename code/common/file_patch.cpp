@@ -0,0 +1,215 @@
+#include "file_patch.h"
+
+#include <cstring>
+#include <memory>
+
+#include "doctest.hpp"
+
+#include "common.h"
+
+namespace {
+
+struct FileCloser {
+    void operator()(FILE *f) const {
+        if (f) fclose(f);
+    }
+};
+using FilePtr = std::unique_ptr<FILE, FileCloser>;
+
+} // namespace
+
+static bool SeekTo(FILE *f, u64 offset) {
+#if _WIN32
+    return _fseeki64(f, (__int64)offset, SEEK_SET) == 0;
+#else
+    return fseeko(f, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+bool ApplyFilePatch(const fs::path &path, const FilePatch &patch, std::string &error) {
+    std::error_code ec;
+    fs::resize_file(path, patch.new_file_size, ec);
+    if (ec) {
+        error = ec.message();
+        return false;
+    }
+
+    FilePtr f {OpenFileRaw(path, "r+b", &ec)};
+    if (!f) {
+        error = ec.message();
+        return false;
+    }
+    for (const auto &w : patch.writes) {
+        if (w.offset + w.bytes.size() > patch.new_file_size) {
+            error = "the patch writes past the end of the file";
+            return false;
+        }
+        if (!SeekTo(f.get(), w.offset) ||
+            std::fwrite(w.bytes.data(), 1, w.bytes.size(), f.get()) != w.bytes.size()) {
+            error = "could not write to the file";
+            return false;
+        }
+    }
+    if (std::fclose(f.release()) != 0) {
+        error = "could not write to the file";
+        return false;
+    }
+    return true;
+}
+
+std::optional<FilePatch>
+CreateUndoFilePatch(const fs::path &path, const FilePatch &patch, std::string &error) {
+    std::error_code ec;
+    const auto file_size = fs::file_size(path, ec);
+    if (ec) {
+        error = ec.message();
+        return {};
+    }
+
+    FilePtr f {OpenFileRaw(path, "rb", &ec)};
+    if (!f) {
+        error = ec.message();
+        return {};
+    }
+
+    FilePatch undo {};
+    undo.new_file_size = file_size;
+    const auto SaveOriginalBytes = [&](u64 offset, u64 size) {
+        if (offset >= file_size) return true;
+        size = std::min(size, file_size - offset);
+        FilePatch::Write w {offset, std::string(size, '\0')};
+        if (!SeekTo(f.get(), offset) || std::fread(w.bytes.data(), 1, size, f.get()) != size) return false;
+        undo.writes.push_back(std::move(w));
+        return true;
+    };
+
+    bool success = true;
+    for (const auto &w : patch.writes) {
+        success = success && SaveOriginalBytes(w.offset, w.bytes.size());
+    }
+    // Anything that the patch truncates needs to be restored too
+    if (patch.new_file_size < file_size) {
+        success = success && SaveOriginalBytes(patch.new_file_size, file_size - patch.new_file_size);
+    }
+    if (!success) {
+        error = "could not read from the file";
+        return {};
+    }
+    return undo;
+}
+
+// The serialised form is:
+//   "SGPT", u32 version, u64 new file size, u32 number of writes
+//   then for each write: u64 offset, u64 size, the bytes
+// All integers are little-endian.
+static constexpr char k_patch_file_magic[4] = {'S', 'G', 'P', 'T'};
+static constexpr u32 k_patch_file_version = 1;
+
+static void AppendLE(std::string &out, u64 value, unsigned num_bytes) {
+    for (unsigned i = 0; i < num_bytes; ++i) {
+        out.push_back((char)((value >> (8 * i)) & 0xff));
+    }
+}
+
+static u64 ReadLE(const char *data, unsigned num_bytes) {
+    u64 result = 0;
+    for (unsigned i = 0; i < num_bytes; ++i) {
+        result |= (u64)(u8)data[i] << (8 * i);
+    }
+    return result;
+}
+
+bool WriteFilePatchToFile(const fs::path &path, const FilePatch &patch, std::string &error) {
+    std::string header;
+    header.append(k_patch_file_magic, 4);
+    AppendLE(header, k_patch_file_version, 4);
+    AppendLE(header, patch.new_file_size, 8);
+    AppendLE(header, patch.writes.size(), 4);
+
+    std::error_code ec;
+    FilePtr f {OpenFileRaw(path, "wb", &ec)};
+    if (!f) {
+        error = ec.message();
+        return false;
+    }
+
+    bool success = std::fwrite(header.data(), 1, header.size(), f.get()) == header.size();
+    for (const auto &w : patch.writes) {
+        std::string write_header;
+        AppendLE(write_header, w.offset, 8);
+        AppendLE(write_header, w.bytes.size(), 8);
+        success = success &&
+                  std::fwrite(write_header.data(), 1, write_header.size(), f.get()) == write_header.size();
+        success = success && std::fwrite(w.bytes.data(), 1, w.bytes.size(), f.get()) == w.bytes.size();
+    }
+    if (std::fclose(f.release()) != 0) success = false;
+    if (!success) error = "could not write to the file";
+    return success;
+}
+
+std::optional<FilePatch> ReadFilePatchFromFile(const fs::path &path, std::string &error) {
+    std::error_code ec;
+    FilePtr f {OpenFileRaw(path, "rb", &ec)};
+    if (!f) {
+        error = ec.message();
+        return {};
+    }
+
+    const auto Read = [&](usize size) -> std::optional<std::string> {
+        std::string result(size, '\0');
+        if (std::fread(result.data(), 1, size, f.get()) != size) return {};
+        return result;
+    };
+
+    const auto header = Read(20);
+    if (!header || std::memcmp(header->data(), k_patch_file_magic, 4) != 0 ||
+        ReadLE(header->data() + 4, 4) != k_patch_file_version) {
+        error = "the file is not a valid patch file";
+        return {};
+    }
+
+    FilePatch patch {};
+    patch.new_file_size = ReadLE(header->data() + 8, 8);
+    const auto num_writes = ReadLE(header->data() + 16, 4);
+    for (u64 i = 0; i < num_writes; ++i) {
+        const auto write_header = Read(16);
+        if (!write_header) break;
+        auto bytes = Read(ReadLE(write_header->data() + 8, 8));
+        if (!bytes) break;
+        patch.writes.push_back({ReadLE(write_header->data(), 8), std::move(*bytes)});
+    }
+    if (patch.writes.size() != num_writes) {
+        error = "the patch file is truncated";
+        return {};
+    }
+    return patch;
+}
+
+TEST_CASE("[FilePatch]") {
+    const fs::path filename = "file_patch_test.bin";
+    const fs::path patch_filename = "file_patch_test.patch";
+    const std::string original = "0123456789abcdefghij";
+    {
+        auto f = OpenFile(filename, "wb");
+        REQUIRE(f);
+        std::fwrite(original.data(), 1, original.size(), f.get());
+    }
+
+    FilePatch patch {};
+    patch.new_file_size = 12;
+    patch.writes.push_back({0, "AB"});
+    patch.writes.push_back({10, "XY"});
+
+    std::string error;
+    const auto undo = CreateUndoFilePatch(filename, patch, error);
+    REQUIRE(undo);
+    REQUIRE(WriteFilePatchToFile(patch_filename, *undo, error));
+
+    REQUIRE(ApplyFilePatch(filename, patch, error));
+    REQUIRE(ReadEntireFile(filename) == "AB23456789XY");
+
+    const auto read_undo = ReadFilePatchFromFile(patch_filename, error);
+    REQUIRE(read_undo);
+    REQUIRE(ApplyFilePatch(filename, *read_undo, error));
+    REQUIRE(ReadEntireFile(filename) == original);
+}
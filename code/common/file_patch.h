@@ -0,0 +1,31 @@
+#pragma once
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "filesystem.hpp"
+#include "types.h"
+
+// A change to the bytes of an existing file: the file is resized to new_file_size and then each block of
+// bytes is written at its offset. Used for edits that only touch a small part of a file, such as its
+// metadata, so that the rest of the file does not need to be rewritten.
+struct FilePatch {
+    struct Write {
+        u64 offset;
+        std::string bytes;
+    };
+
+    u64 new_file_size {};
+    std::vector<Write> writes {};
+};
+
+// These do not print anything; on failure the reason is written to error.
+bool ApplyFilePatch(const fs::path &path, const FilePatch &patch, std::string &error);
+
+// Reads the file as it currently is to create a patch that would reverse the given patch once it has been
+// applied.
+std::optional<FilePatch>
+CreateUndoFilePatch(const fs::path &path, const FilePatch &patch, std::string &error);
+
+bool WriteFilePatchToFile(const fs::path &path, const FilePatch &patch, std::string &error);
+std::optional<FilePatch> ReadFilePatchFromFile(const fs::path &path, std::string &error);
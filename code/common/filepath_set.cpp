@@ -1,59 +1,174 @@
 #include "filepath_set.h"
 
+#include <algorithm>
+
+#if !_WIN32
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
 #include "doctest.hpp"
 
 #include "common.h"
+#include "pattern_cache.h"
 #include "string_utils.h"
 #include "tests_config.h"
+#include "thread_pool.h"
 
-template <typename DirectoryIterator>
-static void ForEachFileInDirectory(const std::string_view directory,
-                                   const std::function<void(const fs::path &)> callback) {
-    for (const auto &entry : DirectoryIterator(directory)) {
-        const auto &path = entry.path();
-        if (!fs::is_directory(path)) {
-            callback(path);
+namespace {
+
+// All of the exclude patterns compiled into a single object.
+class ExcludeMatcher {
+  public:
+    ExcludeMatcher(const std::vector<std::string> &exclude_patterns) {
+        m_patterns.reserve(exclude_patterns.size());
+        for (const auto &p : exclude_patterns) {
+            m_patterns.push_back(&GetCompiledWildcard(p));
         }
     }
-}
 
-static void ForEachFileInDirectory(const std::string_view directory,
-                                   const bool recursively,
-                                   const std::function<void(const fs::path &)> callback) {
-    if (recursively) {
-        ForEachFileInDirectory<fs::recursive_directory_iterator>(directory, callback);
-    } else {
-        ForEachFileInDirectory<fs::directory_iterator>(directory, callback);
+    bool IsExcluded(const std::string &path) const {
+        for (const auto &pattern : m_patterns) {
+            if (pattern->Matches(path)) return true;
+        }
+        return false;
     }
+
+  private:
+    std::vector<const WildcardPattern *> m_patterns {};
+};
+
+// A directory to be searched. The path is kept in 2 forms: as the user would see it (built from the input
+// that was given), which is what exclude patterns are matched against; and canonical, which is what is
+// stored.
+struct DirectoryToSearch {
+    std::string given_path;
+    fs::path canonical_path;
+};
+
+struct DirectoryListing {
+    std::vector<fs::path> files {};
+    std::vector<DirectoryToSearch> subdirectories {};
+    std::string error {};
+};
+
+enum class EntryType { File, Directory, SymlinkToFile, Other };
+
+} // namespace
+
+static std::string JoinPath(const std::string &directory, const std::string &name) {
+    if (directory.empty() || directory.back() == '/') return directory + name;
+    return directory + "/" + name;
 }
 
-static bool IsPathExcluded(const fs::path &path, const std::vector<std::string> &exclude_patterns) {
-    for (const auto &exclude : exclude_patterns) {
-        if (WildcardMatch(exclude, path.generic_string())) {
-            return true;
+// Reads a single directory. Safe to call from multiple threads at once - nothing is printed.
+static DirectoryListing ListDirectory(const DirectoryToSearch &dir, const ExcludeMatcher &excludes) {
+    DirectoryListing listing {};
+
+    const auto AddEntry = [&](const std::string &name, EntryType type) {
+        const auto given_path = JoinPath(dir.given_path, name);
+        switch (type) {
+            case EntryType::Directory:
+                listing.subdirectories.push_back({given_path, dir.canonical_path / name});
+                break;
+            case EntryType::File:
+                // The parent is canonical and this entry is not a link, so the joined path is canonical too
+                if (!excludes.IsExcluded(given_path)) listing.files.push_back(dir.canonical_path / name);
+                break;
+            case EntryType::SymlinkToFile: {
+                if (excludes.IsExcluded(given_path)) break;
+                std::error_code ec;
+                auto canonical = fs::canonical(dir.canonical_path / name, ec);
+                if (!ec) listing.files.push_back(std::move(canonical));
+                break;
+            }
+            case EntryType::Other: break;
+        }
+    };
+
+#if _WIN32
+    std::error_code ec;
+    for (fs::directory_iterator it {dir.canonical_path, ec}, end; !ec && it != end; it.increment(ec)) {
+        const auto &entry = *it;
+        const auto name = entry.path().filename().string();
+        std::error_code entry_ec;
+        if (entry.is_symlink(entry_ec)) {
+            AddEntry(name, fs::is_directory(entry.path(), entry_ec) || entry_ec ? EntryType::Other
+                                                                                 : EntryType::SymlinkToFile);
+        } else {
+            AddEntry(name, entry.is_directory(entry_ec) ? EntryType::Directory : EntryType::File);
+        }
+    }
+    if (ec) listing.error = ec.message();
+#else
+    // We use readdir directly because it gives us the type of each entry (d_type) for free on most file
+    // systems; fs::is_directory would be a stat call per entry, which is very slow over network drives.
+    const auto dir_string = dir.canonical_path.string();
+    auto d = opendir(dir_string.c_str());
+    if (!d) {
+        listing.error = std::error_code(errno, std::generic_category()).message();
+        return listing;
+    }
+    while (const auto entry = readdir(d)) {
+        const std::string name = entry->d_name;
+        if (name == "." || name == "..") continue;
+
+        auto d_type = entry->d_type;
+        if (d_type == DT_UNKNOWN) {
+            struct stat st;
+            if (lstat(JoinPath(dir_string, name).c_str(), &st) != 0) continue;
+            d_type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISLNK(st.st_mode) ? DT_LNK : DT_REG;
+        }
+
+        if (d_type == DT_DIR) {
+            AddEntry(name, EntryType::Directory);
+        } else if (d_type == DT_LNK) {
+            // Links to directories are not followed, and broken links are ignored
+            struct stat st;
+            if (stat(JoinPath(dir_string, name).c_str(), &st) != 0) continue;
+            AddEntry(name, S_ISDIR(st.st_mode) ? EntryType::Other : EntryType::SymlinkToFile);
+        } else {
+            AddEntry(name, EntryType::File);
         }
     }
-    return false;
+    closedir(d);
+#endif
+
+    return listing;
 }
 
-static std::vector<fs::path> GetAllFilepathsInDirectory(const std::string_view dir, const bool recursively) {
+// Searches all of the given directories, level by level. Each level's directories are read in parallel.
+static std::vector<fs::path> GetAllFilepathsInDirectories(std::vector<DirectoryToSearch> directories,
+                                                          const bool recursively,
+                                                          const ExcludeMatcher &excludes) {
     std::vector<fs::path> filepaths;
-    const auto parent_directory = fs::path(std::string(dir));
-    ForEachFileInDirectory(dir, recursively, [&](const auto filepath) {
-        if (parent_directory.compare(filepath) < 0) {
-            filepaths.push_back(filepath);
+    while (directories.size()) {
+        std::vector<DirectoryListing> listings(directories.size());
+        ParallelFor(directories.size(),
+                    [&](usize i) { listings[i] = ListDirectory(directories[i], excludes); });
+
+        std::vector<DirectoryToSearch> next_directories;
+        for (usize i = 0; i < listings.size(); ++i) {
+            auto &listing = listings[i];
+            if (listing.error.size()) {
+                WarningWithNewLine("Signet", {}, "Could not read the directory {} for reason: {}",
+                                   directories[i].given_path, listing.error);
+            }
+            std::move(listing.files.begin(), listing.files.end(), std::back_inserter(filepaths));
+            if (recursively) {
+                std::move(listing.subdirectories.begin(), listing.subdirectories.end(),
+                          std::back_inserter(next_directories));
+            }
         }
-    });
+        directories = std::move(next_directories);
+    }
     return filepaths;
 }
 
-void FilepathSet::AddNonExcludedPaths(const tcb::span<const fs::path> paths,
-                                      const std::vector<std::string> &exclude_patterns) {
-    for (const auto &path : paths) {
-        if (!IsPathExcluded(path, exclude_patterns)) {
-            Add(path);
-        }
-    }
+void FilepathSet::RemoveAndRecordSeenPaths(std::set<fs::path> &seen_paths) {
+    m_filepaths.erase(std::remove_if(m_filepaths.begin(), m_filepaths.end(),
+                                     [&](const fs::path &path) { return !seen_paths.insert(path).second; }),
+                      m_filepaths.end());
 }
 
 std::optional<FilepathSet>
@@ -61,16 +176,21 @@ FilepathSet::CreateFromPaths(const std::vector<std::string> &input_paths,
                              const std::vector<std::string> &exclude_patterns,
                              bool recursive_directory_search,
                              std::string *error) {
+    const ExcludeMatcher excludes {exclude_patterns};
+
     FilepathSet set {};
+    std::vector<DirectoryToSearch> directories;
     for (const auto &input : input_paths) {
-        if (fs::is_directory(input)) {
+        std::error_code ec;
+        const auto status = fs::status(input, ec);
+        if (fs::is_directory(status)) {
             MessageWithNewLine("Signet", {}, "Searching for files {} in the directory {}",
                                recursive_directory_search ? "recursively" : "non-recursively", input);
-            const auto matching_paths = GetAllFilepathsInDirectory(input, recursive_directory_search);
-            set.AddNonExcludedPaths(matching_paths, exclude_patterns);
-        } else if (fs::is_regular_file(input)) {
-            fs::path path {input};
-            set.AddNonExcludedPaths({&path, 1}, exclude_patterns);
+            directories.push_back({fs::path(input).generic_string(), fs::canonical(input)});
+        } else if (fs::is_regular_file(status)) {
+            if (!excludes.IsExcluded(fs::path(input).generic_string())) {
+                set.m_filepaths.push_back(fs::canonical(input));
+            }
         } else {
             if (error) {
                 *error = "no such file or directory: " + input;
@@ -78,6 +198,14 @@ FilepathSet::CreateFromPaths(const std::vector<std::string> &input_paths,
             return {};
         }
     }
+
+    auto directory_files =
+        GetAllFilepathsInDirectories(std::move(directories), recursive_directory_search, excludes);
+    std::move(directory_files.begin(), directory_files.end(), std::back_inserter(set.m_filepaths));
+
+    std::sort(set.m_filepaths.begin(), set.m_filepaths.end());
+    set.m_filepaths.erase(std::unique(set.m_filepaths.begin(), set.m_filepaths.end()), set.m_filepaths.end());
+
     if (!recursive_directory_search && input_paths.size() == 1 &&
         fs::is_directory(std::string(input_paths[0]))) {
         MessageWithNewLine(
@@ -188,6 +316,16 @@ TEST_CASE("FilepathSet") {
                                                          "sandbox/foo.wav"}));
     }
 
+    SUBCASE("duplicates are removed") {
+        std::string err;
+        auto set = FilepathSet::CreateFromPaths(
+            {"sandbox/file1.wav", "sandbox", "sandbox/../sandbox/file1.wav"}, {}, false, &err);
+        CAPTURE(err);
+        REQUIRE(set);
+        REQUIRE(set->Size() == 3);
+        REQUIRE(std::is_sorted(set->begin(), set->end()));
+    }
+
     SUBCASE("nonexistent path produces error") {
         std::string err;
         auto set = FilepathSet::CreateFromPaths({"sandbox/does-not-exist.wav"}, {}, false, &err);
@@ -8,12 +8,12 @@
 #include <vector>
 
 #include "filesystem.hpp"
-#include "span.hpp"
 
 class FilepathSet {
   public:
     // Creates a FilepathSet from a vector of file or directory paths.
     // Any path matching an entry in exclude_patterns (a glob against the path text) is dropped.
+    // Directories are searched in parallel.
     // e.g. input={"sounds/file.wav", "sounds/folder"}, exclude={"*.bak"}
     static std::optional<FilepathSet>
     CreateFromPaths(const std::vector<std::string> &input_paths,
@@ -23,6 +23,10 @@ class FilepathSet {
 
     auto Size() const { return m_filepaths.size(); }
 
+    // Removes any paths that are already in seen_paths, and adds the remaining ones to it. For when paths are
+    // gathered in separate batches but each file should only be used once.
+    void RemoveAndRecordSeenPaths(std::set<fs::path> &seen_paths);
+
     auto begin() { return m_filepaths.begin(); }
     auto end() { return m_filepaths.end(); }
     auto begin() const { return m_filepaths.begin(); }
@@ -30,14 +34,7 @@ class FilepathSet {
 
   private:
     FilepathSet() {}
-    void AddNonExcludedPaths(const tcb::span<const fs::path> paths,
-                             const std::vector<std::string> &exclude_patterns);
-    void Add(const fs::path &path) { m_filepaths.insert(fs::canonical(path)); }
-    void Add(const std::vector<fs::path> &paths) {
-        for (const auto &p : paths) {
-            Add(p);
-        }
-    }
-
-    std::set<fs::path> m_filepaths {};
+
+    // Canonical paths, sorted and with no duplicates.
+    std::vector<fs::path> m_filepaths {};
 };
@@ -3,6 +3,8 @@
 #include <cassert>
 #include <cmath>
 
+#include "doctest.hpp"
+
 static constexpr auto _LN2 = 0.69314718055994530942;
 static constexpr auto _PI = 3.14159265358979323846;
 
@@ -298,4 +300,137 @@ double Process(Data &d, const Coeffs &c, const double in) {
     return out;
 }
 
+// A first-order section, for the odd-order Butterworth filters that Linkwitz-Riley filters are made from
+static Coeffs FirstOrderSection(RBJType type, double sample_rate, double cutoff_freq) {
+    const auto k = std::tan(_PI * std::min(sample_rate / 2, cutoff_freq) / sample_rate);
+    Coeffs c;
+    if (type == RBJType::HighPass) {
+        c.b0 = 1 / (1 + k);
+        c.b1 = -c.b0;
+    } else {
+        c.b0 = k / (1 + k);
+        c.b1 = c.b0;
+    }
+    c.a1 = (k - 1) / (k + 1);
+    return c;
+}
+
+static void AddButterworthSections(std::vector<Coeffs> &sections,
+                                   RBJType type,
+                                   double sample_rate,
+                                   double cutoff_freq,
+                                   int order) {
+    if (order % 2) sections.push_back(FirstOrderSection(type, sample_rate, cutoff_freq));
+    // Each pair of poles is a second-order section with its own Q
+    for (int k = 1; k <= order / 2; ++k) {
+        const auto q = 1 / (2 * std::cos((2 * k - 1) * _PI / (2 * order)));
+        Params params;
+        Coeffs coeffs;
+        SetParamsAndCoeffs(Type::RBJ, params, coeffs, (int)type, sample_rate, cutoff_freq, q, 0);
+        sections.push_back(coeffs);
+    }
+}
+
+std::vector<Coeffs> PassFilterSections(RBJType type,
+                                       double sample_rate,
+                                       double cutoff_freq,
+                                       int slope_db_per_octave,
+                                       bool linkwitz_riley) {
+    assert(type == RBJType::LowPass || type == RBJType::HighPass);
+    assert(slope_db_per_octave % 12 == 0);
+    const auto order = slope_db_per_octave / 6;
+    std::vector<Coeffs> sections;
+    if (linkwitz_riley) {
+        AddButterworthSections(sections, type, sample_rate, cutoff_freq, order / 2);
+        AddButterworthSections(sections, type, sample_rate, cutoff_freq, order / 2);
+    } else {
+        AddButterworthSections(sections, type, sample_rate, cutoff_freq, order);
+    }
+    return sections;
+}
+
+// When the number of channels is known at compile time, the loop over them has a fixed length, which the
+// compiler can unroll into SIMD instructions. A num_channels of 0 means any number of channels.
+template <unsigned k_num_channels>
+static void ProcessSections(const std::vector<Coeffs> &sections,
+                            double *interleaved_samples,
+                            usize num_frames,
+                            unsigned runtime_num_channels) {
+    const auto num_channels = k_num_channels ? k_num_channels : runtime_num_channels;
+    std::vector<double> state1(sections.size() * num_channels, 0.0);
+    std::vector<double> state2(sections.size() * num_channels, 0.0);
+
+    for (usize frame = 0; frame < num_frames; ++frame) {
+        const auto samples = interleaved_samples + frame * num_channels;
+        for (usize section = 0; section < sections.size(); ++section) {
+            const auto &c = sections[section];
+            const auto s1 = state1.data() + section * num_channels;
+            const auto s2 = state2.data() + section * num_channels;
+            for (unsigned chan = 0; chan < num_channels; ++chan) {
+                const auto in = samples[chan];
+                const auto out = c.b0 * in + s1[chan];
+                s1[chan] = c.b1 * in - c.a1 * out + s2[chan];
+                s2[chan] = c.b2 * in - c.a2 * out;
+                samples[chan] = out;
+            }
+        }
+    }
+}
+
+void ProcessInterleaved(const std::vector<Coeffs> &sections,
+                        double *interleaved_samples,
+                        usize num_frames,
+                        unsigned num_channels) {
+    switch (num_channels) {
+        case 1: ProcessSections<1>(sections, interleaved_samples, num_frames, num_channels); break;
+        case 2: ProcessSections<2>(sections, interleaved_samples, num_frames, num_channels); break;
+        case 4: ProcessSections<4>(sections, interleaved_samples, num_frames, num_channels); break;
+        case 6: ProcessSections<6>(sections, interleaved_samples, num_frames, num_channels); break;
+        case 8: ProcessSections<8>(sections, interleaved_samples, num_frames, num_channels); break;
+        default: ProcessSections<0>(sections, interleaved_samples, num_frames, num_channels); break;
+    }
+}
+
 } // namespace Filter
+
+TEST_CASE("[Filter::ProcessInterleaved]") {
+    using namespace Filter;
+    constexpr usize num_frames = 2000;
+    for (const unsigned num_channels : {1u, 2u, 3u, 8u}) {
+        CAPTURE(num_channels);
+        std::vector<double> samples(num_frames * num_channels);
+        for (usize i = 0; i < samples.size(); ++i) {
+            samples[i] = std::sin((double)i * 0.37) * ((i % 7) ? 1 : -1);
+        }
+
+        SUBCASE("each channel is filtered the same as the direct form I filter") {
+            Params params;
+            Coeffs coeffs;
+            SetParamsAndCoeffs(Type::RBJ, params, coeffs, (int)RBJType::LowPass, 44100, 3000,
+                               default_q_factor, 0);
+            auto expected = samples;
+            for (unsigned chan = 0; chan < num_channels; ++chan) {
+                Data data {};
+                for (usize frame = 0; frame < num_frames; ++frame) {
+                    auto &v = expected[frame * num_channels + chan];
+                    v = Process(data, coeffs, v);
+                }
+            }
+            ProcessInterleaved({coeffs}, samples.data(), num_frames, num_channels);
+            for (usize i = 0; i < samples.size(); ++i) {
+                REQUIRE(samples[i] == doctest::Approx(expected[i]).epsilon(1e-9));
+            }
+        }
+
+        SUBCASE("sections in one pass are the same as one pass per section") {
+            const auto sections = PassFilterSections(RBJType::HighPass, 44100, 500, 48, false);
+            REQUIRE(sections.size() == 4);
+            auto expected = samples;
+            for (const auto &section : sections) {
+                ProcessInterleaved({section}, expected.data(), num_frames, num_channels);
+            }
+            ProcessInterleaved(sections, samples.data(), num_frames, num_channels);
+            REQUIRE(samples == expected);
+        }
+    }
+}
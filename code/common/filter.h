@@ -1,4 +1,7 @@
 #pragma once
+#include <vector>
+
+#include "types.h"
 
 namespace Filter {
 
@@ -59,4 +62,23 @@ void SetParamsAndCoeffs(Type filter_type,
 
 double Process(Data &d, const Coeffs &c, const double in);
 
+// The biquad sections of a lowpass or highpass filter (type is RBJType::LowPass or RBJType::HighPass) that
+// falls away at slope_db_per_octave, which is a multiple of 12. A Butterworth filter is flat in the pass band
+// and is 3dB down at the cutoff. A Linkwitz-Riley filter is 2 Butterworth filters of half the slope in a row:
+// it is 6dB down at the cutoff, so that a lowpass and a highpass at the same cutoff sum to a flat response.
+std::vector<Coeffs> PassFilterSections(RBJType type,
+                                       double sample_rate,
+                                       double cutoff_freq,
+                                       int slope_db_per_octave,
+                                       bool linkwitz_riley);
+
+// Filters interleaved audio in place through each of the sections in turn. Every section is applied to a
+// frame before moving on to the next frame, so steep filters still only take 1 pass over the audio, and all
+// of the channels of a frame are worked on together so that they can share SIMD instructions. This uses
+// the transposed direct form II, which needs only 2 values of state per section.
+void ProcessInterleaved(const std::vector<Coeffs> &sections,
+                        double *interleaved_samples,
+                        usize num_frames,
+                        unsigned num_channels);
+
 } // namespace Filter
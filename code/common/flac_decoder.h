@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstdio>
+#include <functional>
 #include <memory>
 
 #include "FLAC/stream_decoder.h"
@@ -43,6 +44,7 @@ struct FlacFileDataContext {
     FlacFileDataContext(FILE *f, AudioData &a) : file(f), data(a) {}
     FILE *file;
     AudioData &data;
+    usize total_frames {};
 };
 
 FLAC__StreamDecoderReadStatus
@@ -107,6 +109,16 @@ FLAC__bool FlacDecodeIsEndOfFile(const FLAC__StreamDecoder *, void *client_data)
     return feof(context.file) ? true : false;
 }
 
+double FlacSampleDivisor(unsigned bits_per_sample) {
+    switch (bits_per_sample) {
+        case 8: return std::pow(2, 7);
+        case 16: return 32768.0; // 2^15
+        case 20: return std::pow(2, 19);
+        case 24: return 8388608.0; // 2^23
+        default: assert(false); return 9999999.0;
+    }
+}
+
 FLAC__StreamDecoderWriteStatus FlacDecoderWriteCallback(const FLAC__StreamDecoder *,
                                                         const FLAC__Frame *flac_frame,
                                                         const FLAC__int32 *const buffer[],
@@ -116,19 +128,7 @@ FLAC__StreamDecoderWriteStatus FlacDecoderWriteCallback(const FLAC__StreamDecode
     context.data.num_channels = flac_frame->header.channels;
     context.data.bits_per_sample = flac_frame->header.bits_per_sample;
 
-    double divisor;
-    switch (flac_frame->header.bits_per_sample) {
-        case 8: divisor = std::pow(2, 7); break;
-        case 16:
-            divisor = 32768.0; // 2^15
-            break;
-        case 20: divisor = std::pow(2, 19); break;
-        case 24:
-            divisor = 8388608.0; // 2^23
-            break;
-        default: divisor = 9999999.0; assert(false);
-    }
-
+    const double divisor = FlacSampleDivisor(flac_frame->header.bits_per_sample);
     for (unsigned int frame = 0; frame < flac_frame->header.blocksize; ++frame) {
         for (unsigned int chan = 0; chan < flac_frame->header.channels; ++chan) {
             const auto val = buffer[chan][frame] / divisor;
@@ -225,3 +225,142 @@ bool DecodeFlacFile(FILE *file, AudioData &output) {
     FLAC__stream_decoder_finish(decoder.get());
     return process_success;
 }
+
+struct FlacFileRangeContext : FlacFileDataContext {
+    FlacFileRangeContext(FILE *f, AudioData &a, usize frames)
+        : FlacFileDataContext(f, a), num_frames(frames) {}
+    usize num_frames;
+};
+
+FLAC__StreamDecoderWriteStatus FlacDecoderRangeWriteCallback(const FLAC__StreamDecoder *,
+                                                             const FLAC__Frame *flac_frame,
+                                                             const FLAC__int32 *const buffer[],
+                                                             void *client_data) {
+    auto &context = *((FlacFileRangeContext *)client_data);
+
+    const double divisor = FlacSampleDivisor(flac_frame->header.bits_per_sample);
+    const auto num_channels = flac_frame->header.channels;
+    for (unsigned int frame = 0; frame < flac_frame->header.blocksize; ++frame) {
+        if (context.data.interleaved_samples.size() >= context.num_frames * num_channels) break;
+        for (unsigned int chan = 0; chan < num_channels; ++chan) {
+            context.data.interleaved_samples.push_back(buffer[chan][frame] / divisor);
+        }
+    }
+
+    return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
+void FlacDecoderStreamInfoCallback(const FLAC__StreamDecoder *,
+                                   const FLAC__StreamMetadata *metadata,
+                                   void *client_data) {
+    auto &context = *((FlacFileDataContext *)client_data);
+    if (metadata->type == FLAC__METADATA_TYPE_STREAMINFO) {
+        context.data.num_channels = metadata->data.stream_info.channels;
+        context.data.bits_per_sample = metadata->data.stream_info.bits_per_sample;
+        context.data.sample_rate = metadata->data.stream_info.sample_rate;
+        context.total_frames = (usize)metadata->data.stream_info.total_samples;
+    }
+}
+
+// Decodes only the frames [start_frame, start_frame + num_frames), using the decoder's seeking so that the
+// frames before the range do not need to be decoded. The range is clamped to the length of the file. Only the
+// STREAMINFO metadata is read.
+bool DecodeFlacFileRange(FILE *file,
+                         AudioData &output,
+                         usize start_frame,
+                         usize num_frames,
+                         usize &total_frames) {
+    std::unique_ptr<FLAC__StreamDecoder, decltype(&FLAC__stream_decoder_delete)> decoder(
+        FLAC__stream_decoder_new(), &FLAC__stream_decoder_delete);
+    if (decoder == nullptr) {
+        ErrorWithNewLine("Flac", {}, "failed to allocate memory for flac decoder");
+        return false;
+    }
+
+    FlacFileRangeContext context(file, output, num_frames);
+
+    const auto init_status = FLAC__stream_decoder_init_stream(
+        decoder.get(), FlacDecodeReadCallback, FlacDecodeSeekCallback, FlacDecodeTellCallback,
+        FlacDecodeLengthCallback, FlacDecodeIsEndOfFile, FlacDecoderRangeWriteCallback,
+        FlacDecoderStreamInfoCallback, FlacStreamDecodeErrorCallback, &context);
+    if (init_status != FLAC__STREAM_DECODER_INIT_STATUS_OK) {
+        ErrorWithNewLine("Flac", {}, "failed to initialise the flac stream: {}",
+                         FLAC__StreamDecoderInitStatusString[init_status]);
+        return false;
+    }
+
+    bool success = FLAC__stream_decoder_process_until_end_of_metadata(decoder.get());
+    total_frames = context.total_frames;
+    if (success && start_frame < total_frames && num_frames) {
+        context.num_frames = std::min(num_frames, total_frames - start_frame);
+        output.interleaved_samples.reserve(context.num_frames * output.num_channels);
+        // Seeking decodes the frame that contains start_frame, passing it to the write callback
+        success = start_frame == 0 || FLAC__stream_decoder_seek_absolute(decoder.get(), start_frame);
+        while (success && output.interleaved_samples.size() < context.num_frames * output.num_channels) {
+            if (FLAC__stream_decoder_get_state(decoder.get()) == FLAC__STREAM_DECODER_END_OF_STREAM) break;
+            success = FLAC__stream_decoder_process_single(decoder.get());
+        }
+    }
+    if (!success) ErrorWithNewLine("Flac", {}, "failed decoding flac data");
+
+    FLAC__stream_decoder_finish(decoder.get());
+    return success;
+}
+
+// Called for each block of decoded audio: channels[channel][frame] are the integer samples, which become
+// floating point values when divided by divisor.
+using FlacBlockCallback =
+    std::function<void(const FLAC__int32 *const channels[], usize num_frames, double divisor)>;
+
+struct FlacFileBlockContext : FlacFileDataContext {
+    FlacFileBlockContext(FILE *f, AudioData &a, const FlacBlockCallback &callback)
+        : FlacFileDataContext(f, a), on_block(callback) {}
+    const FlacBlockCallback &on_block;
+};
+
+FLAC__StreamDecoderWriteStatus FlacDecoderBlockWriteCallback(const FLAC__StreamDecoder *,
+                                                             const FLAC__Frame *flac_frame,
+                                                             const FLAC__int32 *const buffer[],
+                                                             void *client_data) {
+    auto &context = *((FlacFileBlockContext *)client_data);
+    context.on_block(buffer, flac_frame->header.blocksize,
+                     FlacSampleDivisor(flac_frame->header.bits_per_sample));
+    return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
+// Decodes the whole file but passes each block of audio to on_block rather than storing it. on_stream_info is
+// called before any blocks, once the format of output has been filled in from the STREAMINFO metadata, which
+// is the only metadata that is read.
+bool DecodeFlacFileBlocks(FILE *file,
+                          AudioData &output,
+                          const std::function<void(usize total_frames)> &on_stream_info,
+                          const FlacBlockCallback &on_block) {
+    std::unique_ptr<FLAC__StreamDecoder, decltype(&FLAC__stream_decoder_delete)> decoder(
+        FLAC__stream_decoder_new(), &FLAC__stream_decoder_delete);
+    if (decoder == nullptr) {
+        ErrorWithNewLine("Flac", {}, "failed to allocate memory for flac decoder");
+        return false;
+    }
+
+    FlacFileBlockContext context(file, output, on_block);
+
+    const auto init_status = FLAC__stream_decoder_init_stream(
+        decoder.get(), FlacDecodeReadCallback, FlacDecodeSeekCallback, FlacDecodeTellCallback,
+        FlacDecodeLengthCallback, FlacDecodeIsEndOfFile, FlacDecoderBlockWriteCallback,
+        FlacDecoderStreamInfoCallback, FlacStreamDecodeErrorCallback, &context);
+    if (init_status != FLAC__STREAM_DECODER_INIT_STATUS_OK) {
+        ErrorWithNewLine("Flac", {}, "failed to initialise the flac stream: {}",
+                         FLAC__StreamDecoderInitStatusString[init_status]);
+        return false;
+    }
+
+    bool success = FLAC__stream_decoder_process_until_end_of_metadata(decoder.get());
+    if (success) {
+        on_stream_info(context.total_frames);
+        success = FLAC__stream_decoder_process_until_end_of_stream(decoder.get());
+    }
+    if (!success) ErrorWithNewLine("Flac", {}, "failed decoding flac data");
+
+    FLAC__stream_decoder_finish(decoder.get());
+    return success;
+}
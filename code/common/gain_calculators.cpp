@@ -25,7 +25,7 @@ double GetRMS(const tcb::span<const double> samples) {
         result += s * s;
     }
     result /= samples.size();
-    REQUIRE(result >= 0);
+    assert(result >= 0);
     return std::sqrt(result);
 }
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <algorithm>
+#include <cassert>
 #include <cfloat>
 
 #include "doctest.hpp"
@@ -97,7 +98,7 @@ class PeakGainCalculator : public NormalisationGainCalculator {
             }
         }
         m_max_magnitude = std::max(m_max_magnitude, max_magnitude);
-        REQUIRE(m_max_magnitude >= 0);
+        assert(m_max_magnitude >= 0);
         return true;
     }
 
@@ -3,6 +3,7 @@
 #include <regex>
 
 #include "CLI11.hpp"
+#include "pattern_cache.h"
 
 void IdenticalProcessingSet::AddCli(CLI::App &command) {
     command
@@ -55,6 +56,27 @@ The entire folder of different mic positions can be processed in a single comman
 This is the same as --sample-sets, but just takes a single filename for all of the files (rather than allowing multiple sets to be identified using a regex pattern)foo");
 }
 
+std::string IdenticalProcessingSet::SetName(const fs::path &path) const {
+    const auto &re = GetCompiledRegex(m_sample_set_args[0]);
+    const auto filename = GetJustFilenameWithNoExtension(path);
+
+    std::string replaced = filename;
+    std::smatch match;
+    if (std::regex_match(filename, match, re)) {
+        if (match.size() == 2) {
+            replaced.assign(filename.begin(), match[1].first);
+            replaced.append(1, '*');
+            replaced.append(match[1].second, filename.end());
+        }
+    }
+    return fs::path(replaced).generic_string();
+}
+
+std::string IdenticalProcessingSet::ShardGroupKey(const fs::path &path) const {
+    if (ShouldProcessInSets()) return SetName(path);
+    return path.generic_string();
+}
+
 void IdenticalProcessingSet::ProcessSets(
     AudioFiles &files,
     std::string_view command_name,
@@ -62,28 +84,15 @@ void IdenticalProcessingSet::ProcessSets(
         &callback) {
 
     const auto re_str = m_sample_set_args[0];
-    std::regex re {re_str};
+    const auto &re = GetCompiledRegex(re_str);
     const auto &authority_matcher = m_sample_set_args[1];
 
     std::unordered_map<std::string, std::vector<EditTrackedAudioFile *>> sets;
-
-    std::smatch match;
     for (auto &f : files) {
-        const auto filename = GetJustFilenameWithNoExtension(f.GetPath());
-
-        std::string replaced = filename;
-        if (std::regex_match(filename, match, re)) {
-            if (match.size() == 2) {
-                replaced.assign(filename.begin(), match[1].first);
-                replaced.append(1, '*');
-                replaced.append(match[1].second, filename.end());
-            }
-        }
-
-        auto &arr = sets[fs::path(replaced).generic_string()];
-        arr.push_back(&f);
+        sets[SetName(f.GetPath())].push_back(&f);
     }
 
+    std::smatch match;
     for (auto &set : sets) {
         const auto human_set_name = GetJustFilenameWithNoExtension(set.first);
 
@@ -12,6 +12,14 @@ class IdenticalProcessingSet {
   public:
     void AddCli(CLI::App &command);
     bool ShouldProcessInSets() const { return !m_sample_set_args.empty(); }
+    // Returns the name that is shared by every file in the same set as the file at path: its filename with
+    // the differing part replaced by a *.
+    std::string SetName(const fs::path &path) const;
+
+    // For the Command overrides of a command that has sets: files can only be processed independently when
+    // there are no sets, and when there are, every file in a set is kept in the same shard.
+    bool ProcessesFilesIndependently() const { return !ShouldProcessInSets(); }
+    std::string ShardGroupKey(const fs::path &path) const;
     void ProcessSets(AudioFiles &files,
                      std::string_view command_name,
                      const std::function<void(EditTrackedAudioFile *authority,
@@ -1,5 +1,6 @@
 #include "midi_pitches.h"
 
+#include <cassert>
 #include <cfloat>
 #include <cmath>
 
@@ -15,7 +16,7 @@ MIDIPitch FindClosestMidiPitch(const double freq) {
             min_index = i;
         }
     }
-    REQUIRE(min_index != (size_t)-1);
+    assert(min_index != (size_t)-1);
 
     return g_midi_pitches[min_index];
 }
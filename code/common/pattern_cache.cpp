@@ -0,0 +1,79 @@
+#include "pattern_cache.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "doctest.hpp"
+
+namespace {
+
+template <typename Key, typename Pattern>
+class PatternCache {
+  public:
+    template <typename CreateFunction>
+    const Pattern &Get(const Key &key, CreateFunction &&create) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (const auto it = m_patterns.find(key); it != m_patterns.end()) return *it->second;
+        }
+
+        // Compile outside of the lock; if another thread compiled the same pattern in the meantime we just
+        // use theirs.
+        auto pattern = create();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const auto it = m_patterns.try_emplace(key, std::move(pattern)).first;
+        return *it->second;
+    }
+
+  private:
+    std::mutex m_mutex {};
+    std::map<Key, std::unique_ptr<const Pattern>> m_patterns {};
+};
+
+} // namespace
+
+const std::regex &GetCompiledRegex(const std::string &pattern, std::regex::flag_type flags) {
+    static PatternCache<std::pair<std::string, std::regex::flag_type>, std::regex> cache;
+    return cache.Get({pattern, flags}, [&] { return std::make_unique<const std::regex>(pattern, flags); });
+}
+
+const WildcardPattern &GetCompiledWildcard(const std::string &pattern, bool case_insensitive) {
+    static PatternCache<std::pair<std::string, bool>, WildcardPattern> cache;
+    return cache.Get({pattern, case_insensitive},
+                     [&] { return std::make_unique<const WildcardPattern>(pattern, case_insensitive); });
+}
+
+static bool ContainsRegexSpecialCharacters(const std::string &pattern) {
+    return pattern.find_first_of(R"([]{}()*+?.\^$|)") != std::string::npos;
+}
+
+bool RegexSearch(const std::string &pattern, const std::string &str) {
+    if (!ContainsRegexSpecialCharacters(pattern)) return str.find(pattern) != std::string::npos;
+    return std::regex_search(str, GetCompiledRegex(pattern));
+}
+
+TEST_CASE("[PatternCache]") {
+    SUBCASE("patterns are only compiled once") {
+        const auto &a = GetCompiledRegex("file_(\\d+)");
+        const auto &b = GetCompiledRegex("file_(\\d+)");
+        REQUIRE(&a == &b);
+        REQUIRE(&a != &GetCompiledRegex("file_(\\d+)", std::regex::ECMAScript | std::regex::icase));
+        REQUIRE(std::regex_match(std::string("file_12"), a));
+
+        REQUIRE(&GetCompiledWildcard("*.wav", false) == &GetCompiledWildcard("*.wav", false));
+        REQUIRE(&GetCompiledWildcard("*.wav", false) != &GetCompiledWildcard("*.wav", true));
+    }
+
+    SUBCASE("invalid regexes throw and are not cached") {
+        REQUIRE_THROWS_AS(GetCompiledRegex("file_(\\d+"), std::regex_error);
+        REQUIRE_THROWS_AS(GetCompiledRegex("file_(\\d+"), std::regex_error);
+    }
+
+    SUBCASE("regex search") {
+        REQUIRE(RegexSearch("rms", "channel_rms"));
+        REQUIRE(!RegexSearch("peak", "channel_rms"));
+        REQUIRE(RegexSearch("^chan.*rms$", "channel_rms"));
+        REQUIRE(!RegexSearch("^rms", "channel_rms"));
+    }
+}
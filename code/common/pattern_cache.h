@@ -0,0 +1,18 @@
+#pragma once
+#include <regex>
+#include <string>
+
+#include "string_utils.h"
+
+// Patterns given by the user are usually matched against every file, and compiling a std::regex is expensive.
+// These return a pattern that is compiled the first time it is asked for and then reused for the rest of the
+// run. The returned references stay valid until the program exits. They are safe to call from multiple
+// threads. An invalid regex throws std::regex_error, just like constructing a std::regex does.
+const std::regex &GetCompiledRegex(const std::string &pattern,
+                                   std::regex::flag_type flags = std::regex::ECMAScript);
+const WildcardPattern &GetCompiledWildcard(const std::string &pattern,
+                                           bool case_insensitive = target_os != TargetOs::Linux);
+
+// The same as std::regex_search, except that a pattern containing no special characters is looked for as
+// plain text without using std::regex at all.
+bool RegexSearch(const std::string &pattern, const std::string &str);
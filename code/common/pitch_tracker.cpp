@@ -0,0 +1,269 @@
+#include "pitch_tracker.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "doctest.hpp"
+#include "dywapitchtrack/dywapitchtrack.h"
+#include "r8brain-resampler/CDSPRealFFT.h"
+
+#include "common.h"
+#include "test_helpers.h"
+
+PitchEngine g_pitch_engine = PitchEngine::Wavelet;
+
+namespace {
+
+constexpr double k_max_detectable_hz = 5000;
+
+// The offset from the middle of 3 equally spaced values to the peak (or trough) of the parabola that goes
+// through them
+double ParabolicPeakOffset(double before, double at, double after) {
+    const auto denominator = before - 2 * at + after;
+    if (denominator == 0) return 0;
+    return std::clamp(0.5 * (before - after) / denominator, -0.5, 0.5);
+}
+
+class WaveletPitchTracker : public PitchTracker {
+  public:
+    PitchEstimate DetectPitch(const double *samples, usize num_samples, unsigned sample_rate) override {
+        dywapitchtracker pitch_tracker;
+        dywapitch_inittracking(&pitch_tracker);
+        auto hz =
+            dywapitch_computepitch(&pitch_tracker, const_cast<double *>(samples), 0, (int)num_samples);
+        if (sample_rate != 44100) {
+            hz *= static_cast<double>(sample_rate) / 44100.0;
+        }
+        // The detector does not say how sure it is
+        return {hz, hz != 0 ? 1.0 : 0.0};
+    }
+};
+
+// YIN and MPM are both based on the autocorrelation of the chunk. This works it out using an FFT, which is
+// O(n log n) rather than the O(n^2) of doing it directly.
+class AutocorrelationPitchTracker : public PitchTracker {
+  protected:
+    // For each lag from 0 to half of the chunk, m_autocorrelation[lag] is the sum of x[i] * x[i + lag], and
+    // m_energy[lag] is the sum of the squares of all of the samples that are used in those products.
+    void ComputeAutocorrelation(const double *samples, usize num_samples) {
+        // Padding with at least as many zeros as there are samples stops the FFT's correlation from wrapping
+        // around the end of the chunk
+        int len_bits = 1;
+        while (((usize)1 << len_bits) < num_samples * 2) {
+            ++len_bits;
+        }
+        m_fft.init(len_bits);
+        const auto fft_len = (usize)m_fft->getLen();
+
+        m_fft_buffer.assign(fft_len, 0.0);
+        std::copy(samples, samples + num_samples, m_fft_buffer.begin());
+        m_fft->forward(m_fft_buffer.data());
+        // The bins are packed as the real DC bin, the real Nyquist bin, then the real and imaginary parts of
+        // each of the rest. The autocorrelation is the inverse FFT of the power of each bin.
+        m_fft_buffer[0] *= m_fft_buffer[0];
+        m_fft_buffer[1] *= m_fft_buffer[1];
+        for (usize i = 2; i < fft_len; i += 2) {
+            m_fft_buffer[i] = m_fft_buffer[i] * m_fft_buffer[i] + m_fft_buffer[i + 1] * m_fft_buffer[i + 1];
+            m_fft_buffer[i + 1] = 0;
+        }
+        m_fft->inverse(m_fft_buffer.data());
+
+        const auto num_lags = num_samples / 2 + 1;
+        const auto scale = m_fft->getInvMulConst();
+        m_autocorrelation.resize(num_lags);
+        for (usize lag = 0; lag < num_lags; ++lag) {
+            m_autocorrelation[lag] = m_fft_buffer[lag] * scale;
+        }
+
+        m_cumulative_squares.resize(num_samples + 1);
+        m_cumulative_squares[0] = 0;
+        for (usize i = 0; i < num_samples; ++i) {
+            m_cumulative_squares[i + 1] = m_cumulative_squares[i] + samples[i] * samples[i];
+        }
+        m_energy.resize(num_lags);
+        for (usize lag = 0; lag < num_lags; ++lag) {
+            m_energy[lag] = m_cumulative_squares[num_samples - lag] +
+                            (m_cumulative_squares[num_samples] - m_cumulative_squares[lag]);
+        }
+    }
+
+    static usize MinLag(unsigned sample_rate) {
+        return std::max<usize>(2, (usize)((double)sample_rate / k_max_detectable_hz));
+    }
+
+    std::vector<double> m_autocorrelation {};
+    std::vector<double> m_energy {};
+
+  private:
+    r8b::CDSPRealFFTKeeper m_fft {};
+    std::vector<double> m_fft_buffer {};
+    std::vector<double> m_cumulative_squares {};
+};
+
+class YinPitchTracker : public AutocorrelationPitchTracker {
+  public:
+    PitchEstimate DetectPitch(const double *samples, usize num_samples, unsigned sample_rate) override {
+        const auto min_lag = MinLag(sample_rate);
+        const auto max_lag = num_samples / 2;
+        if (max_lag <= min_lag + 1) return {0, 0};
+        ComputeAutocorrelation(samples, num_samples);
+
+        // The cumulative mean normalised difference: how different the chunk is from itself shifted by the
+        // lag, relative to the average difference at all of the smaller lags
+        m_difference.resize(max_lag + 1);
+        m_difference[0] = 1;
+        double running_sum = 0;
+        for (usize lag = 1; lag <= max_lag; ++lag) {
+            const auto difference = std::max(0.0, m_energy[lag] - 2 * m_autocorrelation[lag]);
+            running_sum += difference;
+            m_difference[lag] = running_sum > 0 ? difference * (double)lag / running_sum : 1;
+        }
+
+        // The period is the first dip that goes below the threshold, rather than the deepest one, which could
+        // be a multiple of the period
+        constexpr double threshold = 0.15;
+        for (usize lag = min_lag; lag < max_lag; ++lag) {
+            if (m_difference[lag] >= threshold) continue;
+            while (lag + 1 < max_lag && m_difference[lag + 1] < m_difference[lag]) {
+                ++lag;
+            }
+            const auto offset =
+                ParabolicPeakOffset(m_difference[lag - 1], m_difference[lag], m_difference[lag + 1]);
+            return {(double)sample_rate / ((double)lag + offset),
+                    std::clamp(1 - m_difference[lag], 0.0, 1.0)};
+        }
+        return {0, 0};
+    }
+
+  private:
+    std::vector<double> m_difference {};
+};
+
+class MpmPitchTracker : public AutocorrelationPitchTracker {
+  public:
+    PitchEstimate DetectPitch(const double *samples, usize num_samples, unsigned sample_rate) override {
+        const auto min_lag = MinLag(sample_rate);
+        const auto max_lag = num_samples / 2;
+        if (max_lag <= min_lag + 1) return {0, 0};
+        ComputeAutocorrelation(samples, num_samples);
+
+        // The normalised square difference function: 1 where the chunk shifted by the lag matches it exactly,
+        // -1 where it is exactly inverted
+        m_nsdf.resize(max_lag + 1);
+        for (usize lag = 0; lag <= max_lag; ++lag) {
+            m_nsdf[lag] = m_energy[lag] > 0 ? 2 * m_autocorrelation[lag] / m_energy[lag] : 0;
+        }
+
+        // The candidates are the highest point of each region where the NSDF is positive, other than the one
+        // that starts at lag 0
+        m_peaks.clear();
+        usize lag = 1;
+        while (lag < max_lag && m_nsdf[lag] > 0) {
+            ++lag;
+        }
+        while (lag < max_lag) {
+            while (lag < max_lag && m_nsdf[lag] <= 0) {
+                ++lag;
+            }
+            auto best = lag;
+            while (lag < max_lag && m_nsdf[lag] > 0) {
+                if (m_nsdf[lag] > m_nsdf[best]) best = lag;
+                ++lag;
+            }
+            // A region that runs past the largest lag is not complete, so its highest point is not known
+            if (lag >= max_lag || best < min_lag) continue;
+            const auto offset = ParabolicPeakOffset(m_nsdf[best - 1], m_nsdf[best], m_nsdf[best + 1]);
+            m_peaks.push_back({(double)best + offset,
+                               m_nsdf[best] - 0.25 * (m_nsdf[best - 1] - m_nsdf[best + 1]) * offset});
+        }
+        if (m_peaks.empty()) return {0, 0};
+
+        // The first candidate that is nearly as high as the highest is the period; later ones that are just
+        // as high are multiples of it
+        double highest = 0;
+        for (const auto &peak : m_peaks) {
+            highest = std::max(highest, peak.value);
+        }
+        constexpr double fraction_of_highest = 0.9;
+        constexpr double min_clarity = 0.5;
+        for (const auto &peak : m_peaks) {
+            if (peak.value < highest * fraction_of_highest) continue;
+            if (peak.value < min_clarity) return {0, 0};
+            return {(double)sample_rate / peak.lag, std::clamp(peak.value, 0.0, 1.0)};
+        }
+        return {0, 0};
+    }
+
+  private:
+    struct Peak {
+        double lag;
+        double value;
+    };
+
+    std::vector<double> m_nsdf {};
+    std::vector<Peak> m_peaks {};
+};
+
+} // namespace
+
+PitchTracker &GetPitchTracker(PitchEngine engine) {
+    static thread_local std::array<std::unique_ptr<PitchTracker>, 3> t_trackers {};
+    auto &tracker = t_trackers[(usize)engine];
+    if (!tracker) {
+        switch (engine) {
+            case PitchEngine::Wavelet: tracker = std::make_unique<WaveletPitchTracker>(); break;
+            case PitchEngine::Yin: tracker = std::make_unique<YinPitchTracker>(); break;
+            case PitchEngine::Mpm: tracker = std::make_unique<MpmPitchTracker>(); break;
+        }
+    }
+    return *tracker;
+}
+
+TEST_CASE("[PitchTracker]") {
+    for (const auto engine : {PitchEngine::Wavelet, PitchEngine::Yin, PitchEngine::Mpm}) {
+        CAPTURE((int)engine);
+        auto &tracker = GetPitchTracker(engine);
+        REQUIRE(&tracker == &GetPitchTracker(engine));
+
+        SUBCASE("sines") {
+            for (const auto sample_rate : {44100u, 96000u}) {
+                for (const auto hz : {60.0, 110.0, 440.0, 1000.0, 2500.0}) {
+                    // This is where the wavelet detector goes an octave out, which DetectPitchWithConfidence
+                    // deals with by checking the audio at other octaves too
+                    if (engine == PitchEngine::Wavelet && hz > 2000) continue;
+                    CAPTURE(sample_rate);
+                    CAPTURE(hz);
+                    const auto sine = TestHelpers::CreateSineWaveAtFrequency(1, sample_rate, 0.1, hz);
+                    const auto result = tracker.DetectPitch(sine.interleaved_samples.data(),
+                                                            sine.interleaved_samples.size(), sample_rate);
+                    REQUIRE(std::abs(GetCentsDifference(hz, result.hz)) < 10);
+                    REQUIRE(result.confidence > 0.8);
+                }
+            }
+        }
+
+        SUBCASE("silence") {
+            const std::vector<double> silence(4410, 0.0);
+            const auto result = tracker.DetectPitch(silence.data(), silence.size(), 44100);
+            REQUIRE(result.hz == 0);
+            REQUIRE(result.confidence == 0);
+        }
+    }
+
+    SUBCASE("noise is not confidently pitched by the autocorrelation engines") {
+        std::vector<double> noise(4410);
+        u64 state = 1;
+        for (auto &s : noise) {
+            state = state * 6364136223846793005ull + 1442695040888963407ull;
+            s = (double)(state >> 11) / (double)(1ull << 53) * 2 - 1;
+        }
+        for (const auto engine : {PitchEngine::Yin, PitchEngine::Mpm}) {
+            CAPTURE((int)engine);
+            const auto result = GetPitchTracker(engine).DetectPitch(noise.data(), noise.size(), 44100);
+            REQUIRE(result.confidence < 0.9);
+        }
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <string_view>
+
+#include "types.h"
+
+// The algorithm that detects the pitch of each chunk of audio
+enum class PitchEngine {
+    // The wavelet-based detector (dywapitchtrack). It is quick but can be an octave out, so
+    // AudioData::DetectPitchWithConfidence checks its result against octave-shifted versions of the audio.
+    Wavelet,
+    // YIN: finds the smallest lag at which the audio is most similar to itself
+    Yin,
+    // The McLeod Pitch Method: picks the first strong peak of the normalised autocorrelation
+    Mpm,
+};
+
+// Set by the --pitch-engine option
+extern PitchEngine g_pitch_engine;
+
+struct PitchEstimate {
+    double hz;         // 0 if the chunk is unvoiced
+    double confidence; // 0..1, how clearly the chunk has this pitch
+};
+
+class PitchTracker {
+  public:
+    virtual ~PitchTracker() = default;
+    virtual PitchEstimate DetectPitch(const double *samples, usize num_samples, unsigned sample_rate) = 0;
+};
+
+// The tracker for the given engine that belongs to the calling thread. Trackers keep their FFT plans and
+// working buffers from call to call, so using the same one for every chunk of every file avoids setting them
+// up again each time.
+PitchTracker &GetPitchTracker(PitchEngine engine = g_pitch_engine);
@@ -0,0 +1,543 @@
+#include "resampler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <tuple>
+
+#include "doctest.hpp"
+#include "r8brain-resampler/CDSPResampler.h"
+
+#include "common.h"
+#include "thread_pool.h"
+
+ResampleQuality g_resample_quality = ResampleQuality::Standard;
+
+namespace {
+
+// Audio that is longer than this is split into segments of this many frames (rounded up so that each segment
+// starts at a whole number of frames in the output too)
+constexpr usize k_segment_frames = 1 << 18;
+
+// r8brain's transition band (as a percentage of the spectrum) and stop-band attenuation for each quality.
+// Standard is the same as r8brain's CDSPResampler24, and Draft is CDSPResampler16 with a relaxed transition
+// band.
+struct R8brainSettings {
+    double transition_band;
+    double attenuation_db;
+};
+
+R8brainSettings SettingsForQuality(ResampleQuality quality) {
+    switch (quality) {
+        case ResampleQuality::Draft: return {4.0, 136.45};
+        case ResampleQuality::Standard: return {2.0, 180.15};
+        case ResampleQuality::Mastering: return {1.0, 206.91};
+    }
+    return {2.0, 180.15};
+}
+
+class ChannelResampler {
+  public:
+    ChannelResampler(ResampleQuality quality,
+                     double src_sample_rate,
+                     double dst_sample_rate,
+                     usize block_frames)
+        : m_resampler(src_sample_rate,
+                      dst_sample_rate,
+                      (int)block_frames,
+                      SettingsForQuality(quality).transition_band,
+                      SettingsForQuality(quality).attenuation_db)
+        , m_block(block_frames) {}
+
+    // Resamples in_frames of 1 channel of interleaved audio, followed by silence, in the same way as
+    // r8brain's oneshot, but streamed a block at a time so that there is no limit to the length. The first
+    // skip_frames of the output are dropped and the next out_frames are written to out.
+    void Process(const double *in,
+                 usize in_frames,
+                 usize in_stride,
+                 usize skip_frames,
+                 double *out,
+                 usize out_frames,
+                 usize out_stride) {
+        const auto block_frames = m_block.size();
+        bool block_is_silent = false;
+        while (out_frames) {
+            const auto num_in = std::min(in_frames, block_frames);
+            if (num_in) {
+                for (usize frame = 0; frame < num_in; ++frame) {
+                    m_block[frame] = in[frame * in_stride];
+                }
+                in += num_in * in_stride;
+                in_frames -= num_in;
+                block_is_silent = false;
+            } else if (!block_is_silent) {
+                std::fill(m_block.begin(), m_block.end(), 0.0);
+                block_is_silent = true;
+            }
+
+            double *output;
+            const auto num_output =
+                (usize)m_resampler.process(m_block.data(), (int)(num_in ? num_in : block_frames), output);
+            const auto num_skipped = std::min(skip_frames, num_output);
+            skip_frames -= num_skipped;
+            const auto num_written = std::min(out_frames, num_output - num_skipped);
+            for (usize frame = 0; frame < num_written; ++frame) {
+                out[frame * out_stride] = output[num_skipped + frame];
+            }
+            out += num_written * out_stride;
+            out_frames -= num_written;
+        }
+        m_resampler.clear();
+    }
+
+    // How far the filter reaches, in input frames, either side of the point that an output frame is taken
+    // from
+    usize ContextFrames() {
+        if (!m_context_frames) m_context_frames = (usize)m_resampler.getInLenBeforeOutStart();
+        return *m_context_frames;
+    }
+
+  private:
+    r8b::CDSPResampler m_resampler;
+    std::vector<double> m_block;
+    std::optional<usize> m_context_frames {};
+};
+
+// r8brain shares its filter designs between all resamplers, but each resampler still builds its processing
+// steps and buffers when it is made. Each thread keeps the resamplers that it has used, so converting many
+// files between the same rates only builds them once per thread. The input is given to a resampler in
+// blocks, and the end of the output is flushed out with whole blocks of silence, so blocks are kept small;
+// very short files use a smaller block still.
+ChannelResampler &
+GetResampler(ResampleQuality quality, double src_sample_rate, double dst_sample_rate, usize num_frames) {
+    constexpr usize min_block_frames = 1 << 10;
+    constexpr usize max_block_frames = 1 << 12;
+    usize block_frames = min_block_frames;
+    while (block_frames < num_frames && block_frames < max_block_frames) {
+        block_frames *= 2;
+    }
+
+    using Key = std::tuple<ResampleQuality, double, double, usize>;
+    static thread_local std::map<Key, std::unique_ptr<ChannelResampler>> t_resamplers {};
+    const Key key {quality, src_sample_rate, dst_sample_rate, block_frames};
+    auto it = t_resamplers.find(key);
+    if (it == t_resamplers.end()) {
+        // Things like auto-tune resample to a different rate for each file, which are unlikely to be seen
+        // again
+        constexpr usize max_cached_resamplers = 16;
+        if (t_resamplers.size() >= max_cached_resamplers) t_resamplers.clear();
+        it = t_resamplers
+                 .emplace(key, std::make_unique<ChannelResampler>(quality, src_sample_rate, dst_sample_rate,
+                                                                  block_frames))
+                 .first;
+    }
+    return *it->second;
+}
+
+struct Steps {
+    usize in_step;
+    usize out_step;
+};
+
+// The output frames are at positions in the input that step by the ratio of the sample rates. When both rates
+// are whole numbers, every in_step input frames lines up exactly with every out_step output frames.
+std::optional<Steps> WholeNumberSteps(double src_sample_rate, double dst_sample_rate) {
+    if (src_sample_rate != std::floor(src_sample_rate) || dst_sample_rate != std::floor(dst_sample_rate)) {
+        return {};
+    }
+    const auto gcd = std::gcd((u64)src_sample_rate, (u64)dst_sample_rate);
+    return Steps {(usize)((u64)src_sample_rate / gcd), (usize)((u64)dst_sample_rate / gcd)};
+}
+
+struct Segment {
+    // The input frames that are given to the resampler; this goes past the segment itself on either side
+    // so that the filter has the same audio to look at as it would if the whole signal were resampled
+    usize in_start;
+    usize in_end;
+    // The output frames that belong to the segment, and how many frames of output come before them
+    usize out_start;
+    usize out_end;
+    usize skip_frames;
+};
+
+std::vector<Segment> Segments(usize num_frames,
+                              usize result_num_frames,
+                              double src_sample_rate,
+                              double dst_sample_rate,
+                              ChannelResampler &resampler) {
+    const std::vector<Segment> whole {{0, num_frames, 0, result_num_frames, 0}};
+    if (num_frames < k_segment_frames * 2) return whole;
+
+    // A segment can only be resampled on its own if its first input frame is exactly at the position of an
+    // output frame
+    const auto steps = WholeNumberSteps(src_sample_rate, dst_sample_rate);
+    if (!steps || steps->in_step > k_segment_frames) return whole;
+    const auto [in_step, out_step] = *steps;
+
+    const auto RoundUpToStep = [&](usize frames) { return (frames + in_step - 1) / in_step * in_step; };
+    const auto OutFrame = [&](usize in_frame) { return in_frame / in_step * out_step; };
+    const auto segment_frames = RoundUpToStep(k_segment_frames);
+    const auto context_frames = RoundUpToStep(resampler.ContextFrames());
+
+    std::vector<Segment> segments;
+    for (usize start = 0; start < num_frames; start += segment_frames) {
+        const auto end = std::min(start + segment_frames, num_frames);
+        const auto in_start = start > context_frames ? start - context_frames : 0;
+        const auto out_start = std::min(OutFrame(start), result_num_frames);
+        segments.push_back({
+            in_start,
+            std::min(end + context_frames, num_frames),
+            out_start,
+            end == num_frames ? result_num_frames : std::min(OutFrame(end), result_num_frames),
+            out_start - OutFrame(in_start),
+        });
+    }
+    return segments;
+}
+
+// The pass band of the Draft polyphase filter, as a fraction of the lower of the 2 Nyquist frequencies. The
+// filter has its full attenuation by the Nyquist frequency.
+constexpr double k_draft_passband = 0.8;
+
+// The modified Bessel function of the first kind, of order 0
+double BesselI0(double x) {
+    double sum = 1;
+    double term = 1;
+    for (int k = 1; k < 100 && term > sum * 1e-17; ++k) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+// A Kaiser-windowed sinc filter with 60dB of attenuation, precomputed for each of the out_step positions that
+// an output frame can have between 2 input frames. Each output frame is worked out directly from the input
+// frames around it, so there is no state and the output can be split up anywhere.
+class PolyphaseFilter {
+  public:
+    explicit PolyphaseFilter(Steps steps) : m_steps(steps) {
+        constexpr double attenuation_db = 60;
+        const auto beta = 0.1102 * (attenuation_db - 8.7);
+        // Frequencies are relative to the input's Nyquist frequency
+        const auto ratio = std::min(1.0, (double)steps.out_step / (double)steps.in_step);
+        const auto transition_width = (1 - k_draft_passband) * ratio;
+        const auto cutoff = (1 + k_draft_passband) / 2 * ratio;
+        const auto length = (attenuation_db - 7.95) / (2.285 * pi * transition_width);
+        // A multiple of 4 taps, for Process
+        m_half_taps = ((usize)std::ceil(length / 2) + 1) / 2 * 2;
+        m_num_taps = m_half_taps * 2;
+
+        m_coefficients.resize(steps.out_step * m_num_taps);
+        for (usize phase = 0; phase < steps.out_step; ++phase) {
+            const auto coefficients = m_coefficients.data() + phase * m_num_taps;
+            const auto offset = (double)phase / (double)steps.out_step;
+            double sum = 0;
+            for (usize tap = 0; tap < m_num_taps; ++tap) {
+                // The distance of the input frame from the position of the output frame
+                const auto t = (double)tap - (double)m_half_taps + 1 - offset;
+                const auto x = cutoff * t;
+                const auto sinc = x == 0 ? 1.0 : std::sin(pi * x) / (pi * x);
+                const auto window_position = t / (double)m_half_taps;
+                const auto window =
+                    BesselI0(beta * std::sqrt(std::max(0.0, 1 - window_position * window_position))) /
+                    BesselI0(beta);
+                coefficients[tap] = sinc * window;
+                sum += coefficients[tap];
+            }
+            // Each phase passes DC unchanged
+            for (usize tap = 0; tap < m_num_taps; ++tap) {
+                coefficients[tap] /= sum;
+            }
+        }
+    }
+
+    // Writes out_frames of 1 channel of output, starting at output frame out_start, from 1 channel of
+    // interleaved input. The input is silent beyond its ends.
+    void Process(const double *in,
+                 usize in_frames,
+                 usize in_stride,
+                 usize out_start,
+                 double *out,
+                 usize out_frames,
+                 usize out_stride) const {
+        if (!out_frames) return;
+        const auto [in_step, out_step] = m_steps;
+
+        // The input that the output frames use, with zeros beyond the ends of the input so that the filter
+        // does not need to check for them
+        const auto first_in = (s64)(out_start * in_step / out_step) - (s64)m_half_taps + 1;
+        const auto last_in = (s64)((out_start + out_frames - 1) * in_step / out_step) + (s64)m_half_taps;
+        std::vector<double> input((usize)(last_in - first_in + 1));
+        for (usize i = 0; i < input.size(); ++i) {
+            const auto frame = first_in + (s64)i;
+            input[i] = frame >= 0 && frame < (s64)in_frames ? in[(usize)frame * in_stride] : 0;
+        }
+
+        // The index in the input of the first tap for each output frame
+        usize position = 0;
+        auto phase = out_start * in_step % out_step;
+        for (usize frame = 0; frame < out_frames; ++frame) {
+            const auto coefficients = m_coefficients.data() + phase * m_num_taps;
+            const auto samples = input.data() + position;
+            // Separate sums can be worked on at the same time, rather than each add waiting for the last
+            double sums[4] {};
+            for (usize tap = 0; tap < m_num_taps; tap += 4) {
+                sums[0] += samples[tap + 0] * coefficients[tap + 0];
+                sums[1] += samples[tap + 1] * coefficients[tap + 1];
+                sums[2] += samples[tap + 2] * coefficients[tap + 2];
+                sums[3] += samples[tap + 3] * coefficients[tap + 3];
+            }
+            out[frame * out_stride] = (sums[0] + sums[1]) + (sums[2] + sums[3]);
+
+            position += in_step / out_step;
+            phase += in_step % out_step;
+            if (phase >= out_step) {
+                phase -= out_step;
+                ++position;
+            }
+        }
+    }
+
+  private:
+    Steps m_steps;
+    usize m_half_taps;
+    usize m_num_taps;
+    std::vector<double> m_coefficients {};
+};
+
+// The filters are designed once and shared between every thread, since they do not change after that. Only
+// ratios with few phases are used, and not large amounts of downsampling, which need long filters.
+const PolyphaseFilter *GetPolyphaseFilter(double src_sample_rate, double dst_sample_rate) {
+    const auto steps = WholeNumberSteps(src_sample_rate, dst_sample_rate);
+    constexpr usize max_phases = 512;
+    constexpr usize max_downsampling = 8;
+    if (!steps || steps->out_step > max_phases || steps->in_step > steps->out_step * max_downsampling) {
+        return nullptr;
+    }
+    // r8brain has quicker filters of its own for powers of 2
+    const auto IsPowerOf2 = [](usize v) { return (v & (v - 1)) == 0; };
+    if (IsPowerOf2(steps->in_step) && IsPowerOf2(steps->out_step)) return nullptr;
+
+    static std::mutex mutex;
+    static std::map<std::pair<usize, usize>, std::unique_ptr<const PolyphaseFilter>> filters;
+    const std::scoped_lock lock {mutex};
+    auto &filter = filters[{steps->in_step, steps->out_step}];
+    if (!filter) filter = std::make_unique<const PolyphaseFilter>(*steps);
+    return filter.get();
+}
+
+} // namespace
+
+std::vector<double> ResampleInterleaved(const std::vector<double> &interleaved_samples,
+                                        unsigned num_channels,
+                                        double src_sample_rate,
+                                        double dst_sample_rate,
+                                        ResampleQuality quality) {
+    const auto num_frames = interleaved_samples.size() / num_channels;
+    const auto result_num_frames = (usize)((double)num_frames * (dst_sample_rate / src_sample_rate));
+    std::vector<double> result(num_channels * result_num_frames);
+
+    if (quality == ResampleQuality::Draft) {
+        if (const auto filter = GetPolyphaseFilter(src_sample_rate, dst_sample_rate)) {
+            constexpr usize block_frames = 1 << 16;
+            const auto num_blocks = (result_num_frames + block_frames - 1) / block_frames;
+            ParallelFor(num_blocks * num_channels, [&](usize job) {
+                const auto start = (job / num_channels) * block_frames;
+                const auto channel = job % num_channels;
+                filter->Process(interleaved_samples.data() + channel, num_frames, num_channels, start,
+                                result.data() + start * num_channels + channel,
+                                std::min(block_frames, result_num_frames - start), num_channels);
+            });
+            return result;
+        }
+    }
+
+    const auto segments =
+        Segments(num_frames, result_num_frames, src_sample_rate, dst_sample_rate,
+                 GetResampler(quality, src_sample_rate, dst_sample_rate, num_frames));
+
+    // Every channel of every segment is independent, and each is resampled with its thread's resampler
+    ParallelFor(segments.size() * num_channels, [&](usize job) {
+        const auto &segment = segments[job / num_channels];
+        const auto channel = job % num_channels;
+        GetResampler(quality, src_sample_rate, dst_sample_rate, num_frames)
+            .Process(interleaved_samples.data() + segment.in_start * num_channels + channel,
+                     segment.in_end - segment.in_start, num_channels, segment.skip_frames,
+                     result.data() + segment.out_start * num_channels + channel,
+                     segment.out_end - segment.out_start, num_channels);
+    });
+
+    return result;
+}
+
+ResampleQualityMeasurement
+MeasureResampleQuality(ResampleQuality quality, double src_sample_rate, double dst_sample_rate) {
+    ResampleQualityMeasurement result {};
+    const auto src_nyquist = src_sample_rate / 2;
+    const auto dst_nyquist = dst_sample_rate / 2;
+    result.passband_hz = std::min(src_nyquist, dst_nyquist) * k_draft_passband;
+
+    constexpr double amplitude = 0.5;
+    const auto sine_frames = (usize)(src_sample_rate / 2);
+    const auto ResampledSine = [&](double hz) {
+        std::vector<double> sine(sine_frames);
+        for (usize frame = 0; frame < sine_frames; ++frame) {
+            sine[frame] = amplitude * std::sin(2 * pi * hz * (double)frame / src_sample_rate);
+        }
+        auto resampled = ResampleInterleaved(sine, 1, src_sample_rate, dst_sample_rate, quality);
+        // Only the middle is looked at, away from where the sine starts and stops
+        const auto quarter = resampled.size() / 4;
+        return std::vector<double>(resampled.begin() + quarter, resampled.end() - quarter);
+    };
+
+    double min_gain = std::numeric_limits<double>::max();
+    double max_gain = 0;
+    double max_unwanted = 0;
+
+    // Sines in the pass band should come out the same, with nothing else added
+    constexpr int num_passband_sines = 16;
+    for (int i = 0; i < num_passband_sines; ++i) {
+        const auto hz = 20 * std::pow(result.passband_hz / 20, (double)i / (num_passband_sines - 1));
+        const auto output = ResampledSine(hz);
+
+        // The least-squares fit of a sine at this frequency, with any phase
+        double ss = 0, cc = 0, sc = 0, ys = 0, yc = 0;
+        const auto w = 2 * pi * hz / dst_sample_rate;
+        for (usize frame = 0; frame < output.size(); ++frame) {
+            const auto s = std::sin(w * (double)frame);
+            const auto c = std::cos(w * (double)frame);
+            ss += s * s;
+            cc += c * c;
+            sc += s * c;
+            ys += output[frame] * s;
+            yc += output[frame] * c;
+        }
+        const auto determinant = ss * cc - sc * sc;
+        const auto a = (ys * cc - yc * sc) / determinant;
+        const auto b = (yc * ss - ys * sc) / determinant;
+        const auto gain = std::hypot(a, b) / amplitude;
+        min_gain = std::min(min_gain, gain);
+        max_gain = std::max(max_gain, gain);
+
+        double residual_squares = 0;
+        for (usize frame = 0; frame < output.size(); ++frame) {
+            const auto residual =
+                output[frame] - a * std::sin(w * (double)frame) - b * std::cos(w * (double)frame);
+            residual_squares += residual * residual;
+        }
+        const auto residual_amplitude = std::sqrt(residual_squares / (double)output.size()) * std::sqrt(2.0);
+        max_unwanted = std::max(max_unwanted, residual_amplitude / amplitude);
+    }
+
+    // When downsampling, sines that are above the new Nyquist frequency should be removed rather than aliased
+    if (dst_nyquist < src_nyquist) {
+        constexpr int num_stopband_sines = 8;
+        for (int i = 0; i < num_stopband_sines; ++i) {
+            const auto low = dst_nyquist * 1.02;
+            const auto high = src_nyquist * 0.98;
+            const auto output = ResampledSine(low + (high - low) * i / (num_stopband_sines - 1));
+            double squares = 0;
+            for (const auto v : output) {
+                squares += v * v;
+            }
+            const auto output_amplitude = std::sqrt(squares / (double)output.size()) * std::sqrt(2.0);
+            max_unwanted = std::max(max_unwanted, output_amplitude / amplitude);
+        }
+    }
+
+    result.passband_ripple_db = AmpToDB(max_gain) - AmpToDB(min_gain);
+    result.aliasing_db = AmpToDB(std::max(max_unwanted, 1e-15));
+
+    // Throughput is measured on 1 thread so that the qualities can be compared fairly: everything called from
+    // inside a ParallelFor runs serially on the thread that runs the item
+    ParallelFor(1, [&](usize) {
+        std::vector<double> noise(k_segment_frames);
+        u64 state = 1;
+        for (auto &s : noise) {
+            state = state * 6364136223846793005ull + 1442695040888963407ull;
+            s = (double)(state >> 11) / (double)(1ull << 53) * 2 - 1;
+        }
+        // The first run sets up the filters. The fastest of the rest is used, since other things running on
+        // the computer can only slow it down.
+        ResampleInterleaved(noise, 1, src_sample_rate, dst_sample_rate, quality);
+        double fastest_seconds = std::numeric_limits<double>::max();
+        for (int run = 0; run < 5; ++run) {
+            const auto start = std::chrono::steady_clock::now();
+            ResampleInterleaved(noise, 1, src_sample_rate, dst_sample_rate, quality);
+            const std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+            fastest_seconds = std::min(fastest_seconds, seconds.count());
+        }
+        result.frames_per_second = (double)noise.size() / std::max(fastest_seconds, 1e-9);
+    });
+
+    return result;
+}
+
+TEST_CASE("[ResampleInterleaved]") {
+    // Noise, so that every frequency is present at the seams between segments
+    const usize num_frames = k_segment_frames * 2 + 12345;
+    std::vector<double> stereo(num_frames * 2);
+    u64 state = 1;
+    for (auto &s : stereo) {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        s = (double)(state >> 11) / (double)(1ull << 53) * 2 - 1;
+    }
+
+    for (const auto &[src_sample_rate, dst_sample_rate] :
+         {std::pair {44100.0, 48000.0}, std::pair {48000.0, 44100.0}, std::pair {96000.0, 44100.0},
+          std::pair {44100.0, 44101.0}}) {
+        CAPTURE(src_sample_rate);
+        CAPTURE(dst_sample_rate);
+        const auto result = ResampleInterleaved(stereo, 2, src_sample_rate, dst_sample_rate);
+        const auto result_num_frames = (usize)((double)num_frames * (dst_sample_rate / src_sample_rate));
+        REQUIRE(result.size() == result_num_frames * 2);
+
+        // The segments match the whole signal resampled in one go
+        r8b::CDSPResampler24 resampler(src_sample_rate, dst_sample_rate, 4096);
+        for (unsigned channel = 0; channel < 2; ++channel) {
+            std::vector<double> in(num_frames);
+            for (usize frame = 0; frame < num_frames; ++frame) {
+                in[frame] = stereo[frame * 2 + channel];
+            }
+            std::vector<double> out(result_num_frames);
+            resampler.oneshot(in.data(), (int)num_frames, out.data(), (int)result_num_frames);
+            double max_difference = 0;
+            for (usize frame = 0; frame < result_num_frames; ++frame) {
+                max_difference = std::max(max_difference, std::abs(out[frame] - result[frame * 2 + channel]));
+            }
+            REQUIRE(max_difference < 1e-9);
+        }
+    }
+}
+
+TEST_CASE("[ResampleQuality]") {
+    // Draft uses r8brain rather than a polyphase filter for the powers of 2 and for the last, which is not a
+    // whole number
+    for (const auto &[src_sample_rate, dst_sample_rate] :
+         {std::pair {44100.0, 48000.0}, std::pair {48000.0, 44100.0}, std::pair {44100.0, 22050.0},
+          std::pair {44100.0, 88200.0}, std::pair {44100.0, 44320.5}}) {
+        CAPTURE(src_sample_rate);
+        CAPTURE(dst_sample_rate);
+
+        const auto draft = MeasureResampleQuality(ResampleQuality::Draft, src_sample_rate, dst_sample_rate);
+        REQUIRE(draft.frames_per_second > 0);
+        REQUIRE(draft.passband_ripple_db < 0.01);
+        REQUIRE(draft.aliasing_db < -55);
+
+        const auto standard =
+            MeasureResampleQuality(ResampleQuality::Standard, src_sample_rate, dst_sample_rate);
+        REQUIRE(standard.passband_ripple_db < 0.0001);
+        REQUIRE(standard.aliasing_db < -150);
+
+        const auto mastering =
+            MeasureResampleQuality(ResampleQuality::Mastering, src_sample_rate, dst_sample_rate);
+        REQUIRE(mastering.passband_ripple_db < 0.0001);
+        REQUIRE(mastering.aliasing_db < standard.aliasing_db);
+    }
+}
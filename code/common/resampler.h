@@ -0,0 +1,43 @@
+#pragma once
+#include <vector>
+
+#include "types.h"
+
+enum class ResampleQuality {
+    // A short polyphase filter for common ratios whose sample rates are whole numbers with a small common
+    // factor, such as 44.1kHz to 48kHz or 48kHz to 32kHz. Other ratios, including powers of 2, use r8brain's
+    // 16-bit resampler with a relaxed transition band.
+    Draft,
+    // r8brain's 24-bit resampler
+    Standard,
+    // r8brain with a narrower transition band and more stop-band attenuation than Standard
+    Mastering,
+};
+
+// Set by the --resample-quality option
+extern ResampleQuality g_resample_quality;
+
+// Changes the sample rate of interleaved audio, returning the new interleaved samples. Each channel is
+// resampled separately on the thread pool. Long audio with whole-number sample rates is also split into
+// segments that are resampled in parallel; the result is the same as resampling it all in one go.
+std::vector<double> ResampleInterleaved(const std::vector<double> &interleaved_samples,
+                                        unsigned num_channels,
+                                        double src_sample_rate,
+                                        double dst_sample_rate,
+                                        ResampleQuality quality = g_resample_quality);
+
+struct ResampleQualityMeasurement {
+    // Input frames of 1 channel that are resampled per second on 1 thread
+    double frames_per_second;
+    // The difference between the loudest and the quietest sine in the pass band after resampling
+    double passband_ripple_db;
+    // The loudest output that should not be there, relative to the input: the aliases of sines above the
+    // new Nyquist frequency, and anything other than the sine itself for sines in the pass band
+    double aliasing_db;
+    // The highest frequency that the pass band is measured up to
+    double passband_hz;
+};
+
+// Measures a quality by resampling sines and noise from one sample rate to the other
+ResampleQualityMeasurement
+MeasureResampleQuality(ResampleQuality quality, double src_sample_rate, double dst_sample_rate);
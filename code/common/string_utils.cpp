@@ -4,6 +4,7 @@
 
 #include "doctest.hpp"
 #include "filesystem.hpp"
+#include "pattern_cache.h"
 
 bool EndsWith(std::string_view str, std::string_view suffix) {
     return suffix.size() <= str.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
@@ -42,8 +43,7 @@ bool Replace(std::string &str, std::string_view a, std::string_view b) {
 }
 
 bool RegexReplace(std::string &str, std::string pattern, std::string replacement) {
-    const std::regex r {pattern};
-    const auto result = std::regex_replace(str, r, replacement);
+    const auto result = std::regex_replace(str, GetCompiledRegex(pattern), replacement);
     if (result != str) {
         str = result;
         return true;
@@ -51,39 +51,79 @@ bool RegexReplace(std::string &str, std::string pattern, std::string replacement
     return false;
 }
 
-static bool NeedsRegexEscape(const char c) {
-    static const std::string_view special_chars = R"([]-{}()*+?.\^$|)";
-    for (const char &special_char : special_chars) {
-        if (c == special_char) {
-            return true;
-        }
-    }
-    return false;
-}
+static char ToLowerAscii(char c) { return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c; }
 
-bool WildcardMatch(std::string_view pattern, std::string_view str, bool case_insensitive) {
-    std::string re_pattern;
-    re_pattern.reserve(pattern.size() * 2);
+WildcardPattern::WildcardPattern(std::string_view pattern, bool case_insensitive)
+    : m_case_insensitive(case_insensitive) {
+    m_tokens.reserve(pattern.size());
     for (usize i = 0; i < pattern.size(); ++i) {
         if (pattern[i] == '*') {
             if (i + 1 < pattern.size() && pattern[i + 1] == '*') {
-                re_pattern += ".*";
+                m_tokens.push_back({TokenType::AnyCharacters, 0});
                 i++;
             } else {
-                re_pattern += "[^\\/]*";
+                m_tokens.push_back({TokenType::AnyCharactersExceptSlash, 0});
             }
+            m_is_literal = false;
         } else {
-            if (NeedsRegexEscape(pattern[i])) {
-                re_pattern += '\\';
-            }
-            re_pattern += pattern[i];
+            const char c = case_insensitive ? ToLowerAscii(pattern[i]) : pattern[i];
+            m_tokens.push_back({TokenType::Literal, c});
         }
     }
+}
 
-    const std::regex regex {re_pattern, case_insensitive ? std::regex::ECMAScript | std::regex::icase
-                                                         : std::regex::ECMAScript};
+bool WildcardPattern::Matches(std::string_view str) const {
+    const auto CharsEqual = [&](char pattern_char, char c) {
+        return pattern_char == (m_case_insensitive ? ToLowerAscii(c) : c);
+    };
+
+    if (m_is_literal) {
+        if (str.size() != m_tokens.size()) return false;
+        for (usize i = 0; i < str.size(); ++i) {
+            if (!CharsEqual(m_tokens[i].c, str[i])) return false;
+        }
+        return true;
+    }
+
+    // Simulate the pattern as an NFA where state i means 'the first i tokens have been matched'. Every state
+    // is tracked at once so the cost is linear in the length of the string no matter how many wildcards
+    // there are.
+    const auto num_states = m_tokens.size() + 1;
+    std::vector<u8> current(num_states, 0);
+    std::vector<u8> next(num_states, 0);
+    const auto FollowWildcards = [&](std::vector<u8> &states) {
+        for (usize i = 0; i < m_tokens.size(); ++i) {
+            if (states[i] && m_tokens[i].type != TokenType::Literal) states[i + 1] = 1;
+        }
+    };
 
-    return std::regex_match(std::string(str), regex);
+    current[0] = 1;
+    FollowWildcards(current);
+    for (const auto c : str) {
+        std::fill(next.begin(), next.end(), (u8)0);
+        bool any_active = false;
+        for (usize i = 0; i < m_tokens.size(); ++i) {
+            if (!current[i]) continue;
+            const auto &token = m_tokens[i];
+            switch (token.type) {
+                case TokenType::Literal:
+                    if (CharsEqual(token.c, c)) next[i + 1] = any_active = 1;
+                    break;
+                case TokenType::AnyCharactersExceptSlash:
+                    if (c != '/') next[i] = any_active = 1;
+                    break;
+                case TokenType::AnyCharacters: next[i] = any_active = 1; break;
+            }
+        }
+        if (!any_active) return false;
+        FollowWildcards(next);
+        std::swap(current, next);
+    }
+    return current[m_tokens.size()];
+}
+
+bool WildcardMatch(std::string_view pattern, std::string_view str, bool case_insensitive) {
+    return GetCompiledWildcard(std::string(pattern), case_insensitive).Matches(str);
 }
 
 std::string GetJustFilenameWithNoExtension(fs::path path) {
@@ -326,4 +366,23 @@ TEST_CASE("String Utils") {
         CHECK(WildcardMatch("*.WAV", "file.Wav", true));
         CHECK(!WildcardMatch("*.WAV", "file.wav", false));
     }
+
+    // test the wildcard kinds
+    {
+        CHECK(WildcardMatch("*.wav", "file.wav", false));
+        CHECK(!WildcardMatch("*.wav", "folder/file.wav", false));
+        CHECK(WildcardMatch("**.wav", "folder/file.wav", false));
+        CHECK(WildcardMatch("*/draft/*", "sounds/draft/file.wav", false));
+        CHECK(!WildcardMatch("*/draft/*", "sounds/draft/sub/file.wav", false));
+        CHECK(WildcardMatch("a**b*c", "a/x/b/yc", false) == false);
+        CHECK(WildcardMatch("a**b*c", "a/x/byc", false));
+        CHECK(WildcardMatch("sounds/file.wav", "sounds/file.wav", false));
+        CHECK(!WildcardMatch("sounds/file.wav", "sounds/file.wa", false));
+        CHECK(WildcardMatch("*", "", false));
+        CHECK(WildcardMatch("***", "a/b", false));
+
+        const WildcardPattern pattern {"**/*.flac", false};
+        CHECK(pattern.Matches("a/b/c.flac"));
+        CHECK(!pattern.Matches("c.flac"));
+    }
 }
@@ -12,6 +12,25 @@ bool EndsWith(std::string_view str, std::string_view suffix);
 bool StartsWith(std::string_view str, std::string_view prefix);
 bool Contains(std::string_view haystack, std::string_view needle);
 
+// A glob pattern that is compiled once and can then be matched against many strings. '*' matches any run of
+// characters except '/', and '**' matches any run of characters. Matching does not use std::regex.
+class WildcardPattern {
+  public:
+    WildcardPattern(std::string_view pattern, bool case_insensitive = target_os != TargetOs::Linux);
+    bool Matches(std::string_view str) const;
+
+  private:
+    enum class TokenType : u8 { Literal, AnyCharactersExceptSlash, AnyCharacters };
+    struct Token {
+        TokenType type;
+        char c;
+    };
+
+    std::vector<Token> m_tokens {};
+    bool m_case_insensitive {};
+    bool m_is_literal {true};
+};
+
 bool WildcardMatch(std::string_view pattern,
                    std::string_view str,
                    bool case_insensitive = target_os != TargetOs::Linux);
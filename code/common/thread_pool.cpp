@@ -0,0 +1,164 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+#include "doctest.hpp"
+
+#include "defer.h"
+
+static thread_local bool t_inside_parallel_for = false;
+
+ThreadPool::ThreadPool(unsigned num_worker_threads) {
+    m_threads.reserve(num_worker_threads);
+    for (unsigned i = 0; i < num_worker_threads; ++i) {
+        m_threads.emplace_back([this] { WorkerLoop(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_work_cv.notify_all();
+    for (auto &t : m_threads) {
+        t.join();
+    }
+}
+
+void ThreadPool::RunItems() {
+    usize index;
+    while ((index = m_next_item.fetch_add(1)) < m_num_items) {
+        try {
+            (*m_callback)(index);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_error) m_error = std::current_exception();
+            m_next_item = m_num_items;
+        }
+    }
+}
+
+void ThreadPool::WorkerLoop() {
+    t_inside_parallel_for = true;
+    u64 generation_seen = 0;
+    while (true) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_work_cv.wait(lock, [&] { return m_quit || m_generation != generation_seen; });
+        if (m_quit) return;
+        generation_seen = m_generation;
+
+        // A worker that wakes up after all of the items have been claimed must not join the job: the
+        // submitting thread may already have seen that no workers are busy and returned.
+        if (m_next_item >= m_num_items) continue;
+        ++m_num_busy_workers;
+        lock.unlock();
+
+        RunItems();
+
+        lock.lock();
+        if (--m_num_busy_workers == 0) m_done_cv.notify_all();
+    }
+}
+
+void ThreadPool::ParallelFor(usize num_items, const std::function<void(usize index)> &callback) {
+    if (num_items == 0) return;
+    if (t_inside_parallel_for || m_threads.empty() || num_items == 1) {
+        // Calls made from these callbacks must run serially too, since callers rely on everything inside a
+        // ParallelFor staying on 1 thread
+        const auto was_inside_parallel_for = t_inside_parallel_for;
+        t_inside_parallel_for = true;
+        defer { t_inside_parallel_for = was_inside_parallel_for; };
+        for (usize i = 0; i < num_items; ++i) {
+            callback(i);
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> submit_lock(m_submit_mutex);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_callback = &callback;
+        m_num_items = num_items;
+        m_next_item = 0;
+        m_error = nullptr;
+        ++m_generation;
+    }
+    m_work_cv.notify_all();
+
+    t_inside_parallel_for = true;
+    RunItems();
+    t_inside_parallel_for = false;
+
+    std::exception_ptr error;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done_cv.wait(lock, [&] { return m_num_busy_workers == 0; });
+        m_callback = nullptr;
+        error = m_error;
+        m_error = nullptr;
+    }
+    if (error) std::rethrow_exception(error);
+}
+
+ThreadPool &GetThreadPool() {
+    static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    return pool;
+}
+
+TEST_CASE("[ThreadPool]") {
+    ThreadPool pool(3);
+
+    SUBCASE("every item is run exactly once") {
+        std::vector<std::atomic<int>> counts(1000);
+        pool.ParallelFor(counts.size(), [&](usize i) { counts[i]++; });
+        for (const auto &c : counts) {
+            REQUIRE(c == 1);
+        }
+    }
+
+    SUBCASE("exceptions are rethrown on the calling thread") {
+        REQUIRE_THROWS_AS(pool.ParallelFor(100,
+                                           [&](usize i) {
+                                               if (i == 50) throw std::runtime_error("failed");
+                                           }),
+                          std::runtime_error);
+
+        // the pool is still usable afterwards
+        std::atomic<usize> sum {0};
+        pool.ParallelFor(10, [&](usize i) { sum += i; });
+        REQUIRE(sum == 45);
+    }
+
+    SUBCASE("nested calls run serially") {
+        std::atomic<usize> count {0};
+        pool.ParallelFor(8, [&](usize) { pool.ParallelFor(8, [&](usize) { count++; }); });
+        REQUIRE(count == 64);
+    }
+
+    SUBCASE("calls nested in a single item run on the calling thread") {
+        // MeasureResampleQuality relies on this to time resampling on 1 thread
+        for (int attempt = 0; attempt < 3; ++attempt) {
+            std::vector<std::thread::id> thread_ids(1000);
+            pool.ParallelFor(1, [&](usize) {
+                pool.ParallelFor(thread_ids.size(), [&](usize i) {
+                    thread_ids[i] = std::this_thread::get_id();
+                    std::this_thread::sleep_for(std::chrono::microseconds(10));
+                });
+            });
+            for (const auto id : thread_ids) {
+                REQUIRE(id == std::this_thread::get_id());
+            }
+        }
+
+        // and afterwards the pool is parallel again
+        std::vector<std::thread::id> thread_ids(1000);
+        pool.ParallelFor(thread_ids.size(), [&](usize i) {
+            thread_ids[i] = std::this_thread::get_id();
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        });
+        REQUIRE(std::count(thread_ids.begin(), thread_ids.end(), std::this_thread::get_id()) < 1000);
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "types.h"
+
+// A fixed set of worker threads that cooperatively run the iterations of a ParallelFor. The calling thread
+// also takes part in the work. Calls made from inside a callback (nested parallelism) are run serially on
+// the calling thread so that work can never deadlock waiting for itself.
+class ThreadPool {
+  public:
+    explicit ThreadPool(unsigned num_worker_threads);
+    ~ThreadPool();
+
+    // Calls callback(i) for every i in [0, num_items), spread across the workers. Returns once every
+    // iteration has finished. If any callback throws, the remaining iterations are abandoned and the first
+    // exception is rethrown on the calling thread.
+    void ParallelFor(usize num_items, const std::function<void(usize index)> &callback);
+
+    unsigned NumThreads() const { return (unsigned)m_threads.size() + 1; }
+
+  private:
+    void WorkerLoop();
+    void RunItems();
+
+    std::vector<std::thread> m_threads {};
+
+    std::mutex m_submit_mutex {};
+    std::mutex m_mutex {};
+    std::condition_variable m_work_cv {};
+    std::condition_variable m_done_cv {};
+
+    const std::function<void(usize)> *m_callback {};
+    usize m_num_items {};
+    std::atomic<usize> m_next_item {};
+    u64 m_generation {};
+    unsigned m_num_busy_workers {};
+    std::exception_ptr m_error {};
+    bool m_quit {};
+};
+
+// The process-wide pool, sized to the hardware concurrency.
+ThreadPool &GetThreadPool();
+
+inline void ParallelFor(usize num_items, const std::function<void(usize index)> &callback) {
+    GetThreadPool().ParallelFor(num_items, callback);
+}
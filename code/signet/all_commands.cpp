@@ -0,0 +1,100 @@
+#include "all_commands.h"
+
+#include "CLI11.hpp"
+#include "doctest.hpp"
+
+#include "commands/add_loop/add_loop.h"
+#include "commands/auto_tune/auto_tune.h"
+#include "commands/convert/convert.h"
+#include "commands/detect_pitch/detect_pitch.h"
+#include "commands/detect_pops/detect_pops.h"
+#include "commands/embed_sampler_info/embed_sampler_info.h"
+#include "commands/fade/fade.h"
+#include "commands/filter/filters.h"
+#include "commands/fix_pitch_drift/fix_pitch_drift_command.h"
+#include "commands/folderise/folderise.h"
+#include "commands/gain/gain.h"
+#include "commands/metadata/metadata_command.h"
+#include "commands/mir_report/mir_report.h"
+#include "commands/move/move.h"
+#include "commands/normalise/normalise.h"
+#include "commands/pan/pan.h"
+#include "commands/print_info/print_info.h"
+#include "commands/rename/rename.h"
+#include "commands/reverse/reverse.h"
+#include "commands/sample_blend/sample_blend.h"
+#include "commands/seamless_loop/seamless_loop.h"
+#include "commands/trim/trim.h"
+#include "commands/trim_silence/trim_silence.h"
+#include "commands/tune/tune.h"
+#include "commands/zcross_offset/zcross_offset.h"
+
+struct CommandRegistration {
+    std::string_view name; // the name of the command on the command line
+    std::unique_ptr<Command> (*create)();
+};
+
+template <typename CommandType>
+static std::unique_ptr<Command> Create() {
+    return std::make_unique<CommandType>();
+}
+
+static const CommandRegistration k_command_registrations[] = {
+    {"add-loop", Create<AddLoopCommand>},
+    {"auto-tune", Create<AutoTuneCommand>},
+    {"convert", Create<ConvertCommand>},
+    {"detect-pitch", Create<DetectPitchCommand>},
+    {"detect-pops", Create<DetectPopsCommand>},
+    {"embed-sampler-info", Create<EmbedSamplerInfo>},
+    {"fade", Create<FadeCommand>},
+    {"fix-pitch-drift", Create<FixPitchDriftCommand>},
+    {"folderise", Create<FolderiseCommand>},
+    {"gain", Create<GainCommand>},
+    {"highpass", Create<HighpassCommand>},
+    {"lowpass", Create<LowpassCommand>},
+    {"metadata", Create<MetadataCommand>},
+    {"mir-report", Create<MirReportCommand>},
+    {"move", Create<MoveCommand>},
+    {"norm", Create<NormaliseCommand>},
+    {"pan", Create<PanCommand>},
+    {"print-info", Create<PrintInfoCommand>},
+    {"rename", Create<RenameCommand>},
+    {"reverse", Create<ReverseCommand>},
+    {"sample-blend", Create<SampleBlendCommand>},
+    {"seamless-loop", Create<SeamlessLoopCommand>},
+    {"trim", Create<TrimCommand>},
+    {"trim-silence", Create<TrimSilenceCommand>},
+    {"tune", Create<TuneCommand>},
+    {"zcross-offset", Create<ZeroCrossOffsetCommand>},
+};
+
+std::vector<std::unique_ptr<Command>> CreateAllCommands() {
+    std::vector<std::unique_ptr<Command>> result;
+    for (const auto &registration : k_command_registrations) {
+        result.push_back(registration.create());
+    }
+    return result;
+}
+
+std::vector<std::unique_ptr<Command>> CreateCommandsNamedIn(const std::vector<std::string> &words) {
+    std::vector<std::unique_ptr<Command>> result;
+    for (const auto &registration : k_command_registrations) {
+        if (std::find(words.begin(), words.end(), registration.name) != words.end()) {
+            result.push_back(registration.create());
+        }
+    }
+    return result;
+}
+
+TEST_CASE("[CommandRegistrations]") {
+    CLI::App app;
+    std::vector<std::unique_ptr<Command>> commands;
+    for (const auto &registration : k_command_registrations) {
+        commands.push_back(registration.create());
+        REQUIRE(commands.back()->CreateCommandCLI(app)->get_name() == registration.name);
+    }
+
+    const auto named = CreateCommandsNamedIn({"file.wav", "norm", "-3", "fade", "in", "10ms"});
+    REQUIRE(named.size() == 2);
+    REQUIRE(named[0]->GetName() == "Fade");
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "command.h"
+
+// Creates every one of Signet's audio commands, in alphabetical order of name. Creating a command and its
+// CLI takes a lot longer than the rest of Signet's start-up, so prefer CreateCommandsNamedIn when the help of
+// every command is not needed.
+std::vector<std::unique_ptr<Command>> CreateAllCommands();
+
+// Creates only the commands whose names are in words, such as the arguments of a run of Signet. A command
+// can only be run if its name is given, so these are all of the commands that could be run.
+std::vector<std::unique_ptr<Command>> CreateCommandsNamedIn(const std::vector<std::string> &words);
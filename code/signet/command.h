@@ -17,6 +17,21 @@ class Command {
     virtual bool AllowsSingleOutputFile() const { return true; }
     virtual bool IsReadOnly() const { return false; }
 
+    // True if each file is processed on its own, without looking at any of the other files. The files can
+    // then be given to the command in separate batches, such as when the paths are streamed from stdin.
+    virtual bool ProcessesFilesIndependently() const { return false; }
+
+    // When the input files are split into shards with --shard, files that give the same key here are always
+    // put in the same shard, and with --incremental, they are all processed again if any of them have
+    // changed. By default the files of a command that processes each file on its own can be split up in any
+    // way, whereas the files of any other command are all kept together.
+    virtual std::string ShardGroupKey(const EditTrackedAudioFile &file) const {
+        return ProcessesFilesIndependently() ? file.OriginalPath().generic_string() : std::string {};
+    }
+
+    // True if GenerateFiles writes new files of its own, rather than the command only changing the given files
+    virtual bool GeneratesFiles() const { return false; }
+
     virtual void GenerateFiles(AudioFiles &, SignetBackup &) {}
     virtual void ProcessFiles(AudioFiles &) {}
 };
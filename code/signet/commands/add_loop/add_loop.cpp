@@ -122,7 +122,7 @@ void AddLoopCommand::ProcessFiles(AudioFiles &files) {
         loop.num_times_to_loop = m_num_times_to_loop;
 
         // Add the loop to the file metadata
-        auto &writable_audio = f.GetWritableAudio();
+        auto &writable_audio = f.GetWritableMetadata();
         writable_audio.metadata.loops.push_back(loop);
 
         // Also update the timing info to mark this as a looping file
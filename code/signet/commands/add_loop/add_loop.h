@@ -8,6 +8,7 @@ class AddLoopCommand final : public Command {
     CLI::App *CreateCommandCLI(CLI::App &app) override;
     void ProcessFiles(AudioFiles &files) override;
     std::string GetName() const override { return "AddLoop"; }
+    bool ProcessesFilesIndependently() const override { return true; }
 
   private:
     AudioDuration m_start_point {AudioDuration::Unit::Samples, 0};
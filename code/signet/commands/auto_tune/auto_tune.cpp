@@ -46,7 +46,7 @@ void AutoTuneCommand::ProcessFiles(AudioFiles &files) {
 
     if (!m_identical_processing_set.ShouldProcessInSets()) {
         for (auto &f : files) {
-            if (const auto pitch = f.GetAudio().DetectPitch()) {
+            if (const auto pitch = f.GetAnalysisAudio().DetectPitch()) {
                 const auto closest_musical_note = FindClosestMidiPitch(*pitch);
                 if (ExpectedNoteIsValid(closest_musical_note, f)) {
                     const double cents = GetCentsDifference(*pitch, closest_musical_note.pitch);
@@ -66,7 +66,7 @@ void AutoTuneCommand::ProcessFiles(AudioFiles &files) {
         m_identical_processing_set.ProcessSets(
             files, GetName(),
             [&](EditTrackedAudioFile *authority_file, const std::vector<EditTrackedAudioFile *> &set) {
-                if (const auto pitch = authority_file->GetAudio().DetectPitch()) {
+                if (const auto pitch = authority_file->GetAnalysisAudio().DetectPitch()) {
                     const auto closest_musical_note = FindClosestMidiPitch(*pitch);
                     if (ExpectedNoteIsValid(closest_musical_note, *authority_file)) {
                         const double cents = GetCentsDifference(*pitch, closest_musical_note.pitch);
@@ -95,7 +95,7 @@ void ConvertCommand::ProcessFiles(AudioFiles &files) {
                 const auto from_name = magic_enum::enum_name(audio.format);
                 const auto to_name = magic_enum::enum_name(*m_file_format);
                 MessageWithNewLine(GetName(), f, "Converting file format from {} to {}", from_name, to_name);
-                f.GetWritableAudio().format = *m_file_format;
+                f.SetFormat(*m_file_format);
                 edited = true;
             }
 
@@ -14,15 +14,16 @@ CLI::App *DetectPitchCommand::CreateCommandCLI(CLI::App &app) {
 
 void DetectPitchCommand::ProcessFiles(AudioFiles &files) {
     for (auto &f : files) {
-        const auto pitch = f.GetAudio().DetectPitch();
+        const auto pitch = f.GetAnalysisAudio().DetectPitch();
         if (pitch) {
             const auto closest_musical_note = FindClosestMidiPitch(*pitch);
 
-            MessageWithNewLine(GetName(), f, "Detected pitch {:.2f} Hz ({:.1f} cents from {}, MIDI {})",
-                               *pitch, GetCentsDifference(closest_musical_note.pitch, *pitch),
-                               closest_musical_note.name, closest_musical_note.midi_note);
+            PrintCommandResult(GetName(), f,
+                               fmt::format("Detected pitch {:.2f} Hz ({:.1f} cents from {}, MIDI {})", *pitch,
+                                           GetCentsDifference(closest_musical_note.pitch, *pitch),
+                                           closest_musical_note.name, closest_musical_note.midi_note));
         } else {
-            MessageWithNewLine(GetName(), f, "No pitch could be found");
+            PrintCommandResult(GetName(), f, "No pitch could be found");
         }
     }
 }
@@ -7,5 +7,6 @@ class DetectPitchCommand final : public Command {
     CLI::App *CreateCommandCLI(CLI::App &app) override;
     void ProcessFiles(AudioFiles &files) override;
     std::string GetName() const override { return "DetectPitch"; }
+    bool ProcessesFilesIndependently() const override { return true; }
     bool IsReadOnly() const override { return true; }
 };
@@ -177,7 +177,7 @@ void DetectPopsCommand::RepairPops(AudioData &audio, const std::vector<PopLocati
 
 void DetectPopsCommand::ReportDetections(EditTrackedAudioFile &f, const std::vector<PopLocation> &pops) const {
     if (pops.empty()) {
-        MessageWithNewLine(GetName(), f, "none-detected");
+        PrintCommandResult(GetName(), f, "none-detected");
     } else {
         // Sort by frame (stable sort to maintain channel order for same frame)
         auto sorted_pops = pops;
@@ -196,14 +196,14 @@ void DetectPopsCommand::ReportDetections(EditTrackedAudioFile &f, const std::vec
             }
         }
 
-        MessageWithNewLine(GetName(), f, "Pops detected at frame{}: {}",
-                           pops.size() > 1 ? "s" : "", pop_locations);
+        PrintCommandResult(GetName(), f,
+                           fmt::format("Pops detected at frame{}: {}", pops.size() > 1 ? "s" : "", pop_locations));
     }
 }
 
 void DetectPopsCommand::ReportRepairs(EditTrackedAudioFile &f, const std::vector<PopLocation> &pops) const {
     if (pops.empty()) {
-        MessageWithNewLine(GetName(), f, "none-detected");
+        PrintCommandResult(GetName(), f, "none-detected");
     } else {
         // Sort by frame (stable sort to maintain channel order for same frame)
         auto sorted_pops = pops;
@@ -222,8 +222,9 @@ void DetectPopsCommand::ReportRepairs(EditTrackedAudioFile &f, const std::vector
             }
         }
 
-        MessageWithNewLine(GetName(), f, "Detected and repaired {} pop{} at frame{}: {}",
-                           pops.size(), pops.size() > 1 ? "s" : "", pops.size() > 1 ? "s" : "", pop_locations);
+        PrintCommandResult(GetName(), f,
+                           fmt::format("Detected and repaired {} pop{} at frame{}: {}", pops.size(),
+                                       pops.size() > 1 ? "s" : "", pops.size() > 1 ? "s" : "", pop_locations));
     }
 }
 
@@ -235,7 +236,12 @@ void DetectPopsCommand::ProcessFiles(AudioFiles &files) {
         if (m_fix) {
             // Repair mode: only get writable audio if there are pops to fix
             if (!detected_pops.empty()) {
-                RepairPops(f.GetWritableAudio(), detected_pops);
+                // A repair only changes the frame before each detected pop
+                AudioData *audio = nullptr;
+                for (const auto &pop : detected_pops) {
+                    audio = &f.GetWritableAudioFrames(pop.frame > 0 ? pop.frame - 1 : pop.frame, 1);
+                }
+                RepairPops(*audio, detected_pops);
             }
             ReportRepairs(f, detected_pops);
         } else {
@@ -14,6 +14,7 @@ class DetectPopsCommand : public Command {
     CLI::App *CreateCommandCLI(CLI::App &app) override;
     void ProcessFiles(AudioFiles &files) override;
     std::string GetName() const override { return "DetectPops"; }
+    bool ProcessesFilesIndependently() const override { return true; }
 
     bool AllowsOutputFolder() const override { return m_fix; }
     bool AllowsSingleOutputFile() const override { return m_fix; }
@@ -7,6 +7,7 @@
 #include <fmt/core.h>
 
 #include "midi_pitches.h"
+#include "pattern_cache.h"
 #include "test_helpers.h"
 
 std::optional<int> GetIntIfValid(std::string_view str) {
@@ -31,8 +32,7 @@ void CLIValidateIntArgIsInRange(const std::string &arg_description, int arg, int
 }
 
 bool IsRegexString(std::string_view str, const std::string &arg_description) {
-    std::regex r(str.data(), str.size());
-    const auto capture_regions = r.mark_count();
+    const auto capture_regions = GetCompiledRegex(std::string(str)).mark_count();
     if (capture_regions == 1) return true;
     if (capture_regions > 1) {
         throw CLI::ValidationError(arg_description, "Argument does not have exactly 1 capture group.");
@@ -226,7 +226,7 @@ void EmbedSamplerInfo::ProcessFiles(AudioFiles &files) {
             GetName(), {},
             "Remove command was specified, removing all sampler metadata from all given files");
         for (auto &f : files) {
-            auto &metadata = f.GetWritableAudio().metadata;
+            auto &metadata = f.GetWritableMetadata().metadata;
             metadata.midi_mapping = std::nullopt;
         }
         return;
@@ -234,7 +234,7 @@ void EmbedSamplerInfo::ProcessFiles(AudioFiles &files) {
 
     for (auto &f : files) {
         const auto filename = GetJustFilenameWithNoExtension(f.GetPath());
-        auto &metadata = f.GetWritableAudio().metadata;
+        auto &metadata = f.GetWritableMetadata().metadata;
         if (!metadata.midi_mapping) metadata.midi_mapping.emplace();
 
         if (!metadata.midi_mapping->sampler_mapping) {
@@ -243,9 +243,8 @@ void EmbedSamplerInfo::ProcessFiles(AudioFiles &files) {
         auto &sampler_mapping = metadata.midi_mapping->sampler_mapping;
 
         auto SetFromFilenameRegexMatch = [&](const std::string &pattern, int &out) {
-            const std::regex r {pattern};
             std::smatch pieces_match;
-            if (std::regex_match(filename, pieces_match, r)) {
+            if (std::regex_match(filename, pieces_match, GetCompiledRegex(pattern))) {
                 assert(pieces_match.size() == 2); // should be validated by the CLI parsing
                 auto o = GetIntIfValid(pieces_match[1].str());
                 if (!o) {
@@ -271,7 +270,7 @@ void EmbedSamplerInfo::ProcessFiles(AudioFiles &files) {
             SetFromFilenameRegexMatch(m_root_regex_pattern.value(), metadata.midi_mapping->root_midi_note);
         } else if (m_root_auto_detect_name) {
             int midi_note = 60;
-            if (auto pitch = f.GetAudio().DetectPitch()) {
+            if (auto pitch = f.GetAnalysisAudio().DetectPitch()) {
                 midi_note = FindClosestMidiPitch(*pitch).midi_note;
             }
 
@@ -320,15 +319,17 @@ void EmbedSamplerInfo::ProcessFiles(AudioFiles &files) {
 
     if (m_note_range_auto_map) {
         for (auto &[parent_path, files_in_folder] : files.Folders()) {
-            auto sorted_files = files_in_folder;
+            std::vector<EditTrackedAudioFile *> sorted_files(files_in_folder.begin(), files_in_folder.end());
             std::sort(sorted_files.begin(), sorted_files.end(), [](const auto &a, const auto &b) {
                 return a->GetAudio().metadata.midi_mapping->root_midi_note <
                        b->GetAudio().metadata.midi_mapping->root_midi_note;
             });
 
             if (sorted_files.size() == 1) {
-                sorted_files[0]->GetWritableAudio().metadata.midi_mapping->sampler_mapping->low_note = 0;
-                sorted_files[0]->GetWritableAudio().metadata.midi_mapping->sampler_mapping->high_note = 127;
+                auto &sampler_mapping =
+                    *sorted_files[0]->GetWritableMetadata().metadata.midi_mapping->sampler_mapping;
+                sampler_mapping.low_note = 0;
+                sampler_mapping.high_note = 127;
             } else {
                 struct MappingData {
                     int root;
@@ -346,8 +347,8 @@ void EmbedSamplerInfo::ProcessFiles(AudioFiles &files) {
 
                 auto MapFile = [&](EditTrackedAudioFile &f, MappingData prev, MappingData next) {
                     auto this_data = GetMappingData(f);
-                    f.GetWritableAudio().metadata.midi_mapping->sampler_mapping->low_note = prev.high + 1;
-                    f.GetWritableAudio().metadata.midi_mapping->sampler_mapping->high_note =
+                    f.GetWritableMetadata().metadata.midi_mapping->sampler_mapping->low_note = prev.high + 1;
+                    f.GetWritableMetadata().metadata.midi_mapping->sampler_mapping->high_note =
                         this_data.root + (next.root - this_data.root) / 2;
                 };
 
@@ -361,7 +362,7 @@ void EmbedSamplerInfo::ProcessFiles(AudioFiles &files) {
                                 GetMappingData(*sorted_files[i + 1]));
                     }
                 }
-                sorted_files.back()->GetWritableAudio().metadata.midi_mapping->sampler_mapping->high_note =
+                sorted_files.back()->GetWritableMetadata().metadata.midi_mapping->sampler_mapping->high_note =
                     127;
             }
         }
@@ -8,6 +8,9 @@ class EmbedSamplerInfo : public Command {
     void ProcessFiles(AudioFiles &files) override;
 
     std::string GetName() const override { return "Sample Info Embedder"; }
+    std::string ShardGroupKey(const EditTrackedAudioFile &file) const override {
+        return file.OriginalPath().parent_path().generic_string();
+    }
 
   private:
     bool m_remove_embedded_info {false};
@@ -47,7 +47,7 @@ CLI::App *FadeCommand::CreateCommandCLI(CLI::App &app) {
 }
 
 static double GetFade(const FadeCommand::Shape shape, const s64 x_index, const s64 size) {
-    REQUIRE(size);
+    assert(size);
     if (x_index == 0) return 0;
     if (x_index == size) return 1;
 
@@ -77,7 +77,7 @@ static double GetFade(const FadeCommand::Shape shape, const s64 x_index, const s
         case FadeCommand::Shape::Sqrt: {
             return std::sqrt(x);
         }
-        default: REQUIRE(0);
+        default: assert(0);
     }
     return 0;
 }
@@ -100,12 +100,12 @@ void FadeCommand::PerformFade(AudioData &audio,
 
 void FadeCommand::ProcessFiles(AudioFiles &files) {
     for (auto &f : files) {
-        auto &audio = f.GetWritableAudio();
+        const auto &audio = f.GetAudio();
         if (m_fade_in_duration) {
             const auto fade_in_frames =
                 std::min(audio.NumFrames() - 1,
                          m_fade_in_duration->GetDurationAsFrames(audio.sample_rate, audio.NumFrames()));
-            PerformFade(audio, 0, (s64)fade_in_frames, m_fade_in_shape);
+            PerformFade(f.GetWritableAudioFrames(0, fade_in_frames), 0, (s64)fade_in_frames, m_fade_in_shape);
 
             MessageWithNewLine(GetName(), f, "Fading in {} frames with a {} curve", fade_in_frames,
                                magic_enum::enum_name(m_fade_in_shape));
@@ -115,7 +115,8 @@ void FadeCommand::ProcessFiles(AudioFiles &files) {
                 m_fade_out_duration->GetDurationAsFrames(audio.sample_rate, audio.NumFrames());
             const auto last = (s64)audio.NumFrames() - 1;
             const auto start_frame = std::max<s64>(0, (s64)last - (s64)fade_out_frames);
-            PerformFade(audio, last, start_frame, m_fade_out_shape);
+            PerformFade(f.GetWritableAudioFrames((usize)start_frame, audio.NumFrames() - (usize)start_frame),
+                        last, start_frame, m_fade_out_shape);
 
             MessageWithNewLine(GetName(), f, "Fading out {} frames with a {} curve", fade_out_frames,
                                magic_enum::enum_name(m_fade_out_shape));
@@ -9,6 +9,7 @@ class FadeCommand final : public Command {
     enum class Shape { Linear, Sine, SCurve, Log, Exp, Sqrt };
 
     std::string GetName() const override { return "Fade"; }
+    bool ProcessesFilesIndependently() const override { return true; }
     CLI::App *CreateCommandCLI(CLI::App &app) override;
     void ProcessFiles(AudioFiles &files) override;
 
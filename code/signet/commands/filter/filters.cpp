@@ -5,42 +5,46 @@
 #include "audio_files.h"
 #include "common.h"
 #include "filter.h"
+#include "test_helpers.h"
 
 void FilterProcessFiles(AudioFiles &files,
                         const Filter::RBJType type,
                         const double cutoff,
-                        const double Q,
-                        const double gain_db) {
+                        const int slope_db_per_octave,
+                        const bool linkwitz_riley) {
     for (auto &f : files) {
         auto &audio = f.GetWritableAudio();
-
-        Filter::Params params;
-        Filter::Coeffs coeffs;
-        Filter::SetParamsAndCoeffs(Filter::Type::RBJ, params, coeffs, (int)type, (double)audio.sample_rate,
-                                   cutoff, Q, gain_db);
-
-        for (unsigned chan = 0; chan < audio.num_channels; ++chan) {
-            Filter::Data data {};
-            for (size_t frame = 0; frame < audio.NumFrames(); ++frame) {
-                auto &v = audio.GetSample(chan, frame);
-                v = Filter::Process(data, coeffs, v);
-            }
-        }
+        const auto sections = Filter::PassFilterSections(type, (double)audio.sample_rate, cutoff,
+                                                         slope_db_per_octave, linkwitz_riley);
+        Filter::ProcessInterleaved(sections, audio.interleaved_samples.data(), audio.NumFrames(),
+                                   audio.num_channels);
     }
 }
 
+static void AddSlopeOptions(CLI::App *filter, int &slope, bool &linkwitz_riley) {
+    filter
+        ->add_option("--slope", slope,
+                     "How steeply the filter cuts, in dB per octave: 12, 24 or 48. Steeper filters are made from several filters in a row, which are all applied in a single pass over the audio.")
+        ->check(CLI::IsMember({12, 24, 48}))
+        ->capture_default_str();
+    filter->add_flag(
+        "--linkwitz-riley", linkwitz_riley,
+        "Use a Linkwitz-Riley filter rather than a Butterworth filter. It is 6dB down at the cutoff rather than 3dB, so a lowpass and a highpass at the same cutoff add up to a flat frequency response, as in a crossover. At 12dB per octave, 1 of the 2 must be inverted for this.");
+}
+
 CLI::App *HighpassCommand::CreateCommandCLI(CLI::App &app) {
     auto hp = app.add_subcommand("highpass", R"aa(Removes frequencies below the given cutoff.)aa");
 
     hp->add_option("cutoff-freq-hz", m_cutoff,
                    "The cutoff point where frequencies below this should be removed.")
         ->required();
+    AddSlopeOptions(hp, m_slope, m_linkwitz_riley);
 
     return hp;
 }
 
 void HighpassCommand::ProcessFiles(AudioFiles &files) {
-    FilterProcessFiles(files, Filter::RBJType::HighPass, m_cutoff, Filter::default_q_factor, 0);
+    FilterProcessFiles(files, Filter::RBJType::HighPass, m_cutoff, m_slope, m_linkwitz_riley);
 }
 
 CLI::App *LowpassCommand::CreateCommandCLI(CLI::App &app) {
@@ -50,10 +54,58 @@ CLI::App *LowpassCommand::CreateCommandCLI(CLI::App &app) {
     lp->add_option("cutoff-freq-hz", m_cutoff,
                    "The cutoff point where frequencies above this should be removed.")
         ->required();
+    AddSlopeOptions(lp, m_slope, m_linkwitz_riley);
 
     return lp;
 }
 
 void LowpassCommand::ProcessFiles(AudioFiles &files) {
-    FilterProcessFiles(files, Filter::RBJType::LowPass, m_cutoff, Filter::default_q_factor, 0);
+    FilterProcessFiles(files, Filter::RBJType::LowPass, m_cutoff, m_slope, m_linkwitz_riley);
+}
+
+TEST_CASE("FilterCommands") {
+    // The level in dB of a sine after it has been filtered, ignoring the start where the filter settles
+    const auto FilteredLevel = [](const std::string &command, double hz) {
+        const auto sine = TestHelpers::CreateSineWaveAtFrequency(2, 44100, 0.5, hz);
+        const auto out = command.rfind("highpass", 0) == 0
+                             ? TestHelpers::ProcessBufferWithCommand<HighpassCommand>(command, sine)
+                             : TestHelpers::ProcessBufferWithCommand<LowpassCommand>(command, sine);
+        REQUIRE(out);
+        double in_squares = 0;
+        double out_squares = 0;
+        for (usize frame = out->NumFrames() / 2; frame < out->NumFrames(); ++frame) {
+            in_squares += sine.GetSample(0, frame) * sine.GetSample(0, frame);
+            out_squares += out->GetSample(0, frame) * out->GetSample(0, frame);
+            REQUIRE(out->GetSample(0, frame) == out->GetSample(1, frame));
+        }
+        return AmpToDB(std::sqrt(out_squares / in_squares));
+    };
+
+    SUBCASE("the pass band is unchanged") {
+        for (const auto slope : {"12", "24", "48"}) {
+            CAPTURE(slope);
+            REQUIRE(std::abs(FilteredLevel(std::string("lowpass 2000 --slope ") + slope, 200)) < 0.05);
+            REQUIRE(std::abs(FilteredLevel(std::string("highpass 200 --slope ") + slope, 2000)) < 0.05);
+        }
+    }
+
+    SUBCASE("2 octaves into the stop band is cut by at least twice the slope") {
+        REQUIRE(FilteredLevel("lowpass 1000", 4000) < -24);
+        REQUIRE(FilteredLevel("lowpass 1000 --slope 24", 4000) < -48);
+        REQUIRE(FilteredLevel("lowpass 1000 --slope 48", 4000) < -96);
+        REQUIRE(FilteredLevel("highpass 1000 --slope 24", 250) < -48);
+    }
+
+    SUBCASE("the level at the cutoff") {
+        REQUIRE(FilteredLevel("lowpass 1000 --slope 24", 1000) == doctest::Approx(-3).epsilon(0.02));
+        REQUIRE(FilteredLevel("lowpass 1000 --slope 24 --linkwitz-riley", 1000) ==
+                doctest::Approx(-6).epsilon(0.02));
+        REQUIRE(FilteredLevel("highpass 1000 --slope 12 --linkwitz-riley", 1000) ==
+                doctest::Approx(-6).epsilon(0.02));
+    }
+
+    SUBCASE("other slopes are not allowed") {
+        const auto sine = TestHelpers::CreateSineWaveAtFrequency(1, 44100, 0.1, 100);
+        REQUIRE_THROWS(TestHelpers::ProcessBufferWithCommand<LowpassCommand>("lowpass 1000 --slope 36", sine));
+    }
 }
@@ -3,20 +3,23 @@
 #include "filter.h"
 #include "command.h"
 
-void FilterProcessFiles(const tcb::span<EditTrackedAudioFile> files,
+void FilterProcessFiles(AudioFiles &files,
                         Filter::RBJType type,
                         double cutoff,
-                        double Q,
-                        double gain_db);
+                        int slope_db_per_octave,
+                        bool linkwitz_riley);
 
 class HighpassCommand final : public Command {
   public:
     CLI::App *CreateCommandCLI(CLI::App &app) override;
     void ProcessFiles(AudioFiles &files) override;
     std::string GetName() const override { return "Highpass"; }
+    bool ProcessesFilesIndependently() const override { return true; }
 
   private:
     double m_cutoff;
+    int m_slope = 12;
+    bool m_linkwitz_riley = false;
 };
 
 class LowpassCommand final : public Command {
@@ -24,7 +27,10 @@ class LowpassCommand final : public Command {
     CLI::App *CreateCommandCLI(CLI::App &app) override;
     void ProcessFiles(AudioFiles &files) override;
     std::string GetName() const override { return "Lowpass"; }
+    bool ProcessesFilesIndependently() const override { return true; }
 
   private:
     double m_cutoff;
+    int m_slope = 12;
+    bool m_linkwitz_riley = false;
 };
@@ -8,6 +8,12 @@
 class FixPitchDriftCommand final : public Command {
   public:
     std::string GetName() const override { return "FixPitchDrift"; }
+    bool ProcessesFilesIndependently() const override {
+        return m_identical_processing_set.ProcessesFilesIndependently();
+    }
+    std::string ShardGroupKey(const EditTrackedAudioFile &file) const override {
+        return m_identical_processing_set.ShardGroupKey(file.OriginalPath());
+    }
     CLI::App *CreateCommandCLI(CLI::App &app) override;
     void ProcessFiles(AudioFiles &files) override;
 
@@ -3,13 +3,14 @@
 #include <algorithm>
 
 #include "doctest.hpp"
-#include "dywapitchtrack/dywapitchtrack.h"
 
 #include "common.h"
 #include "defer.h"
 #include "gain_calculators.h"
+#include "pitch_tracker.h"
 #include "test_helpers.h"
 #include "tests_config.h"
+#include "thread_pool.h"
 
 class SmoothingFilter {
   public:
@@ -65,19 +66,20 @@ PitchDriftCorrector::PitchDriftCorrector(const AudioData &data,
 
     const auto chunk_seconds = m_chunk_length_milliseconds / 1000.0;
     const auto chunk_frames = (usize)(chunk_seconds * data.sample_rate);
-    for (usize frame = 0; frame < mono_signal.size(); frame += chunk_frames) {
+    // Each chunk is detected on its own, so they are spread across the threads
+    const auto engine = g_pitch_engine;
+    m_chunks.resize((mono_signal.size() + chunk_frames - 1) / chunk_frames);
+    ParallelFor(m_chunks.size(), [&](usize i) {
+        const auto frame = i * chunk_frames;
         const auto chunk_size = (int)std::min(chunk_frames, mono_signal.size() - frame);
-        dywapitchtracker pitch_tracker;
-        dywapitch_inittracking(&pitch_tracker);
-        auto detected_pitch = dywapitch_computepitch(&pitch_tracker, const_cast<double *>(mono_signal.data()),
-                                                     (int)frame, chunk_size);
-        detected_pitch *= static_cast<double>(data.sample_rate) / 44100.0;
-        m_chunks.push_back({
+        const auto estimate = GetPitchTracker(engine).DetectPitch(mono_signal.data() + frame,
+                                                                  (usize)chunk_size, data.sample_rate);
+        m_chunks[i] = {
             frame,
             chunk_size,
-            detected_pitch,
-        });
-    }
+            estimate.hz,
+        };
+    });
 
     if constexpr (k_brute_force_fix_octave_errors) {
         if (const auto whole_file_pitch = mono_data.DetectPitch(); whole_file_pitch) {
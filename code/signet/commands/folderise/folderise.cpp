@@ -5,6 +5,7 @@
 #include "audio_file_io.h"
 #include "common.h"
 #include "midi_pitches.h"
+#include "pattern_cache.h"
 #include "string_utils.h"
 #include "test_helpers.h"
 
@@ -49,9 +50,8 @@ void FolderiseCommand::ProcessFiles(AudioFiles &files) {
     for (auto &f : files) {
         const auto filename = GetJustFilenameWithNoExtension(f.GetPath());
 
-        const std::regex r {m_filename_pattern};
         std::smatch pieces_match;
-        if (std::regex_match(filename, pieces_match, r)) {
+        if (std::regex_match(filename, pieces_match, GetCompiledRegex(m_filename_pattern))) {
             std::string output_folder = m_out_folder;
             for (size_t i = 0; i < pieces_match.size(); ++i) {
                 const std::ssub_match sub_match = pieces_match[i];
@@ -33,7 +33,7 @@ double GainAmount::GetMultiplier() const {
             const auto db = AmpToDB(m_value / 100);
             return DBToAmp(db);
         }
-        default: REQUIRE(0);
+        default: assert(0);
     }
     return 1;
 }
@@ -23,6 +23,7 @@ class GainCommand final : public Command {
     CLI::App *CreateCommandCLI(CLI::App &app) override;
     void ProcessFiles(AudioFiles &files) override;
     std::string GetName() const override { return "Gain"; }
+    bool ProcessesFilesIndependently() const override { return true; }
 
   private:
     GainAmount m_gain;
@@ -93,7 +93,7 @@ static void ExportMetadata(AudioFiles &files, const std::string &command_name) {
                 continue;
             }
         }
-        fmt::print(stdout, "{}\n", line.dump());
+        PrintCommandOutput(line.dump() + "\n");
     }
 }
 
@@ -173,7 +173,7 @@ static void ImportMetadata(AudioFiles &files,
             ErrorWithNewLine(command_name, f, "Failed to parse metadata: {}", err);
             return;
         }
-        f.GetWritableAudio().metadata = std::move(new_meta);
+        f.GetWritableMetadata().metadata = std::move(new_meta);
         MessageWithNewLine(command_name, f, "Metadata replaced");
     };
 
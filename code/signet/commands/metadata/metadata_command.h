@@ -10,6 +10,9 @@ class MetadataCommand final : public Command {
     bool IsReadOnly() const override { return m_mode != Mode::Import; }
     bool AllowsOutputFolder() const override { return m_mode == Mode::Import; }
     bool AllowsSingleOutputFile() const override { return m_mode == Mode::Import; }
+    std::string ShardGroupKey(const EditTrackedAudioFile &file) const override {
+        return file.OriginalPath().generic_string();
+    }
 
   private:
     enum class Mode { None, Export, Import };
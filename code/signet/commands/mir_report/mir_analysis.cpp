@@ -133,11 +133,17 @@ nlohmann::json ComputePitchTrack(const AudioData &audio, int columns) {
 
     if (columns <= 0 || audio.NumFrames() == 0 || audio.sample_rate == 0) return out;
 
-    const auto track = audio.DetectPitchTrack();
-    if (track.empty()) return out;
     if (total_seconds <= 0.0) return out;
     const double col_seconds = total_seconds / (double)columns;
 
+    // When the columns are narrower than a chunk, the chunks overlap so that there is a pitch for more of
+    // the columns. This is limited so that short files with many columns do not do a great deal more work.
+    constexpr double max_overlaps = 4;
+    const auto chunk_seconds = AudioData::pitch_track_chunk_seconds;
+    const auto hop_seconds = std::clamp(col_seconds, chunk_seconds / max_overlaps, chunk_seconds);
+    const auto track = audio.DetectPitchTrack(chunk_seconds, hop_seconds);
+    if (track.empty()) return out;
+
     size_t idx = 0;
     for (int c = 0; c < columns; ++c) {
         const double t_hi = (c == columns - 1) ? total_seconds + 1.0 : (double)(c + 1) * col_seconds;
@@ -202,12 +208,13 @@ nlohmann::json ComputeEnvelope(const AudioData &audio, int columns) {
 
 } // namespace
 
-nlohmann::json Analyse(const AudioData &audio, int envelope_columns, int spectrum_bands) {
+nlohmann::json
+Analyse(const AudioData &audio, const AudioData &analysis_audio, int envelope_columns, int spectrum_bands) {
     nlohmann::json j;
     j["length_seconds"] = (double)audio.NumFrames() / (double)audio.sample_rate;
     j["channels"] = audio.num_channels;
 
-    if (auto const pitch = audio.DetectPitchWithConfidence()) {
+    if (auto const pitch = analysis_audio.DetectPitchWithConfidence()) {
         const auto note = FindClosestMidiPitch(pitch->hz);
         j["pitch"] = {
             {"hz", pitch->hz},
@@ -229,7 +236,7 @@ nlohmann::json Analyse(const AudioData &audio, int envelope_columns, int spectru
     const auto mag = AveragedMagnitudes(mono);
     j["spectrum"] = BinMagnitudesToBands(mag, (double)audio.sample_rate, spectrum_bands);
     j["envelope"] = ComputeEnvelope(audio, envelope_columns);
-    j["pitch_track"] = ComputePitchTrack(audio, envelope_columns);
+    j["pitch_track"] = ComputePitchTrack(analysis_audio, envelope_columns);
     return j;
 }
 
@@ -6,7 +6,9 @@ struct AudioData;
 
 namespace mir {
 
+// analysis_audio is used for the pitch detection; see CreateAnalysisAudio.
 nlohmann::json Analyse(const AudioData &audio,
+                       const AudioData &analysis_audio,
                        int envelope_columns = 96,
                        int spectrum_bands = 32);
 
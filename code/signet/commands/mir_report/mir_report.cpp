@@ -31,12 +31,15 @@ void MirReportCommand::ProcessFiles(AudioFiles &files) {
     auto report = nlohmann::json::array();
     for (auto &f : files) {
         MessageWithNewLine(GetName(), f, "Analysing");
-        auto entry = mir::Analyse(f.GetAudio());
+        // Loading the audio first means the analysis signal is made from it rather than decoding the file a
+        // second time
+        const auto &audio = f.GetAudio();
+        auto entry = mir::Analyse(audio, f.GetAnalysisAudio());
         entry["path"] = f.OriginalPath().u8string();
         report.push_back(std::move(entry));
     }
 
-    fmt::print(stdout, "{}\n", report.dump(2));
+    PrintCommandOutput(report.dump(2) + "\n");
 }
 
 TEST_CASE("MirReportCommand") {
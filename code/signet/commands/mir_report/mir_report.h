@@ -13,4 +13,7 @@ class MirReportCommand : public Command {
     bool AllowsOutputFolder() const override { return false; }
     bool AllowsSingleOutputFile() const override { return false; }
     bool IsReadOnly() const override { return true; }
+    std::string ShardGroupKey(const EditTrackedAudioFile &file) const override {
+        return file.OriginalPath().generic_string();
+    }
 };
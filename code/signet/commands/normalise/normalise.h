@@ -6,6 +6,7 @@ class NormaliseCommand final : public Command {
     CLI::App *CreateCommandCLI(CLI::App &app) override;
     void ProcessFiles(AudioFiles &files) override;
     std::string GetName() const override { return "Normalise"; }
+    bool ProcessesFilesIndependently() const override { return m_normalise_independently; }
 
   private:
     enum class Mode { Peak, Rms, Energy, Count };
@@ -15,6 +15,7 @@ class PanCommand final : public Command {
     CLI::App *CreateCommandCLI(CLI::App &app) override;
     void ProcessFiles(AudioFiles &files) override;
     std::string GetName() const override { return "Pan"; }
+    bool ProcessesFilesIndependently() const override { return true; }
 
   private:
     PanUnit m_pan {};
@@ -12,6 +12,7 @@
 #include "gain_calculators.h"
 #include "magic_enum.hpp"
 #include "midi_pitches.h"
+#include "pattern_cache.h"
 #include "test_helpers.h"
 
 CLI::App *PrintInfoCommand::CreateCommandCLI(CLI::App &app) {
@@ -185,7 +186,7 @@ nlohmann::json PrintInfoCommand::CalculateFileInfo(EditTrackedAudioFile &file) c
     file_info["crest_factor"] = crest_factor;
 
     if (m_detect_pitch) {
-        if (auto const pitch = file.GetAudio().DetectPitchWithConfidence()) {
+        if (auto const pitch = file.GetAnalysisAudio().DetectPitchWithConfidence()) {
             const auto closest_musical_note = FindClosestMidiPitch(pitch->hz);
             file_info["detected_pitch_hz"] = pitch->hz;
             file_info["detected_pitch_confidence"] = pitch->confidence;
@@ -249,10 +250,7 @@ void PrintInfoCommand::ProcessFiles(AudioFiles &files) {
             }
 
             if (EndsWith(info_text, "\n")) info_text.resize(info_text.size() - 1);
-            PrintMessagePrefix(stdout, GetName());
-            fmt::print(stdout, "Info:\n{}", info_text);
-            PrintFilename(stdout, f);
-            fmt::print(stdout, "\n");
+            PrintCommandResult(GetName(), f, "Info:\n" + info_text);
         }
     } else {
         auto output_json = nlohmann::json::array();
@@ -264,10 +262,9 @@ void PrintInfoCommand::ProcessFiles(AudioFiles &files) {
             auto file_info = CalculateFileInfo(f);
 
             if (m_field_filter_regex) {
-                std::regex filter_regex(*m_field_filter_regex);
                 nlohmann::json filtered_file_info;
                 for (auto it = file_info.begin(); it != file_info.end(); ++it) {
-                    if (std::regex_search(it.key(), filter_regex)) {
+                    if (RegexSearch(*m_field_filter_regex, it.key())) {
                         filtered_file_info[it.key()] = it.value();
                     }
                 }
@@ -283,18 +280,21 @@ void PrintInfoCommand::ProcessFiles(AudioFiles &files) {
         }
 
         switch (m_format) {
-            case Format::Json: fmt::print(stdout, "{}\n", output_json.dump(2)); break;
-            case Format::Lua:
+            case Format::Json: PrintCommandOutput(output_json.dump(2) + "\n"); break;
+            case Format::Lua: {
+                std::string lua;
                 if (g_signet_invocation_args && g_signet_invocation_args->size()) {
-                    fmt::print(stdout, "-- {} ",
-                               fs::path((*g_signet_invocation_args)[0]).filename().generic_string());
+                    lua += fmt::format("-- {} ",
+                                       fs::path((*g_signet_invocation_args)[0]).filename().generic_string());
                     for (size_t i = 1; i < g_signet_invocation_args->size(); ++i) {
-                        fmt::print(stdout, "{} ", (*g_signet_invocation_args)[i]);
+                        lua += fmt::format("{} ", (*g_signet_invocation_args)[i]);
                     }
-                    fmt::print(stdout, "\n");
+                    lua += "\n";
                 }
-                fmt::print(stdout, "return {}\n", JsonToLuaTable(output_json));
+                lua += fmt::format("return {}\n", JsonToLuaTable(output_json));
+                PrintCommandOutput(lua);
                 break;
+            }
         }
     }
 }
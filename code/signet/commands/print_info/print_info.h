@@ -9,6 +9,9 @@ class PrintInfoCommand : public Command {
     void ProcessFiles(AudioFiles &files) override;
     std::string GetName() const override { return "PrintInfo"; }
     bool IsReadOnly() const override { return true; }
+    std::string ShardGroupKey(const EditTrackedAudioFile &file) const override {
+        return file.OriginalPath().generic_string();
+    }
 
   private:
     enum class Format { Text, Json, Lua };
@@ -3,6 +3,7 @@
 #include <regex>
 
 #include "doctest.hpp"
+#include "pattern_cache.h"
 
 void AutoMapper::CreateCLI(CLI::App &rename) {
     auto auto_map = rename.add_subcommand(
@@ -36,11 +37,10 @@ You control the format of the renaming by specifing a pattern containing substit
 }
 
 void AutoMapper::AddToFolderMap(const fs::path &folder, const fs::path &path) {
-    REQUIRE(m_automap_pattern);
+    assert(m_automap_pattern);
     const std::string filename = GetJustFilenameWithNoExtension(path);
     std::smatch pieces_match;
-    std::regex r {*m_automap_pattern};
-    if (std::regex_match(filename, pieces_match, r)) {
+    if (std::regex_match(filename, pieces_match, GetCompiledRegex(*m_automap_pattern))) {
         if (m_root_note_regex_group >= (int)pieces_match.size()) {
             ErrorWithNewLine("Auto-map", path,
                              "the regex pattern does not contain contain the group given {}",
@@ -74,6 +74,7 @@ class AutoMapper {
     void CreateCLI(CLI::App &rename);
     void InitialiseProcessing(AudioFiles &files);
     bool Rename(const EditTrackedAudioFile &file, const fs::path &folder, std::string &filename);
+    bool IsEnabled() const { return m_automap_pattern.has_value(); }
 
   private:
     void AddToFolderMap(const fs::path &folder, const fs::path &path);
@@ -5,6 +5,7 @@
 #include "audio_file_io.h"
 #include "common.h"
 #include "midi_pitches.h"
+#include "pattern_cache.h"
 #include "rename_substitutions.h"
 #include "string_utils.h"
 #include "test_helpers.h"
@@ -61,6 +62,20 @@ Any text added via this command can contain special substitution variables; thes
     return rename;
 }
 
+std::string RenameCommand::ShardGroupKey(const EditTrackedAudioFile &file) const {
+    // The counters number all of the files in order, so the name of each file depends on every other file
+    const auto UsesCounter = [](const std::string &text) {
+        return Contains(text, "<counter>") || Contains(text, "<alpha-counter>");
+    };
+    if ((m_prefix && UsesCounter(*m_prefix)) || (m_suffix && UsesCounter(*m_suffix)) ||
+        (m_regex_pattern && UsesCounter(m_regex_replacement))) {
+        return {};
+    }
+    // The auto-mapper looks at all of the files in a folder together
+    if (m_auto_mapper.IsEnabled()) return file.OriginalPath().parent_path().generic_string();
+    return file.OriginalPath().generic_string();
+}
+
 void RenameCommand::ProcessFiles(AudioFiles &files) {
     m_auto_mapper.InitialiseProcessing(files);
 
@@ -72,9 +87,8 @@ void RenameCommand::ProcessFiles(AudioFiles &files) {
             renamed = m_auto_mapper.Rename(*f, folder, filename) | renamed;
 
             if (m_regex_pattern) {
-                const std::regex r {*m_regex_pattern};
                 std::smatch pieces_match;
-                if (std::regex_match(filename, pieces_match, r)) {
+                if (std::regex_match(filename, pieces_match, GetCompiledRegex(*m_regex_pattern))) {
                     auto replacement = m_regex_replacement;
                     for (size_t i = 0; i < pieces_match.size(); ++i) {
                         const std::ssub_match sub_match = pieces_match[i];
@@ -114,7 +128,7 @@ void RenameCommand::ProcessFiles(AudioFiles &files) {
                     Contains(filename, "<detected-midi-note-octave-minus-1>") ||
                     Contains(filename, "<detected-midi-note-octave-minus-2>") ||
                     Contains(filename, "<detected-midi-note-octave-nearest-to-middle-c>")) {
-                    if (const auto pitch = f->GetAudio().DetectPitch()) {
+                    if (const auto pitch = f->GetAnalysisAudio().DetectPitch()) {
                         const auto closest_musical_note = FindClosestMidiPitch(*pitch);
 
                         Replace(filename, "<detected-pitch>",
@@ -162,7 +176,7 @@ void RenameCommand::ProcessFiles(AudioFiles &files) {
                     }
                 }
 
-                const std::regex re {"<\\w+>"};
+                const auto &re = GetCompiledRegex("<\\w+>");
                 auto var_begin = std::sregex_iterator(filename.begin(), filename.end(), re);
                 auto var_end = std::sregex_iterator();
                 for (std::sregex_iterator i = var_begin; i != var_end; ++i) {
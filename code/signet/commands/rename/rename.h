@@ -14,6 +14,7 @@ class RenameCommand final : public Command {
     void ProcessFiles(AudioFiles &files) override;
     std::string GetName() const override { return "Rename"; }
     bool AllowsSingleOutputFile() const override { return false; }
+    std::string ShardGroupKey(const EditTrackedAudioFile &file) const override;
 
   private:
     AutoMapper m_auto_mapper;
@@ -7,4 +7,5 @@ class ReverseCommand final : public Command {
     CLI::App *CreateCommandCLI(CLI::App &app) override;
     void ProcessFiles(AudioFiles &files) override;
     std::string GetName() const override { return "Reverse"; }
+    bool ProcessesFilesIndependently() const override { return true; }
 };
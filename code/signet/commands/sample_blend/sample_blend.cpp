@@ -10,6 +10,7 @@
 #include "common.h"
 #include "filepath_set.h"
 #include "midi_pitches.h"
+#include "pattern_cache.h"
 #include "string_utils.h"
 #include "test_helpers.h"
 
@@ -102,11 +103,10 @@ void SampleBlendCommand::GenerateFiles(AudioFiles &input_files, SignetBackup &ba
     std::map<fs::path, std::vector<BaseBlendFile>> base_file_folders;
     for (auto [folder, files] : input_files.Folders()) {
         for (auto &f : files) {
-            const std::regex r {m_regex};
             std::smatch pieces_match;
             const auto name = GetJustFilenameWithNoExtension(f->GetPath());
 
-            if (std::regex_match(name, pieces_match, r)) {
+            if (std::regex_match(name, pieces_match, GetCompiledRegex(m_regex))) {
                 if (pieces_match.size() != 2) {
                     ErrorWithNewLine(
                         GetName(), *f,
@@ -10,7 +10,11 @@ class SampleBlendCommand : public Command {
   public:
     CLI::App *CreateCommandCLI(CLI::App &app) override;
     void GenerateFiles(AudioFiles &files, SignetBackup &backup) override;
+    bool GeneratesFiles() const override { return true; }
     std::string GetName() const override { return "SampleBlend"; }
+    std::string ShardGroupKey(const EditTrackedAudioFile &file) const override {
+        return file.OriginalPath().parent_path().generic_string();
+    }
 
     bool AllowsOutputFolder() const override { return false; }
     bool AllowsSingleOutputFile() const override { return true; }
@@ -7,6 +7,7 @@ class SeamlessLoopCommand final : public Command {
     CLI::App *CreateCommandCLI(CLI::App &app) override;
     void ProcessFiles(AudioFiles &files) override;
     std::string GetName() const override { return "SeamlessLoop"; }
+    bool ProcessesFilesIndependently() const override { return true; }
 
   private:
     double m_crossfade_percent;
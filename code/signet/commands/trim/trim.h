@@ -10,6 +10,7 @@ class TrimCommand final : public Command {
     CLI::App *CreateCommandCLI(CLI::App &app) override;
     void ProcessFiles(AudioFiles &files) override;
     std::string GetName() const override { return "Trim"; }
+    bool ProcessesFilesIndependently() const override { return true; }
 
   private:
     std::optional<AudioDuration> m_start_duration;
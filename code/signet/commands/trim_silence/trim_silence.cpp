@@ -1,5 +1,7 @@
 #include "trim_silence.h"
 
+#include <fstream>
+
 #include "magic_enum.hpp"
 
 #include "common.h"
@@ -36,10 +38,19 @@ CLI::App *TrimSilenceCommand::CreateCommandCLI(CLI::App &app) {
     return trim_silence;
 }
 
-std::pair<usize, usize> TrimSilenceCommand::GetLoudRegion(EditTrackedAudioFile &f) const {
-    auto &audio = f.GetAudio();
+TrimSilenceCommand::LoudRegion TrimSilenceCommand::GetLoudRegion(EditTrackedAudioFile &f) const {
+    // A file that cannot be read must not be mistaken for one that is all silence
+    const auto ReadFrames = [&](usize first_frame, usize count, usize *file_num_frames = nullptr) {
+        auto frames = f.GetAudioFrames(first_frame, count, file_num_frames);
+        if (!frames) ErrorWithNewLine(GetName(), f, "could not read the audio");
+        return std::move(*frames);
+    };
+
+    usize num_frames = 0;
+    ReadFrames(0, 0, &num_frames);
+
     usize loud_region_start = 0;
-    usize loud_region_end = audio.NumFrames();
+    usize loud_region_end = num_frames;
     double amp_threshold = 0;
     if (!m_relative_to_peak) {
         amp_threshold = DBToAmp(m_silence_threshold_db);
@@ -50,37 +61,52 @@ std::pair<usize, usize> TrimSilenceCommand::GetLoudRegion(EditTrackedAudioFile &
         amp_threshold = DBToAmp(peak_db + m_silence_threshold_db);
     }
 
+    const auto IsSilent = [&](const AudioData &audio, usize frame) {
+        for (unsigned channel = 0; channel < audio.num_channels; ++channel) {
+            if (std::abs(audio.GetSample(channel, frame)) > amp_threshold) return false;
+        }
+        return true;
+    };
+
+    // We only need to look at the audio up to the first and last loud frames. Blocks of frames are read from
+    // the ends of the file, getting bigger each time, so that a file that has little or no silence to trim
+    // does not need to be decoded in full.
+    static constexpr usize initial_block_frames = 4096;
+    bool found_loud_frame = false;
+
     if (m_region == Region::Start || m_region == Region::Both) {
-        for (usize frame = 0; frame < audio.NumFrames(); ++frame) {
-            bool is_silent = true;
-            for (unsigned channel = 0; channel < audio.num_channels; ++channel) {
-                if (std::abs(audio.GetSample(channel, frame)) > amp_threshold) {
-                    is_silent = false;
+        usize block_size = initial_block_frames;
+        for (usize block_start = 0; block_start < num_frames && !found_loud_frame; block_size *= 2) {
+            const auto block = ReadFrames(block_start, block_size);
+            if (block.IsEmpty()) break;
+            for (usize frame = 0; frame < block.NumFrames(); ++frame) {
+                if (!IsSilent(block, frame)) {
+                    loud_region_start = block_start + frame;
+                    found_loud_frame = true;
                     break;
                 }
             }
-
-            if (!is_silent) {
-                loud_region_start = frame;
-                break;
-            }
+            block_start += block.NumFrames();
         }
     }
 
-    if (m_region == Region::End || m_region == Region::Both) {
-        for (usize frame = audio.NumFrames(); frame-- > 0;) {
-            bool is_silent = true;
-            for (unsigned channel = 0; channel < audio.num_channels; ++channel) {
-                if (std::abs(audio.GetSample(channel, frame)) > amp_threshold) {
-                    is_silent = false;
+    // If the start was searched and it was all silence then so is the end, there's no need to search it again
+    const bool whole_file_is_silent = m_region == Region::Both && !found_loud_frame;
+    if ((m_region == Region::End || m_region == Region::Both) && !whole_file_is_silent) {
+        usize block_size = initial_block_frames;
+        for (usize block_end = num_frames; block_end > 0; block_size *= 2) {
+            const auto block_start = block_end > block_size ? block_end - block_size : 0;
+            const auto block = ReadFrames(block_start, block_end - block_start);
+            bool found = false;
+            for (usize frame = block.NumFrames(); frame-- > 0;) {
+                if (!IsSilent(block, frame)) {
+                    loud_region_end = block_start + frame + 1;
+                    found = true;
                     break;
                 }
             }
-
-            if (!is_silent) {
-                loud_region_end = frame + 1;
-                break;
-            }
+            if (found) break;
+            block_end = block_start;
         }
     }
 
@@ -91,34 +117,32 @@ std::pair<usize, usize> TrimSilenceCommand::GetLoudRegion(EditTrackedAudioFile &
         loud_region_start = 0;
     else
         loud_region_start -= silence_allowence;
-    loud_region_end = std::min(audio.NumFrames(), loud_region_end + 4);
+    loud_region_end = std::min(num_frames, loud_region_end + 4);
 
-    return {loud_region_start, loud_region_end};
+    return {loud_region_start, loud_region_end, num_frames};
 }
 
-void TrimSilenceCommand::ProcessFile(EditTrackedAudioFile &f,
-                                     usize loud_region_start,
-                                     usize loud_region_end) const {
-    auto &audio = f.GetAudio();
+void TrimSilenceCommand::ProcessFile(EditTrackedAudioFile &f, const LoudRegion &region) const {
+    const auto [loud_region_start, loud_region_end, num_frames] = region;
     if (loud_region_start >= loud_region_end) {
         MessageWithNewLine(GetName(), f, "The whole sample is silence - no change will be made");
         return;
     }
-    if (loud_region_start == 0 && loud_region_end == audio.NumFrames()) {
+    if (loud_region_start == 0 && loud_region_end == num_frames) {
         MessageWithNewLine(GetName(), f, "No silence to trim at start or end");
         return;
     }
 
-    if (loud_region_start != 0 && loud_region_end != audio.NumFrames()) {
+    if (loud_region_start != 0 && loud_region_end != num_frames) {
         MessageWithNewLine(GetName(), f, "Removing {} frames from the start and {} frames from the end",
-                           loud_region_start, audio.NumFrames() - loud_region_end);
+                           loud_region_start, num_frames - loud_region_end);
     } else if (loud_region_start) {
         MessageWithNewLine(GetName(), f, "Removing {} frames from the start", loud_region_start);
     } else {
-        MessageWithNewLine(GetName(), f, "Removing {} frames from the end",
-                           audio.NumFrames() - loud_region_end);
+        MessageWithNewLine(GetName(), f, "Removing {} frames from the end", num_frames - loud_region_end);
     }
 
+    auto &audio = f.GetAudio();
     if (m_region == Region::End || m_region == Region::Both) {
         const auto new_size = loud_region_end * audio.num_channels;
         if (audio.interleaved_samples.size() != new_size) {
@@ -140,8 +164,7 @@ void TrimSilenceCommand::ProcessFile(EditTrackedAudioFile &f,
 void TrimSilenceCommand::ProcessFiles(AudioFiles &files) {
     if (!m_identical_processing_set.ShouldProcessInSets()) {
         for (auto &f : files) {
-            const auto [loud_region_start, loud_region_end] = GetLoudRegion(f);
-            ProcessFile(f, loud_region_start, loud_region_end);
+            ProcessFile(f, GetLoudRegion(f));
         }
     } else {
         m_identical_processing_set.ProcessSets(
@@ -154,9 +177,9 @@ void TrimSilenceCommand::ProcessFiles(AudioFiles &files) {
                     return;
                 }
 
-                const auto [loud_region_start, loud_region_end] = GetLoudRegion(*authority_file);
+                const auto loud_region = GetLoudRegion(*authority_file);
                 for (auto f : set) {
-                    ProcessFile(*f, loud_region_start, loud_region_end);
+                    ProcessFile(*f, loud_region);
                 }
             });
     }
@@ -209,4 +232,17 @@ TEST_CASE("[TrimSilenceCommand]") {
         REQUIRE(result->NumFrames() == starting_size - 3);
         REQUIRE(result->interleaved_samples[silence_allowence + 0] == 1.0);
     }
+
+    SUBCASE("a file that cannot be read is an error rather than silence") {
+        const fs::path path = "trim_silence_unreadable.wav";
+        {
+            std::ofstream file {path, std::ios::binary};
+            file << "not a wav file";
+        }
+        std::vector<EditTrackedAudioFile> unreadable;
+        unreadable.emplace_back(path);
+        AudioFiles files {std::move(unreadable)};
+        TrimSilenceCommand command {};
+        REQUIRE_THROWS_AS(command.ProcessFiles(files), SignetError);
+    }
 }
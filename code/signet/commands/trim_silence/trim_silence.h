@@ -10,10 +10,21 @@ class TrimSilenceCommand final : public Command {
     CLI::App *CreateCommandCLI(CLI::App &app) override;
     void ProcessFiles(AudioFiles &files) override;
     std::string GetName() const override { return "TrimSilence"; }
+    bool ProcessesFilesIndependently() const override {
+        return m_identical_processing_set.ProcessesFilesIndependently();
+    }
+    std::string ShardGroupKey(const EditTrackedAudioFile &file) const override {
+        return m_identical_processing_set.ShardGroupKey(file.OriginalPath());
+    }
 
   private:
-    std::pair<usize, usize> GetLoudRegion(EditTrackedAudioFile &f) const;
-    void ProcessFile(EditTrackedAudioFile &f, usize loud_region_start, usize loud_region_end) const;
+    struct LoudRegion {
+        usize start;
+        usize end;
+        usize num_frames;
+    };
+    LoudRegion GetLoudRegion(EditTrackedAudioFile &f) const;
+    void ProcessFile(EditTrackedAudioFile &f, const LoudRegion &region) const;
 
     IdenticalProcessingSet m_identical_processing_set;
     enum class Region { Start, End, Both };
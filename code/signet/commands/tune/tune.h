@@ -7,6 +7,7 @@ class TuneCommand final : public Command {
     CLI::App *CreateCommandCLI(CLI::App &app) override;
     void ProcessFiles(AudioFiles &files) override;
     std::string GetName() const override { return "Tune"; }
+    bool ProcessesFilesIndependently() const override { return true; }
 
   private:
     double m_tune_cents {};
@@ -47,7 +47,7 @@ bool ZeroCrossOffsetCommand::CreateSampleOffsetToNearestZCross(AudioData &audio,
     if (append_skipped_frames_on_end) {
         new_interleaved_samples.insert(new_interleaved_samples.end(), audio.interleaved_samples.begin(),
                                        interleaved_samples_new_start_it);
-        REQUIRE(new_interleaved_samples.size() == audio.interleaved_samples.size());
+        assert(new_interleaved_samples.size() == audio.interleaved_samples.size());
     }
 
     audio.interleaved_samples = new_interleaved_samples;
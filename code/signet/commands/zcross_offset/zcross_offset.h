@@ -23,13 +23,25 @@ class ZeroCrossOffsetCommand final : public Command {
 
     void ProcessFiles(AudioFiles &files) override {
         for (auto &f : files) {
-            auto &audio = f.GetAudio();
-            if (audio.IsEmpty()) continue;
+            // Only the frames that are searched need to be decoded to find out whether the file needs changing
+            usize num_frames = 0;
+            const auto header = f.GetAudioFrames(0, 0, &num_frames);
+            if (!header || !num_frames) continue;
+            const auto search_frames = m_search_size.GetDurationAsFrames(header->sample_rate, num_frames);
+            const auto searched_audio = f.GetAudioFrames(0, search_frames);
+            if (!searched_audio) continue;
+            if (FindFrameNearestToZeroInBuffer(searched_audio->interleaved_samples, searched_audio->NumFrames(),
+                                               searched_audio->num_channels) == 0) {
+                MessageWithNewLine(GetNameInternal(), f, "No start frame change needed");
+                continue;
+            }
+
             CreateSampleOffsetToNearestZCross(f.GetWritableAudio(), m_search_size,
                                               m_append_skipped_frames_on_end);
         }
     }
     std::string GetName() const override { return GetNameInternal(); }
+    bool ProcessesFilesIndependently() const override { return true; }
     static std::string GetNameInternal() { return "ZeroCrossOffset"; }
 
     CLI::App *CreateCommandCLI(CLI::App &app) override {
@@ -0,0 +1,258 @@
+#include "incremental.h"
+
+#include <chrono>
+
+#include "doctest.hpp"
+#include "fmt/format.h"
+#include "json.hpp"
+
+#include "common.h"
+#include "shard.h"
+#include "tests_config.h"
+
+namespace {
+
+// The manifest stores modification times as a count of nanoseconds
+s64 ToNanoseconds(fs::file_time_type time) {
+    return (s64)std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+fs::file_time_type FromNanoseconds(s64 nanoseconds) {
+    return fs::file_time_type {
+        std::chrono::duration_cast<fs::file_time_type::duration>(std::chrono::nanoseconds {nanoseconds})};
+}
+
+std::string ManifestKey(const fs::path &path) {
+    std::error_code ec;
+    return fs::absolute(path, ec).lexically_normal().generic_string();
+}
+
+std::string HashToString(u64 hash) { return fmt::format("{:016x}", hash); }
+
+std::optional<u64> HashFromString(const std::string &str) {
+    if (str.empty() || str.size() > 16) return {};
+    u64 result = 0;
+    for (const auto c : str) {
+        result <<= 4;
+        if (c >= '0' && c <= '9') {
+            result |= (u64)(c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            result |= (u64)(c - 'a' + 10);
+        } else {
+            return {};
+        }
+    }
+    return result;
+}
+
+} // namespace
+
+std::optional<u64> HashFileContents(const fs::path &path) {
+    auto f = OpenFile(path, "rb");
+    if (!f) return {};
+    std::vector<char> buffer(1024 * 1024);
+    u64 hash = k_stable_hash_seed;
+    while (true) {
+        const auto num_read = std::fread(buffer.data(), 1, buffer.size(), f.get());
+        if (num_read == 0) break;
+        hash = StableHash({buffer.data(), num_read}, hash);
+    }
+    if (std::ferror(f.get())) return {};
+    return hash;
+}
+
+u64 CommandChainFingerprint(const std::vector<std::string> &args) {
+    u64 hash = k_stable_hash_seed;
+    for (const auto &arg : args) {
+        // The terminating NUL keeps ["ab", "c"] different from ["a", "bc"]
+        hash = StableHash({arg.c_str(), arg.size() + 1}, hash);
+    }
+    return hash;
+}
+
+std::optional<IncrementalManifest> IncrementalManifest::Load(const fs::path &path, std::string &error) {
+    IncrementalManifest result;
+    if (!fs::exists(path)) return result;
+
+    const auto NotAManifest = [&](std::string_view reason) -> std::optional<IncrementalManifest> {
+        error = fmt::format("{} is not a Signet manifest file: {}", path.generic_string(), reason);
+        return {};
+    };
+
+    nlohmann::json json;
+    try {
+        json = nlohmann::json::parse(ReadEntireFile(path));
+    } catch (const nlohmann::json::exception &e) {
+        return NotAManifest(e.what());
+    }
+    if (!json.is_object() || !json.contains("files") || !json["files"].is_object()) {
+        return NotAManifest("it has no files object");
+    }
+
+    for (const auto &[key, value] : json["files"].items()) {
+        try {
+            const auto content_hash = HashFromString(value.at("hash").get<std::string>());
+            const auto fingerprint = HashFromString(value.at("fingerprint").get<std::string>());
+            if (!content_hash || !fingerprint) return NotAManifest(fmt::format("{} has an invalid hash", key));
+            result.m_entries[key] = Entry {value.at("size").get<u64>(), FromNanoseconds(value.at("mtime").get<s64>()),
+                                           *content_hash, *fingerprint,
+                                           value.at("outputs").get<std::vector<std::string>>()};
+        } catch (const nlohmann::json::exception &e) {
+            return NotAManifest(fmt::format("{} is not valid: {}", key, e.what()));
+        }
+    }
+    return result;
+}
+
+bool IncrementalManifest::Save(const fs::path &path, std::string &error) const {
+    nlohmann::json files = nlohmann::json::object();
+    for (const auto &[key, entry] : m_entries) {
+        files[key] = {
+            {"size", entry.size},
+            {"mtime", ToNanoseconds(entry.modified_time)},
+            {"hash", HashToString(entry.content_hash)},
+            {"fingerprint", HashToString(entry.fingerprint)},
+            {"outputs", entry.outputs},
+        };
+    }
+    const nlohmann::json json {{"version", 1}, {"files", files}};
+
+    // Written to a temporary file first so that an interrupted save never leaves a half-written manifest
+    auto temp_path = path;
+    temp_path += ".tmp";
+    {
+        auto f = OpenFile(temp_path, "wb");
+        const auto text = json.dump(2) + "\n";
+        if (!f || std::fwrite(text.data(), 1, text.size(), f.get()) != text.size()) {
+            error = fmt::format("could not write the manifest file {}", temp_path.generic_string());
+            return false;
+        }
+    }
+    std::error_code ec;
+    fs::rename(temp_path, path, ec);
+    if (ec) {
+        error = fmt::format("could not write the manifest file {}: {}", path.generic_string(), ec.message());
+        fs::remove(temp_path, ec);
+        return false;
+    }
+    return true;
+}
+
+bool IncrementalManifest::IsUpToDate(const fs::path &path, u64 fingerprint) {
+    const auto it = m_entries.find(ManifestKey(path));
+    if (it == m_entries.end()) return false;
+    auto &entry = it->second;
+    if (entry.fingerprint != fingerprint) return false;
+
+    const auto stamp = GetFileStamp(path);
+    if (!stamp || stamp->size != entry.size) return false;
+    if (stamp->last_write_time != entry.modified_time) {
+        const auto hash = HashFileContents(path);
+        if (!hash || *hash != entry.content_hash) return false;
+        // The contents are the same, so the new time can be trusted next time without hashing again
+        entry.modified_time = stamp->last_write_time;
+    }
+
+    for (const auto &output : entry.outputs) {
+        if (!fs::exists(output)) return false;
+    }
+    return true;
+}
+
+void IncrementalManifest::Record(const fs::path &path,
+                                 u64 fingerprint,
+                                 const std::vector<fs::path> &outputs) {
+    const auto key = ManifestKey(path);
+    const auto stamp = GetFileStamp(path);
+    const auto hash = HashFileContents(path);
+    if (!stamp || !hash) {
+        m_entries.erase(key);
+        return;
+    }
+
+    std::vector<std::string> output_keys;
+    for (const auto &output : outputs) {
+        output_keys.push_back(ManifestKey(output));
+    }
+    m_entries[key] = Entry {stamp->size, stamp->last_write_time, *hash, fingerprint, std::move(output_keys)};
+}
+
+void IncrementalManifest::RemoveMissingFiles() {
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        if (!fs::exists(it->first)) {
+            it = m_entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+TEST_CASE("[IncrementalManifest]") {
+    const fs::path folder = "incremental-test-folder";
+    fs::remove_all(folder);
+    fs::create_directories(folder);
+    const auto file = folder / "a.wav";
+    const auto output = folder / "a-copy.wav";
+    const auto manifest_path = folder / "manifest.json";
+    REQUIRE(fs::copy_file(TEST_DATA_DIRECTORY "/test.wav", file));
+    REQUIRE(fs::copy_file(TEST_DATA_DIRECTORY "/test.wav", output));
+
+    std::string error;
+    auto manifest = IncrementalManifest::Load(manifest_path, error);
+    REQUIRE(manifest);
+    REQUIRE(manifest->Size() == 0);
+    REQUIRE(!manifest->IsUpToDate(file, 1));
+
+    manifest->Record(file, 1, {output});
+    REQUIRE(manifest->IsUpToDate(file, 1));
+    REQUIRE(!manifest->IsUpToDate(file, 2));
+
+    SUBCASE("saving and loading") {
+        REQUIRE(manifest->Save(manifest_path, error));
+        auto loaded = IncrementalManifest::Load(manifest_path, error);
+        REQUIRE(loaded);
+        REQUIRE(loaded->IsUpToDate(file, 1));
+
+        { auto f = OpenFile(manifest_path, "wb"); }
+        REQUIRE(!IncrementalManifest::Load(manifest_path, error));
+        REQUIRE(error.size());
+    }
+
+    SUBCASE("touching a file does not make it out of date") {
+        fs::last_write_time(file, fs::last_write_time(file) + std::chrono::hours(1));
+        REQUIRE(manifest->IsUpToDate(file, 1));
+    }
+
+    SUBCASE("changing the contents makes it out of date") {
+        const auto original_time = fs::last_write_time(file);
+        {
+            auto f = OpenFile(file, "r+b");
+            REQUIRE(f);
+            std::fseek(f.get(), -1, SEEK_END);
+            const auto c = (char)std::fgetc(f.get());
+            std::fseek(f.get(), -1, SEEK_END);
+            std::fputc(c ^ 1, f.get());
+        }
+        fs::last_write_time(file, original_time + std::chrono::seconds(1));
+        REQUIRE(!manifest->IsUpToDate(file, 1));
+    }
+
+    SUBCASE("a missing output makes it out of date") {
+        fs::remove(output);
+        REQUIRE(!manifest->IsUpToDate(file, 1));
+    }
+
+    SUBCASE("missing files are forgotten") {
+        fs::remove(file);
+        manifest->RemoveMissingFiles();
+        REQUIRE(manifest->Size() == 0);
+    }
+
+    fs::remove_all(folder);
+}
+
+TEST_CASE("[CommandChainFingerprint]") {
+    REQUIRE(CommandChainFingerprint({"norm", "-3"}) == CommandChainFingerprint({"norm", "-3"}));
+    REQUIRE(CommandChainFingerprint({"norm", "-3"}) != CommandChainFingerprint({"norm", "-1"}));
+    REQUIRE(CommandChainFingerprint({"ab", "c"}) != CommandChainFingerprint({"a", "bc"}));
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "filesystem.hpp"
+#include "types.h"
+
+// Remembers which files a chain of commands has already been run on, so that --incremental can skip the files
+// that have not changed since. For each file it records the size, the modification time, a hash of the
+// contents, a fingerprint of the commands, and the paths of any copies that were written from it. It is saved
+// as a JSON file.
+class IncrementalManifest {
+  public:
+    // Returns an empty manifest if the file does not exist yet. Returns nothing and sets error if the file
+    // exists but is not a manifest.
+    static std::optional<IncrementalManifest> Load(const fs::path &path, std::string &error);
+    bool Save(const fs::path &path, std::string &error) const;
+
+    // True if the file was recorded with the same command fingerprint, has not changed since, and all of the
+    // outputs that were recorded for it still exist. The contents are only hashed if the modification time is
+    // different but the size is the same, such as when a file has been touched or copied over with itself.
+    bool IsUpToDate(const fs::path &path, u64 fingerprint);
+
+    // Records the current state of the file, which has been processed by the commands with the fingerprint
+    void Record(const fs::path &path, u64 fingerprint, const std::vector<fs::path> &outputs);
+
+    // Forgets the files that no longer exist, such as ones that have since been renamed
+    void RemoveMissingFiles();
+
+    usize Size() const { return m_entries.size(); }
+
+  private:
+    struct Entry {
+        u64 size;
+        fs::file_time_type modified_time;
+        u64 content_hash;
+        u64 fingerprint;
+        std::vector<std::string> outputs;
+    };
+
+    std::map<std::string, Entry> m_entries {};
+};
+
+// Identifies the commands of a run by their arguments, so that files are processed again if the commands or
+// their options change
+u64 CommandChainFingerprint(const std::vector<std::string> &args);
+
+// Returns nothing if the file cannot be read
+std::optional<u64> HashFileContents(const fs::path &path);
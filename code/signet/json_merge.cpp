@@ -0,0 +1,180 @@
+#include "json_merge.h"
+
+#include <algorithm>
+#include <set>
+
+#include "doctest.hpp"
+#include "fmt/format.h"
+#include "json.hpp"
+
+#include "types.h"
+
+namespace {
+
+enum class OutputKind { Array, Object, Lines };
+
+std::string_view Trimmed(std::string_view str) {
+    while (str.size() && std::isspace((unsigned char)str.front()))
+        str.remove_prefix(1);
+    while (str.size() && std::isspace((unsigned char)str.back()))
+        str.remove_suffix(1);
+    return str;
+}
+
+std::optional<std::string> PathOf(const nlohmann::json &entry) {
+    if (entry.is_object() && entry.contains("path") && entry["path"].is_string()) return entry["path"];
+    return {};
+}
+
+void SortByPath(std::vector<nlohmann::json> &entries) {
+    std::stable_sort(entries.begin(), entries.end(), [&](const nlohmann::json &a, const nlohmann::json &b) {
+        return PathOf(a).value_or("") < PathOf(b).value_or("");
+    });
+}
+
+} // namespace
+
+std::optional<std::string> MergeJsonOutputs(const std::vector<std::string> &outputs, std::string &error) {
+    std::optional<OutputKind> kind {};
+    std::vector<nlohmann::json> entries;
+    auto merged_object = nlohmann::json::object();
+    std::set<std::string> paths;
+
+    const auto SetKind = [&](OutputKind k, usize output_index) {
+        if (kind && *kind != k) {
+            error = fmt::format("output {} is a different kind of JSON to the ones before it", output_index + 1);
+            return false;
+        }
+        kind = k;
+        return true;
+    };
+
+    // Each file is only in 1 shard, so the same path twice means that the outputs overlap
+    const auto AddPath = [&](const std::string &path) {
+        if (!paths.insert(path).second) {
+            error = fmt::format("the path {} is in more than one of the outputs", path);
+            return false;
+        }
+        return true;
+    };
+    const auto AddEntry = [&](nlohmann::json &&entry) {
+        if (const auto path = PathOf(entry); path && !AddPath(*path)) return false;
+        entries.push_back(std::move(entry));
+        return true;
+    };
+
+    for (usize i = 0; i < outputs.size(); ++i) {
+        const auto output = Trimmed(outputs[i]);
+        if (output.empty()) continue;
+
+        // metadata export prints 1 compact object per line, whereas the others print a single indented value
+        auto whole = nlohmann::json::parse(output.begin(), output.end(), nullptr, false);
+        const bool single_line = output.find('\n') == std::string_view::npos;
+        if (!whole.is_discarded() && whole.is_array()) {
+            if (!SetKind(OutputKind::Array, i)) return {};
+            for (auto &entry : whole) {
+                if (!AddEntry(std::move(entry))) return {};
+            }
+        } else if (!whole.is_discarded() && whole.is_object() && (!single_line || whole.empty())) {
+            if (whole.empty()) continue;
+            if (!SetKind(OutputKind::Object, i)) return {};
+            for (auto &[key, value] : whole.items()) {
+                if (!AddPath(key)) return {};
+                merged_object[key] = std::move(value);
+            }
+        } else {
+            if (!SetKind(OutputKind::Lines, i)) return {};
+            std::string_view remaining = output;
+            while (remaining.size()) {
+                const auto newline = remaining.find('\n');
+                const auto line = Trimmed(remaining.substr(0, newline));
+                remaining =
+                    newline == std::string_view::npos ? std::string_view {} : remaining.substr(newline + 1);
+                if (line.empty()) continue;
+                auto entry = nlohmann::json::parse(line.begin(), line.end(), nullptr, false);
+                if (entry.is_discarded() || !entry.is_object()) {
+                    error = fmt::format("output {} is not JSON that was printed by Signet", i + 1);
+                    return {};
+                }
+                if (!AddEntry(std::move(entry))) return {};
+            }
+        }
+    }
+
+    if (!kind) return std::string {};
+    switch (*kind) {
+        case OutputKind::Array: {
+            SortByPath(entries);
+            return fmt::format("{}\n", nlohmann::json(std::move(entries)).dump(2));
+        }
+        case OutputKind::Object: return fmt::format("{}\n", merged_object.dump(2));
+        case OutputKind::Lines: {
+            SortByPath(entries);
+            std::string result;
+            for (const auto &entry : entries) {
+                result += entry.dump();
+                result += '\n';
+            }
+            return result;
+        }
+    }
+    return {};
+}
+
+TEST_CASE("[MergeJsonOutputs]") {
+    std::string error;
+
+    SUBCASE("arrays") {
+        const auto merged = MergeJsonOutputs(
+            {R"([{"path": "b.wav", "rms": 1}])", "", R"([{"path": "a.wav", "rms": 2}, {"path": "c.wav"}])"},
+            error);
+        REQUIRE(merged);
+        const auto json = nlohmann::json::parse(*merged);
+        REQUIRE(json.size() == 3);
+        REQUIRE(json[0]["path"] == "a.wav");
+        REQUIRE(json[1]["path"] == "b.wav");
+        REQUIRE(json[2]["path"] == "c.wav");
+    }
+
+    SUBCASE("objects keyed by path") {
+        const auto merged = MergeJsonOutputs({"{\n  \"b.wav\": {}\n}", "{}", "{\n  \"a.wav\": {}\n}"}, error);
+        REQUIRE(merged);
+        const auto json = nlohmann::json::parse(*merged);
+        REQUIRE(json.size() == 2);
+        REQUIRE(json.contains("a.wav"));
+        REQUIRE(json.contains("b.wav"));
+    }
+
+    SUBCASE("lines") {
+        const auto merged = MergeJsonOutputs(
+            {"{\"path\":\"b.wav\",\"metadata\":null}\n{\"path\":\"c.wav\",\"metadata\":null}\n",
+             "{\"path\":\"a.wav\",\"metadata\":null}\n"},
+            error);
+        REQUIRE(merged);
+        REQUIRE(*merged == "{\"metadata\":null,\"path\":\"a.wav\"}\n{\"metadata\":null,\"path\":\"b.wav\"}\n"
+                           "{\"metadata\":null,\"path\":\"c.wav\"}\n");
+    }
+
+    SUBCASE("a path in more than one output is an error") {
+        const auto expected_error = "the path a.wav is in more than one of the outputs";
+        REQUIRE(!MergeJsonOutputs({R"([{"path": "a.wav"}])", R"([{"path": "a.wav"}])"}, error));
+        REQUIRE(error == expected_error);
+        REQUIRE(!MergeJsonOutputs({"{\n  \"a.wav\": {}\n}", "{\n  \"a.wav\": {}\n}"}, error));
+        REQUIRE(error == expected_error);
+        REQUIRE(!MergeJsonOutputs({"{\"path\":\"a.wav\",\"metadata\":null}\n",
+                                   "{\"path\":\"a.wav\",\"metadata\":null}\n"},
+                                  error));
+        REQUIRE(error == expected_error);
+    }
+
+    SUBCASE("different kinds cannot be merged") {
+        REQUIRE(!MergeJsonOutputs({R"([{"path": "a.wav"}])", "{\"path\":\"b.wav\",\"metadata\":null}"}, error));
+        REQUIRE(!error.empty());
+    }
+
+    SUBCASE("nothing to merge") {
+        const auto merged = MergeJsonOutputs({"", "\n"}, error);
+        REQUIRE(merged);
+        REQUIRE(merged->empty());
+    }
+}
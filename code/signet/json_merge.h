@@ -0,0 +1,13 @@
+#pragma once
+#include <optional>
+#include <string>
+#include <vector>
+
+// Combines the JSON printed by separate runs of 'mir-report', 'print-info --format json' or 'metadata export',
+// such as one run per --shard, into the same form that a single run over all of the files prints. An array of
+// per-file objects (mir-report and print-info) is combined into one array, an object keyed by path
+// (print-info --path-as-key) into one object, and lines of JSON objects (metadata export) into one set of
+// lines. The per-file entries are sorted by their path. Empty outputs, such as from a shard with no files,
+// are ignored. Returns nothing and sets error if the outputs cannot be combined, including if the same path is
+// in more than one of them.
+std::optional<std::string> MergeJsonOutputs(const std::vector<std::string> &outputs, std::string &error);
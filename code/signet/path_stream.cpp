@@ -0,0 +1,189 @@
+#include "path_stream.h"
+
+#include <cerrno>
+#include <cstring>
+#include <thread>
+
+#ifdef _WIN32
+#include <io.h>
+#define SIGNET_READ _read
+#define SIGNET_FILENO _fileno
+#define SIGNET_DUP _dup
+#define SIGNET_CLOSE _close
+#else
+#include <unistd.h>
+#define SIGNET_READ read
+#define SIGNET_FILENO fileno
+#define SIGNET_DUP dup
+#define SIGNET_CLOSE close
+#endif
+
+#include "doctest.hpp"
+
+#include "common.h"
+#include "defer.h"
+
+void PathListSplitter::AddBytes(std::string_view bytes, std::vector<std::string> &paths) {
+    if (!m_separator) {
+        m_undecided_bytes.append(bytes);
+        if (m_undecided_bytes.find('\0') != std::string::npos) {
+            m_separator = '\0';
+        } else if (m_undecided_bytes.find('\n') != std::string::npos) {
+            m_separator = '\n';
+        } else {
+            return;
+        }
+        const auto undecided_bytes = std::move(m_undecided_bytes);
+        m_undecided_bytes.clear();
+        Split(undecided_bytes, paths);
+        return;
+    }
+    Split(bytes, paths);
+}
+
+void PathListSplitter::Finish(std::vector<std::string> &paths) {
+    if (!m_separator) {
+        m_separator = '\n';
+        Split(m_undecided_bytes, paths);
+        m_undecided_bytes.clear();
+    }
+    EndPath(paths);
+}
+
+void PathListSplitter::Split(std::string_view bytes, std::vector<std::string> &paths) {
+    for (const auto c : bytes) {
+        if (c == *m_separator) {
+            EndPath(paths);
+        } else {
+            m_current.push_back(c);
+        }
+    }
+}
+
+void PathListSplitter::EndPath(std::vector<std::string> &paths) {
+    if (*m_separator == '\n' && !m_current.empty() && m_current.back() == '\r') m_current.pop_back();
+    if (!m_current.empty()) paths.push_back(std::move(m_current));
+    m_current.clear();
+}
+
+PathStream::PathStream(FILE *file, usize max_queued_paths) : m_queue(std::make_shared<Queue>()) {
+    m_queue->max_paths = max_queued_paths;
+    // The thread reads from its own duplicate of the file descriptor so that if it outlives us it never reads
+    // from whatever the descriptor is later changed to, such as the stdin of the next client of 'signet serve'
+    std::thread(ReadPaths, SIGNET_DUP(SIGNET_FILENO(file)), m_queue).detach();
+}
+
+PathStream::~PathStream() {
+    // The reading thread cannot be interrupted if it is waiting for input, so rather than waiting for it we
+    // just tell it to stop; it exits the next time it has any paths to queue.
+    const std::scoped_lock lock {m_queue->mutex};
+    m_queue->stopped = true;
+    m_queue->space_available.notify_all();
+}
+
+std::vector<std::string> PathStream::NextPaths(usize max_paths) {
+    std::unique_lock lock {m_queue->mutex};
+    m_queue->paths_available.wait(lock, [&] { return m_queue->paths.size() || m_queue->input_ended; });
+    if (m_queue->paths.empty() && m_queue->read_error.size()) {
+        ErrorWithNewLine("Signet", {}, "Could not read the list of paths: {}", m_queue->read_error);
+    }
+
+    std::vector<std::string> result;
+    while (result.size() < max_paths && m_queue->paths.size()) {
+        result.push_back(std::move(m_queue->paths.front()));
+        m_queue->paths.pop_front();
+    }
+    m_queue->space_available.notify_all();
+    return result;
+}
+
+void PathStream::ReadPaths(int fd, std::shared_ptr<Queue> queue) {
+    defer { SIGNET_CLOSE(fd); };
+    PathListSplitter splitter;
+    std::vector<std::string> paths;
+    char buffer[4096];
+    bool input_ended = false;
+    std::string read_error;
+    while (!input_ended) {
+        const auto num_read = SIGNET_READ(fd, buffer, sizeof(buffer));
+        if (num_read > 0) {
+            splitter.AddBytes({buffer, (usize)num_read}, paths);
+        } else if (num_read < 0 && errno == EINTR) {
+            continue;
+        } else if (num_read < 0) {
+            // The last path may have been cut short, so it is not used
+            read_error = std::strerror(errno);
+            input_ended = true;
+        } else {
+            splitter.Finish(paths);
+            input_ended = true;
+        }
+
+        std::unique_lock lock {queue->mutex};
+        for (auto &path : paths) {
+            queue->space_available.wait(
+                lock, [&] { return queue->paths.size() < queue->max_paths || queue->stopped; });
+            if (queue->stopped) return;
+            queue->paths.push_back(std::move(path));
+            queue->paths_available.notify_all();
+        }
+        paths.clear();
+        if (input_ended) {
+            queue->input_ended = true;
+            queue->read_error = std::move(read_error);
+            queue->paths_available.notify_all();
+        }
+    }
+}
+
+TEST_CASE("[PathListSplitter]") {
+    const auto SplitInChunks = [](std::string_view bytes, usize chunk_size) {
+        PathListSplitter splitter;
+        std::vector<std::string> paths;
+        for (usize i = 0; i < bytes.size(); i += chunk_size) {
+            splitter.AddBytes(bytes.substr(i, chunk_size), paths);
+        }
+        splitter.Finish(paths);
+        return paths;
+    };
+
+    for (const usize chunk_size : {1, 3, 100}) {
+        CAPTURE(chunk_size);
+        REQUIRE(SplitInChunks("a.wav\nb c.wav\r\n\nd.flac", chunk_size) ==
+                std::vector<std::string> {"a.wav", "b c.wav", "d.flac"});
+        REQUIRE(SplitInChunks(std::string_view {"a.wav\0new\nline.wav\0", 20}, chunk_size) ==
+                std::vector<std::string> {"a.wav", "new\nline.wav"});
+        REQUIRE(SplitInChunks("", chunk_size).empty());
+    }
+}
+
+TEST_CASE("[PathStream]") {
+    SUBCASE("paths are read until the end of the file") {
+        auto file = std::tmpfile();
+        REQUIRE(file);
+        defer { std::fclose(file); };
+        std::fputs("a.wav\nb.wav", file);
+        std::fflush(file);
+        std::rewind(file);
+
+        PathStream stream {file, 16};
+        std::vector<std::string> paths;
+        while (true) {
+            const auto next = stream.NextPaths(16);
+            if (next.empty()) break;
+            paths.insert(paths.end(), next.begin(), next.end());
+        }
+        REQUIRE(paths == std::vector<std::string> {"a.wav", "b.wav"});
+    }
+
+#ifndef _WIN32
+    SUBCASE("a read error is reported rather than treated as the end of the paths") {
+        // Reading from a directory fails with EISDIR
+        auto dir = std::fopen(".", "r");
+        REQUIRE(dir);
+        defer { std::fclose(dir); };
+        PathStream stream {dir, 16};
+        REQUIRE_THROWS_AS(stream.NextPaths(16), SignetError);
+    }
+#endif
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "types.h"
+
+// Splits a list of paths into separate strings as its bytes are given. The paths are separated by newlines
+// (with any \r before the newline removed), or by NUL characters if there is a NUL in the bytes that contain
+// the first separator, such as from 'fd -0'. Empty paths are skipped.
+class PathListSplitter {
+  public:
+    // Appends the paths that the bytes complete to paths
+    void AddBytes(std::string_view bytes, std::vector<std::string> &paths);
+    // Appends the final path, if there is one
+    void Finish(std::vector<std::string> &paths);
+
+  private:
+    void Split(std::string_view bytes, std::vector<std::string> &paths);
+    void EndPath(std::vector<std::string> &paths);
+
+    std::optional<char> m_separator {};
+    std::string m_undecided_bytes {};
+    std::string m_current {};
+};
+
+// Reads a list of paths from a file, such as stdin, on a background thread so that the paths can be used as
+// they arrive rather than waiting for whatever is writing them to finish. At most max_queued_paths are read
+// ahead of the paths that have been taken.
+class PathStream {
+  public:
+    PathStream(FILE *file, usize max_queued_paths);
+    ~PathStream();
+    PathStream(const PathStream &) = delete;
+    PathStream &operator=(const PathStream &) = delete;
+
+    // Blocks until there is at least 1 path or the input has ended. Returns up to max_paths of the paths that
+    // are available; an empty result means that there are no more. If the input ended because it could not be
+    // read, that is reported as an error once the paths before it have been returned.
+    std::vector<std::string> NextPaths(usize max_paths);
+
+  private:
+    // Shared with the reading thread, which may still be blocked reading when the PathStream is destroyed
+    struct Queue {
+        std::mutex mutex {};
+        std::condition_variable paths_available {};
+        std::condition_variable space_available {};
+        std::deque<std::string> paths {};
+        usize max_paths {};
+        bool input_ended = false;
+        bool stopped = false;
+        std::string read_error {};
+    };
+
+    static void ReadPaths(int fd, std::shared_ptr<Queue> queue);
+
+    std::shared_ptr<Queue> m_queue;
+};
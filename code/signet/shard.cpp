@@ -0,0 +1,144 @@
+#include "shard.h"
+
+#include <charconv>
+#include <numeric>
+#include <unordered_map>
+
+#include "doctest.hpp"
+#include "fmt/format.h"
+
+std::optional<Shard> ParseShard(std::string_view text, std::string &error) {
+    const auto ParseNumber = [](std::string_view str) -> std::optional<usize> {
+        usize result {};
+        const auto [end, ec] = std::from_chars(str.data(), str.data() + str.size(), result);
+        if (ec != std::errc {} || end != str.data() + str.size() || str.empty()) return {};
+        return result;
+    };
+
+    const auto slash = text.find('/');
+    if (slash == std::string_view::npos) {
+        error = "the shard must be given as i/N, for example 2/8";
+        return {};
+    }
+    const auto index = ParseNumber(text.substr(0, slash));
+    const auto count = ParseNumber(text.substr(slash + 1));
+    if (!index || !count) {
+        error = "the shard must be given as i/N, for example 2/8";
+        return {};
+    }
+    if (*count == 0 || *index == 0 || *index > *count) {
+        error = "the shard index must be from 1 to the number of shards, for example 1/8 to 8/8";
+        return {};
+    }
+    return Shard {*index - 1, *count};
+}
+
+u64 StableHash(std::string_view text, u64 seed) {
+    // FNV-1a
+    u64 hash = seed;
+    for (const auto c : text) {
+        hash ^= (u8)c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+std::vector<usize>
+GroupFilesByKeys(usize num_files, const std::vector<std::vector<std::string>> &group_keys) {
+    // Union-find of the files that have to stay together
+    std::vector<usize> parents(num_files);
+    std::iota(parents.begin(), parents.end(), usize {0});
+    const auto Root = [&](usize i) {
+        while (parents[i] != i) {
+            parents[i] = parents[parents[i]];
+            i = parents[i];
+        }
+        return i;
+    };
+
+    for (const auto &keys : group_keys) {
+        std::unordered_map<std::string_view, usize> first_file_with_key;
+        for (usize i = 0; i < num_files; ++i) {
+            const auto [it, inserted] = first_file_with_key.try_emplace(keys[i], i);
+            if (!inserted) parents[Root(i)] = Root(it->second);
+        }
+    }
+
+    std::vector<usize> result(num_files);
+    for (usize i = 0; i < num_files; ++i) {
+        result[i] = Root(i);
+    }
+    return result;
+}
+
+std::vector<bool>
+FilesInShard(const Shard &shard, usize num_files, const std::vector<std::vector<std::string>> &group_keys) {
+    const auto groups = GroupFilesByKeys(num_files, group_keys);
+
+    std::vector<const std::string *> smallest_key(num_files, nullptr);
+    for (const auto &keys : group_keys) {
+        for (usize i = 0; i < num_files; ++i) {
+            auto &smallest = smallest_key[groups[i]];
+            if (!smallest || keys[i] < *smallest) smallest = &keys[i];
+        }
+    }
+
+    std::vector<bool> result(num_files);
+    for (usize i = 0; i < num_files; ++i) {
+        const auto key = smallest_key[groups[i]];
+        result[i] = StableHash(key ? *key : std::string_view {}) % shard.count == shard.index;
+    }
+    return result;
+}
+
+TEST_CASE("[Shard]") {
+    SUBCASE("parsing") {
+        std::string error;
+        const auto shard = ParseShard("2/8", error);
+        REQUIRE(shard);
+        REQUIRE(shard->index == 1);
+        REQUIRE(shard->count == 8);
+        for (const auto invalid : {"", "2", "0/8", "9/8", "1/0", "a/8", "1/8x", "-1/8"}) {
+            CAPTURE(invalid);
+            REQUIRE(!ParseShard(invalid, error));
+        }
+    }
+
+    SUBCASE("the hash is stable") { REQUIRE(StableHash("a") == 0xaf63dc4c8601ec8cull); }
+
+    SUBCASE("every file is in exactly 1 shard, and groups stay together") {
+        std::vector<std::string> per_file_keys;
+        std::vector<std::string> folder_keys;
+        for (int folder = 0; folder < 10; ++folder) {
+            for (int file = 0; file < 10; ++file) {
+                per_file_keys.push_back(fmt::format("folder{}/file{}.wav", folder, file));
+                folder_keys.push_back(fmt::format("folder{}", folder));
+            }
+        }
+        const auto num_files = per_file_keys.size();
+
+        using GroupKeys = std::vector<std::vector<std::string>>;
+        for (const auto &group_keys : {GroupKeys {per_file_keys}, GroupKeys {per_file_keys, folder_keys}}) {
+            constexpr usize num_shards = 3;
+            std::vector<int> num_shards_containing(num_files, 0);
+            std::vector<usize> shard_of_file(num_files);
+            for (usize s = 0; s < num_shards; ++s) {
+                const auto in_shard = FilesInShard({s, num_shards}, num_files, group_keys);
+                for (usize i = 0; i < num_files; ++i) {
+                    if (in_shard[i]) {
+                        ++num_shards_containing[i];
+                        shard_of_file[i] = s;
+                    }
+                }
+            }
+            for (const auto n : num_shards_containing) {
+                REQUIRE(n == 1);
+            }
+            if (group_keys.size() == 2) {
+                for (usize i = 0; i < num_files; ++i) {
+                    REQUIRE(shard_of_file[i] == shard_of_file[(i / 10) * 10]);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "types.h"
+
+// One of N parts of the input files, for when the work of a run is split across separate processes or
+// machines with --shard. Which part a file is in depends only on its path (relative to the current folder),
+// so processes that are given the same files but different shard indexes process different files, and
+// together the N shards cover every file exactly once.
+struct Shard {
+    usize index; // from 0
+    usize count;
+};
+
+// Parses text such as "2/8": the second of 8 shards. Returns nothing and sets error if the text is not valid.
+std::optional<Shard> ParseShard(std::string_view text, std::string &error);
+
+// Unlike std::hash, this gives the same result on every machine and for every run. Long data can be hashed in
+// pieces by passing the result for the previous piece as the seed.
+constexpr u64 k_stable_hash_seed = 14695981039346656037ull;
+u64 StableHash(std::string_view text, u64 seed = k_stable_hash_seed);
+
+// Groups the num_files files so that files that share a key for any of the commands (see FilesInShard) are in
+// the same group. Returns the group of each file, which is the index of one of the files in the group.
+std::vector<usize>
+GroupFilesByKeys(usize num_files, const std::vector<std::vector<std::string>> &group_keys);
+
+// Returns which of the num_files files are in the shard. group_keys has a key for every file for each of the
+// commands that are going to be run (see Command::ShardGroupKey). Files that share a key for any of the
+// commands are always in the same shard, and each such group is placed by the hash of the smallest key in it.
+std::vector<bool>
+FilesInShard(const Shard &shard, usize num_files, const std::vector<std::vector<std::string>> &group_keys);
@@ -2,6 +2,7 @@
 
 #include <cstdio>
 #include <functional>
+#include <set>
 
 #ifdef _WIN32
 #include <io.h>
@@ -15,101 +16,39 @@
 
 #include "doctest.hpp"
 
+#include "all_commands.h"
 #include "audio_file_io.h"
 #include "cli_formatter.h"
-#include "commands/add_loop/add_loop.h"
-#include "commands/auto_tune/auto_tune.h"
-#include "commands/convert/convert.h"
-#include "commands/detect_pitch/detect_pitch.h"
-#include "commands/detect_pops/detect_pops.h"
-#include "commands/embed_sampler_info/embed_sampler_info.h"
-#include "commands/fade/fade.h"
-#include "commands/filter/filters.h"
-#include "commands/fix_pitch_drift/fix_pitch_drift_command.h"
-#include "commands/folderise/folderise.h"
-#include "commands/gain/gain.h"
-#include "commands/metadata/metadata_command.h"
-#include "commands/mir_report/mir_report.h"
-#include "commands/move/move.h"
-#include "commands/normalise/normalise.h"
-#include "commands/pan/pan.h"
-#include "commands/print_info/print_info.h"
-#include "commands/rename/rename.h"
-#include "commands/reverse/reverse.h"
-#include "commands/sample_blend/sample_blend.h"
-#include "commands/seamless_loop/seamless_loop.h"
-#include "commands/trim/trim.h"
-#include "commands/trim_silence/trim_silence.h"
-#include "commands/tune/tune.h"
-#include "commands/zcross_offset/zcross_offset.h"
+#include "filepath_set.h"
+#include "json_merge.h"
+#include "path_stream.h"
+#include "pattern_cache.h"
+#include "pitch_tracker.h"
+#include "resampler.h"
+#include "signet_server.h"
 #include "test_helpers.h"
 #include "tests_config.h"
 #include "version.h"
-
-SignetInterface::SignetInterface() {
-    m_commands.push_back(std::make_unique<AddLoopCommand>());
-    m_commands.push_back(std::make_unique<AutoTuneCommand>());
-    m_commands.push_back(std::make_unique<ConvertCommand>());
-    m_commands.push_back(std::make_unique<DetectPitchCommand>());
-    m_commands.push_back(std::make_unique<DetectPopsCommand>());
-    m_commands.push_back(std::make_unique<EmbedSamplerInfo>());
-    m_commands.push_back(std::make_unique<FadeCommand>());
-    m_commands.push_back(std::make_unique<FixPitchDriftCommand>());
-    m_commands.push_back(std::make_unique<FolderiseCommand>());
-    m_commands.push_back(std::make_unique<GainCommand>());
-    m_commands.push_back(std::make_unique<HighpassCommand>());
-    m_commands.push_back(std::make_unique<LowpassCommand>());
-    m_commands.push_back(std::make_unique<MetadataCommand>());
-    m_commands.push_back(std::make_unique<MirReportCommand>());
-    m_commands.push_back(std::make_unique<MoveCommand>());
-    m_commands.push_back(std::make_unique<NormaliseCommand>());
-    m_commands.push_back(std::make_unique<PanCommand>());
-    m_commands.push_back(std::make_unique<PrintInfoCommand>());
-    m_commands.push_back(std::make_unique<RenameCommand>());
-    m_commands.push_back(std::make_unique<ReverseCommand>());
-    m_commands.push_back(std::make_unique<SampleBlendCommand>());
-    m_commands.push_back(std::make_unique<SeamlessLoopCommand>());
-    m_commands.push_back(std::make_unique<TrimCommand>());
-    m_commands.push_back(std::make_unique<TrimSilenceCommand>());
-    m_commands.push_back(std::make_unique<TuneCommand>());
-    m_commands.push_back(std::make_unique<ZeroCrossOffsetCommand>());
-}
-
-std::optional<tcb::span<const char *>> g_signet_invocation_args;
+#include "watch.h"
 
 static bool IsStdinPiped() { return SIGNET_ISATTY(SIGNET_FILENO(stdin)) == 0; }
 
 static std::vector<std::string> ReadPathsFromStdin() {
-    std::string buffer;
+    PathListSplitter splitter;
+    std::vector<std::string> paths;
     char chunk[4096];
     while (true) {
         const size_t n = std::fread(chunk, 1, sizeof(chunk), stdin);
         if (n == 0) break;
-        buffer.append(chunk, n);
+        splitter.AddBytes({chunk, n}, paths);
     }
-
-    const bool nul_separated = buffer.find('\0') != std::string::npos;
-    const char separator = nul_separated ? '\0' : '\n';
-
-    std::vector<std::string> paths;
-    std::string current;
-    for (char c : buffer) {
-        if (c == separator) {
-            if (!nul_separated && !current.empty() && current.back() == '\r') current.pop_back();
-            if (!current.empty()) paths.push_back(std::move(current));
-            current.clear();
-        } else {
-            current.push_back(c);
-        }
-    }
-    if (!nul_separated && !current.empty() && current.back() == '\r') current.pop_back();
-    if (!current.empty()) paths.push_back(std::move(current));
+    splitter.Finish(paths);
     return paths;
 }
 
-void SignetInterface::EnsureInputAudioFilesBuilt() {
-    if (m_input_audio_files_built) return;
-    m_input_audio_files_built = true;
+void SignetInterface::ListInputAudioFiles() {
+    if (m_input_audio_files_listed) return;
+    m_input_audio_files_listed = true;
 
     std::vector<std::string> paths;
     bool stdin_consumed = false;
@@ -136,8 +75,260 @@ void SignetInterface::EnsureInputAudioFilesBuilt() {
     m_input_audio_files = AudioFiles(paths, m_exclude_patterns, m_recursive_directory_search);
 }
 
+static std::vector<std::string> GroupKeys(AudioFiles &files, const Command &command) {
+    std::vector<std::string> keys(files.Size());
+    for (usize i = 0; i < files.Size(); ++i) {
+        keys[i] = command.ShardGroupKey(files[i]);
+    }
+    return keys;
+}
+
+void SignetInterface::EnsureInputAudioFilesBuilt(const std::vector<const Command *> &commands) {
+    if (m_input_audio_files_built) return;
+    m_input_audio_files_built = true;
+    ListInputAudioFiles();
+
+    // Null commands are ones such as script; the commands that a script runs have already been gathered
+    auto group_keys = m_script_group_keys;
+    bool any_read_only_command = m_script_has_read_only_command;
+    for (const auto command : commands) {
+        if (!command) continue;
+        group_keys.push_back(GroupKeys(m_input_audio_files, *command));
+        if (command->IsReadOnly()) any_read_only_command = true;
+    }
+
+    if (m_shard) KeepOnlyFilesInShard(m_input_audio_files, group_keys);
+    StartIncrementalRun(any_read_only_command);
+    if (m_incremental_manifest) SkipUpToDateFiles(m_input_audio_files, group_keys);
+    if (m_max_memory) m_input_audio_files.SetMemoryLimit(*m_max_memory);
+}
+
+// group_keys has the keys of the files for each command; the keys of the files that are removed are removed
+// too
+void SignetInterface::KeepOnlyFilesInShard(AudioFiles &files,
+                                           std::vector<std::vector<std::string>> &group_keys) {
+    const auto in_shard = FilesInShard(*m_shard, files.Size(), group_keys);
+    const auto num_files = files.Size();
+    files.KeepOnly(in_shard);
+    m_num_files_outside_shard += num_files - files.Size();
+
+    for (auto &keys : group_keys) {
+        std::vector<std::string> kept_keys;
+        for (usize i = 0; i < keys.size(); ++i) {
+            if (in_shard[i]) kept_keys.push_back(std::move(keys[i]));
+        }
+        keys = std::move(kept_keys);
+    }
+}
+
+void SignetInterface::StartIncrementalRun(bool any_read_only_command) {
+    if (!m_incremental_manifest) return;
+    if (any_read_only_command) {
+        WarningWithNewLine(
+            "Signet", {},
+            "--incremental is ignored because commands that only print information need to see every file");
+        m_incremental_manifest.reset();
+        return;
+    }
+    m_incremental_fingerprint = IncrementalFingerprint();
+}
+
+// Everything that affects how the files are processed, but not which files are given
+u64 SignetInterface::IncrementalFingerprint() const {
+    std::vector<std::string> args {SIGNET_VERSION};
+    for (usize i = 0; i < m_args.size(); ++i) {
+        const auto &arg = m_args[i];
+        if (arg == "--incremental") {
+            ++i;
+            continue;
+        }
+        if (StartsWith(arg, "--incremental=")) continue;
+        if (std::find(m_input_path_strings.begin(), m_input_path_strings.end(), arg) !=
+            m_input_path_strings.end()) {
+            continue;
+        }
+        args.push_back(arg);
+    }
+    if (!m_script_filepath.empty()) args.push_back(ReadEntireFile(m_script_filepath));
+    return CommandChainFingerprint(args);
+}
+
+// A file is only skipped if every file that it is grouped with is unchanged too, since commands such as norm
+// or rename with a counter change each file based on all of the others.
+void SignetInterface::SkipUpToDateFiles(AudioFiles &files,
+                                        const std::vector<std::vector<std::string>> &group_keys) {
+    const auto groups = GroupFilesByKeys(files.Size(), group_keys);
+    std::vector<bool> group_changed(files.Size(), false);
+    for (usize i = 0; i < files.Size(); ++i) {
+        if (group_changed[groups[i]]) continue;
+        if (!m_incremental_manifest->IsUpToDate(files[i].OriginalPath(), m_incremental_fingerprint)) {
+            group_changed[groups[i]] = true;
+        }
+    }
+
+    std::vector<bool> keep(files.Size());
+    for (usize i = 0; i < files.Size(); ++i) {
+        keep[i] = group_changed[groups[i]];
+    }
+    const auto num_files = files.Size();
+    files.KeepOnly(keep);
+    m_num_unchanged_files_skipped += num_files - files.Size();
+}
+
+void SignetInterface::RecordProcessedFiles(const AudioFiles &files) {
+    for (const auto &f : files) {
+        if (m_output_path || m_single_output_file) {
+            // The input file is left as it is, and a copy is written if it was changed
+            std::vector<fs::path> outputs;
+            if (f.AudioChanged() || f.PathChanged() || f.FormatChanged()) outputs.push_back(f.WrittenPath());
+            m_incremental_manifest->Record(f.OriginalPath(), m_incremental_fingerprint, outputs);
+        } else {
+            // The file is changed where it is, so the next run sees the file as it is now
+            m_incremental_manifest->Record(f.WrittenPath(), m_incremental_fingerprint, {});
+        }
+    }
+}
+
+void SignetInterface::SaveIncrementalManifest() {
+    if (!m_incremental_manifest) return;
+    m_incremental_manifest->RemoveMissingFiles();
+    std::string error;
+    if (!m_incremental_manifest->Save(m_incremental_manifest_path, error)) {
+        WarningWithNewLine("Signet", {}, "{}", error);
+    }
+}
+
+bool SignetInterface::CanStreamInputPaths(const Command &command) const {
+    if (m_input_audio_files_built || m_single_output_file || !command.ProcessesFilesIndependently()) {
+        return false;
+    }
+    if (m_input_path_strings.empty()) return IsStdinPiped();
+    for (const auto &p : m_input_path_strings) {
+        if (p != "-") return false;
+    }
+    return true;
+}
+
+void SignetInterface::ProcessStreamedInputPaths(Command &command) {
+    m_input_audio_files_built = true;
+    m_input_paths_streamed = true;
+
+    // The paths are processed in small batches so that the first files are processed as soon as their paths
+    // arrive, while the reading of paths is limited so that it does not get far ahead of the processing.
+    constexpr usize max_batch_size = 64;
+    constexpr usize max_queued_paths = 4096;
+    PathStream stream {stdin, max_queued_paths};
+
+    MessageWithNewLine("Signet", {}, "Processing files as their paths are read from stdin");
+    StartIncrementalRun(command.IsReadOnly());
+    MessageWithNewLine(command.GetName(), {}, "Starting processing");
+
+    // Files are only processed once, even if their paths are given in different batches
+    std::set<fs::path> seen_paths;
+    // The paths that the files of every batch so far have been left at or written to. A renamed file or one
+    // written to --output-folder must not replace a file from another batch.
+    std::set<fs::path> output_paths;
+    usize num_paths = 0;
+    usize num_audio_edits = 0;
+    usize num_path_edits = 0;
+    while (true) {
+        const auto paths = stream.NextPaths(max_batch_size);
+        if (paths.empty()) break;
+        num_paths += paths.size();
+
+        std::string parse_error;
+        auto filepaths = FilepathSet::CreateFromPaths(paths, m_exclude_patterns, m_recursive_directory_search,
+                                                      &parse_error);
+        if (!filepaths) throw CLI::ValidationError("Input files", parse_error);
+        filepaths->RemoveAndRecordSeenPaths(seen_paths);
+        if (filepaths->Size() == 0) continue;
+
+        AudioFiles files {*filepaths};
+        std::vector<std::vector<std::string>> group_keys {GroupKeys(files, command)};
+        if (m_shard) KeepOnlyFilesInShard(files, group_keys);
+        if (m_incremental_manifest) SkipUpToDateFiles(files, group_keys);
+        if (files.Size() == 0) continue;
+        m_num_streamed_files += files.Size();
+        if (m_max_memory) files.SetMemoryLimit(*m_max_memory);
+        for (auto &f : files) {
+            f.SetDecodeAnalysisAudioDirectly(command.IsReadOnly());
+        }
+
+        command.ProcessFiles(files);
+        command.GenerateFiles(files, m_backup);
+        files.AllowUnloadingAll();
+
+        for (const auto &f : files) {
+            if (f.NumTimesAudioChanged()) ++num_audio_edits;
+            if (f.NumTimesPathChanged()) ++num_path_edits;
+        }
+        if (const auto num_processed = files.GetNumFilesProcessed()) {
+            m_num_streamed_files_processed += num_processed;
+            m_streamed_files_written = true;
+            if (!WriteEditedFiles(files, &output_paths)) {
+                m_streamed_files_write_failed = true;
+                return;
+            }
+        } else if (files.WouldWritingAllFilesCreateConflicts(output_paths)) {
+            m_streamed_files_write_failed = true;
+            return;
+        }
+        if (m_incremental_manifest) RecordProcessedFiles(files);
+    }
+
+    if (num_paths == 0) {
+        throw CLI::ValidationError("Input files",
+                                   "no input files given (provide paths as arguments, or pipe them on stdin)");
+    }
+    if (seen_paths.empty()) {
+        throw CLI::ValidationError("Input files", "there are no files that match the paths given on stdin");
+    }
+    if (m_shard) {
+        MessageWithNewLine("Signet", {}, "Found {} matching files in shard {}/{}", m_num_streamed_files,
+                           m_shard->index + 1, m_shard->count);
+    } else {
+        MessageWithNewLine("Signet", {}, "Found {} matching files", m_num_streamed_files);
+    }
+    if (m_num_unchanged_files_skipped) {
+        MessageWithNewLine("Signet", {}, "Skipped {} files that have not changed since they were last processed",
+                           m_num_unchanged_files_skipped);
+    }
+    MessageWithNewLine(command.GetName(), {}, "Total audio files edited: {}", num_audio_edits);
+    MessageWithNewLine(command.GetName(), {}, "Total audio file paths edited: {}", num_path_edits);
+}
+
+bool SignetInterface::WriteEditedFiles(AudioFiles &files, std::set<fs::path> *other_batch_paths) {
+    if (m_output_path) {
+        for (auto &f : files) {
+            auto const path = f.GetPath();
+
+            auto const relative_path = fs::relative(path);
+            if (!StartsWith(relative_path.u8string(), "..")) {
+                f.SetPath(*m_output_path / relative_path);
+            } else {
+                f.SetPath(*m_output_path / path.filename());
+            }
+        }
+    } else if (m_single_output_file) {
+        REQUIRE(files.Size() == 1);
+        files[0].SetPath(*m_single_output_file);
+    }
+
+    return files.WriteFilesThatHaveBeenEdited(m_backup, m_output_path || m_single_output_file ? true : false,
+                                              other_batch_paths);
+}
+
 int SignetInterface::Main(const int argc, const char *const argv[]) {
     g_signet_invocation_args = tcb::span<const char *>((const char **)argv, (size_t)argc);
+    m_args.assign(argv + 1, argv + argc);
+
+    // Creating every command and its CLI is most of the start-up time, so only the commands that are named in
+    // the arguments are created. All of them are needed for the help, and for a script since its commands are
+    // not known until it is read.
+    const auto needs_all_commands = std::any_of(m_args.begin(), m_args.end(), [](const std::string &arg) {
+        return arg == "-h" || arg == "--help" || arg == "--help-all" || arg == "make-docs" || arg == "script";
+    });
+    m_commands = needs_all_commands ? CreateAllCommands() : CreateCommandsNamedIn(m_args);
 
     CLI::App app {
         R"^^(Signet is a command-line program designed for bulk editing audio files. It has commands for converting, editing, renaming and moving WAV and FLAC files. It also features commands that generate audio files. Signet was primarily designed for people who make sample libraries, but its features can be useful for any type of bulk audio processing.)^^"};
@@ -200,7 +391,8 @@ int SignetInterface::Main(const int argc, const char *const argv[]) {
                       [](const CLI::App *a, const CLI::App *b) { return a->get_name() < b->get_name(); });
 
             std::map<std::string, std::vector<std::string>> command_categories;
-            command_categories["Signet Utility"] = {"undo", "clear-backup", "make-docs", "script"};
+            command_categories["Signet Utility"] = {"undo",       "clear-backup", "make-docs",      "script",
+                                                     "merge-json", "serve",        "resample-report"};
             command_categories["Filepath"] = {"rename", "move", "folderise"};
             command_categories["Audio"] = {
                 "add-loop",     "auto-tune", "fade",          "fix-pitch-drift", "gain",          "highpass",
@@ -257,8 +449,8 @@ int SignetInterface::Main(const int argc, const char *const argv[]) {
                 for (auto l : Split(markdown, "\n", true)) {
                     if (Contains(l, "```")) inside_code_block = !inside_code_block;
                     if (!inside_code_block) {
-                        result +=
-                            std::regex_replace(std::string(l), std::regex("<[a-z0-9-]{2,}>"), "`$&`") + "\n";
+                        const auto &option_regex = GetCompiledRegex("<[a-z0-9-]{2,}>");
+                        result += std::regex_replace(std::string(l), option_regex, "`$&`") + "\n";
                     } else {
                         result += std::string(l) + "\n";
                     }
@@ -308,6 +500,54 @@ int SignetInterface::Main(const int argc, const char *const argv[]) {
             throw CLI::Success();
         });
 
+    {
+        auto serve = app.add_subcommand(
+            "serve",
+            "Keep Signet running in the background, listening for commands on a local socket, for when Signet is run many times in a row, such as by a build system. Run commands through it by putting --connect and the socket path at the start of the arguments, e.g. signet --connect /tmp/signet.sock my-folder norm -3. They behave exactly as if they were run normally - including reading stdin and printing to stdout and stderr - but the start-up of a new process is skipped, and the decoded audio of files is kept in memory so that the same unchanged files do not need to be read again by later commands. The server runs 1 command at a time and stops when it is interrupted (Ctrl+C) or terminated. Not available on Windows.");
+        serve->add_option("--socket", m_server_socket_path, "The path of the socket file to listen on.")
+            ->required();
+        serve
+            ->add_option("--cache-size", m_server_cache_size,
+                         "The maximum size of the decoded audio to keep in memory between commands. Takes a size in bytes, optionally followed by a unit such as MB or GB. The default is 1GB.")
+            ->transform(CLI::AsSizeValue(false));
+        serve->final_callback([&]() {
+            RunSignetServer(m_server_socket_path, m_server_cache_size);
+            success_thrown = true;
+            throw CLI::Success();
+        });
+    }
+
+    // This is handled before the arguments are parsed (see signet_main.cpp); it is only here to be documented
+    app.add_option_function<std::string>(
+           "--connect",
+           [](const std::string &) {
+               throw CLI::ValidationError("--connect", "this must be given before any other arguments");
+           },
+           "Run the rest of the arguments in a Signet process that was started with the serve command, rather than in this one. Takes the socket path that was given to serve. This must be the first argument. If the server cannot be reached, the command is run normally instead.")
+        ->type_name("SOCKET");
+
+    app.add_option(
+           "--watch", m_watch_folder,
+           "Keep running and watch the given folder for audio files that are written or moved into it (or its subfolders if --recursive is given), running the command on just those files each time. Each file is processed once it has not changed for half a second, and the files that are ready at the same time are processed together. Each run is the same as a separate invocation of Signet on those files, so undo undoes the last run. Files that Signet itself writes are not processed again. Do not give any input-files; they come from the folder. Stops when interrupted (Ctrl+C). Only available on Linux.")
+        ->type_name("FOLDER");
+
+    // This runs once everything has been parsed but before any of the commands, which --watch runs again each
+    // time files change rather than now
+    app.parse_complete_callback([&]() {
+        if (m_watch_folder.empty()) return;
+        std::vector<std::string> args {argv[0]};
+        for (usize i = 0; i < m_args.size(); ++i) {
+            if (m_args[i] == "--watch") {
+                ++i;
+            } else if (!StartsWith(m_args[i], "--watch=")) {
+                args.push_back(m_args[i]);
+            }
+        }
+        RunWatchLoop(m_watch_folder, m_recursive_directory_search, args);
+        success_thrown = true;
+        throw CLI::Success();
+    });
+
     g_messages_enabled = true;
     app.add_flag_callback("--silent", []() { g_messages_enabled = false; }, "Disable all messages");
 
@@ -315,6 +555,42 @@ int SignetInterface::Main(const int argc, const char *const argv[]) {
         "--warnings-are-errors", []() { g_warnings_as_errors = true; },
         "Attempt to exit Signet and return a non-zero value as soon as possible if a warning occurs.");
 
+    {
+        const std::map<std::string, BackupCompression> compression_names {{"none", BackupCompression::None},
+                                                                           {"flac", BackupCompression::Flac}};
+        app.add_option_function<BackupCompression>(
+               "--backup-compression",
+               [&](const BackupCompression &compression) { m_backup.SetCompression(compression); },
+               "How the undo backups of files that are about to be overwritten or deleted are stored. 'none' (the default) stores plain copies. 'flac' losslessly compresses integer PCM WAV files into FLAC files, which are typically around half the size; all of the other bytes of the WAV file (such as its metadata chunks) are stored verbatim so that undo restores the exact original file. Files that cannot be FLAC-compressed are stored as plain copies. This is useful when writing backups is slow, such as when the temporary folder is on a different or networked drive.")
+            ->transform(CLI::CheckedTransformer(compression_names, CLI::ignore_case));
+    }
+
+    g_pitch_engine = PitchEngine::Wavelet;
+    {
+        const std::map<std::string, PitchEngine> engine_names {
+            {"wavelet", PitchEngine::Wavelet}, {"yin", PitchEngine::Yin}, {"mpm", PitchEngine::Mpm}};
+        app.add_option_function<PitchEngine>(
+               "--pitch-engine", [](const PitchEngine &engine) { g_pitch_engine = engine; },
+               "The algorithm that commands use to detect pitch, such as detect-pitch, auto-tune, fix-pitch-drift and print-info. 'wavelet' (the default) is a fast wavelet-based detector; because it can be an octave out, the audio is also checked at other octaves to find the most likely pitch. 'yin' and 'mpm' (the McLeod Pitch Method) are based on the autocorrelation of the audio, which they work out with an FFT. They are less prone to octave errors, so they only check the audio once, and they give a more meaningful confidence for each part of the audio, such as in the pitch track of mir-report.")
+            ->transform(CLI::CheckedTransformer(engine_names, CLI::ignore_case));
+    }
+
+    g_resample_quality = ResampleQuality::Standard;
+    {
+        const std::map<std::string, ResampleQuality> quality_names {{"draft", ResampleQuality::Draft},
+                                                                    {"standard", ResampleQuality::Standard},
+                                                                    {"mastering", ResampleQuality::Mastering}};
+        app.add_option_function<ResampleQuality>(
+               "--resample-quality", [](const ResampleQuality &quality) { g_resample_quality = quality; },
+               "The quality of resampling, for commands that change the sample rate or pitch of audio, such as convert sample-rate, tune, auto-tune and sample-blend. 'standard' (the default) is r8brain's 24-bit resampler. 'mastering' has a narrower transition band and more stop-band attenuation, for when every bit of the high frequencies matters. 'draft' is around twice as quick and is for when the audio will not be kept: common ratios whose sample rates are whole numbers with a small common factor, such as 44.1kHz to 48kHz, use a short polyphase filter, and others (including 2x) use r8brain's 16-bit resampler with a relaxed transition band. Run resample-report to see how they compare.")
+            ->transform(CLI::CheckedTransformer(quality_names, CLI::ignore_case));
+    }
+
+    app.add_option(
+           "--max-memory", m_max_memory,
+           "Limit how much memory the decoded audio of the input files can take up. Takes a size in bytes, optionally followed by a unit such as KB, MB or GB (e.g. 2GB). Normally Signet keeps every file in memory once it has been read; with this option, when the limit would be exceeded, the least-recently used files are unloaded: unchanged files are read again when needed and edited files are temporarily stored on disk. This allows very large sets of files to be processed, at the cost of some speed. A single file that is bigger than the limit is still processed.")
+        ->transform(CLI::AsSizeValue(false));
+
     app.add_flag("--recursive", m_recursive_directory_search,
                  "When the input is a directory, scan for files in it recursively.");
 
@@ -327,7 +603,7 @@ int SignetInterface::Main(const int argc, const char *const argv[]) {
 
     app.add_option(
         "input-files", m_input_path_strings,
-        R"aa(The audio files to process. Each input must be a path to an existing file or directory; signet does not do glob expansion itself, so rely on your shell or pipe in paths from a tool like fd. If a directory is given, all audio files directly inside it are processed; use --recursive to also descend into subdirectories. Use - to read paths from stdin (one per line, or NUL-separated). If you pipe paths into signet without specifying any input-files, stdin is read automatically. Use --exclude to drop unwanted paths from the gathered set.)aa");
+        R"aa(The audio files to process. Each input must be a path to an existing file or directory; signet does not do glob expansion itself, so rely on your shell or pipe in paths from a tool like fd. If a directory is given, all audio files directly inside it are processed; use --recursive to also descend into subdirectories. Use - to read paths from stdin (one per line, or NUL-separated). If you pipe paths into signet without specifying any input-files, stdin is read automatically. When stdin is the only input and the command processes each file on its own (such as gain or fade), files are processed in batches as their paths arrive rather than after all of the paths have been read. Use --exclude to drop unwanted paths from the gathered set.)aa");
 
     auto output_folder_option =
         app.add_option(
@@ -346,21 +622,86 @@ int SignetInterface::Main(const int argc, const char *const argv[]) {
                "Write to a single output file rather than overwrite the original. Only valid if there's only 1 input file. If the output file already exists it is overwritten. Directories are created. Some commands do not allow this option - such as move.")
             ->excludes(output_folder_option);
 
+    app.add_option_function<std::string>(
+           "--shard",
+           [&](const std::string &str) {
+               std::string error;
+               m_shard = ParseShard(str, error);
+               if (!m_shard) throw CLI::ValidationError("--shard", error);
+           },
+           "Only process 1 part of the input files, so that the work can be split between several processes or machines. Takes the part to process and the number of parts as i/N, e.g. 2/8 for the second of 8 parts. Which part a file is in is worked out from its path relative to the current folder, so each process should be run from the same folder with the same input-files, only changing i. Files that the command needs to process together are always kept in the same part: such as the files of a folder for embed-sampler-info, or the files of each set when using --sample-sets. Commands that look at all of the files at once (such as norm without --independently) keep all of the files in one part. A part that has no files is not an error. The JSON outputs of each part can be combined with merge-json.")
+        ->type_name("i/N");
+
+    app.add_option_function<std::string>(
+           "--incremental",
+           [&](const std::string &path) {
+               std::string error;
+               m_incremental_manifest_path = path;
+               m_incremental_manifest = IncrementalManifest::Load(path, error);
+               if (!m_incremental_manifest) throw CLI::ValidationError("--incremental", error);
+           },
+           "Skip the files that have not changed since they were last processed by the same command, such as when the same script is run every night over a large set of files. Takes the path of a manifest file where Signet records what it has processed; it is created if it does not exist. For each file, the manifest records its size, modification time and a hash of its contents, the arguments of the command, and the paths of any files that were written from it when using --output-folder or --output-file. A file is skipped if all of these still match and the files written from it still exist. Files are recorded as they are after processing, so a file that was changed in place is not processed again. Files that a command processes together are only skipped if none of them have changed: such as every file for norm without --independently or for rename with a <counter>, the files of each folder for the auto-mapper or embed-sampler-info, or the files of each set when using --sample-sets. Changing the command or any of its options processes every file again. Commands that only print information about the files, such as print-info, always see every file. Use a separate manifest for each --shard.")
+        ->type_name("MANIFEST");
+
     bool printed_input_files_info = false;
     bool any_writable_command_ran = false;
 
+    // The commands that have been given on the command line, in order. Null for subcommands that are not
+    // audio commands, such as script.
+    std::map<const CLI::App *, const Command *> command_of_subcommand;
+    const auto CommandsToRun = [&]() {
+        std::vector<const Command *> result;
+        for (const auto subcommand : app.get_subcommands()) {
+            const auto it = command_of_subcommand.find(subcommand);
+            result.push_back(it != command_of_subcommand.end() ? it->second : nullptr);
+        }
+        return result;
+    };
+
     for (auto &command : m_commands) {
         auto s = command->CreateCommandCLI(app);
-        s->final_callback([&] {
-            EnsureInputAudioFilesBuilt();
-            if (m_single_output_file && m_input_audio_files.Size() != 1) {
+        command_of_subcommand[s] = command.get();
+        s->final_callback([&, s] {
+            if (m_gathering_script_commands) {
+                ListInputAudioFiles();
+                m_script_group_keys.push_back(GroupKeys(m_input_audio_files, *command));
+                if (command->IsReadOnly()) m_script_has_read_only_command = true;
+                return;
+            }
+
+            // When the paths are piped in and the command only ever looks at 1 file at a time, the files can
+            // be processed as the paths arrive rather than waiting for all of them. This is not possible if
+            // there are multiple commands, since each command needs to run on all of the files before the
+            // next.
+            const auto parsed_subcommands = app.get_subcommands();
+            if (parsed_subcommands.size() == 1 && parsed_subcommands[0] == s &&
+                CanStreamInputPaths(*command)) {
+                ProcessStreamedInputPaths(*command);
+                if (!command->IsReadOnly()) any_writable_command_ran = true;
+                return;
+            }
+
+            EnsureInputAudioFilesBuilt(CommandsToRun());
+            const auto num_input_files =
+                m_input_audio_files.Size() + m_num_files_outside_shard + m_num_unchanged_files_skipped;
+            if (m_single_output_file && num_input_files != 1) {
                 throw CLI::ValidationError(
                     "--output-file", "You can only specify one input file when using --output-file");
             }
             // We print the input files message here because we want to allow subcommands to set
             // g_messages_enabled to false, in which case this MessageWithNewLine will correctly be a no-op.
             if (!printed_input_files_info) {
-                MessageWithNewLine("Signet", {}, "Found {} matching files", m_input_audio_files.Size());
+                if (m_shard) {
+                    MessageWithNewLine("Signet", {}, "Found {} matching files in shard {}/{}",
+                                       m_input_audio_files.Size(), m_shard->index + 1, m_shard->count);
+                } else {
+                    MessageWithNewLine("Signet", {}, "Found {} matching files", m_input_audio_files.Size());
+                }
+                if (m_num_unchanged_files_skipped) {
+                    MessageWithNewLine("Signet", {},
+                                       "Skipped {} files that have not changed since they were last processed",
+                                       m_num_unchanged_files_skipped);
+                }
                 printed_input_files_info = true;
             }
 
@@ -373,9 +714,14 @@ int SignetInterface::Main(const int argc, const char *const argv[]) {
                 initial_file_edit_state.push_back({f.NumTimesAudioChanged(), f.NumTimesPathChanged()});
             }
 
+            for (auto &f : m_input_audio_files) {
+                f.SetDecodeAnalysisAudioDirectly(command->IsReadOnly());
+            }
+
             MessageWithNewLine(command->GetName(), {}, "Starting processing");
             command->ProcessFiles(m_input_audio_files);
             command->GenerateFiles(m_input_audio_files, m_backup);
+            m_input_audio_files.AllowUnloadingAll();
             if (!command->IsReadOnly()) any_writable_command_ran = true;
 
             int num_audio_edits = 0;
@@ -397,6 +743,59 @@ int SignetInterface::Main(const int argc, const char *const argv[]) {
         }
     }
 
+    {
+        auto merge_json = app.add_subcommand(
+            "merge-json",
+            "Combine the JSON outputs of separate runs of mir-report, print-info --format json or metadata export into one, as if they were a single run over all of the files. This is for when the work is split up using --shard: save the output of each shard to a file and then pass all of the files to this command. The combined JSON is printed to stdout, with the entries for each file sorted by path.");
+        merge_json
+            ->add_option("json-files", m_merge_json_paths, "The files containing the JSON outputs to combine.")
+            ->required()
+            ->check(CLI::ExistingFile);
+        merge_json->final_callback([&]() {
+            std::vector<std::string> outputs;
+            for (const auto &path : m_merge_json_paths) {
+                outputs.push_back(ReadEntireFile(path));
+            }
+            std::string error;
+            const auto merged = MergeJsonOutputs(outputs, error);
+            if (!merged) throw CLI::ValidationError("merge-json", error);
+            fmt::print(stdout, "{}", *merged);
+            success_thrown = true;
+            throw CLI::Success();
+        });
+    }
+
+    {
+        auto resample_report = app.add_subcommand(
+            "resample-report",
+            "Measure each --resample-quality by resampling test signals, and print how fast and how accurate each one is. Throughput is how many seconds of 1 channel of audio are resampled per second on 1 thread. Pass-band ripple is the difference in dB between the loudest and quietest sines in the pass band after resampling. Aliasing is the loudest output that should not be there, in dB relative to the input: the aliases of sines above the new Nyquist frequency, and anything other than the sine itself for sines in the pass band.");
+        resample_report->add_option("--from", m_resample_report_src_rate, "The sample rate to resample from.")
+            ->check(CLI::PositiveNumber)
+            ->capture_default_str();
+        resample_report->add_option("--to", m_resample_report_dst_rate, "The sample rate to resample to.")
+            ->check(CLI::PositiveNumber)
+            ->capture_default_str();
+        resample_report->final_callback([&]() {
+            const auto src_rate = (double)m_resample_report_src_rate;
+            const auto dst_rate = (double)m_resample_report_dst_rate;
+            fmt::print("Resampling from {} Hz to {} Hz\n\n", src_rate, dst_rate);
+            fmt::print("{:<10} {:>12} {:>18} {:>12}\n", "Quality", "Throughput", "Pass-band ripple", "Aliasing");
+            double passband_hz = 0;
+            for (const auto &[name, quality] : {std::pair {"draft", ResampleQuality::Draft},
+                                                std::pair {"standard", ResampleQuality::Standard},
+                                                std::pair {"mastering", ResampleQuality::Mastering}}) {
+                const auto measurement = MeasureResampleQuality(quality, src_rate, dst_rate);
+                passband_hz = measurement.passband_hz;
+                fmt::print("{:<10} {:>10.0f}x {:>15.2g} dB {:>9.1f} dB\n", name,
+                           measurement.frames_per_second / src_rate, measurement.passband_ripple_db,
+                           measurement.aliasing_db);
+            }
+            fmt::print("\nThe pass band is measured up to {:.0f} Hz.\n", passband_hz);
+            success_thrown = true;
+            throw CLI::Success();
+        });
+    }
+
     {
         auto script = app.add_subcommand(
             "script",
@@ -413,42 +812,61 @@ int SignetInterface::Main(const int argc, const char *const argv[]) {
             Replace(file_data, "\r", "\n");
             auto lines = Split(file_data, "\n", false);
 
-            for (auto line : lines) {
-                while (line.size() && std::isspace(line.front()))
-                    line.remove_prefix(1);
-                while (line.size() && std::isspace(line.back()))
-                    line.remove_suffix(1);
+            const auto RunLines = [&](bool only_audio_commands) {
+                for (auto line : lines) {
+                    while (line.size() && std::isspace(line.front()))
+                        line.remove_prefix(1);
+                    while (line.size() && std::isspace(line.back()))
+                        line.remove_suffix(1);
+
+                    if (line.empty()) continue;
+                    if (line[0] == '#') continue;
+
+                    std::string_view command_name {};
+                    {
+                        size_t pos = 0;
+                        while (pos < line.size() && !std::isspace(line[pos])) {
+                            ++pos;
+                        }
+                        command_name = line.substr(0, pos);
+                    }
 
-                if (line.empty()) continue;
-                if (line[0] == '#') continue;
+                    bool found = false;
+                    for (auto subcommand : app.get_subcommands({})) {
+                        if (subcommand == script) continue;
+                        if (subcommand->get_name() != command_name) continue;
 
-                std::string_view command_name {};
-                {
-                    size_t pos = 0;
-                    while (pos < line.size() && !std::isspace(line[pos])) {
-                        ++pos;
+                        found = true;
+                        if (only_audio_commands && !command_of_subcommand.count(subcommand)) break;
+                        subcommand->clear();
+                        subcommand->parse(std::string(line.substr(command_name.size())));
+                        break;
                     }
-                    command_name = line.substr(0, pos);
-                }
 
-                bool found = false;
-                for (auto subcommand : app.get_subcommands({})) {
-                    if (subcommand == script) continue;
-                    if (subcommand->get_name() != command_name) continue;
-
-                    subcommand->clear();
-                    subcommand->parse(std::string(line.substr(command_name.size())));
-                    found = true;
-                    break;
+                    if (!found && !only_audio_commands) {
+                        WarningWithNewLine("Signet", {}, "Unknown command: {}", command_name);
+                    }
                 }
+            };
 
-                if (!found) {
-                    WarningWithNewLine("Signet", {}, "Unknown command: {}", command_name);
-                }
+            // --shard and --incremental need to know which files each command processes together before any
+            // of the commands are run, so the commands are first parsed without running them
+            if (m_shard || m_incremental_manifest) {
+                m_gathering_script_commands = true;
+                RunLines(true);
+                m_gathering_script_commands = false;
             }
+            RunLines(false);
         });
     }
 
+    const auto stopped_message = [&]() -> std::string_view {
+        if (m_streamed_files_written) {
+            return "The files from the paths before this point have already been saved; run 'signet undo' to undo them.";
+        }
+        return "No files have been changed or saved.";
+    };
+
     const auto PrintSuccess = []() {
         fmt::print(stderr, fmt::fg(fmt::terminal_color::green), "Signet completed successfully.\n");
     };
@@ -456,30 +874,41 @@ int SignetInterface::Main(const int argc, const char *const argv[]) {
     try {
         app.parse(argc, argv);
 
-        if (m_input_audio_files.GetNumFilesProcessed()) {
-            if (m_output_path) {
-                for (auto &f : m_input_audio_files) {
-                    auto const path = f.GetPath();
-
-                    auto const relative_path = fs::relative(path);
-                    if (!StartsWith(relative_path.u8string(), "..")) {
-                        f.SetPath(*m_output_path / relative_path);
-                    } else {
-                        f.SetPath(*m_output_path / path.filename());
-                    }
-                }
-            } else if (m_single_output_file) {
-                REQUIRE(m_input_audio_files.Size() == 1);
-                m_input_audio_files.begin()[0].SetPath(*m_single_output_file);
+        if (m_input_paths_streamed) {
+            // The files have already been written batch by batch
+            SaveIncrementalManifest();
+            if (m_streamed_files_write_failed) return SignetResult::FailedToWriteFiles;
+            if (m_num_streamed_files == 0 && m_num_unchanged_files_skipped) {
+                MessageWithNewLine("Signet", {}, "None of the files have changed since they were last processed");
+            } else if (m_num_streamed_files == 0 && m_num_files_outside_shard) {
+                MessageWithNewLine("Signet", {}, "None of the files are in this shard");
+            } else if (m_num_streamed_files == 0) {
+                return SignetResult::NoFilesMatchingInput;
+            } else if (any_writable_command_ran && m_num_streamed_files_processed == 0) {
+                return SignetResult::NoFilesWereProcessed;
             }
+            PrintSuccess();
+            return SignetResult::Success;
+        }
 
-            if (!m_input_audio_files.WriteFilesThatHaveBeenEdited(
-                    m_backup, m_output_path || m_single_output_file ? true : false)) {
-                return SignetResult::FailedToWriteFiles;
+        if (m_input_audio_files.GetNumFilesProcessed()) {
+            if (!WriteEditedFiles(m_input_audio_files)) return SignetResult::FailedToWriteFiles;
+            for (const auto &f : m_input_audio_files) {
+                if (f.AudioChanged() || f.PathChanged() || f.FormatChanged()) {
+                    m_written_file_paths.push_back(f.WrittenPath());
+                }
             }
         }
+        if (m_incremental_manifest) {
+            RecordProcessedFiles(m_input_audio_files);
+            SaveIncrementalManifest();
+        }
 
-        if (m_input_audio_files.Size() == 0) {
+        if (m_input_audio_files.Size() == 0 && m_num_unchanged_files_skipped) {
+            MessageWithNewLine("Signet", {}, "None of the files have changed since they were last processed");
+        } else if (m_input_audio_files.Size() == 0 && m_num_files_outside_shard) {
+            MessageWithNewLine("Signet", {}, "None of the files are in this shard");
+        } else if (m_input_audio_files.Size() == 0) {
             return SignetResult::NoFilesMatchingInput;
         } else if (any_writable_command_ran && m_input_audio_files.GetNumFilesProcessed() == 0) {
             return SignetResult::NoFilesWereProcessed;
@@ -506,12 +935,12 @@ int SignetInterface::Main(const int argc, const char *const argv[]) {
             return SignetResult::Success;
         }
     } catch (const SignetError &e) {
-        fmt::print(stderr, fg(fmt::color::red) | fmt::emphasis::bold,
-                   "{}. Processing has stopped. No files have been changed or saved.\n", e.what());
+        fmt::print(stderr, fg(fmt::color::red) | fmt::emphasis::bold, "{}. Processing has stopped. {}\n",
+                   e.what(), stopped_message());
         return SignetResult::FatalErrorOcurred;
     } catch (const SignetWarning &e) {
-        fmt::print(stderr, fg(fmt::color::red) | fmt::emphasis::bold,
-                   "{}. Processing has stopped. No files have been changed or saved.\n", e.what());
+        fmt::print(stderr, fg(fmt::color::red) | fmt::emphasis::bold, "{}. Processing has stopped. {}\n",
+                   e.what(), stopped_message());
         return SignetResult::WarningsAreErrors;
     }
 }
@@ -563,6 +992,57 @@ TEST_CASE("[SignetInterface]") {
                 TestHelpers::StringToArgs {"signet test-folder/test.wav test-folder/tf1.wav norm -3"};
             REQUIRE(signet.Main(args.Size(), args.Args()) == 0);
         }
+
+        SUBCASE("shards") {
+            for (const auto shard : {"1/2", "2/2"}) {
+                SignetInterface shard_signet;
+                const auto args = TestHelpers::StringToArgs {
+                    fmt::format("signet --shard {} test-folder print-info --format json", shard)};
+                REQUIRE(shard_signet.Main(args.Size(), args.Args()) == 0);
+            }
+            const auto args = TestHelpers::StringToArgs {"signet --shard 3/2 test-folder norm -3"};
+            REQUIRE(signet.Main(args.Size(), args.Args()) != 0);
+        }
+
+        SUBCASE("incremental") {
+            const fs::path manifest = "test-folder-manifest.json";
+            fs::remove(manifest);
+            const auto Run = [&]() {
+                SignetInterface incremental_signet;
+                const auto args = TestHelpers::StringToArgs {
+                    "signet --incremental test-folder-manifest.json test-folder gain -1db"};
+                return incremental_signet.Main(args.Size(), args.Args());
+            };
+
+            REQUIRE(Run() == 0);
+            REQUIRE(fs::is_regular_file(manifest));
+            const auto tf1_after_first_run = ReadEntireFile("test-folder/tf1.wav");
+            const auto tf2_after_first_run = ReadEntireFile("test-folder/tf2.wav");
+
+            // Only the file that has changed is processed again
+            REQUIRE(fs::copy_file(TEST_DATA_DIRECTORY "/white-noise.wav", "test-folder/tf2.wav",
+                                  fs::copy_options::overwrite_existing));
+            REQUIRE(Run() == 0);
+            REQUIRE(ReadEntireFile("test-folder/tf1.wav") == tf1_after_first_run);
+            REQUIRE(ReadEntireFile("test-folder/tf2.wav") == tf2_after_first_run);
+
+            REQUIRE(Run() == 0);
+            REQUIRE(ReadEntireFile("test-folder/tf2.wav") == tf2_after_first_run);
+            fs::remove(manifest);
+        }
+
+        SUBCASE("watch") {
+            // Both forms of --watch start watching rather than running the command once; a folder that does
+            // not exist stops it straight away
+            const auto tf1_before = ReadEntireFile("test-folder/tf1.wav");
+            for (const auto watch : {"--watch watch-missing-folder", "--watch=watch-missing-folder"}) {
+                SignetInterface watch_signet;
+                const auto args =
+                    TestHelpers::StringToArgs {fmt::format("signet {} test-folder/tf1.wav norm -3", watch)};
+                REQUIRE(watch_signet.Main(args.Size(), args.Args()) == SignetResult::FatalErrorOcurred);
+            }
+            REQUIRE(ReadEntireFile("test-folder/tf1.wav") == tf1_before);
+        }
     }
 
     SUBCASE("undo") {
@@ -11,6 +11,8 @@
 #include "command.h"
 #include "common.h"
 #include "filesystem.hpp"
+#include "incremental.h"
+#include "shard.h"
 
 namespace SignetResult {
 enum SignetResultEnum {
@@ -25,21 +27,62 @@ enum SignetResultEnum {
 
 class SignetInterface final {
   public:
-    SignetInterface();
-
     int Main(const int argc, const char *const argv[]);
 
+    // The paths of the files that were written by Main
+    const std::vector<fs::path> &WrittenFilePaths() const { return m_written_file_paths; }
+
   private:
     std::vector<std::unique_ptr<Command>> m_commands {};
     SignetBackup m_backup {};
 
+    std::vector<std::string> m_args {};
     AudioFiles m_input_audio_files {};
+    bool m_input_audio_files_listed {};
     bool m_input_audio_files_built {};
     std::vector<std::string> m_input_path_strings {};
     std::vector<std::string> m_exclude_patterns {};
     bool m_recursive_directory_search {};
+    std::optional<usize> m_max_memory {};
+
+    void ListInputAudioFiles();
+    void EnsureInputAudioFilesBuilt(const std::vector<const Command *> &commands);
+    void KeepOnlyFilesInShard(AudioFiles &files, std::vector<std::vector<std::string>> &group_keys);
+    std::optional<Shard> m_shard {};
+    usize m_num_files_outside_shard {};
+
+    // The commands of a script are gathered before any of them are run, so that --shard and --incremental
+    // know which files need to be processed together
+    bool m_gathering_script_commands {};
+    std::vector<std::vector<std::string>> m_script_group_keys {};
+    bool m_script_has_read_only_command {};
+
+    void StartIncrementalRun(bool any_read_only_command);
+    u64 IncrementalFingerprint() const;
+    void SkipUpToDateFiles(AudioFiles &files, const std::vector<std::vector<std::string>> &group_keys);
+    void RecordProcessedFiles(const AudioFiles &files);
+    void SaveIncrementalManifest();
+    fs::path m_incremental_manifest_path {};
+    std::optional<IncrementalManifest> m_incremental_manifest {};
+    u64 m_incremental_fingerprint {};
+    usize m_num_unchanged_files_skipped {};
+
+    std::vector<fs::path> m_merge_json_paths {};
+    unsigned m_resample_report_src_rate = 44100;
+    unsigned m_resample_report_dst_rate = 48000;
+    std::vector<fs::path> m_written_file_paths {};
+    fs::path m_server_socket_path {};
+    fs::path m_watch_folder {};
+    usize m_server_cache_size = 1024 * 1024 * 1024;
 
-    void EnsureInputAudioFilesBuilt();
+    bool CanStreamInputPaths(const Command &command) const;
+    void ProcessStreamedInputPaths(Command &command);
+    bool WriteEditedFiles(AudioFiles &files, std::set<fs::path> *other_batch_paths = nullptr);
+    bool m_input_paths_streamed {};
+    usize m_num_streamed_files {};
+    usize m_num_streamed_files_processed {};
+    bool m_streamed_files_written {};
+    bool m_streamed_files_write_failed {};
     fs::path m_make_docs_filepath {};
     fs::path m_script_filepath {};
     std::optional<fs::path> m_output_path {};
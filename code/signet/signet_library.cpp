@@ -0,0 +1,191 @@
+#include "signet_library.h"
+
+#include <map>
+#include <thread>
+
+#include "CLI11.hpp"
+#include "doctest.hpp"
+#include "json.hpp"
+
+#include "all_commands.h"
+#include "audio_files.h"
+#include "common.h"
+#include "defer.h"
+#include "test_helpers.h"
+
+struct SignetProcessor::Impl {
+    // Each call to AddCommands parses into its own set of commands, since the same command can be in the chain
+    // more than once with different options. The CLI is kept alive along with the commands that it configured.
+    struct ParsedCommands {
+        std::vector<std::unique_ptr<Command>> commands;
+        std::unique_ptr<CLI::App> app;
+    };
+
+    std::vector<ParsedCommands> parsed {};
+    std::vector<Command *> chain {};
+    bool messages_enabled = false;
+};
+
+SignetProcessor::SignetProcessor() : m_impl(std::make_unique<Impl>()) {}
+SignetProcessor::~SignetProcessor() = default;
+
+bool SignetProcessor::AddCommands(std::string_view commands, std::string &error) {
+    std::vector<std::string> words(1);
+    for (const auto c : commands) {
+        if (std::isspace((unsigned char)c)) {
+            if (words.back().size()) words.emplace_back();
+        } else {
+            words.back() += c;
+        }
+    }
+
+    Impl::ParsedCommands parsed {CreateCommandsNamedIn(words), std::make_unique<CLI::App>()};
+    auto &app = *parsed.app;
+    app.require_subcommand();
+    std::map<const CLI::App *, Command *> command_of_subcommand;
+    for (auto &command : parsed.commands) {
+        command_of_subcommand[command->CreateCommandCLI(app)] = command.get();
+    }
+
+    try {
+        app.parse(std::string(commands), false);
+    } catch (const CLI::ParseError &e) {
+        error = e.what();
+        return false;
+    } catch (const SignetError &e) {
+        error = e.what();
+        return false;
+    }
+
+    std::vector<Command *> chain;
+    for (const auto subcommand : app.get_subcommands()) {
+        const auto command = command_of_subcommand.at(subcommand);
+        if (command->GeneratesFiles()) {
+            error = fmt::format("{} writes new files, which is not possible when processing buffers",
+                                subcommand->get_name());
+            return false;
+        }
+        chain.push_back(command);
+    }
+
+    m_impl->chain.insert(m_impl->chain.end(), chain.begin(), chain.end());
+    m_impl->parsed.push_back(std::move(parsed));
+    return true;
+}
+
+void SignetProcessor::ClearCommands() {
+    m_impl->chain.clear();
+    m_impl->parsed.clear();
+}
+
+void SignetProcessor::SetMessagesEnabled(bool enabled) { m_impl->messages_enabled = enabled; }
+
+SignetProcessResult SignetProcessor::Process(std::vector<SignetAudioBuffer> &buffers) {
+    std::vector<EditTrackedAudioFile> files;
+    files.reserve(buffers.size());
+    for (const auto &buffer : buffers) {
+        files.emplace_back(fs::path {buffer.name});
+        files.back().SetAudioData(buffer.audio);
+    }
+    AudioFiles audio_files {std::move(files)};
+
+    std::string output;
+    const auto messages_enabled = g_messages_enabled;
+    const auto command_output = g_command_output;
+    g_messages_enabled = m_impl->messages_enabled;
+    g_command_output = &output;
+    defer {
+        g_messages_enabled = messages_enabled;
+        g_command_output = command_output;
+    };
+
+    try {
+        for (const auto command : m_impl->chain) {
+            command->ProcessFiles(audio_files);
+        }
+    } catch (const SignetError &e) {
+        return {false, e.what(), std::move(output)};
+    } catch (const SignetWarning &e) {
+        return {false, e.what(), std::move(output)};
+    }
+
+    for (usize i = 0; i < buffers.size(); ++i) {
+        auto &f = audio_files[i];
+        if (f.AudioChanged()) buffers[i].audio = f.GetAudio();
+        if (f.PathChanged() || f.FormatChanged()) buffers[i].name = f.WrittenPath().generic_string();
+    }
+    return {true, {}, std::move(output)};
+}
+
+TEST_CASE("[SignetProcessor]") {
+    const auto sine = TestHelpers::CreateSineWaveAtFrequency(1, 44100, 0.5, 440);
+    std::vector<SignetAudioBuffer> buffers {{"folder/a.wav", sine}, {"folder/b.wav", sine}};
+    SignetProcessor processor;
+    std::string error;
+
+    SUBCASE("audio is processed") {
+        REQUIRE(processor.AddCommands("gain 50%", error));
+        REQUIRE(processor.AddCommands("rename prefix x-", error));
+        const auto result = processor.Process(buffers);
+        REQUIRE(result.success);
+        REQUIRE(buffers[0].name == "folder/x-a.wav");
+        REQUIRE(buffers[1].name == "folder/x-b.wav");
+        for (usize i = 0; i < sine.interleaved_samples.size(); ++i) {
+            REQUIRE(buffers[0].audio.interleaved_samples[i] ==
+                    doctest::Approx(sine.interleaved_samples[i] * 0.5));
+        }
+    }
+
+    SUBCASE("results are returned rather than printed") {
+        REQUIRE(processor.AddCommands("print-info --format json", error));
+        const auto result = processor.Process(buffers);
+        REQUIRE(result.success);
+        const auto json = nlohmann::json::parse(result.output);
+        REQUIRE(json.size() == 2);
+        REQUIRE(json[0]["path"] == "folder/a.wav");
+        REQUIRE(buffers[0].audio.interleaved_samples == sine.interleaved_samples);
+    }
+
+    SUBCASE("per-file results are returned") {
+        REQUIRE(processor.AddCommands("detect-pitch", error));
+        const auto result = processor.Process(buffers);
+        REQUIRE(result.success);
+        REQUIRE(result.output.find("folder/a.wav: Detected pitch 440") != std::string::npos);
+        REQUIRE(result.output.find("folder/b.wav: Detected pitch 440") != std::string::npos);
+    }
+
+    SUBCASE("processors on different threads do not share output") {
+        const auto ProcessOnThread = [&](std::string name, std::string commands, SignetProcessResult &result) {
+            return std::thread([&result, name = std::move(name), commands = std::move(commands), &sine]() {
+                SignetProcessor thread_processor;
+                std::string thread_error;
+                std::vector<SignetAudioBuffer> thread_buffers {{name, sine}};
+                if (!thread_processor.AddCommands(commands, thread_error)) return;
+                for (int i = 0; i < 20; ++i) {
+                    result = thread_processor.Process(thread_buffers);
+                    if (!result.success) return;
+                }
+            });
+        };
+        SignetProcessResult pitch_result {}, info_result {};
+        auto pitch_thread = ProcessOnThread("pitch.wav", "detect-pitch", pitch_result);
+        auto info_thread = ProcessOnThread("info.wav", "print-info --format json", info_result);
+        pitch_thread.join();
+        info_thread.join();
+
+        REQUIRE(pitch_result.success);
+        REQUIRE(info_result.success);
+        REQUIRE(pitch_result.output.find("pitch.wav: Detected pitch 440") == 0);
+        REQUIRE(pitch_result.output.find("info.wav") == std::string::npos);
+        REQUIRE(info_result.output.find("pitch.wav") == std::string::npos);
+        REQUIRE(nlohmann::json::parse(info_result.output)[0]["path"] == "info.wav");
+    }
+
+    SUBCASE("invalid commands") {
+        REQUIRE(!processor.AddCommands("not-a-command", error));
+        REQUIRE(error.size());
+        REQUIRE(!processor.AddCommands("", error));
+        REQUIRE(!processor.AddCommands("sample-blend .* 12 out", error));
+        REQUIRE(processor.Process(buffers).success);
+    }
+}
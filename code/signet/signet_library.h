@@ -0,0 +1,54 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "audio_data.h"
+
+// Signet as a library: runs a chain of Signet's commands on audio that is already in memory, inside the
+// calling program, rather than running the signet program on files. Nothing is read from or written to the
+// filesystem (except by commands that are asked to, such as metadata import), and there is no undo. Link
+// against the libsignet target to use this.
+
+// An audio buffer to process. The name is used in place of a file path: by commands that look at filenames
+// (such as rename, or auto-tune with --sample-sets) and as the "path" in JSON results.
+struct SignetAudioBuffer {
+    std::string name;
+    AudioData audio;
+};
+
+struct SignetProcessResult {
+    bool success;
+    // Why processing stopped, if it did not succeed
+    std::string error;
+    // The results that the commands printed, such as the JSON of print-info --format json or mir-report.
+    // Results for a single buffer, such as those of detect-pitch, are given as "<name>: <result>" lines.
+    std::string output;
+};
+
+class SignetProcessor {
+  public:
+    SignetProcessor();
+    ~SignetProcessor();
+    SignetProcessor(const SignetProcessor &) = delete;
+    SignetProcessor &operator=(const SignetProcessor &) = delete;
+
+    // Adds commands to the end of the chain. They are given in the same way as on the command line, after the
+    // input files; e.g. "norm -3" or "norm -3 fade in 10ms". Returns false and sets error if they are not
+    // valid. Commands that write new files of their own, such as sample-blend, are not allowed.
+    bool AddCommands(std::string_view commands, std::string &error);
+    void ClearCommands();
+
+    // Normally Signet's progress messages are not printed while processing
+    void SetMessagesEnabled(bool enabled);
+
+    // Runs the chain of commands on the buffers. Buffers that are changed have their audio replaced, and their
+    // name too if the commands renamed, moved or converted them. Processors on different threads can run at
+    // the same time, but each processor must only be used by 1 thread at a time.
+    SignetProcessResult Process(std::vector<SignetAudioBuffer> &buffers);
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> m_impl;
+};
@@ -1,4 +1,5 @@
 #include "signet_interface.h"
+#include "signet_server.h"
 
 #define DOCTEST_CONFIG_IMPLEMENT
 #include "doctest.hpp"
@@ -7,6 +8,24 @@ int main(const int argc, const char *argv[]) {
     doctest::Context context(0, nullptr);
     context.setAsDefaultForAssertsOutOfTestCases();
 
+    // signet --connect <socket> <args>: the args are run by a 'signet serve' process, or here if there isn't one
+    if (argc >= 3 && std::string_view {argv[1]} == "--connect") {
+        std::vector<std::string> args {argv[0]};
+        for (int i = 3; i < argc; ++i) {
+            args.push_back(argv[i]);
+        }
+        if (const auto result = RunThroughSignetServer(argv[2], args)) return *result;
+        WarningWithNewLine("Signet", {}, "Could not connect to a server at {}; running the command here instead",
+                           argv[2]);
+
+        std::vector<const char *> local_argv;
+        for (const auto &arg : args) {
+            local_argv.push_back(arg.c_str());
+        }
+        SignetInterface signet;
+        return signet.Main((int)local_argv.size(), local_argv.data());
+    }
+
     SignetInterface signet;
     return signet.Main(argc, argv);
 }
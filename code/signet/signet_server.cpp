@@ -0,0 +1,425 @@
+#include "signet_server.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "doctest.hpp"
+
+#include "common.h"
+#include "decoded_audio_cache.h"
+#include "signet_interface.h"
+#include "tests_config.h"
+
+std::string EncodeServerRequest(const ServerRequest &request) {
+    std::string result = request.working_directory;
+    result.push_back('\0');
+    for (const auto &arg : request.args) {
+        result += arg;
+        result.push_back('\0');
+    }
+    return result;
+}
+
+std::optional<ServerRequest> DecodeServerRequest(std::string_view bytes) {
+    if (bytes.empty() || bytes.back() != '\0') return {};
+    bytes.remove_suffix(1);
+
+    ServerRequest request;
+    bool first = true;
+    while (true) {
+        const auto end = bytes.find('\0');
+        auto &str = first ? request.working_directory : request.args.emplace_back();
+        str = std::string(bytes.substr(0, end));
+        first = false;
+        if (end == std::string_view::npos) break;
+        bytes.remove_prefix(end + 1);
+    }
+    if (request.working_directory.empty() || request.args.empty()) return {};
+    return request;
+}
+
+#ifndef _WIN32
+
+static volatile std::sig_atomic_t g_stop_requested = 0;
+
+static void RequestStop(int) { g_stop_requested = 1; }
+
+static bool ReadAll(int fd, void *data, usize size) {
+    auto bytes = (char *)data;
+    while (size) {
+        const auto n = read(fd, bytes, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        bytes += n;
+        size -= (usize)n;
+    }
+    return true;
+}
+
+static bool WriteAll(int fd, const void *data, usize size) {
+    auto bytes = (const char *)data;
+    while (size) {
+        const auto n = write(fd, bytes, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        bytes += n;
+        size -= (usize)n;
+    }
+    return true;
+}
+
+// The standard streams of the client are sent as ancillary data alongside the size of the request
+constexpr int k_num_passed_fds = 3;
+
+static bool SendSizeAndStreams(int socket_fd, u32 size) {
+    iovec io {&size, sizeof(size)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * k_num_passed_fds)] {};
+    msghdr message {};
+    message.msg_iov = &io;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    auto cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * k_num_passed_fds);
+    const int fds[k_num_passed_fds] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+    std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    return sendmsg(socket_fd, &message, 0) == (ssize_t)sizeof(size);
+}
+
+static bool ReceiveSizeAndStreams(int socket_fd, u32 &size, int (&fds)[k_num_passed_fds]) {
+    iovec io {&size, sizeof(size)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * k_num_passed_fds)] {};
+    msghdr message {};
+    message.msg_iov = &io;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    if (recvmsg(socket_fd, &message, 0) != (ssize_t)sizeof(size)) return false;
+    const auto cmsg = CMSG_FIRSTHDR(&message);
+    if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) return false;
+    if (cmsg->cmsg_len != CMSG_LEN(sizeof(int) * k_num_passed_fds)) {
+        // Close whatever we were given so that it does not leak
+        const auto num_fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (usize i = 0; i < num_fds; ++i) {
+            int fd;
+            std::memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            close(fd);
+        }
+        return false;
+    }
+    std::memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    return true;
+}
+
+static std::optional<sockaddr_un> SocketAddress(const fs::path &socket_path) {
+    const auto path = socket_path.string();
+    sockaddr_un address {};
+    if (path.size() >= sizeof(address.sun_path)) return {};
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+
+static int ConnectToSocket(const sockaddr_un &address) {
+    const auto fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (const sockaddr *)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Output goes to the client through a pipe that is relayed by a thread rather than straight to the client's
+// stream. That way, if the client goes away part-way through (such as when its output is piped into head),
+// the command's writes still succeed and the server carries on, instead of the write errors stopping the
+// command wherever it happens to be.
+class OutputRelay {
+  public:
+    OutputRelay(int destination_fd) {
+        int fds[2];
+        if (pipe(fds) != 0) {
+            m_write_fd = destination_fd;
+            return;
+        }
+        m_write_fd = fds[1];
+        m_thread = std::thread([read_fd = fds[0], destination_fd]() {
+            char buffer[4096];
+            bool destination_ok = true;
+            while (true) {
+                const auto n = read(read_fd, buffer, sizeof(buffer));
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) break;
+                if (destination_ok) destination_ok = WriteAll(destination_fd, buffer, (usize)n);
+            }
+            close(read_fd);
+            close(destination_fd);
+        });
+    }
+    ~OutputRelay() { Finish(); }
+    OutputRelay(const OutputRelay &) = delete;
+    OutputRelay &operator=(const OutputRelay &) = delete;
+
+    // Once this has been dup2'd to where the output should go it must be closed, so that the relay finishes
+    // when that is closed too
+    int WriteFd() const { return m_write_fd; }
+
+    // Waits for all of the output to be passed on
+    void Finish() {
+        if (m_thread.joinable()) m_thread.join();
+    }
+
+  private:
+    int m_write_fd;
+    std::thread m_thread {};
+};
+
+struct ServerStreams {
+    int fds[k_num_passed_fds];
+    fs::path working_directory;
+};
+
+static void HandleConnection(int connection, const ServerStreams &server_streams) {
+    u32 size {};
+    int client_fds[k_num_passed_fds] {};
+    if (!ReceiveSizeAndStreams(connection, size, client_fds)) return;
+    std::string payload(size, '\0');
+    const auto request = ReadAll(connection, payload.data(), size) ? DecodeServerRequest(payload) : std::nullopt;
+    if (!request) {
+        for (const auto fd : client_fds) {
+            close(fd);
+        }
+        return;
+    }
+
+    std::fflush(stdout);
+    std::fflush(stderr);
+    dup2(client_fds[0], STDIN_FILENO);
+    close(client_fds[0]);
+    OutputRelay stdout_relay {client_fds[1]};
+    OutputRelay stderr_relay {client_fds[2]};
+    dup2(stdout_relay.WriteFd(), STDOUT_FILENO);
+    dup2(stderr_relay.WriteFd(), STDERR_FILENO);
+    close(stdout_relay.WriteFd());
+    close(stderr_relay.WriteFd());
+
+    int result = SignetResult::FatalErrorOcurred;
+    std::error_code ec;
+    fs::current_path(request->working_directory, ec);
+    if (ec) {
+        fmt::print(stderr, "Signet server could not change to the folder {}: {}\n", request->working_directory,
+                   ec.message());
+    } else {
+        // Each request starts from the same state as a new process would
+        const auto messages_enabled = g_messages_enabled;
+        const auto warnings_as_errors = g_warnings_as_errors;
+        g_warnings_as_errors = false;
+
+        std::vector<const char *> argv;
+        for (const auto &arg : request->args) {
+            argv.push_back(arg.c_str());
+        }
+        try {
+            SignetInterface signet;
+            result = signet.Main((int)argv.size(), argv.data());
+        } catch (const std::exception &e) {
+            fmt::print(stderr, "Signet server: {}\n", e.what());
+        }
+
+        g_messages_enabled = messages_enabled;
+        g_warnings_as_errors = warnings_as_errors;
+    }
+
+    std::fflush(stdout);
+    std::fflush(stderr);
+    std::clearerr(stdin);
+    for (int i = 0; i < k_num_passed_fds; ++i) {
+        dup2(server_streams.fds[i], i);
+    }
+    fs::current_path(server_streams.working_directory, ec);
+    stdout_relay.Finish();
+    stderr_relay.Finish();
+
+    const s32 reply = result;
+    WriteAll(connection, &reply, sizeof(reply));
+}
+
+void RunSignetServer(const fs::path &socket_path, usize cache_bytes) {
+    const auto address = SocketAddress(socket_path);
+    if (!address) ErrorWithNewLine("Signet", {}, "The socket path {} is too long", socket_path);
+
+    // A socket file that is left behind by a server that was killed can be replaced, but not one that a
+    // server is still listening on
+    if (fs::exists(socket_path)) {
+        if (const auto fd = ConnectToSocket(*address); fd >= 0) {
+            close(fd);
+            ErrorWithNewLine("Signet", {}, "There is already a server listening on {}", socket_path);
+        }
+        std::error_code ec;
+        fs::remove(socket_path, ec);
+    }
+
+    const auto listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) ErrorWithNewLine("Signet", {}, "Could not create a socket: {}", std::strerror(errno));
+    if (bind(listener, (const sockaddr *)&*address, sizeof(*address)) != 0 || listen(listener, 16) != 0) {
+        const auto error = errno;
+        close(listener);
+        ErrorWithNewLine("Signet", {}, "Could not listen on {}: {}", socket_path, std::strerror(error));
+    }
+
+    // No SA_RESTART, so that a signal interrupts accept and the server can clean up
+    struct sigaction stop_action {};
+    stop_action.sa_handler = RequestStop;
+    sigemptyset(&stop_action.sa_mask);
+    struct sigaction previous_int {}, previous_term {}, previous_pipe {};
+    sigaction(SIGINT, &stop_action, &previous_int);
+    sigaction(SIGTERM, &stop_action, &previous_term);
+    // A client that goes away should not take the server with it
+    struct sigaction ignore_action {};
+    ignore_action.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &ignore_action, &previous_pipe);
+
+    // Each client's stdin is swapped in for its request; it must not be buffered or the remains of one
+    // client's input could be read by the next.
+    std::setvbuf(stdin, nullptr, _IONBF, 0);
+    SetDecodedAudioCacheLimit(cache_bytes);
+
+    ServerStreams server_streams {};
+    for (int i = 0; i < k_num_passed_fds; ++i) {
+        server_streams.fds[i] = dup(i);
+    }
+    server_streams.working_directory = fs::current_path();
+
+    MessageWithNewLine("Signet", {}, "Listening on {0}; run commands with 'signet --connect {0} ...'",
+                       socket_path.generic_string());
+    g_stop_requested = 0;
+    while (!g_stop_requested) {
+        const auto connection = accept(listener, nullptr, nullptr);
+        if (connection < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            WarningWithNewLine("Signet", {}, "Could not accept a connection: {}", std::strerror(errno));
+            break;
+        }
+        HandleConnection(connection, server_streams);
+        close(connection);
+    }
+
+    close(listener);
+    std::error_code ec;
+    fs::remove(socket_path, ec);
+    for (const auto fd : server_streams.fds) {
+        close(fd);
+    }
+    SetDecodedAudioCacheLimit(0);
+    sigaction(SIGINT, &previous_int, nullptr);
+    sigaction(SIGTERM, &previous_term, nullptr);
+    sigaction(SIGPIPE, &previous_pipe, nullptr);
+    MessageWithNewLine("Signet", {}, "Server stopped");
+}
+
+std::optional<int> RunThroughSignetServer(const fs::path &socket_path, const std::vector<std::string> &args) {
+    const auto address = SocketAddress(socket_path);
+    if (!address) return {};
+    const auto fd = ConnectToSocket(*address);
+    if (fd < 0) return {};
+
+    std::error_code ec;
+    const auto payload = EncodeServerRequest({fs::current_path(ec).string(), args});
+    s32 result {};
+    const bool success = SendSizeAndStreams(fd, (u32)payload.size()) &&
+                         WriteAll(fd, payload.data(), payload.size()) && ReadAll(fd, &result, sizeof(result));
+    close(fd);
+    if (!success) {
+        fmt::print(stderr, "Lost the connection to the signet server at {}\n", socket_path);
+        return SignetResult::FatalErrorOcurred;
+    }
+    return result;
+}
+
+#else
+
+void RunSignetServer(const fs::path &, usize) {
+    ErrorWithNewLine("Signet", {}, "serve is not available on Windows");
+}
+
+std::optional<int> RunThroughSignetServer(const fs::path &, const std::vector<std::string> &) { return {}; }
+
+#endif
+
+TEST_CASE("[ServerRequest]") {
+    const ServerRequest request {"/some folder", {"signet", "file.wav", "", "gain", "-3db"}};
+    const auto decoded = DecodeServerRequest(EncodeServerRequest(request));
+    REQUIRE(decoded);
+    REQUIRE(decoded->working_directory == request.working_directory);
+    REQUIRE(decoded->args == request.args);
+
+    REQUIRE(!DecodeServerRequest(""));
+    REQUIRE(!DecodeServerRequest(std::string_view {"/folder\0signet", 14}));
+}
+
+#ifndef _WIN32
+TEST_CASE("[SignetServer]") {
+    const fs::path socket_path = "signet-server-test.sock";
+    const fs::path audio_path = "server-test.wav";
+    REQUIRE(fs::copy_file(TEST_DATA_DIRECTORY "/white-noise.wav", audio_path,
+                          fs::copy_options::overwrite_existing));
+    const auto PeakOf = [](const AudioData &audio) {
+        double peak = 0;
+        for (const auto s : audio.interleaved_samples) {
+            peak = std::max(peak, std::abs(s));
+        }
+        return peak;
+    };
+    const auto original = ReadAudioFile(audio_path);
+    REQUIRE(original);
+
+    const auto messages_enabled = g_messages_enabled;
+    std::thread server {[&] {
+        g_messages_enabled = messages_enabled;
+        RunSignetServer(socket_path, 64 * 1024 * 1024);
+    }};
+
+    // The first request is retried until the server is listening
+    std::optional<int> result {};
+    for (int attempt = 0; attempt < 500 && !result; ++attempt) {
+        result = RunThroughSignetServer(socket_path, {"signet", audio_path.generic_string(), "gain", "-6db"});
+        if (!result) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    REQUIRE(result);
+    CHECK(*result == SignetResult::Success);
+    const auto processed = ReadAudioFile(audio_path);
+    REQUIRE(processed);
+    CHECK(PeakOf(*processed) / PeakOf(*original) == doctest::Approx(DBToAmp(-6)).epsilon(0.01));
+
+    // A failing command's exit code comes back to the client, and the server keeps going
+    CHECK(RunThroughSignetServer(socket_path, {"signet", "server-test-missing.wav", "gain", "-6db"}) !=
+          std::optional<int> {SignetResult::Success});
+    CHECK(RunThroughSignetServer(socket_path, {"signet", audio_path.generic_string(), "gain", "6db"}) ==
+          std::optional<int> {SignetResult::Success});
+
+    // The signal interrupts the server's accept; if it arrives just before accept is called, the connection
+    // afterwards wakes it up instead
+    pthread_kill(server.native_handle(), SIGTERM);
+    if (const auto address = SocketAddress(socket_path)) {
+        if (const auto fd = ConnectToSocket(*address); fd >= 0) close(fd);
+    }
+    server.join();
+    CHECK(!fs::exists(socket_path));
+    CHECK(!RunThroughSignetServer(socket_path, {"signet", audio_path.generic_string(), "gain", "-6db"}));
+}
+#endif
@@ -0,0 +1,29 @@
+#pragma once
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "filesystem.hpp"
+#include "types.h"
+
+// 'signet serve' keeps a process running that listens on a Unix domain socket. Each client ('signet --connect')
+// sends the arguments it was run with, its working directory and its stdin, stdout and stderr. The server runs
+// the arguments just like a separate invocation of signet would, but in its own process and with its output
+// going straight to the client's streams, then sends back the exit code. The server skips the start-up of a
+// new process and keeps decoded audio cached between runs (see SetDecodedAudioCacheLimit).
+
+struct ServerRequest {
+    std::string working_directory;
+    std::vector<std::string> args; // including the program name, like argv
+};
+
+std::string EncodeServerRequest(const ServerRequest &request);
+std::optional<ServerRequest> DecodeServerRequest(std::string_view bytes);
+
+// Runs requests one at a time until the process is sent SIGINT or SIGTERM
+void RunSignetServer(const fs::path &socket_path, usize cache_bytes);
+
+// Runs the args in the server listening at socket_path, returning the exit code. Returns nothing if the server
+// could not be reached, in which case nothing has been run.
+std::optional<int> RunThroughSignetServer(const fs::path &socket_path, const std::vector<std::string> &args);
@@ -0,0 +1,2 @@
+#pragma once
+#define SIGNET_VERSION "0.2.0"
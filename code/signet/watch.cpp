@@ -0,0 +1,321 @@
+#include "watch.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <optional>
+
+#if __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "doctest.hpp"
+
+#include "audio_file_io.h"
+#include "common.h"
+#include "defer.h"
+#include "signet_interface.h"
+#include "tests_config.h"
+
+namespace {
+
+// Collects the paths of files that have changed, and hands each one out once it has had no more changes for a
+// while, so that a file that is written in several goes is only processed once. Each file has its own
+// deadline, so a file that keeps changing does not hold back the others.
+class ChangeDebouncer {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    ChangeDebouncer(Clock::duration quiet_period) : m_quiet_period(quiet_period) {}
+
+    void AddChange(const fs::path &path, Clock::time_point time) { m_last_change_times[path] = time; }
+
+    // Returns the changed paths, sorted, that have had no changes for the quiet period, or nothing if there
+    // are none yet. The rest are kept until they settle too.
+    std::optional<std::vector<fs::path>> TakeSettledChanges(Clock::time_point now) {
+        std::vector<fs::path> result;
+        for (auto it = m_last_change_times.begin(); it != m_last_change_times.end();) {
+            if (now - it->second >= m_quiet_period) {
+                result.push_back(it->first);
+                it = m_last_change_times.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        if (result.empty()) return {};
+        return result;
+    }
+
+    // How long until TakeSettledChanges could return something, or nothing if there are no changes waiting
+    std::optional<Clock::duration> TimeUntilSettled(Clock::time_point now) const {
+        if (m_last_change_times.empty()) return {};
+        auto first_settled = Clock::time_point::max();
+        for (const auto &[path, time] : m_last_change_times) {
+            first_settled = std::min(first_settled, time + m_quiet_period);
+        }
+        return std::max(Clock::duration {0}, first_settled - now);
+    }
+
+  private:
+    Clock::duration m_quiet_period;
+    // The time of the last change of each path
+    std::map<fs::path, Clock::time_point> m_last_change_times {};
+};
+
+} // namespace
+
+#if __linux__
+
+namespace {
+
+volatile std::sig_atomic_t g_watch_stop_requested = 0;
+
+void RequestWatchStop(int) { g_watch_stop_requested = 1; }
+
+class FolderWatcher {
+  public:
+    FolderWatcher(const fs::path &folder, bool recursive) : m_recursive(recursive) {
+        m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (m_fd < 0) ErrorWithNewLine("Signet", {}, "Could not start watching: {}", std::strerror(errno));
+        AddFolder(folder, nullptr);
+    }
+    ~FolderWatcher() {
+        if (m_fd >= 0) close(m_fd);
+    }
+    FolderWatcher(const FolderWatcher &) = delete;
+    FolderWatcher &operator=(const FolderWatcher &) = delete;
+
+    int Fd() const { return m_fd; }
+
+    // Reads all of the waiting events, calling on_change for each audio file that has been written and closed
+    // or moved into a watched folder
+    void ReadEvents(const std::function<void(const fs::path &)> &on_change) {
+        alignas(inotify_event) char buffer[16 * 1024];
+        while (true) {
+            const auto num_read = read(m_fd, buffer, sizeof(buffer));
+            if (num_read <= 0) break;
+            for (auto ptr = buffer; ptr < buffer + num_read;) {
+                const auto &event = *(const inotify_event *)ptr;
+                ptr += sizeof(inotify_event) + event.len;
+                HandleEvent(event, on_change);
+            }
+        }
+    }
+
+  private:
+    void HandleEvent(const inotify_event &event, const std::function<void(const fs::path &)> &on_change) {
+        if (event.mask & IN_Q_OVERFLOW) {
+            WarningWithNewLine("Signet", {},
+                               "Too many files changed at once to keep track of; some may not be processed");
+            return;
+        }
+        const auto folder = m_folders.find(event.wd);
+        if (folder == m_folders.end()) return;
+        if (event.mask & IN_IGNORED) {
+            m_folders.erase(folder);
+            return;
+        }
+        if (!event.len) return;
+
+        const auto path = folder->second / event.name;
+        if (event.mask & IN_ISDIR) {
+            // A folder that is created or moved in might already have files in it by the time it is watched
+            if (m_recursive && (event.mask & (IN_CREATE | IN_MOVED_TO))) AddFolder(path, &on_change);
+        } else if ((event.mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) && IsPathReadableAudioFile(path)) {
+            on_change(path);
+        }
+    }
+
+    void AddFolder(const fs::path &folder, const std::function<void(const fs::path &)> *on_existing_file) {
+        constexpr u32 mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE;
+        const auto wd = inotify_add_watch(m_fd, folder.c_str(), mask);
+        if (wd < 0) {
+            WarningWithNewLine("Signet", {}, "Could not watch the folder {}: {}", folder, std::strerror(errno));
+            return;
+        }
+        m_folders[wd] = folder;
+
+        std::error_code ec;
+        for (const auto &entry : fs::directory_iterator(folder, ec)) {
+            if (entry.is_directory(ec)) {
+                if (m_recursive) AddFolder(entry.path(), on_existing_file);
+            } else if (on_existing_file && IsPathReadableAudioFile(entry.path())) {
+                (*on_existing_file)(entry.path());
+            }
+        }
+    }
+
+    int m_fd = -1;
+    bool m_recursive;
+    std::map<int, fs::path> m_folders {};
+};
+
+std::string StampKey(const fs::path &path) {
+    std::error_code ec;
+    return fs::absolute(path, ec).lexically_normal().generic_string();
+}
+
+int RunBatch(const std::vector<fs::path> &paths,
+             const std::vector<std::string> &args,
+             std::map<std::string, FileStamp> &files_written_by_us) {
+    std::vector<std::string> run_args {args[0]};
+    for (const auto &p : paths) {
+        run_args.push_back(p.string());
+    }
+    run_args.insert(run_args.end(), args.begin() + 1, args.end());
+    std::vector<const char *> argv;
+    for (const auto &arg : run_args) {
+        argv.push_back(arg.c_str());
+    }
+
+    // Each run starts from the same state as a new process would
+    const auto messages_enabled = g_messages_enabled;
+    const auto warnings_as_errors = g_warnings_as_errors;
+    SignetInterface signet;
+    const auto result = signet.Main((int)argv.size(), argv.data());
+    g_messages_enabled = messages_enabled;
+    g_warnings_as_errors = warnings_as_errors;
+
+    for (const auto &path : signet.WrittenFilePaths()) {
+        if (const auto stamp = GetFileStamp(path)) files_written_by_us[StampKey(path)] = *stamp;
+    }
+    return result;
+}
+
+} // namespace
+
+void RunWatchLoop(const fs::path &folder, bool recursive, const std::vector<std::string> &args) {
+    if (!fs::is_directory(folder)) {
+        ErrorWithNewLine("Signet", {}, "{} is not a folder that can be watched", folder);
+    }
+    FolderWatcher watcher {folder, recursive};
+
+    // No SA_RESTART, so that a signal interrupts poll; a run that is in progress is allowed to finish
+    struct sigaction stop_action {};
+    stop_action.sa_handler = RequestWatchStop;
+    sigemptyset(&stop_action.sa_mask);
+    struct sigaction previous_int {}, previous_term {};
+    sigaction(SIGINT, &stop_action, &previous_int);
+    sigaction(SIGTERM, &stop_action, &previous_term);
+    defer {
+        sigaction(SIGINT, &previous_int, nullptr);
+        sigaction(SIGTERM, &previous_term, nullptr);
+    };
+
+    // Files that we have written ourselves cause events too, but they should not be processed again unless
+    // they are changed again afterwards
+    std::map<std::string, FileStamp> files_written_by_us;
+    ChangeDebouncer debouncer {std::chrono::milliseconds(500)};
+
+    MessageWithNewLine("Signet", {}, "Watching {} for new or changed audio files; press Ctrl+C to stop",
+                       folder.generic_string());
+    g_watch_stop_requested = 0;
+    while (!g_watch_stop_requested) {
+        int timeout_ms = -1;
+        if (const auto wait = debouncer.TimeUntilSettled(ChangeDebouncer::Clock::now())) {
+            timeout_ms = (int)std::chrono::ceil<std::chrono::milliseconds>(*wait).count();
+        }
+        pollfd poll_fd {watcher.Fd(), POLLIN, 0};
+        poll(&poll_fd, 1, timeout_ms);
+
+        const auto now = ChangeDebouncer::Clock::now();
+        watcher.ReadEvents([&](const fs::path &path) {
+            if (const auto it = files_written_by_us.find(StampKey(path)); it != files_written_by_us.end()) {
+                if (GetFileStamp(path) == it->second) return;
+                files_written_by_us.erase(it);
+            }
+            debouncer.AddChange(path, now);
+        });
+
+        if (auto paths = debouncer.TakeSettledChanges(now)) {
+            // Files may have been deleted or moved away again before they settled
+            paths->erase(std::remove_if(paths->begin(), paths->end(),
+                                        [](const fs::path &p) { return !fs::is_regular_file(p); }),
+                         paths->end());
+            if (paths->empty()) continue;
+            MessageWithNewLine("Signet", {}, "Processing {} new or changed files", paths->size());
+            const auto result = RunBatch(*paths, args, files_written_by_us);
+            if (result != SignetResult::Success) {
+                MessageWithNewLine("Signet", {}, "That run finished with exit code {}", result);
+            }
+            MessageWithNewLine("Signet", {}, "Watching {} for new or changed audio files",
+                               folder.generic_string());
+        }
+    }
+
+    MessageWithNewLine("Signet", {}, "Stopped watching");
+}
+
+TEST_CASE("[FolderWatcher]") {
+    const fs::path folder = "watch-test-folder";
+    fs::remove_all(folder);
+    fs::create_directories(folder / "sub");
+    {
+        FolderWatcher watcher {folder, true};
+        REQUIRE(fs::copy_file(TEST_DATA_DIRECTORY "/test.wav", folder / "a.wav"));
+        REQUIRE(fs::copy_file(TEST_DATA_DIRECTORY "/test.wav", folder / "sub" / "b.wav"));
+        { auto f = OpenFile(folder / "notes.txt", "w"); }
+
+        std::vector<fs::path> changes;
+        watcher.ReadEvents([&](const fs::path &path) { changes.push_back(path); });
+        std::sort(changes.begin(), changes.end());
+        REQUIRE(changes == std::vector<fs::path> {folder / "a.wav", folder / "sub" / "b.wav"});
+    }
+    fs::remove_all(folder);
+}
+
+#else
+
+void RunWatchLoop(const fs::path &, bool, const std::vector<std::string> &) {
+    ErrorWithNewLine("Signet", {}, "--watch is only available on Linux");
+}
+
+#endif
+
+TEST_CASE("[ChangeDebouncer]") {
+    using namespace std::chrono_literals;
+    const auto start = ChangeDebouncer::Clock::now();
+    ChangeDebouncer debouncer {500ms};
+    REQUIRE(!debouncer.TimeUntilSettled(start));
+    REQUIRE(!debouncer.TakeSettledChanges(start + 1s));
+
+    SUBCASE("each path settles on its own") {
+        debouncer.AddChange("b.wav", start);
+        debouncer.AddChange("a.wav", start + 300ms);
+        debouncer.AddChange("b.wav", start + 400ms);
+        REQUIRE(*debouncer.TimeUntilSettled(start + 500ms) == 300ms);
+        REQUIRE(!debouncer.TakeSettledChanges(start + 799ms));
+        REQUIRE(debouncer.TakeSettledChanges(start + 800ms) == std::vector<fs::path> {"a.wav"});
+        REQUIRE(*debouncer.TimeUntilSettled(start + 800ms) == 100ms);
+        REQUIRE(debouncer.TakeSettledChanges(start + 900ms) == std::vector<fs::path> {"b.wav"});
+        REQUIRE(!debouncer.TimeUntilSettled(start + 900ms));
+        REQUIRE(!debouncer.TakeSettledChanges(start + 2s));
+    }
+
+    SUBCASE("paths that settle together are returned together, sorted") {
+        debouncer.AddChange("b.wav", start);
+        debouncer.AddChange("a.wav", start + 100ms);
+        REQUIRE(debouncer.TakeSettledChanges(start + 1s) == std::vector<fs::path> {"a.wav", "b.wav"});
+    }
+
+    SUBCASE("a file that keeps changing does not hold back the others") {
+        debouncer.AddChange("quiet.wav", start);
+        bool quiet_settled = false;
+        for (auto t = start; t < start + 2s; t += 100ms) {
+            debouncer.AddChange("busy.wav", t);
+            if (const auto settled = debouncer.TakeSettledChanges(t)) {
+                REQUIRE(*settled == std::vector<fs::path> {"quiet.wav"});
+                REQUIRE(t == start + 500ms);
+                quiet_settled = true;
+            }
+        }
+        REQUIRE(quiet_settled);
+        REQUIRE(debouncer.TakeSettledChanges(start + 3s) == std::vector<fs::path> {"busy.wav"});
+    }
+}
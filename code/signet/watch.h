@@ -0,0 +1,11 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "filesystem.hpp"
+
+// Runs 'signet --watch FOLDER ...': waits for audio files in the folder to be written or moved in, and
+// whenever some have, runs signet with the rest of the args on just those files. If recursive, subfolders are
+// watched too. Files that the runs themselves write are not processed again. Returns when the process is
+// interrupted, or throws a SignetError if the folder cannot be watched.
+void RunWatchLoop(const fs::path &folder, bool recursive, const std::vector<std::string> &args);
@@ -124,7 +124,7 @@ class TestCommandProcessor {
             files.push_back(fd.path);
             files.back().SetAudioData(fd.data);
         }
-        m_files.emplace(files);
+        m_files.emplace(std::move(files));
 
         command.ProcessFiles(*m_files);
         SignetBackup backup;